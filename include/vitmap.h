@@ -1,55 +1,386 @@
 #ifndef VITMAP_H
 #define VITMAP_H
 
+#include <stdbool.h>
 #include "raylib.h"
 #include "tesselator.h"
+#include "vitmap_arena.h"
 
-// Shapes are closed polyogns
+// File format versions. Version 0 is the original headerless layout, version 1
+// puts a four byte magic tag and the version number in front of the same body.
+// Version 2 adds a palette to each vitmap and a palette index to each shape.
+// Version 3 adds a winding rule and contour list to each shape.
+// Version 4 adds curved edges to each shape.
+// Animation set files came after version 1 and always start with a header.
+#define VITMAP_FORMAT_LEGACY 0
+#define VITMAP_FORMAT_VERSION 4
+
+typedef enum VitmapFileKind
+{
+    VITMAP_FILE_UNKNOWN,    // Legacy file, the kind is only known from context
+    VITMAP_FILE_VITMAP,
+    VITMAP_FILE_ANIMATION,
+    VITMAP_FILE_ANIMATION_SET   // Always has a header, there are no legacy sets
+} VitmapFileKind;
+
+// Cleanup of a shape's points on their way into the tessellator. Baking works
+// on a copy, so the stored points stay as they were; cleanVitmap applies the
+// same cleanup to the stored points for good.
+typedef struct VitmapBakeOptions
+{
+    float weldDistance;         // Points this close to the one before them are merged, 0 merges exact repeats
+    float collinearTolerance;   // Points this close to the line through their neighbours are dropped, negative keeps them
+    float minArea;              // Shapes with no more area than this bake to an empty mesh
+    bool resolveSelfIntersections;  // cleanVitmap only, splits crossing shapes into simple ones
+    float curveTolerance;       // Furthest a flattened curve may stray from the true one, in pixels
+    float pixelsPerUnit;        // Scale the vitmap is drawn at, see getVitmapCurveScale
+} VitmapBakeOptions;
+
+// Scale the default bake flattens curves for, the editor's grid drawn at 16 pixels a unit
+#define VITMAP_DEFAULT_PIXELS_PER_UNIT 16.0f
+
+// Exact repeats, exactly collinear points and zero area shapes, none of which
+// change the result. Curves are kept within a quarter pixel.
+#define VITMAP_DEFAULT_BAKE_OPTIONS ((VitmapBakeOptions){0.0f, 0.0f, 0.0f, false, 0.25f, VITMAP_DEFAULT_PIXELS_PER_UNIT})
+
+typedef struct VitmapBakeStats
+{
+    int numPointsRemoved;
+    int numTrianglesSaved;      // Against the n - 2 triangles a polygon of the original points needs
+    int numShapesDropped;       // Degenerate shapes baked empty, or removed by cleanVitmap
+    int numShapesSplit;         // Self-intersecting shapes cleanVitmap replaced with simple ones
+} VitmapBakeStats;
+
+// Triangles a shape was baked into, indices are three per triangle
+typedef struct ShapeMesh
+{
+    Vector2* vertices;
+    int numVertices;
+    int* indices;
+    int numIndices;
+    Vector2 boundsMin;      // Bounding box of the vertices, zero for an empty mesh
+    Vector2 boundsMax;
+} ShapeMesh;
+
+typedef enum VitmapStrokeJoin
+{
+    VITMAP_JOIN_MITER,      // Falls back to a bevel past the miter limit
+    VITMAP_JOIN_ROUND,
+    VITMAP_JOIN_BEVEL
+} VitmapStrokeJoin;
+
+typedef enum VitmapStrokeCap
+{
+    VITMAP_CAP_BUTT,
+    VITMAP_CAP_SQUARE,
+    VITMAP_CAP_ROUND
+} VitmapStrokeCap;
+
+// Shapes are closed, so caps only show on open strokes such as a shape that
+// is still being drawn
+typedef struct VitmapStrokeStyle
+{
+    float width;
+    VitmapStrokeJoin join;
+    VitmapStrokeCap cap;
+    float miterLimit;       // Longest miter allowed as a multiple of the width, like SVG's stroke-miterlimit
+    bool closed;
+} VitmapStrokeStyle;
+
+// Triangles of a shape's outline, centered on its edges
+typedef struct ShapeStroke
+{
+    ShapeMesh mesh;
+    VitmapStrokeStyle style;    // Kept so a rebake of the shape rebakes the stroke too
+} ShapeStroke;
+
+// How overlapping contours of one shape combine. Only the odd rule existed
+// before format version 3.
+typedef enum VitmapWindingRule
+{
+    VITMAP_WINDING_ODD,         // Filled where an odd number of contours overlap, so any inner contour is a hole
+    VITMAP_WINDING_NONZERO,     // Holes have to wind the other way from the contour around them
+    VITMAP_WINDING_POSITIVE     // Only area wound with positive signed area (counter-clockwise with y up) fills
+} VitmapWindingRule;
+
+typedef enum VitmapCurveKind
+{
+    VITMAP_CURVE_LINE,          // A straight edge, only used to take a curve off
+    VITMAP_CURVE_QUADRATIC,     // One control point
+    VITMAP_CURVE_CUBIC          // Two control points
+} VitmapCurveKind;
+
+// A curved edge, from a point to the next one in its contour
+typedef struct ShapeCurve
+{
+    int point;
+    VitmapCurveKind kind;
+    Vector2 controls[2];    // The second is only used by cubics
+} ShapeCurve;
+
+// Shapes are closed polygons, made of one or more contours that are filled
+// together, so a ring is one shape with a hole instead of two stacked shapes.
+// The contours are stored back to back in points. Any edge can be a curve,
+// which baking flattens into as many straight edges as the scale needs.
 typedef struct Shape
 {
-    Vector2* points;
+    Vector2* points;        // Copy-on-write, may be shared with copies of the shape in other frames
     int numPoints;
-    TESStesselator* tesselation;
-    Color color;
+    int pointCapacity;
+    unsigned int pointGeneration;   // Bumped when points are removed, so old point handles go stale
+    const int* contourStarts;   // First point of each contour after the first, NULL for one contour. Never written in place.
+    int numContours;
+    VitmapWindingRule windingRule;
+    const ShapeCurve* curves;   // Sorted by point, NULL for none. Never written in place.
+    int numCurves;
+    ShapeMesh* mesh;        // NULL until the shape is baked
+    ShapeStroke* stroke;    // NULL unless a stroke was baked for the shape
+    Color color;            // Used when paletteIndex is -1 or past the end of the palette
+    int paletteIndex;       // Palette slot the shape is drawn in, -1 for its own color
+    Vector2 offset;         // Deferred move, added to the points and mesh when drawing and querying
 } Shape;
 
+// Stable reference to a shape in a vitmap. Unlike a Shape pointer it survives
+// the shape storage growing and the shape being reordered, and once the shape
+// is removed the handle is reported as stale instead of pointing at garbage.
+typedef struct ShapeHandle
+{
+    int slot;
+    unsigned int generation;
+} ShapeHandle;
+
+// Stable reference to one point of a shape. Goes stale when any point of the
+// shape is removed, since that shifts the points after it.
+typedef struct PointHandle
+{
+    ShapeHandle shape;
+    int index;
+    unsigned int generation;
+} PointHandle;
+
+#define INVALID_SHAPE_HANDLE ((ShapeHandle){-1, 0})
+#define INVALID_POINT_HANDLE ((PointHandle){{-1, 0}, -1, 0})
+
+typedef struct ShapeSlot
+{
+    unsigned int generation;
+    int orderIndex;         // Position in the draw order, -1 while the slot is free
+    int nextFree;
+} ShapeSlot;
+
+// Shapes sit in slots that never move while the vitmap lives, and a separate
+// compact order array lists the slots in draw order, bottom shape first.
+// All memory behind a vitmap (shapes, points, meshes) lives in its arena.
+// Duplicated frames share the shape table and point arrays; the edit
+// functions copy whatever is still shared before the first write to it.
 typedef struct Vitmap
 {
-    Shape* shapes;
+    Shape* shapes;          // Indexed by slot, use getVitmapShape to walk them in draw order
+    ShapeSlot* slots;
+    int* order;
     int numShapes;
+    int numSlots;
+    int shapeCapacity;
+    int freeSlot;
+    VitmapArena* arena;
+    bool ownsArena;         // False for frames, which share their animation's arena
+    Vector2 offset;         // Deferred move of every shape, on top of each shape's own
+    const Color* palette;   // Never written in place, so frames can share it
+    int numPaletteColors;
 } Vitmap;
 
 typedef struct VitmapAnimation
 {
     Vitmap* frames;
     int numFrames;
+    int frameCapacity;
     int currentFrame;
+    VitmapArena* arena;
 } VitmapAnimation;
 
+// One named animation of a set, as indices into the set's frame pool
+typedef struct VitmapSetAnimation
+{
+    char* name;
+    int* frames;
+    int numFrames;
+} VitmapSetAnimation;
+
+// Named animations that all take their frames from one pool, so a frame that
+// shows up in several animations is stored, baked and drawn from one copy.
+// The whole set lives in the pool's arena.
 typedef struct VitmapAnimationSet
 {
-    VitmapAnimation* animations;
+    VitmapAnimation pool;           // Every distinct frame once, bake and draw these
+    unsigned int* frameHashes;      // Per pool frame, for finding repeats
+    int* frameIndex;                // Open addressed, pool frame or -1
+    int frameIndexCapacity;
+    VitmapSetAnimation* animations;
     int numAnimations;
+    int animationCapacity;
+    int* nameIndex;                 // Open addressed, animation or -1
+    int nameIndexCapacity;
 } VitmapAnimationSet;
 
+// What a vitmap held when the snapshot was taken. Holding one makes the next
+// edit copy the shape table first, as if the vitmap were a duplicated frame,
+// so telling whether it was edited since is a few compares.
+typedef struct VitmapSnapshot
+{
+    const Shape* shapes;
+    const Color* palette;
+    int numShapes;
+    int numPaletteColors;
+    Vector2 offset;
+} VitmapSnapshot;
+
 void printVitmap(const Vitmap* vitmap);
+void initVitmap(Vitmap* vitmap);
+void initVitmapAnimation(VitmapAnimation* vitmapAnimation);
+void initVitmapAnimationSet(VitmapAnimationSet* vitmapAnimationSet);
 Shape* createShape();
 Vitmap* createVitmap();
 VitmapAnimation* createVitmapAnimation();
+void unloadVitmap(Vitmap* vitmap);
+void destroyVitmap(Vitmap* vitmap);
+void unloadAnimation(VitmapAnimation* animation);
+void destroyVitmapAnimation(VitmapAnimation* animation);
+void unloadAnimationSet(VitmapAnimationSet* set);
 void bakeVitmap(Vitmap* vitmap);
-void addPointToShape(Shape* shape, Vector2 point);
-void removePointFromShape(Shape* shape, Vector2* point);
-void addShapeToVitmap(Vitmap* vitmap);
-void removeShapeFromVitmap(Vitmap* vitmap, Shape* shape);
-Shape* reorderShapeInVitmap(Vitmap* vitmap, Shape* shape, int direction);
+// Points are added to the shape's last contour
+PointHandle addPointToShape(Vitmap* vitmap, ShapeHandle shape, Vector2 point);
+// Starts a new, empty last contour, a hole under the odd winding rule
+bool addContourToShape(Vitmap* vitmap, ShapeHandle shape);
+// Takes effect when the shape is next baked
+void setShapeWindingRule(Vitmap* vitmap, ShapeHandle shape, VitmapWindingRule rule);
+// Bends the edge from a point to the next one in its contour, or straightens
+// it again with VITMAP_CURVE_LINE. Takes effect when the shape is next baked.
+bool setShapeCurve(Vitmap* vitmap, PointHandle point, VitmapCurveKind kind, Vector2 control0, Vector2 control1);
+void removePointFromShape(Vitmap* vitmap, PointHandle point);
+const Vector2* getPoint(const Vitmap* vitmap, PointHandle point);
+Vector2* editPoint(Vitmap* vitmap, PointHandle point);
+Vector2* editShapePoints(Vitmap* vitmap, ShapeHandle shape);
+PointHandle getPointHandle(const Vitmap* vitmap, ShapeHandle shape, int index);
+ShapeHandle addShapeToVitmap(Vitmap* vitmap);
+ShapeHandle duplicateShapeInVitmap(Vitmap* vitmap, ShapeHandle shape);
+void removeShapeFromVitmap(Vitmap* vitmap, ShapeHandle shape);
+bool reorderShapeInVitmap(Vitmap* vitmap, ShapeHandle shape, int direction);
+const Shape* getShape(const Vitmap* vitmap, ShapeHandle shape);
+Shape* editShape(Vitmap* vitmap, ShapeHandle shape);
+bool isShapeHandleValid(const Vitmap* vitmap, ShapeHandle shape);
+ShapeHandle getShapeHandleAt(const Vitmap* vitmap, int orderIndex);
+int getShapeOrderIndex(const Vitmap* vitmap, ShapeHandle shape);
 Vitmap* addFrameToAnimation(VitmapAnimation* animation, Vitmap vitmap);
+Vitmap* addEmptyFrameToAnimation(VitmapAnimation* animation);
+Vitmap* duplicateFrameInAnimation(VitmapAnimation* animation, int index);
+VitmapSnapshot takeVitmapSnapshot(const Vitmap* vitmap);
+// The vitmap's memory has to still be there, release before unloading it
+void releaseVitmapSnapshot(VitmapSnapshot* snapshot);
+bool isVitmapUnchangedSince(const Vitmap* vitmap, const VitmapSnapshot* snapshot);
 void saveVitmapToFile(Vitmap* vitmap, const char* filename);
+bool saveVitmapToFileVersion(Vitmap* vitmap, const char* filename, int version);
 Vitmap loadVitmapFromFile(const char* filename);
 void saveAnimationToFile(VitmapAnimation* animation, const char* filename);
+bool saveAnimationToFileVersion(VitmapAnimation* animation, const char* filename, int version);
 VitmapAnimation loadAnimationFromFile(const char* filename);
+// Copies every frame of the animation into the set's pool, except the ones
+// already in it. Returns the new animation's index, or -1 if the name is taken.
+int addAnimationToSet(VitmapAnimationSet* set, const char* name, const VitmapAnimation* animation);
+int findAnimationInSet(const VitmapAnimationSet* set, const char* name);
+Vitmap* getAnimationSetFrame(const VitmapAnimationSet* set, int animation, int frame);
+void saveAnimationSetToFile(VitmapAnimationSet* set, const char* filename);
+bool saveAnimationSetToFileVersion(VitmapAnimationSet* set, const char* filename, int version);
+VitmapAnimationSet loadAnimationSetFromFile(const char* filename);
+unsigned char* loadVitmapFileData(const char* filename, int* sizeOut);
+int readVitmapFileHeader(const unsigned char* data, int size, VitmapFileKind* kindOut);
+bool decodeVitmap(const unsigned char* data, int size, Vitmap* vitmapOut, const char** errorOut);
+bool decodeAnimation(const unsigned char* data, int size, VitmapAnimation* animationOut, const char** errorOut);
+bool decodeAnimationSet(const unsigned char* data, int size, VitmapAnimationSet* setOut, const char** errorOut);
+// The bytes a save would write, from malloc. NULL if they cannot be encoded.
+unsigned char* encodeAnimation(VitmapAnimation* animation, int version, int* sizeOut);
+// One frame as animation files store it, without a file header
+unsigned char* encodeVitmapFrame(Vitmap* frame, int version, int* sizeOut);
+// Decodes a frame from encodeVitmapFrame over frame index of the animation,
+// or appends it when index is numFrames
+bool decodeAnimationFrame(const unsigned char* data, int size, int version, VitmapAnimation* animation, int index, const char** errorOut);
 Vitmap* loadAndBakeVitmap(const char* filename);
-void drawVitmap(Vitmap *vitmap, Vector2 position, Vector2 scale, float rotation);
-void moveShape(Shape* shape, Vector2 deltaPos);
+void moveShape(Vitmap* vitmap, ShapeHandle shape, Vector2 deltaPos);
 void moveVitmap(Vitmap* vitmap, Vector2 deltaPos);
+void applyShapeTransform(Vitmap* vitmap, ShapeHandle shape);
+void applyVitmapTransform(Vitmap* vitmap);
+void bakeShape(Vitmap* vitmap, ShapeHandle shape);
+// bakeVitmap and bakeShape use VITMAP_DEFAULT_BAKE_OPTIONS. Stats are added to, pass NULL to skip them.
+void bakeVitmapWithOptions(Vitmap* vitmap, const VitmapBakeOptions* options, VitmapBakeStats* statsOut);
+// Rewrites the stored points and rebakes the shapes it changed, if they were baked
+void cleanVitmap(Vitmap* vitmap, const VitmapBakeOptions* options, VitmapBakeStats* statsOut);
+// Strokes are baked on their own, and from then on every bake of the shape
+// bakes its stroke again in the same style
+void bakeShapeStroke(Vitmap* vitmap, ShapeHandle shape, const VitmapStrokeStyle* style);
+void bakeVitmapStrokes(Vitmap* vitmap, const VitmapStrokeStyle* style);
+// Stroke triangles for any polyline, allocated from the arena. For outlines
+// that change too often to bake, the arena can be reset every frame.
+bool tessellateStroke(const Vector2* points, int numPoints, const VitmapStrokeStyle* style, VitmapArena* arena, ShapeMesh* meshOut);
+bool setVitmapPalette(Vitmap* vitmap, const Color* colors, int numColors);
+// The shape's contours with every curve flattened to within tolerance, in the
+// shape's units, allocated from the arena in the same layout as the shape.
+// Returns the number of points, with pointsOut NULL if the arena ran out.
+int flattenShape(const Shape* shape, float tolerance, VitmapArena* arena, Vector2** pointsOut, int** contourStartsOut);
+// Rounds a draw scale in pixels per unit up to a power of two, so bakes for
+// nearby zoom levels flatten curves the same way and share bake cache entries
+float getVitmapCurveScale(float pixelsPerUnit);
+// Winding number of every contour of the shape around a point in the shape's
+// own space, without its offset. Filled if isWindingFilled says so.
+int getShapeWinding(const Shape* shape, Vector2 point);
+
+// Subtract a polygon or a circle, in vitmap space, from every shape it
+// touches. A shape cut in two or more is split into shapes placed right above
+// it, one cut away completely is removed, and only the shapes that were cut
+// are baked again, if they were baked before. Returns how many shapes were cut.
+// Once the geometry cut away outweighs the rest, the vitmap is compacted.
+int carveVitmap(Vitmap* vitmap, const Vector2* cut, int numCut);
+int carveVitmapCircle(Vitmap* vitmap, Vector2 center, float radius);
+// Arenas never free single allocations, so geometry replaced by edits stays
+// in them. Copies what the vitmap still uses into a fresh arena and frees the
+// old one. Handles stay valid, Shape and point pointers do not. Does nothing
+// and returns false for animation frames, which share their arena, and while
+// a snapshot holds the vitmap.
+bool compactVitmap(Vitmap* vitmap);
+
+// The shape drawn at a position in the draw order, 0 being the bottom one
+static inline const Shape* getVitmapShape(const Vitmap* vitmap, int orderIndex)
+{
+    return &vitmap->shapes[vitmap->order[orderIndex]];
+}
+
+// Where the shape's stored points and mesh really are, relative to the vitmap origin
+static inline Vector2 getShapeOffset(const Vitmap* vitmap, const Shape* shape)
+{
+    return (Vector2){vitmap->offset.x + shape->offset.x, vitmap->offset.y + shape->offset.y};
+}
+
+// Where a contour of the shape starts in its points, and how many points it has
+static inline int getShapeContour(const Shape* shape, int contour, int* countOut)
+{
+    int start = contour > 0 ? shape->contourStarts[contour - 1] : 0;
+    int end = contour + 1 < shape->numContours ? shape->contourStarts[contour] : shape->numPoints;
+    *countOut = end - start;
+    return start;
+}
+
+static inline bool isWindingFilled(VitmapWindingRule rule, int winding)
+{
+    return rule == VITMAP_WINDING_ODD ? (winding & 1) != 0 : rule == VITMAP_WINDING_NONZERO ? winding != 0 : winding > 0;
+}
+
+// The color a shape is drawn in with the given palette. Meshes hold no color,
+// so a different palette recolors a vitmap without a rebake.
+static inline Color getShapeColor(const Shape* shape, const Color* palette, int numColors)
+{
+    if (shape->paletteIndex >= 0 && shape->paletteIndex < numColors)
+    {
+        return palette[shape->paletteIndex];
+    }
+    return shape->color;
+}
 
 #endif // VITMAP_H
\ No newline at end of file
@@ -0,0 +1,28 @@
+#ifndef VITMAP_ARENA_H
+#define VITMAP_ARENA_H
+
+#include <stddef.h>
+
+// Chunked bump allocator. Everything a loaded vitmap or animation owns comes
+// out of one arena, and destroying the arena frees all of it in one call.
+// Individual allocations are never freed on their own.
+
+#define VITMAP_ARENA_DEFAULT_CHUNK_SIZE (16 * 1024)
+
+typedef struct VitmapArenaChunk VitmapArenaChunk;
+
+typedef struct VitmapArena
+{
+    VitmapArenaChunk* head;     // Chunk new allocations come from, the rest follow it
+    size_t chunkSize;
+    size_t bytesReserved;       // Total size of all chunks, including adopted ones
+} VitmapArena;
+
+VitmapArena* createVitmapArena(size_t chunkSize);
+void destroyVitmapArena(VitmapArena* arena);
+void resetVitmapArena(VitmapArena* arena);
+void* allocateFromVitmapArena(VitmapArena* arena, size_t size);
+void* growVitmapArenaAllocation(VitmapArena* arena, void* allocation, size_t oldSize, size_t newSize);
+void adoptVitmapArena(VitmapArena* arena, VitmapArena* other);
+
+#endif // VITMAP_ARENA_H
@@ -0,0 +1,42 @@
+#ifndef VITMAP_ASSETS_H
+#define VITMAP_ASSETS_H
+
+#include <stddef.h>
+#include "vitmap.h"
+
+// Loaded and baked vitmaps and animations, shared by everything that asks for
+// the same file. Files are keyed by their full path, and a file that changed
+// on disk since it was loaded is loaded again on the next acquire. Every
+// acquire needs a release; assets nobody holds stay loaded, most recently
+// released first, as long as they fit in the cache's budget.
+// All functions are thread safe, jobs on the job system included. A file asked
+// for by several threads at once is loaded by the first one while the others
+// wait for it, and the loading thread decodes and bakes it on its own.
+
+typedef struct VitmapAssetCache VitmapAssetCache;
+
+typedef struct VitmapAssetStats
+{
+    int hits;
+    int misses;             // Loads, including reloads of changed files
+    int evictions;          // Unused assets unloaded to stay in the budget
+    int numAssets;          // Loaded right now, in use or not
+    size_t bytes;           // Arena memory of every loaded asset
+    size_t unusedBytes;     // The part of bytes nobody holds
+} VitmapAssetStats;
+
+// unusedBudget is how much memory assets nobody holds may keep, 0 unloads them on release
+VitmapAssetCache* createVitmapAssetCache(size_t unusedBudget);
+// Unloads everything, assets still held included
+void destroyVitmapAssetCache(VitmapAssetCache* cache);
+void setVitmapAssetBudget(VitmapAssetCache* cache, size_t unusedBudget);
+VitmapAssetStats getVitmapAssetStats(VitmapAssetCache* cache);
+
+// Baked and shared, so draw them but do not edit them. NULL if the file
+// cannot be loaded, which needs no release.
+Vitmap* acquireVitmapAsset(VitmapAssetCache* cache, const char* path);
+VitmapAnimation* acquireAnimationAsset(VitmapAssetCache* cache, const char* path);
+void releaseVitmapAsset(VitmapAssetCache* cache, Vitmap* vitmap);
+void releaseAnimationAsset(VitmapAssetCache* cache, VitmapAnimation* animation);
+
+#endif // VITMAP_ASSETS_H
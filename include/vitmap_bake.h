@@ -0,0 +1,44 @@
+#ifndef VITMAP_BAKE_H
+#define VITMAP_BAKE_H
+
+#include "vitmap.h"
+
+// Spreads baking over frames. Shapes are queued, from code or by drawing a
+// shape that was never baked, and each frame bakes as many of them as fit in
+// a time budget. The queue keeps plain vitmap pointers, so cancel a vitmap's
+// bakes before unloading it or moving it in memory.
+
+typedef struct VitmapBakeRequest
+{
+    Vitmap* vitmap;
+    ShapeHandle shape;
+} VitmapBakeRequest;
+
+typedef struct VitmapBakeQueue
+{
+    VitmapBakeRequest* requests;    // Ring buffer, oldest first
+    int head;
+    int count;
+    int capacity;
+    VitmapBakeRequest* queued;      // Hash set of everything queued since the queue was last empty
+    int numQueued;
+    int queuedCapacity;
+    double secondsPerPoint;         // Running estimate used to predict how long the next bake takes
+} VitmapBakeQueue;
+
+VitmapBakeQueue createVitmapBakeQueue();
+void unloadVitmapBakeQueue(VitmapBakeQueue* queue);
+
+// Queuing a shape that is already queued or already baked does nothing
+bool queueShapeBake(VitmapBakeQueue* queue, Vitmap* vitmap, ShapeHandle shape);
+// Queues every shape of the vitmap that has no mesh, returns how many
+int queueVitmapBake(VitmapBakeQueue* queue, Vitmap* vitmap);
+void cancelVitmapBakes(VitmapBakeQueue* queue, const Vitmap* vitmap);
+
+// Bakes queued shapes in order, stopping before the one that is predicted to
+// go over the budget. A shape predicted to need more than the whole budget
+// still has to be baked at some point; it gets a call of its own, as the only
+// shape that call bakes. Returns how many shapes were baked.
+int processVitmapBakeQueue(VitmapBakeQueue* queue, double budgetSeconds);
+
+#endif // VITMAP_BAKE_H
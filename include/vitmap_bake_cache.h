@@ -0,0 +1,37 @@
+#ifndef VITMAP_BAKE_CACHE_H
+#define VITMAP_BAKE_CACHE_H
+
+#include <stddef.h>
+#include "vitmap.h"
+
+// Baked meshes kept on disk between runs. Every file is named after a hash of
+// what went into the tessellator (the cleaned up contours, the winding rule, the
+// bake options left that change the result and the cache version), so the
+// same shape is only ever tessellated once per machine. Once the files add up
+// to more than the size cap, the least recently used ones are deleted.
+// While the cache is open, bakeShape and bakeVitmap go through it on their own.
+
+#define VITMAP_BAKE_CACHE_VERSION 2     // Bump when baking changes its output
+
+typedef struct VitmapBakeCacheStats
+{
+    int hits;
+    int misses;
+    int evictions;
+    size_t bytes;           // Size of every file in the cache right now
+} VitmapBakeCacheStats;
+
+// Creates the directory if needed. Open and close from one thread while
+// nothing is baking, the lookups in between are thread safe.
+bool openVitmapBakeCache(const char* directory, size_t maxBytes);
+void closeVitmapBakeCache();
+VitmapBakeCacheStats getVitmapBakeCacheStats();
+
+// Used by the bake. A hit points meshOut into memory taken from scratch.
+// contourStarts holds where the contours after the first begin, NULL for one contour.
+bool findCachedVitmapBake(const Vector2* points, int numPoints, const int* contourStarts, int numContours,
+    VitmapWindingRule windingRule, float minArea, VitmapArena* scratch, ShapeMesh* meshOut);
+void storeCachedVitmapBake(const Vector2* points, int numPoints, const int* contourStarts, int numContours,
+    VitmapWindingRule windingRule, float minArea, const ShapeMesh* mesh);
+
+#endif // VITMAP_BAKE_CACHE_H
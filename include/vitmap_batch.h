@@ -0,0 +1,44 @@
+#ifndef VITMAP_BATCH_H
+#define VITMAP_BATCH_H
+
+#include "vitmap.h"
+
+// Loads and bakes a whole list of files at once, such as a level's manifest.
+// The calling thread reads every file through vitmap_io.h, with many reads in
+// flight where the platform allows, and each file that arrives becomes a job on
+// the job system (vitmap_jobs.h) that decodes and bakes it. The frames and
+// shapes of big files are split over idle workers too. Without the job system
+// started each file is decoded and baked on the calling thread as it arrives.
+
+typedef enum VitmapLoadStatus
+{
+    VITMAP_LOAD_OK,
+    VITMAP_LOAD_UNREADABLE,     // Missing, or could not be read
+    VITMAP_LOAD_INVALID         // Read, but did not decode
+} VitmapLoadStatus;
+
+typedef struct VitmapLoadResult
+{
+    VitmapLoadStatus status;
+    const char* error;          // Static string, NULL when the file loaded
+    int bytes;                  // Size of the file, 0 if it could not be read
+    double seconds;             // Decoding and baking it, after it was read
+} VitmapLoadResult;
+
+typedef struct VitmapBatchStats
+{
+    int numLoaded;
+    int numFailed;
+    long long bytesRead;
+    double seconds;             // Wall time of the whole batch
+} VitmapBatchStats;
+
+// out has one entry per path, and so does resultsOut unless it is NULL.
+// statsOut may be NULL too. A file that fails leaves an empty entry, so every
+// entry is unloaded the same way afterwards. Returns true if every file loaded.
+bool loadVitmapsBatch(const char* const* paths, int count, Vitmap* out,
+    VitmapLoadResult* resultsOut, VitmapBatchStats* statsOut);
+bool loadAnimationsBatch(const char* const* paths, int count, VitmapAnimation* out,
+    VitmapLoadResult* resultsOut, VitmapBatchStats* statsOut);
+
+#endif // VITMAP_BATCH_H
@@ -0,0 +1,27 @@
+#ifndef VITMAP_DRAW_H
+#define VITMAP_DRAW_H
+
+#include "vitmap.h"
+#include "vitmap_bake.h"
+
+// What an unbaked shape looks like while it waits in the bake queue
+typedef enum VitmapBakeFallback
+{
+    VITMAP_BAKE_FALLBACK_NONE,
+    VITMAP_BAKE_FALLBACK_OUTLINE,
+    VITMAP_BAKE_FALLBACK_FAN,       // Right for convex shapes, rough for the rest
+} VitmapBakeFallback;
+
+// Draws with raylib, so it needs a window and GL context. Link libvitmap_draw
+// and raylib next to libvitmap to use it.
+void drawVitmap(Vitmap *vitmap, Vector2 position, Vector2 scale, float rotation);
+// Draws with another palette in place of the vitmap's own, for team colors and flashes
+void drawVitmapWithPalette(Vitmap *vitmap, Vector2 position, Vector2 scale, float rotation, const Color* palette, int numColors);
+// Draws the baked strokes only, all in one color, for selections and highlights
+void drawVitmapStrokes(Vitmap *vitmap, Vector2 position, Vector2 scale, Color color);
+// Shapes without a mesh are baked the first time they are drawn. With a queue
+// set they are queued instead and drawn with the fallback until the queue gets
+// to them, with none they are baked during the draw. NULL clears the queue.
+void setVitmapDrawBakeQueue(VitmapBakeQueue* queue, VitmapBakeFallback fallback);
+
+#endif // VITMAP_DRAW_H
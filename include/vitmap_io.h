@@ -0,0 +1,34 @@
+#ifndef VITMAP_IO_H
+#define VITMAP_IO_H
+
+#include <stdbool.h>
+
+// Reads a whole list of files at once. On Linux the reads go to the kernel
+// through io_uring, up to VITMAP_IO_QUEUE_DEPTH of them in flight, so the disk
+// sees them together instead of one blocking read at a time. Where io_uring is
+// missing or not allowed, such as older kernels and some containers, files are
+// read one by one with pread instead, and on Windows with plain reads.
+
+#define VITMAP_IO_QUEUE_DEPTH 64
+
+typedef enum VitmapIoBackend
+{
+    VITMAP_IO_AUTO,         // io_uring where it works, blocking reads elsewhere
+    VITMAP_IO_URING,
+    VITMAP_IO_BLOCKING
+} VitmapIoBackend;
+
+// Called on the reading thread as each file finishes, in the order they
+// finish. data comes from malloc and belongs to the callee, and is NULL if
+// the file could not be read.
+typedef void (*VitmapFileReadFunc)(void* userData, int index, unsigned char* data, int size);
+
+bool isVitmapIoUringAvailable();
+const char* getVitmapIoBackendName(VitmapIoBackend backend);
+// Asking for io_uring where it is not available reads with blocking calls.
+// Returns the backend that did the reads, blocking if io_uring failed partway
+// and the rest were read with blocking calls.
+VitmapIoBackend readVitmapFiles(const char* const* paths, int count, VitmapIoBackend backend,
+    VitmapFileReadFunc func, void* userData);
+
+#endif // VITMAP_IO_H
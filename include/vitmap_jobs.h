@@ -0,0 +1,44 @@
+#ifndef VITMAP_JOBS_H
+#define VITMAP_JOBS_H
+
+#include <stdbool.h>
+
+// One work-stealing job scheduler shared by everything in the library that
+// runs in parallel, so baking, decoding and rasterizing never start threads of
+// their own. Each worker pushes and pops jobs at one end of its own deque and
+// idle workers steal from the other end of someone else's. Until the scheduler
+// is started every job simply runs on the thread that submits it.
+
+#define VITMAP_JOB_DEQUE_SIZE 4096      // Jobs queued per worker, a power of two
+
+typedef struct VitmapJob VitmapJob;
+
+typedef void (*VitmapJobFunc)(void* userData);
+typedef void (*VitmapJobRangeFunc)(void* userData, int begin, int end);
+
+// maxThreads counts the calling thread, which becomes one of the workers.
+// 0 or less means one per core. Not thread safe, call from the main thread.
+bool startVitmapJobs(int maxThreads);
+// Every job has to be waited on before stopping
+void stopVitmapJobs();
+// 1 when the scheduler is not running, or inside beginVitmapJobsInline
+int getVitmapJobThreadCount();
+// Until the matching end, jobs submitted from this thread run on it at once,
+// as if the scheduler were stopped, and its waits never pick up other jobs.
+// For work done while holding something another job may wait for.
+void beginVitmapJobsInline();
+void endVitmapJobsInline();
+
+// A job with a parent counts as part of it, so waiting on the parent also
+// waits for all its children and their children. Children are created from
+// the parent's function, or before the parent is run.
+VitmapJob* createVitmapJob(VitmapJobFunc func, void* userData, VitmapJob* parent);
+void runVitmapJob(VitmapJob* job);
+// Runs other jobs until this one and its children are done, then frees it.
+// Only for jobs without a parent, children are freed when they finish.
+void waitVitmapJob(VitmapJob* job);
+
+// Splits 0 to count into batches of batchSize, runs them as jobs and waits
+void runVitmapJobsFor(int count, int batchSize, VitmapJobRangeFunc func, void* userData);
+
+#endif // VITMAP_JOBS_H
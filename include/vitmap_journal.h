@@ -0,0 +1,33 @@
+#ifndef VITMAP_JOURNAL_H
+#define VITMAP_JOURNAL_H
+
+#include <stddef.h>
+#include "vitmap.h"
+
+// Saves a big animation by appending what changed instead of rewriting it.
+// The animation file stays a plain .vmpa that everything else reads, and next
+// to it a journal (the same path with .journal added) collects the frames
+// edited since. A save appends and syncs just those frames, so it takes as
+// long as the edit is big. Once the journal passes its compact size it is
+// folded back into the animation file on a thread the journal starts for it,
+// and closing folds in whatever is left. Records are
+// checksummed and every save ends in a commit, so after a crash opening the
+// journal replays the saves that finished and drops the one that did not.
+
+#define VITMAP_JOURNAL_DEFAULT_COMPACT_SIZE (8 * 1024 * 1024)
+
+typedef struct VitmapJournal VitmapJournal;
+
+// Loads the animation at path with its journal replayed on top, and keeps the
+// journal open for saving it. NULL if the animation cannot be loaded, which
+// leaves it empty.
+VitmapJournal* openVitmapJournal(const char* path, size_t compactSize, VitmapAnimation* animationOut);
+// Saves the whole animation to path, replacing the file and any journal there
+VitmapJournal* createVitmapJournal(const char* path, size_t compactSize, VitmapAnimation* animation);
+// Folds the journal into the animation file. Close it before unloading the animation.
+void closeVitmapJournal(VitmapJournal* journal);
+// Appends the frames of the journal's animation edited since the last save.
+// Frames may be added, removed and reordered in between.
+bool saveVitmapJournal(VitmapJournal* journal);
+
+#endif // VITMAP_JOURNAL_H
@@ -0,0 +1,42 @@
+#ifndef VITMAP_LIVE_H
+#define VITMAP_LIVE_H
+
+#include <stddef.h>
+#include "vitmap.h"
+
+// Live preview of an animation while it is being edited. The editor publishes
+// its animation into named shared memory and a running game maps the same
+// name, so edits show up in the game on its next frame without saving or
+// loading a file. The game's frames point straight into the shared memory.
+// Three buffers take turns so neither side ever waits for the other: the
+// publisher writes one the view is not reading, then marks it the newest.
+// Both sides have to be built from the same version of the library, and a
+// name takes one publisher and one view at a time.
+
+#define VITMAP_LIVE_DEFAULT_NAME "vitmap-live"
+#define VITMAP_LIVE_DEFAULT_BUFFER_SIZE (4 * 1024 * 1024)   // Per buffer, three are mapped
+
+typedef struct VitmapLivePublisher VitmapLivePublisher;
+typedef struct VitmapLiveView VitmapLiveView;
+
+// NULL if the shared memory cannot be made, or is in use with another buffer size
+VitmapLivePublisher* createVitmapLivePublisher(const char* name, size_t bufferSize);
+// Tells the view the animation is gone
+void destroyVitmapLivePublisher(VitmapLivePublisher* publisher);
+// Copies the animation into a free buffer, cheap to call every frame since an
+// animation that did not change is not handed to the view again. False if it
+// does not fit in a buffer.
+bool publishVitmapAnimation(VitmapLivePublisher* publisher, const VitmapAnimation* animation);
+
+// The view maps the shared memory once a publisher has made it, and lets go
+// of it again when the publisher goes away
+VitmapLiveView* openVitmapLiveView(const char* name);
+void closeVitmapLiveView(VitmapLiveView* view);
+// Call once a frame. Returns true when the animation changed, the old one and
+// every pointer into it are gone by then.
+bool updateVitmapLiveView(VitmapLiveView* view);
+// NULL while nothing is published. Unbaked shapes are baked the first time
+// they are drawn, like any others, but the frames must not be edited.
+VitmapAnimation* getVitmapLiveAnimation(VitmapLiveView* view);
+
+#endif // VITMAP_LIVE_H
@@ -0,0 +1,71 @@
+#ifndef VITMAP_LOG_H
+#define VITMAP_LOG_H
+
+// Leveled logging for the library. Each call is checked against the runtime
+// level before any formatting happens, and calls below the compile-time level
+// VITMAP_LOG_COMPILE_LEVEL are removed by the preprocessor altogether, e.g.
+// -DVITMAP_LOG_COMPILE_LEVEL=VITMAP_LOG_NONE strips every message.
+
+#define VITMAP_LOG_TRACE 0      // Per point and per shape detail
+#define VITMAP_LOG_DEBUG 1      // Per frame and per file detail
+#define VITMAP_LOG_INFO 2
+#define VITMAP_LOG_WARNING 3
+#define VITMAP_LOG_ERROR 4
+#define VITMAP_LOG_NONE 5
+
+#ifndef VITMAP_LOG_COMPILE_LEVEL
+#define VITMAP_LOG_COMPILE_LEVEL VITMAP_LOG_TRACE
+#endif
+
+typedef struct VitmapLogRecord
+{
+    int level;
+    const char* file;
+    int line;
+    const char* message;
+} VitmapLogRecord;
+
+typedef void (*VitmapLogSink)(const VitmapLogRecord* record, void* userData);
+
+// Read directly by the log macros, change it with setVitmapLogLevel
+extern int vitmapLogLevel;
+
+void setVitmapLogLevel(int level);
+void setVitmapLogSink(VitmapLogSink sink, void* userData);
+const char* getVitmapLogLevelName(int level);
+void logVitmapMessage(int level, const char* file, int line, const char* format, ...);
+
+#define VITMAP_LOG_AT(level, ...) \
+    do { if ((level) >= vitmapLogLevel) logVitmapMessage((level), __FILE__, __LINE__, __VA_ARGS__); } while (0)
+
+#if VITMAP_LOG_COMPILE_LEVEL <= VITMAP_LOG_TRACE
+#define VITMAP_TRACE(...) VITMAP_LOG_AT(VITMAP_LOG_TRACE, __VA_ARGS__)
+#else
+#define VITMAP_TRACE(...) do { } while (0)
+#endif
+
+#if VITMAP_LOG_COMPILE_LEVEL <= VITMAP_LOG_DEBUG
+#define VITMAP_DEBUG(...) VITMAP_LOG_AT(VITMAP_LOG_DEBUG, __VA_ARGS__)
+#else
+#define VITMAP_DEBUG(...) do { } while (0)
+#endif
+
+#if VITMAP_LOG_COMPILE_LEVEL <= VITMAP_LOG_INFO
+#define VITMAP_INFO(...) VITMAP_LOG_AT(VITMAP_LOG_INFO, __VA_ARGS__)
+#else
+#define VITMAP_INFO(...) do { } while (0)
+#endif
+
+#if VITMAP_LOG_COMPILE_LEVEL <= VITMAP_LOG_WARNING
+#define VITMAP_WARNING(...) VITMAP_LOG_AT(VITMAP_LOG_WARNING, __VA_ARGS__)
+#else
+#define VITMAP_WARNING(...) do { } while (0)
+#endif
+
+#if VITMAP_LOG_COMPILE_LEVEL <= VITMAP_LOG_ERROR
+#define VITMAP_ERROR(...) VITMAP_LOG_AT(VITMAP_LOG_ERROR, __VA_ARGS__)
+#else
+#define VITMAP_ERROR(...) do { } while (0)
+#endif
+
+#endif // VITMAP_LOG_H
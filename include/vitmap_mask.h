@@ -0,0 +1,45 @@
+#ifndef VITMAP_MASK_H
+#define VITMAP_MASK_H
+
+#include "vitmap.h"
+
+// 1-bit collision masks rasterized from shape polygons with each shape's
+// winding rule, 64 pixels to a word, for pixel precise overlap tests. Built on
+// the CPU straight from the points, with curves flattened to within a quarter
+// pixel, so they need neither a bake nor a GL context.
+
+typedef struct VitmapMask
+{
+    int width;
+    int height;
+    int wordsPerRow;
+    unsigned long long* bits;   // Row by row, top row first, bit 0 of a word is its leftmost pixel
+    int originX;                // Pixel position of the mask's top left corner
+    int originY;                // relative to the vitmap origin
+} VitmapMask;
+
+// Masks for the frames of an animation, each made the first time it is asked for
+typedef struct VitmapAnimationMasks
+{
+    VitmapMask* masks;
+    bool* generated;
+    int numFrames;
+    float scale;
+} VitmapAnimationMasks;
+
+// scale is pixels per vitmap unit
+VitmapMask createVitmapMask(const Vitmap* vitmap, float scale);
+void unloadVitmapMask(VitmapMask* mask);
+bool getVitmapMaskPixel(const VitmapMask* mask, int x, int y);
+
+// Positions are in pixels, where each vitmap's origin ends up. True if any
+// pixel is set in both masks.
+bool doVitmapMasksOverlap(const VitmapMask* a, int ax, int ay, const VitmapMask* b, int bx, int by);
+
+// Frame masks are cached until the set is unloaded, recreate it after the
+// animation is edited
+VitmapAnimationMasks createVitmapAnimationMasks(const VitmapAnimation* animation, float scale);
+const VitmapMask* getVitmapAnimationMask(VitmapAnimationMasks* masks, const VitmapAnimation* animation, int frame);
+void unloadVitmapAnimationMasks(VitmapAnimationMasks* masks);
+
+#endif // VITMAP_MASK_H
@@ -0,0 +1,83 @@
+#ifndef VITMAP_PLATFORM_H
+#define VITMAP_PLATFORM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Thin wrappers over the OS thread, timer, file and shared memory APIs so the rest of the library
+// can stay portable between MinGW (win32 thread model) and POSIX systems.
+// This header deliberately does not include raylib.h or windows.h, the two
+// of them clash on names like CloseWindow and Rectangle.
+
+typedef struct VitmapThread
+{
+    void* handle;
+} VitmapThread;
+
+typedef struct VitmapMutex
+{
+    void* handle;
+} VitmapMutex;
+
+typedef struct VitmapCondition
+{
+    void* handle;
+} VitmapCondition;
+
+typedef struct VitmapSharedMemory
+{
+    void* handle;
+    void* data;
+    size_t size;
+} VitmapSharedMemory;
+
+typedef void (*VitmapThreadFunc)(void* userData);
+
+bool startVitmapThread(VitmapThread* thread, VitmapThreadFunc func, void* userData);
+void joinVitmapThread(VitmapThread* thread);
+// Gives the rest of the time slice to another thread
+void yieldVitmapThread();
+
+bool initVitmapMutex(VitmapMutex* mutex);
+void destroyVitmapMutex(VitmapMutex* mutex);
+void lockVitmapMutex(VitmapMutex* mutex);
+void unlockVitmapMutex(VitmapMutex* mutex);
+
+bool initVitmapCondition(VitmapCondition* condition);
+void destroyVitmapCondition(VitmapCondition* condition);
+void waitVitmapCondition(VitmapCondition* condition, VitmapMutex* mutex);
+void signalVitmapCondition(VitmapCondition* condition);
+void broadcastVitmapCondition(VitmapCondition* condition);
+
+int getVitmapCpuCount();
+
+// Monotonic time in seconds, only meaningful as a difference
+double getVitmapTime();
+
+// Succeeds if the directory is already there
+bool makeVitmapDirectory(const char* path);
+// Renames over an existing file, which plain rename does not do on Windows
+bool replaceVitmapFile(const char* from, const char* to);
+// Flushes what was written to the file all the way to the disk
+bool syncVitmapFile(FILE* file);
+// Sets the modification time to now
+bool touchVitmapFile(const char* path);
+// Absolute path with . and .. resolved, so every way of naming a file gives
+// the same string. Lower case on Windows, where file names ignore case.
+bool getVitmapFullPath(const char* path, char* out, int outSize);
+// Modification time in the OS's own units, only meaningful compared to another
+bool getVitmapFileInfo(const char* path, long long* modifiedOut, long long* sizeOut);
+
+// Named memory that other processes can map by the same name. Creating a name
+// that is already taken maps the memory that is there and sets existedOut,
+// its size is then whatever it was created with.
+bool createVitmapSharedMemory(VitmapSharedMemory* memory, const char* name, size_t size, bool* existedOut);
+// Fails if nothing was created under the name
+bool openVitmapSharedMemory(VitmapSharedMemory* memory, const char* name);
+void closeVitmapSharedMemory(VitmapSharedMemory* memory);
+// Frees the name for the next create, processes that have the memory mapped
+// keep it. Does nothing on Windows, where the memory goes with its last user.
+void removeVitmapSharedMemory(const char* name);
+
+#endif // VITMAP_PLATFORM_H
@@ -0,0 +1,51 @@
+#ifndef VITMAP_QUERY_H
+#define VITMAP_QUERY_H
+
+#include "vitmap.h"
+
+// Collision queries against baked vitmaps. A collider is a snapshot of the
+// baked triangles with shape and vitmap offsets applied, sorted into a uniform
+// grid; rebuild it after the vitmap is edited, moved or rebaked. Shapes
+// without a mesh are left out. Queries only read the collider, so several
+// threads can query one collider at once.
+
+typedef struct VitmapColliderTriangle
+{
+    Vector2 a;
+    Vector2 b;
+    Vector2 c;
+    int shape;              // Order index of the shape the triangle belongs to
+} VitmapColliderTriangle;
+
+typedef struct VitmapCollider
+{
+    VitmapColliderTriangle* triangles;  // Grouped by shape, bottom shape first
+    int numTriangles;
+    Rectangle* shapeBounds;             // Per order index, zero sized for unbaked shapes
+    int numShapes;
+    Vector2 origin;                     // Top left corner of the grid
+    float cellSize;
+    int columns;
+    int rows;
+    int* cellStarts;                    // columns * rows + 1 offsets into cellTriangles
+    int* cellTriangles;                 // Triangle indices per cell, ascending
+    VitmapArena* arena;
+} VitmapCollider;
+
+// cellSize <= 0 picks one that puts about one triangle in each cell
+VitmapCollider createVitmapCollider(const Vitmap* vitmap, float cellSize);
+void unloadVitmapCollider(VitmapCollider* collider);
+
+// Each query writes the order indices of the shapes it hits to hitsOut in draw
+// order, bottom shape first, at most maxHits of them, and returns how many
+// shapes were hit in total
+int queryVitmapPoint(const VitmapCollider* collider, Vector2 point, int* hitsOut, int maxHits);
+int queryVitmapRect(const VitmapCollider* collider, Rectangle rect, int* hitsOut, int maxHits);
+int queryVitmapCircle(const VitmapCollider* collider, Vector2 center, float radius, int* hitsOut, int maxHits);
+
+// Tests against every contour of the shape under its winding rule, curves
+// included, offsets too. Needs no bake, for editing where meshes are not
+// kept up to date.
+bool isPointInShape(const Vitmap* vitmap, const Shape* shape, Vector2 point);
+
+#endif // VITMAP_QUERY_H
@@ -0,0 +1,21 @@
+#ifndef VITMAP_RASTER_H
+#define VITMAP_RASTER_H
+
+#include "vitmap.h"
+
+// CPU rasterization of baked vitmaps into an RGBA8 pixel buffer. Needs no
+// window or GL context, so it works in tools and on servers.
+typedef struct VitmapRaster
+{
+    int width;
+    int height;
+    unsigned char* pixels; // width * height * 4 bytes, RGBA, top row first
+} VitmapRaster;
+
+VitmapRaster createVitmapRaster(int width, int height);
+void unloadVitmapRaster(VitmapRaster* raster);
+void clearVitmapRaster(VitmapRaster* raster, Color color);
+void rasterizeVitmap(VitmapRaster* raster, const Vitmap* vitmap, Vector2 position, Vector2 scale);
+bool exportVitmapRasterToPng(const VitmapRaster* raster, const char* filename);
+
+#endif // VITMAP_RASTER_H
@@ -0,0 +1,81 @@
+#ifndef VITMAP_TRACE_H
+#define VITMAP_TRACE_H
+
+#include <stdbool.h>
+
+// Lightweight timing spans. Build with -DVITMAP_ENABLE_TRACING to record them;
+// without it the span macros expand to nothing. Each thread writes finished
+// spans into its own ring buffer, so recording takes no lock, and the newest
+// VITMAP_TRACE_BUFFER_SIZE spans per thread can be dumped as Chrome trace JSON
+// (load the file in chrome://tracing or ui.perfetto.dev).
+
+#define VITMAP_TRACE_BUFFER_SIZE 16384     // Spans kept per thread, a power of two
+
+typedef struct VitmapTraceEvent
+{
+    const char* name;       // Must outlive the trace, in practice a string literal
+    unsigned long long start;
+    unsigned long long end;
+} VitmapTraceEvent;
+
+typedef struct VitmapTraceBuffer
+{
+    VitmapTraceEvent events[VITMAP_TRACE_BUFFER_SIZE];
+    unsigned long long count;
+    int threadIndex;
+    struct VitmapTraceBuffer* next;
+} VitmapTraceBuffer;
+
+typedef struct VitmapTraceSpan
+{
+    const char* name;
+    unsigned long long start;
+} VitmapTraceSpan;
+
+extern __thread VitmapTraceBuffer* vitmapTraceBuffer;
+
+VitmapTraceBuffer* registerVitmapTraceThread();
+unsigned long long readVitmapTraceClockFallback();
+bool dumpVitmapTrace(const char* filename);
+void clearVitmapTrace();
+void shutdownVitmapTrace();
+
+// The TSC where there is one, monotonic nanoseconds otherwise. Either way the
+// dump converts to microseconds.
+static inline unsigned long long readVitmapTraceClock()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return readVitmapTraceClockFallback();
+#endif
+}
+
+static inline void endVitmapTraceSpan(const VitmapTraceSpan* span)
+{
+    unsigned long long end = readVitmapTraceClock();
+    VitmapTraceBuffer* buffer = vitmapTraceBuffer;
+    if (buffer == NULL)
+    {
+        buffer = registerVitmapTraceThread();
+        if (buffer == NULL)
+        {
+            return;
+        }
+    }
+    VitmapTraceEvent* event = &buffer->events[buffer->count & (VITMAP_TRACE_BUFFER_SIZE - 1)];
+    event->name = span->name;
+    event->start = span->start;
+    event->end = end;
+    buffer->count++;
+}
+
+#ifdef VITMAP_ENABLE_TRACING
+#define VITMAP_SPAN_BEGIN(span, name) VitmapTraceSpan span = {(name), readVitmapTraceClock()}
+#define VITMAP_SPAN_END(span) endVitmapTraceSpan(&span)
+#else
+#define VITMAP_SPAN_BEGIN(span, name) do { } while (0)
+#define VITMAP_SPAN_END(span) do { } while (0)
+#endif
+
+#endif // VITMAP_TRACE_H
@@ -4,12 +4,19 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <string.h>
 #include "include/raylib.h"
 #include "include/raymath.h"
 #include "include/raygui.h"
 #include "include/rlgl.h"
 #include "include/tesselator.h"
 #include "vitmap.h"
+#include "vitmap_jobs.h"
+#include "vitmap_journal.h"
+#include "vitmap_live.h"
+#include "vitmap_platform.h"
+#include "vitmap_query.h"
+#include "vitmap_trace.h"
 
 typedef enum Tool
 {
@@ -41,8 +48,8 @@ Camera2D camera = {
 
 VitmapAnimation* currentAnimation = NULL;
 Vitmap* currentVitmap = NULL;
-Shape* currentShape = NULL;
-Vector2* currentVertex = NULL;
+ShapeHandle currentShape = INVALID_SHAPE_HANDLE;
+PointHandle currentVertex = INVALID_POINT_HANDLE;
 
 Tool currentTool = TOOL_DRAW;
 bool isDrawingShape = false;
@@ -56,6 +63,13 @@ Sound pressSound;
 Sound snapSound; 
 Sound slidingSound;
 
+// Set while the Live toggle is on, a running game can map the animation from it
+VitmapLivePublisher* livePublisher = NULL;
+
+// Saving the animation again appends only the frames that changed
+VitmapJournal* animationJournal = NULL;
+char animationJournalPath[128] = "";
+
 Color ColorPickerValue = {90, 170, 200, 0};
 Texture2D overlayImg;
 
@@ -70,18 +84,6 @@ static void LoadOverlay(char* filePath);
 static void DecodeButton();
 static void LabelButton007();
 
-bool isPointInPoly(int nvert, float *vertx, float *verty, float testx, float testy)
-{
-    int i, j = 0;
-    bool c = false;
-    for (i = 0, j = nvert-1; i < nvert; j = i++) {
-        if ( ((verty[i]>testy) != (verty[j]>testy)) &&
-        (testx < (vertx[j]-vertx[i]) * (testy-verty[i]) / (verty[j]-verty[i]) + vertx[i]) )
-        c = !c;
-    }
-    return c;
-}
-
 void drawTesselation(TESStesselator* tesselator, Color color)
 {
     //int vertexCount = tessGetVertexCount(tesselator);
@@ -111,35 +113,71 @@ void drawTesselation(TESStesselator* tesselator, Color color)
     }
 }
 
-void drawWorkShape(Shape *shape, Vector2 position, Vector2 scale)
+// Shapes change under the mouse, so they are flattened and their outlines
+// stroked again every frame into a scratch arena that is reset instead of freed
+static VitmapArena* workScratch = NULL;
+
+static VitmapArena* getWorkScratch()
 {
-    Vector2* points = shape->points;
-    int numPoints = shape->numPoints;
-    Vector2* transformedPoints = calloc(numPoints, sizeof(Vector2));
-    Color color = shape->color;
+    if (workScratch == NULL)
+    {
+        workScratch = createVitmapArena(VITMAP_ARENA_DEFAULT_CHUNK_SIZE);
+    }
+    return workScratch;
+}
+
+// Curves are flattened for the zoom they are seen at, a quarter pixel off at most
+static float getWorkCurveTolerance(Vector2 scale)
+{
+    return 0.25f / (camera.zoom * fmaxf(fabsf(scale.x), fabsf(scale.y)));
+}
+
+void drawWorkShape(const Shape *shape, Color color, Vector2 position, Vector2 scale)
+{
+    VitmapArena* scratch = getWorkScratch();
+    if (scratch == NULL) {
+        return;
+    }
+    Vector2* transformedPoints = NULL;
+    int* starts = NULL;
+    int numPoints = flattenShape(shape, getWorkCurveTolerance(scale), scratch, &transformedPoints, &starts);
+    if (transformedPoints == NULL) {
+        resetVitmapArena(scratch);
+        return;
+    }
     for (int i = 0; i < numPoints; i++)
     {
-        transformedPoints[i].x = position.x + points[i].x * scale.x;
-        transformedPoints[i].y = position.y + points[i].y * scale.y;
+        transformedPoints[i].x = position.x + transformedPoints[i].x * scale.x;
+        transformedPoints[i].y = position.y + transformedPoints[i].y * scale.y;
     }
 
+    // Same rules as baking, in the order of VitmapWindingRule
+    static const int windingRules[] = {TESS_WINDING_ODD, TESS_WINDING_NONZERO, TESS_WINDING_POSITIVE};
     TESStesselator *tesselator = tessNewTess(NULL);
     tessSetOption(tesselator, TESS_CONSTRAINED_DELAUNAY_TRIANGULATION, 1);
-    tessAddContour(tesselator, 2, transformedPoints, sizeof(Vector2), numPoints);
-    tessTesselate(tesselator, TESS_WINDING_ODD, TESS_POLYGONS, 3, 2, NULL);
+    for (int i = 0; i < shape->numContours; i++)
+    {
+        int start = i > 0 ? starts[i - 1] : 0;
+        int count = (i + 1 < shape->numContours ? starts[i] : numPoints) - start;
+        if (count >= 3)
+        {
+            tessAddContour(tesselator, 2, &transformedPoints[start], sizeof(Vector2), count);
+        }
+    }
+    // Positive winds around +z in the shape's own space, which a mirroring scale turns over
+    const TESSreal normal[3] = {0.0f, 0.0f, scale.x * scale.y < 0.0f ? -1.0f : 1.0f};
+    tessTesselate(tesselator, windingRules[shape->windingRule], TESS_POLYGONS, 3, 2,
+        shape->windingRule == VITMAP_WINDING_POSITIVE ? normal : NULL);
     drawTesselation(tesselator, color);
     tessDeleteTess(tesselator);
-    free(transformedPoints);
+    resetVitmapArena(scratch);
 
     // DrawLineStrip(transformedPoints, numPoints, WHITE);
     // DrawLineV(transformedPoints[numPoints - 1], transformedPoints[0], WHITE);
 }
 
-void drawWorkShapeOutline(Shape* shape, Vector2 position, Vector2 scale, int pattern)
+void drawWorkShapeOutline(const Shape* shape, Vector2 position, Vector2 scale, int pattern)
 {
-    Vector2* points = shape->points;
-    int numPoints = shape->numPoints;
-    Vector2* transformedPoints = calloc(numPoints, sizeof(Vector2));
     Color color = WHITE;
     switch (pattern)
     {
@@ -150,24 +188,49 @@ void drawWorkShapeOutline(Shape* shape, Vector2 position, Vector2 scale, int pat
             color = ColorFromHSV(0, 0, sinf(GetTime() * 10) * 0.4 + 0.5);
             break;
     }
-    
-    for (int i = 0; i < numPoints; i++)
+
+    VitmapArena* scratch = getWorkScratch();
+    if (scratch == NULL) {
+        return;
+    }
+    Vector2* points = NULL;
+    int* starts = NULL;
+    int numPoints = flattenShape(shape, getWorkCurveTolerance(scale), scratch, &points, &starts);
+    if (points == NULL) {
+        resetVitmapArena(scratch);
+        return;
+    }
+    // Two pixels wide at any zoom
+    VitmapStrokeStyle style = {2.0f / camera.zoom, VITMAP_JOIN_MITER, VITMAP_CAP_BUTT, 4.0f, true};
+    for (int c = 0; c < shape->numContours; c++)
     {
-        transformedPoints[i].x = position.x + points[i].x * scale.x;
-        transformedPoints[i].y = position.y + points[i].y * scale.y;
+        int start = c > 0 ? starts[c - 1] : 0;
+        int count = (c + 1 < shape->numContours ? starts[c] : numPoints) - start;
+        ShapeMesh outline;
+        if (!tessellateStroke(&points[start], count, &style, scratch, &outline))
+        {
+            continue;
+        }
+        for (int i = 0; i < outline.numIndices; i += 3)
+        {
+            DrawTriangle(
+                Vector2Add(Vector2Multiply(outline.vertices[outline.indices[i]], scale), position),
+                Vector2Add(Vector2Multiply(outline.vertices[outline.indices[i + 1]], scale), position),
+                Vector2Add(Vector2Multiply(outline.vertices[outline.indices[i + 2]], scale), position),
+                color);
+        }
     }
-    
-    DrawLineStrip(transformedPoints, numPoints, color);
-    DrawLineV(transformedPoints[numPoints-1], transformedPoints[0], color);
-    free(transformedPoints);
+    resetVitmapArena(scratch);
 }
 
 void drawWorkVitmap(Vitmap *vitmap, Vector2 position, Vector2 scale)
 {
     for (int i = 0; i < vitmap->numShapes; i++)
     {
-        Shape* shape = &vitmap->shapes[i];
-        drawWorkShape(shape, position, scale);
+        const Shape* shape = getVitmapShape(vitmap, i);
+        Vector2 offset = getShapeOffset(vitmap, shape);
+        Color color = getShapeColor(shape, vitmap->palette, vitmap->numPaletteColors);
+        drawWorkShape(shape, color, (Vector2){position.x + offset.x * scale.x, position.y + offset.y * scale.y}, scale);
     }
 }
 
@@ -200,22 +263,15 @@ float lerp(float a, float b, float t)
     return a + (b - a) * t;
 }
 
-int getShapesUnderPos(Vitmap* vitmap, Vector2 pos, Shape* shapesUnderMouseOut[111])
+int getShapesUnderPos(Vitmap* vitmap, Vector2 pos, ShapeHandle shapesUnderMouseOut[111])
 {
     int shapesUnderMouseIndex = 0;
-    for (int i = 0; i < vitmap->numShapes; i++)
+    for (int i = 0; i < vitmap->numShapes && shapesUnderMouseIndex < 111; i++)
     {
-        int numVerts = vitmap->shapes[i].numPoints;
-        float* xVerts = calloc(numVerts, sizeof(float));
-        float* yVerts = calloc(numVerts, sizeof(float));
-        for (int j = 0; j < numVerts; j++)
+        // The editor's shapes are not baked, so test the points directly
+        if (isPointInShape(vitmap, getVitmapShape(vitmap, i), pos))
         {
-            xVerts[j] = vitmap->shapes[i].points[j].x;
-            yVerts[j] = vitmap->shapes[i].points[j].y;
-        }
-        if (isPointInPoly(numVerts, xVerts, yVerts, pos.x, pos.y))
-        {
-            shapesUnderMouseOut[shapesUnderMouseIndex] = &vitmap->shapes[i];
+            shapesUnderMouseOut[shapesUnderMouseIndex] = getShapeHandleAt(vitmap, i);
             shapesUnderMouseIndex++;
         }
     }
@@ -223,14 +279,14 @@ int getShapesUnderPos(Vitmap* vitmap, Vector2 pos, Shape* shapesUnderMouseOut[11
     return shapesFound;
 }
 
-Shape* getShapeUnderPos(Vitmap* vitmap, Vector2 pos)
+ShapeHandle getShapeUnderPos(Vitmap* vitmap, Vector2 pos)
 {
     const int max_shapes = 111;
-    Shape* shapesUnderPos[111];
-    // initialize them to null
+    ShapeHandle shapesUnderPos[111];
+    // initialize them to invalid handles
     for (int i = 0; i < max_shapes; i++)
     {
-        shapesUnderPos[i] = NULL;
+        shapesUnderPos[i] = INVALID_SHAPE_HANDLE;
     }
     getShapesUnderPos(vitmap, pos, shapesUnderPos);
     // print out the results
@@ -244,13 +300,13 @@ Shape* getShapeUnderPos(Vitmap* vitmap, Vector2 pos)
     // Find and return the one on top (The last one in the array)
     for (int i = max_shapes - 1; i >= 0; i--)
     {
-        if (shapesUnderPos[i] != NULL)
+        if (shapesUnderPos[i].slot != -1)
         {
             return shapesUnderPos[i];
         }
     }
     printf("No shapes here.\n");
-    return NULL;
+    return INVALID_SHAPE_HANDLE;
 }
 
 Vector2 vector2Transform(Vector2 input, Vector2 pos, Vector2 scale)
@@ -275,6 +331,29 @@ void drawVertexHandle(Vector2 pos, float size, bool inProximity)
     }
 }
 
+// Writes the picked color to the shape only when it differs from what the shape
+// shows, since editing a shape splits it off from frames that share it. A
+// picked color replaces the shape's palette slot.
+void applyPickedColor(Vitmap* vitmap, ShapeHandle handle)
+{
+    const Shape* shape = getShape(vitmap, handle);
+    if (shape == NULL)
+    {
+        return;
+    }
+    Color current = getShapeColor(shape, vitmap->palette, vitmap->numPaletteColors);
+    if (current.r == ColorPickerValue.r && current.g == ColorPickerValue.g && current.b == ColorPickerValue.b)
+    {
+        return;
+    }
+    Shape* editedShape = editShape(vitmap, handle);
+    if (editedShape != NULL)
+    {
+        editedShape->color = (Color){ColorPickerValue.r, ColorPickerValue.g, ColorPickerValue.b, 255};
+        editedShape->paletteIndex = -1;
+    }
+}
+
 void processTool(Tool currentTool, Vector2 mouseDrawAreaPos)
 {
     const float proxDistance = 0.4f;
@@ -287,23 +366,36 @@ void processTool(Tool currentTool, Vector2 mouseDrawAreaPos)
     {
         isDrawingShape = false;
     }
+    // Leaving the tool in the middle of a move confirms it where it is
+    if (TOOL_DRAW != currentTool && isMovingShape)
+    {
+        isMovingShape = false;
+        applyShapeTransform(currentVitmap, currentShape);
+    }
+    if (TOOL_MOVE != currentTool && isMovingVitmap)
+    {
+        isMovingVitmap = false;
+        applyVitmapTransform(currentVitmap);
+    }
+    // Resolved fresh every frame, a stale handle just means nothing is selected
+    const Shape* shape = getShape(currentVitmap, currentShape);
     switch (currentTool)
     {
         case TOOL_DRAW:
             if (!isMovingShape && IsMouseButtonPressed(MOUSE_LEFT_BUTTON) && !IsKeyDown(KEY_LEFT_SHIFT))
             {
-                if (isDrawingShape)
+                if (isDrawingShape && shape != NULL)
                 {
                     
-                    addPointToShape(currentShape, mouseSnappedPos);
+                    addPointToShape(currentVitmap, currentShape, mouseSnappedPos);
                 }
                 else
                 {
-                    addShapeToVitmap(currentVitmap);
-                    currentShape = &currentVitmap->shapes[currentVitmap->numShapes - 1];
+                    currentShape = addShapeToVitmap(currentVitmap);
                     isDrawingShape = true;
-                    addPointToShape(currentShape, mouseSnappedPos);
+                    addPointToShape(currentVitmap, currentShape, mouseSnappedPos);
                 }
+                shape = getShape(currentVitmap, currentShape);
                 PlaySound(pressSound);
             }
             // Drop it
@@ -311,25 +403,27 @@ void processTool(Tool currentTool, Vector2 mouseDrawAreaPos)
             {
                 isDrawingShape = false;
                 // if it has less than 3 points destroy the shape
-                if (currentShape->numPoints < 3)
+                if (shape != NULL && shape->numPoints < 3)
                 {
                     removeShapeFromVitmap(currentVitmap, currentShape);
-                    currentShape = NULL;
+                    currentShape = INVALID_SHAPE_HANDLE;
+                    shape = NULL;
                 }
             }
             // Press esc to deselect shape
             if (IsMouseButtonPressed(KEY_ESCAPE))
             {
                 isDrawingShape = false;
-                currentShape = NULL;
+                currentShape = INVALID_SHAPE_HANDLE;
+                shape = NULL;
             }
             drawPlus(GetWorldToScreen2D(mouseSnappedPos, camera));
             // See verts when holding shift
-            if (IsKeyDown(KEY_LEFT_SHIFT))
+            if (IsKeyDown(KEY_LEFT_SHIFT) && shape != NULL)
             {
-                for (int i = 0; i < currentShape->numPoints; i++)
+                for (int i = 0; i < shape->numPoints; i++)
                 {
-                    Vector2 point = currentShape->points[i];
+                    Vector2 point = shape->points[i];
                     float dist = Vector2Distance(mouseDrawAreaPos, point);
                     drawVertexHandle(GetWorldToScreen2D(point, camera), 5.0f - dist * 2.0f, dist < proxDistance);
                 }
@@ -337,81 +431,88 @@ void processTool(Tool currentTool, Vector2 mouseDrawAreaPos)
             // Shift-click to delete a point
             if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON) && IsKeyDown(KEY_LEFT_SHIFT))
             {
-                if (currentShape != NULL)
+                if (shape != NULL)
                 {
-                    for (int i = 0; i < currentShape->numPoints; i++)
+                    for (int i = 0; i < shape->numPoints; i++)
                     {
-                        Vector2 point = currentShape->points[i];
+                        Vector2 point = shape->points[i];
                         if (Vector2Distance(mouseDrawAreaPos, point) < proxDistance)
                         {
-                            removePointFromShape(currentShape, &currentShape->points[i]);
+                            removePointFromShape(currentVitmap, getPointHandle(currentVitmap, currentShape, i));
                             break;
                         }
                     }
                 }
             }
+            // Press H while drawing to start a hole, the next points go into a new contour
+            if (isDrawingShape && IsKeyPressed(KEY_H) && shape != NULL)
+            {
+                addContourToShape(currentVitmap, currentShape);
+            }
             // Press arrow up or arrow down to reorder the shape in the vitmap
             if (IsKeyPressed(KEY_UP))
             {
-                if (currentShape != NULL)
+                if (shape != NULL)
                 {
-                    // printf("--------------------\n");
-                    // printf("Currentshape before: %x\n", currentShape);
-                    currentShape = reorderShapeInVitmap(currentVitmap, currentShape, 1);
-                    //printf("Currentshape after: %x\n", currentShape);
+                    reorderShapeInVitmap(currentVitmap, currentShape, 1);
                 }
             }
             if (IsKeyPressed(KEY_DOWN))
             {
-                if (currentShape != NULL)
+                if (shape != NULL)
                 {
-                    // printf("--------------------\n");
-                    // printf("Currentshape before: %x\n", currentShape);
-                    currentShape = reorderShapeInVitmap(currentVitmap, currentShape, -1);
-                    //printf("Currentshape after: %x\n", currentShape);
+                    reorderShapeInVitmap(currentVitmap, currentShape, -1);
                 }
             }    
             // Right click while not drawing a shape to select a different one
             if (!isDrawingShape && IsMouseButtonPressed(MOUSE_RIGHT_BUTTON))
             {
-                Shape* shapeUnderMouse = getShapeUnderPos(currentVitmap, mouseDrawAreaPos);
-                if (shapeUnderMouse != NULL)
+                ShapeHandle shapeUnderMouse = getShapeUnderPos(currentVitmap, mouseDrawAreaPos);
+                if (isShapeHandleValid(currentVitmap, shapeUnderMouse))
                 {
                     currentShape = shapeUnderMouse;
-                    ColorPickerValue = currentShape->color;
+                    shape = getShape(currentVitmap, currentShape);
+                    ColorPickerValue = getShapeColor(shape, currentVitmap->palette, currentVitmap->numPaletteColors);
                 }
                 PlaySound(clickSound);
             }        
             // Press delete to delete the current shape
             if (IsKeyPressed(KEY_DELETE))
             {
-                if (currentShape != NULL)
+                if (shape != NULL)
                 {
                     removeShapeFromVitmap(currentVitmap, currentShape);
-                    currentShape = NULL;
+                    currentShape = INVALID_SHAPE_HANDLE;
+                    shape = NULL;
                 }
             }
             // Press G while not editing a shape to move it. Click to confirm.
             if (!isDrawingShape && IsKeyPressed(KEY_G))
             {
-                if (currentShape != NULL)
+                if (shape != NULL)
                 {
                     isMovingShape = true;
                     moveShapeStartPos = mouseSnappedPos;
                 }
             }
+            if (isMovingShape && shape == NULL)
+            {
+                isMovingShape = false;
+            }
             if (isMovingShape)
             {
                 if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON))
                 {
+                    // The move only changed the offset until now, bake it into the points
                     isMovingShape = false;
                     moveShapeStartPos = (Vector2){0, 0};
+                    applyShapeTransform(currentVitmap, currentShape);
                 }
                 else
                 {
                     Vector2 moveVector = Vector2Subtract(mouseSnappedPos, moveShapeStartPos);
                     moveShapeStartPos = mouseSnappedPos;
-                    moveShape(currentShape, moveVector);
+                    moveShape(currentVitmap, currentShape, moveVector);
                 }
             }
             break;
@@ -419,10 +520,10 @@ void processTool(Tool currentTool, Vector2 mouseDrawAreaPos)
         {
             if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON))
             {
-                Shape* shapeToGetColorFrom = getShapeUnderPos(currentVitmap, mouseDrawAreaPos);
+                const Shape* shapeToGetColorFrom = getShape(currentVitmap, getShapeUnderPos(currentVitmap, mouseDrawAreaPos));
                 if (shapeToGetColorFrom != NULL)
                 {
-                    ColorPickerValue = shapeToGetColorFrom->color;
+                    ColorPickerValue = getShapeColor(shapeToGetColorFrom, currentVitmap->palette, currentVitmap->numPaletteColors);
                 }
             }
             break;
@@ -430,51 +531,77 @@ void processTool(Tool currentTool, Vector2 mouseDrawAreaPos)
         case TOOL_EDIT:
         {
             // Draw a dot at each vertex of the current shape
-            if (currentShape != NULL)
+            if (shape != NULL)
             {
-                for (int i = 0; i < currentShape->numPoints; i++)
+                for (int i = 0; i < shape->numPoints; i++)
                 {
-                    Vector2 point = currentShape->points[i];
+                    Vector2 point = shape->points[i];
                     float dist = Vector2Distance(mouseDrawAreaPos, point);
                     drawVertexHandle(GetWorldToScreen2D(point, camera), 5.0f - dist * 2.0f, dist < proxDistance);
                 }
-                currentShape->color = (Color){ColorPickerValue.r, ColorPickerValue.g, ColorPickerValue.b, 255};
+                applyPickedColor(currentVitmap, currentShape);
             }
             // Click near a dot and drag it to change its position
             if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON))
             {
-                if (currentShape != NULL)
+                if (shape != NULL)
                 {
-                    for (int i = 0; i < currentShape->numPoints; i++)
+                    for (int i = 0; i < shape->numPoints; i++)
                     {
-                        Vector2 point = currentShape->points[i];
+                        Vector2 point = shape->points[i];
                         if (Vector2Distance(mouseDrawAreaPos, point) < proxDistance)
                         {
-                            currentVertex = &currentShape->points[i];
+                            currentVertex = getPointHandle(currentVitmap, currentShape, i);
                             break;
                         }
                     }
                 }
             }
-            if (IsMouseButtonDown(MOUSE_LEFT_BUTTON) && currentVertex != NULL)
+            // A stale vertex handle resolves to NULL, so these all skip it safely
+            const Vector2* vertex = getPoint(currentVitmap, currentVertex);
+            if (IsMouseButtonDown(MOUSE_LEFT_BUTTON) && vertex != NULL)
             {
+                // The first drag of a point in a duplicated frame splits it off
+                Vector2* editedVertex = editPoint(currentVitmap, currentVertex);
                 if (IsKeyDown(KEY_LEFT_CONTROL))
                 {
-                    *currentVertex = mouseDrawAreaPos;
+                    *editedVertex = mouseDrawAreaPos;
                 }
                 else
                 {
-                    *currentVertex = mouseSnappedPos;
+                    *editedVertex = mouseSnappedPos;
                 }
+                vertex = editedVertex;
             }
-            if (IsKeyPressed(KEY_DELETE) && currentVertex != NULL)
+            // Press Q to bend the edge after the selected point through the mouse, L to straighten it again
+            if ((IsKeyPressed(KEY_Q) || IsKeyPressed(KEY_L)) && vertex != NULL)
             {
-                removePointFromShape(currentShape, currentVertex);
-                currentVertex = NULL;
+                const Shape* edited = getShape(currentVitmap, currentVertex.shape);
+                int next = currentVertex.index + 1;
+                for (int i = 0; i < edited->numContours; i++)
+                {
+                    int count = 0;
+                    int start = getShapeContour(edited, i, &count);
+                    if (currentVertex.index >= start && currentVertex.index < start + count)
+                    {
+                        next = next < start + count ? next : start;
+                    }
+                }
+                // Half way along, a quadratic is halfway between the middle of its ends and its control
+                Vector2 middle = Vector2Scale(Vector2Add(*vertex, edited->points[next]), 0.5f);
+                Vector2 control = Vector2Subtract(Vector2Scale(mouseDrawAreaPos, 2.0f), middle);
+                setShapeCurve(currentVitmap, currentVertex, IsKeyPressed(KEY_Q) ? VITMAP_CURVE_QUADRATIC : VITMAP_CURVE_LINE,
+                    control, control);
             }
-            if (currentVertex != NULL)
+            if (IsKeyPressed(KEY_DELETE) && vertex != NULL)
             {
-               DrawCircleV(GetWorldToScreen2D(*currentVertex, camera), 4, RED);
+                removePointFromShape(currentVitmap, currentVertex);
+                currentVertex = INVALID_POINT_HANDLE;
+                vertex = NULL;
+            }
+            if (vertex != NULL)
+            {
+               DrawCircleV(GetWorldToScreen2D(*vertex, camera), 4, RED);
             }
             break;
         }
@@ -492,6 +619,7 @@ void processTool(Tool currentTool, Vector2 mouseDrawAreaPos)
                 {
                     isMovingVitmap = false;
                     moveVitmapStartPos = (Vector2){0, 0};
+                    applyVitmapTransform(currentVitmap);
                 }
                 else
                 {
@@ -534,6 +662,9 @@ void drawSizeGuide(int size, Color color)
 //------------------------------------------------------------------------------------
 int main(int argc, char *argv[])
 {
+    // Leave a core for the window and audio threads
+    startVitmapJobs(getVitmapCpuCount() - 1);
+
     // If the filepath is given as the second argument (argv[1]),
     // write down the path to load from it soon.
     char* fileToLoad = NULL;
@@ -546,13 +677,11 @@ int main(int argc, char *argv[])
     //--------------------------------------------------------------------------------------
 
     currentAnimation = createVitmapAnimation();
-    currentVitmap = createVitmap();
-    addFrameToAnimation(currentAnimation, *currentVitmap);
+    currentVitmap = addEmptyFrameToAnimation(currentAnimation);
     
     if (fileToLoad != NULL)
     {
-        Vitmap loadedVmp = loadVitmapFromFile(fileToLoad);
-        currentVitmap = &loadedVmp;
+        *currentVitmap = loadVitmapFromFile(fileToLoad);
     }
     
     int screenWidth = 1280;
@@ -594,7 +723,19 @@ int main(int argc, char *argv[])
     while (!WindowShouldClose()) // Detect window close button or ESC key
     {
         // Update
-        currentVitmap = &currentAnimation->frames[currentAnimation->currentFrame];
+        // Shape handles only mean something in the frame they came from
+        Vitmap* frameVitmap = &currentAnimation->frames[currentAnimation->currentFrame];
+        if (frameVitmap != currentVitmap)
+        {
+            currentShape = INVALID_SHAPE_HANDLE;
+            currentVertex = INVALID_POINT_HANDLE;
+            isDrawingShape = false;
+            // A move left unconfirmed in another frame is folded in on the way back
+            isMovingShape = false;
+            isMovingVitmap = false;
+            applyVitmapTransform(frameVitmap);
+        }
+        currentVitmap = frameVitmap;
         //currentShape = &currentVitmap->shapes[currentVitmap->numShapes - 1];
 
         Vector2 mouseDrawAreaPos = GetScreenToWorld2D(GetMousePosition(), camera);
@@ -668,15 +809,16 @@ int main(int argc, char *argv[])
                 drawWorkVitmap(currentVitmap, (Vector2){0, 0}, (Vector2){1, 1});
             }
                 //drawWorkShape(currentShape, (Vector2){drawingArea.x, drawingArea.y}, (Vector2){drawingArea.width / gridSize.x, drawingArea.height / gridSize.y});
-            if (currentShape != NULL)
+            const Shape* selectedShape = getShape(currentVitmap, currentShape);
+            if (selectedShape != NULL)
             {
                 if (isDrawingShape)
                 {
-                    drawWorkShapeOutline(currentShape, (Vector2){0, 0}, (Vector2){1, 1}, 0);
+                    drawWorkShapeOutline(selectedShape, getShapeOffset(currentVitmap, selectedShape), (Vector2){1, 1}, 0);
                 }
                 else
                 {
-                    drawWorkShapeOutline(currentShape, (Vector2){0, 0}, (Vector2){1, 1}, 1);
+                    drawWorkShapeOutline(selectedShape, getShapeOffset(currentVitmap, selectedShape), (Vector2){1, 1}, 1);
                 }
             }
             // rlEnableBackfaceCulling();
@@ -706,7 +848,7 @@ int main(int argc, char *argv[])
                     WHITE);
             }
         }
-        if (currentShape != NULL) DrawText(TextFormat("pts: %d", currentShape->numPoints), 24, 456, 20, BLACK);
+        if (selectedShape != NULL) DrawText(TextFormat("pts: %d", selectedShape->numPoints), 24, 456, 20, BLACK);
         DrawText(TextFormat("raw mouse pos: %f, %f", GetMousePosition().x, GetMousePosition().y), 24, 460, 20, BLACK);
         DrawText(TextFormat("mouse draw area pos: %f, %f", mouseDrawAreaPos.x, mouseDrawAreaPos.y), 24, 480, 20, BLACK);
 
@@ -732,6 +874,18 @@ int main(int argc, char *argv[])
             LoadAnimationButton(currentAnimation, FilePathText);
             PlaySound(clickSound);
         }
+        bool isLive = GuiToggle((Rectangle){312, 24, 48, 48}, "Live", livePublisher != NULL);
+        if (isLive && livePublisher == NULL)
+        {
+            livePublisher = createVitmapLivePublisher(VITMAP_LIVE_DEFAULT_NAME, VITMAP_LIVE_DEFAULT_BUFFER_SIZE);
+            PlaySound(clickSound);
+        }
+        else if (!isLive && livePublisher != NULL)
+        {
+            destroyVitmapLivePublisher(livePublisher);
+            livePublisher = NULL;
+            PlaySound(clickSound);
+        }
         if (GuiButton((Rectangle){24, 408, 120, 24}, "Load Overlay"))
         {
             LoadOverlay(OverlayImgPathText);
@@ -765,7 +919,14 @@ int main(int argc, char *argv[])
         // Animation add frame button
         if (GuiButton((Rectangle){816, 640, 20, 20}, "+"))
         {
-            addFrameToAnimation(currentAnimation, *createVitmap());
+            addEmptyFrameToAnimation(currentAnimation);
+            currentAnimation->currentFrame = currentAnimation->numFrames - 1;
+            isDrawingShape = false;
+        }
+        // Duplicate frame button, the copy shares geometry until it is edited
+        if (GuiButton((Rectangle){840, 640, 40, 20}, "Dup"))
+        {
+            duplicateFrameInAnimation(currentAnimation, currentAnimation->currentFrame);
             currentAnimation->currentFrame = currentAnimation->numFrames - 1;
             isDrawingShape = false;
         }
@@ -774,9 +935,11 @@ int main(int argc, char *argv[])
         {
             processTool(currentTool, mouseDrawAreaPos);
         }
-        if (currentShape != NULL)
+        applyPickedColor(currentVitmap, currentShape);
+        // Every frame, the game only picks it up again when something changed
+        if (livePublisher != NULL)
         {
-            currentShape->color = (Color){ColorPickerValue.r, ColorPickerValue.g, ColorPickerValue.b, 255};
+            publishVitmapAnimation(livePublisher, currentAnimation);
         }
 
         drawOverlayImg(overlayImg, drawingArea, 0.2f);
@@ -803,6 +966,16 @@ int main(int argc, char *argv[])
 
     CloseAudioDevice();
 
+    destroyVitmapLivePublisher(livePublisher);
+    closeVitmapJournal(animationJournal);
+    destroyVitmapAnimation(currentAnimation);
+    destroyVitmapArena(workScratch);
+    stopVitmapJobs();
+#ifdef VITMAP_ENABLE_TRACING
+    dumpVitmapTrace("vitmap-trace.json");
+    shutdownVitmapTrace();
+#endif
+
     CloseWindow(); // Close window and OpenGL context
     //--------------------------------------------------------------------------------------
 
@@ -818,15 +991,30 @@ static void SaveButton(Vitmap* vitmap, const char* name)
 }
 static void LoadButton(Vitmap* vitmapOut, const char* name)
 {
+    currentShape = INVALID_SHAPE_HANDLE;
+    currentVertex = INVALID_POINT_HANDLE;
+    unloadVitmap(vitmapOut);
     *vitmapOut = loadVitmapFromFile(name);
 }
 static void SaveAnimationButton(VitmapAnimation* animation, const char* name)
 {
-    saveAnimationToFile(animation, name);
+    if (animationJournal != NULL && strcmp(animationJournalPath, name) == 0)
+    {
+        saveVitmapJournal(animationJournal);
+        return;
+    }
+    closeVitmapJournal(animationJournal);
+    animationJournal = createVitmapJournal(name, VITMAP_JOURNAL_DEFAULT_COMPACT_SIZE, animation);
+    snprintf(animationJournalPath, sizeof animationJournalPath, "%s", name);
 }
 static void LoadAnimationButton(VitmapAnimation* animationOut, const char* name)
 {
-    *animationOut = loadAnimationFromFile(name);
+    currentShape = INVALID_SHAPE_HANDLE;
+    currentVertex = INVALID_POINT_HANDLE;
+    closeVitmapJournal(animationJournal);
+    unloadAnimation(animationOut);
+    animationJournal = openVitmapJournal(name, VITMAP_JOURNAL_DEFAULT_COMPACT_SIZE, animationOut);
+    snprintf(animationJournalPath, sizeof animationJournalPath, "%s", name);
 }
 static void LoadOverlay(char* filePath)
 {
@@ -1,3 +1,3 @@
 del vitmap-maker.exe
-gcc main.c vitmap.c -o vitmap-maker.exe -O1 -Wall -std=c99 -Wno-missing-braces -I include/ -L lib/ -lraylib -llibtess2 -lopengl32 -lgdi32 -lwinmm
+gcc main.c vitmap.c vitmap_arena.c vitmap_log.c vitmap_trace.c vitmap_platform.c vitmap_query.c vitmap_mask.c vitmap_jobs.c vitmap_bake.c vitmap_stroke.c vitmap_bake_cache.c vitmap_assets.c vitmap_live.c vitmap_batch.c vitmap_io.c vitmap_journal.c -o vitmap-maker.exe -O1 -Wall -std=c99 -Wno-missing-braces -I include/ -L lib/ -lraylib -llibtess2 -lopengl32 -lgdi32 -lwinmm
 vitmap-maker.exe
\ No newline at end of file
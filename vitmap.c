@@ -1,29 +1,195 @@
+#include <limits.h>
+#include <math.h>
 #include <stdio.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 #include "include/vitmap.h"
-#include "include/raymath.h"
+#include "include/vitmap_bake_cache.h"
+#include "include/vitmap_jobs.h"
+#include "include/vitmap_log.h"
+#include "include/vitmap_platform.h"
+#include "include/vitmap_trace.h"
 
 void initShape(Shape* shape)
 {
+    shape->points = NULL;
     shape->numPoints = 0;
+    shape->pointCapacity = 0;
+    shape->pointGeneration = 0;
+    shape->contourStarts = NULL;
+    shape->numContours = 1;
+    shape->windingRule = VITMAP_WINDING_ODD;
+    shape->curves = NULL;
+    shape->numCurves = 0;
+    shape->mesh = NULL;
+    shape->stroke = NULL;
     shape->color = (Color){0, 0, 0, 0};
+    shape->paletteIndex = -1;
+    shape->offset = (Vector2){0.0f, 0.0f};
 }
 
 void initVitmap(Vitmap* vitmap)
 {
+    vitmap->shapes = NULL;
+    vitmap->slots = NULL;
+    vitmap->order = NULL;
     vitmap->numShapes = 0;
+    vitmap->numSlots = 0;
+    vitmap->shapeCapacity = 0;
+    vitmap->freeSlot = -1;
+    vitmap->arena = NULL;
+    vitmap->ownsArena = false;
+    vitmap->offset = (Vector2){0.0f, 0.0f};
+    vitmap->palette = NULL;
+    vitmap->numPaletteColors = 0;
 }
 
 void initVitmapAnimation(VitmapAnimation* vitmapAnimation)
 {
+    vitmapAnimation->frames = NULL;
     vitmapAnimation->numFrames = 0;
+    vitmapAnimation->frameCapacity = 0;
     vitmapAnimation->currentFrame = 0;
+    vitmapAnimation->arena = NULL;
 }
 
 void initVitmapAnimationSet(VitmapAnimationSet* vitmapAnimationSet)
 {
+    initVitmapAnimation(&vitmapAnimationSet->pool);
+    vitmapAnimationSet->frameHashes = NULL;
+    vitmapAnimationSet->frameIndex = NULL;
+    vitmapAnimationSet->frameIndexCapacity = 0;
+    vitmapAnimationSet->animations = NULL;
     vitmapAnimationSet->numAnimations = 0;
+    vitmapAnimationSet->animationCapacity = 0;
+    vitmapAnimationSet->nameIndex = NULL;
+    vitmapAnimationSet->nameIndexCapacity = 0;
+}
+
+// Vitmaps made from scratch get their arena on first use
+static VitmapArena* getVitmapArena(Vitmap* vitmap)
+{
+    if (vitmap->arena == NULL)
+    {
+        vitmap->arena = createVitmapArena(VITMAP_ARENA_DEFAULT_CHUNK_SIZE);
+        vitmap->ownsArena = true;
+    }
+    return vitmap->arena;
+}
+
+static VitmapArena* getAnimationArena(VitmapAnimation* animation)
+{
+    if (animation->arena == NULL)
+    {
+        animation->arena = createVitmapArena(VITMAP_ARENA_DEFAULT_CHUNK_SIZE);
+    }
+    return animation->arena;
+}
+
+// Shape tables and point arrays live in shared blocks with a reference count in
+// front of the data. A count above one means another frame or shape still
+// reads the block, so it is copied on the first write instead of changed.
+// Counts are atomic, frames sharing a block may be split from different threads.
+#define SHARED_BLOCK_HEADER_SIZE 16
+
+static void* allocateSharedBlock(VitmapArena* arena, size_t size)
+{
+    unsigned char* block = allocateFromVitmapArena(arena, SHARED_BLOCK_HEADER_SIZE + size);
+    if (block == NULL) {
+        return NULL;
+    }
+    *(int*)block = 1;
+    return block + SHARED_BLOCK_HEADER_SIZE;
+}
+
+static int* getSharedBlockRefs(const void* data)
+{
+    return (int*)((unsigned char*)data - SHARED_BLOCK_HEADER_SIZE);
+}
+
+static void retainSharedBlock(const void* data)
+{
+    if (data != NULL)
+    {
+        __atomic_add_fetch(getSharedBlockRefs(data), 1, __ATOMIC_RELAXED);
+    }
+}
+
+// Arena memory is only reclaimed with the arena, releasing just drops the count
+static void releaseSharedBlock(const void* data)
+{
+    if (data != NULL)
+    {
+        __atomic_sub_fetch(getSharedBlockRefs(data), 1, __ATOMIC_ACQ_REL);
+    }
+}
+
+static bool isSharedBlock(const void* data)
+{
+    return data != NULL && __atomic_load_n(getSharedBlockRefs(data), __ATOMIC_ACQUIRE) > 1;
+}
+
+// Only for blocks that are not shared, may grow in place
+static void* growSharedBlock(VitmapArena* arena, void* data, size_t oldSize, size_t newSize)
+{
+    if (data == NULL)
+    {
+        return allocateSharedBlock(arena, newSize);
+    }
+    unsigned char* block = growVitmapArenaAllocation(arena, getSharedBlockRefs(data),
+        SHARED_BLOCK_HEADER_SIZE + oldSize, SHARED_BLOCK_HEADER_SIZE + newSize);
+    if (block == NULL) {
+        return NULL;
+    }
+    return block + SHARED_BLOCK_HEADER_SIZE;
+}
+
+// Gives the vitmap its own copy of the shape table. The copied shapes keep
+// pointing at the same point arrays, which become shared one level down.
+static bool unshareShapeTable(Vitmap* vitmap)
+{
+    if (!isSharedBlock(vitmap->shapes))
+    {
+        return true;
+    }
+    VitmapArena* arena = getVitmapArena(vitmap);
+    int capacity = vitmap->shapeCapacity;
+    Shape* shapes = allocateSharedBlock(arena, capacity * sizeof(Shape));
+    ShapeSlot* slots = allocateFromVitmapArena(arena, capacity * sizeof(ShapeSlot));
+    int* order = allocateFromVitmapArena(arena, capacity * sizeof(int));
+    if (shapes == NULL || slots == NULL || order == NULL) {
+        return false;
+    }
+    memcpy(shapes, vitmap->shapes, vitmap->numSlots * sizeof(Shape));
+    memcpy(slots, vitmap->slots, vitmap->numSlots * sizeof(ShapeSlot));
+    memcpy(order, vitmap->order, vitmap->numShapes * sizeof(int));
+    for (int i = 0; i < vitmap->numShapes; i++)
+    {
+        retainSharedBlock(shapes[order[i]].points);
+    }
+    releaseSharedBlock(vitmap->shapes);
+    vitmap->shapes = shapes;
+    vitmap->slots = slots;
+    vitmap->order = order;
+    return true;
+}
+
+// The shape must already sit in an unshared table
+static bool unshareShapePoints(Vitmap* vitmap, Shape* shape)
+{
+    if (!isSharedBlock(shape->points))
+    {
+        return true;
+    }
+    Vector2* points = allocateSharedBlock(getVitmapArena(vitmap), shape->pointCapacity * sizeof(Vector2));
+    if (points == NULL) {
+        return false;
+    }
+    memcpy(points, shape->points, shape->numPoints * sizeof(Vector2));
+    releaseSharedBlock(shape->points);
+    shape->points = points;
+    return true;
 }
 
 void printVitmap(const Vitmap* vitmap)
@@ -34,21 +200,26 @@ void printVitmap(const Vitmap* vitmap)
 
     for (int i = 0; i < vitmap->numShapes; i++)
     {
+        const Shape* shape = getVitmapShape(vitmap, i);
         printf("    Shape %d:\n", i + 1);
-        printf("      Number of Points: %d\n", vitmap->shapes[i].numPoints);
+        printf("      Number of Points: %d\n", shape->numPoints);
         printf("      Color (RGBA): (%d, %d, %d, %d)\n",
-               vitmap->shapes[i].color.r,
-               vitmap->shapes[i].color.g,
-               vitmap->shapes[i].color.b,
-               vitmap->shapes[i].color.a);
+               shape->color.r,
+               shape->color.g,
+               shape->color.b,
+               shape->color.a);
+        if (shape->paletteIndex >= 0)
+        {
+            printf("      Palette Index: %d\n", shape->paletteIndex);
+        }
 
         printf("      Points:\n");
-        for (int j = 0; j < vitmap->shapes[i].numPoints; j++)
+        for (int j = 0; j < shape->numPoints; j++)
         {
             printf("          Point %d: (%.2f, %.2f)\n",
                    j + 1,
-                   vitmap->shapes[i].points[j].x,
-                   vitmap->shapes[i].points[j].y);
+                   shape->points[j].x,
+                   shape->points[j].y);
         }
     }
 }
@@ -59,10 +230,8 @@ Shape* createShape()
     if (shape == NULL) {
         return NULL;
     }
-    shape->numPoints = 0;
+    initShape(shape);
     shape->color = (Color){0, 0, 0, 255};
-    shape->points = NULL;
-    shape->tesselation = NULL;
     return shape;
 }
 
@@ -72,8 +241,7 @@ Vitmap* createVitmap()
     if (vitmap == NULL) {
         return NULL;
     }
-    vitmap->numShapes = 0;
-    vitmap->shapes = NULL;
+    initVitmap(vitmap);
     return vitmap;
 }
 
@@ -83,399 +251,3659 @@ VitmapAnimation* createVitmapAnimation()
     if (vitmapAnimation == NULL) {
         return NULL;
     }
-    vitmapAnimation->numFrames = 0;
-    vitmapAnimation->currentFrame = 0;
-    vitmapAnimation->frames = NULL;
+    initVitmapAnimation(vitmapAnimation);
     return vitmapAnimation;
 }
 
-void addPointToShape(Shape* shape, Vector2 point)
+// Frees everything the vitmap owns and leaves it empty
+void unloadVitmap(Vitmap* vitmap)
 {
-    printf("adding point to shape. current count: %d\n", shape->numPoints);
-    shape->points = (Vector2*)realloc(shape->points, (shape->numPoints + 1) * sizeof(Vector2));
-    shape->points[shape->numPoints] = point;
-    shape->numPoints++;
-    // printf("points in shape:\n");
-    // for(int i = 0; i < shape->numPoints; i++)
-    // {
-    //     printf("%f %f\n", shape->points[i].x, shape->points[i].y);
-    // }
+    if (vitmap->ownsArena)
+    {
+        destroyVitmapArena(vitmap->arena);
+    }
+    initVitmap(vitmap);
 }
 
-void removePointFromShape(Shape *shape, Vector2 *point)
+void destroyVitmap(Vitmap* vitmap)
 {
-    // See if shape has this pointer
-    int index = -1;
-    for (int i = 0; i < shape->numPoints; i++)
-    {
-        if (&shape->points[i] == point)
-        {
-            index = i;
-            break;
-        }
-    }
-    if (index == -1)
+    if (vitmap == NULL)
     {
         return;
     }
-    // Remove the point
-    for (int i = index; i < shape->numPoints - 1; i++)
+    unloadVitmap(vitmap);
+    free(vitmap);
+}
+
+void unloadAnimation(VitmapAnimation* animation)
+{
+    // Frames normally live in the animation's arena, but one can have been
+    // swapped for a separately loaded vitmap that still owns its own
+    for (int i = 0; i < animation->numFrames; i++)
     {
-        shape->points[i] = shape->points[i + 1];
+        unloadVitmap(&animation->frames[i]);
     }
-    shape->numPoints--;
-    // Reallocate memory
-    shape->points = (Vector2*)realloc(shape->points, shape->numPoints * sizeof(Vector2));
+    destroyVitmapArena(animation->arena);
+    initVitmapAnimation(animation);
 }
 
-void addShapeToVitmap(Vitmap* vitmap)
+void destroyVitmapAnimation(VitmapAnimation* animation)
 {
-    printf("Shapes pointer before: %p\n", vitmap->shapes);
-    // Increment the number of shapes in the vitmap
-    vitmap->numShapes++;
-  
-    // Reallocate memory for the shapes array to accommodate the new shape
-    Shape* newShapes = (Shape*)realloc(vitmap->shapes, vitmap->numShapes * sizeof(Shape));
-    if (newShapes == NULL) {
-        // Handle allocation failure
-        vitmap->numShapes = 0; // Reset the number of shapes
-        return;
-    }
-  
-    vitmap->shapes = newShapes; // Update the pointer to the reallocated memory
-  
-    // Create the new shape using createShape function
-    Shape* newShape = createShape();
-    if (newShape == NULL) {
-        // Handle creation failure
-        vitmap->numShapes--; // Decrement the number of shapes
+    if (animation == NULL)
+    {
         return;
     }
-  
-    // Add the new shape to the shapes array
-    vitmap->shapes[vitmap->numShapes - 1] = *newShape;
+    unloadAnimation(animation);
+    free(animation);
 }
 
-void removeShapeFromVitmap(Vitmap* vitmap, Shape* shape)
+// Names, frame lists and indices all live in the pool's arena
+void unloadAnimationSet(VitmapAnimationSet* set)
 {
-    // See if vitmap has this shape
-    int index = -1;
-    for (int i = 0; i < vitmap->numShapes; i++)
+    unloadAnimation(&set->pool);
+    initVitmapAnimationSet(set);
+}
+
+bool isShapeHandleValid(const Vitmap* vitmap, ShapeHandle shape)
+{
+    return shape.slot >= 0 && shape.slot < vitmap->numSlots
+        && vitmap->slots[shape.slot].generation == shape.generation
+        && vitmap->slots[shape.slot].orderIndex >= 0;
+}
+
+// Returns NULL for stale handles. The pointer itself is only good until the
+// next shape is added, hold on to the handle instead. The shape may be shared
+// with other frames, use editShape to change it.
+const Shape* getShape(const Vitmap* vitmap, ShapeHandle shape)
+{
+    if (!isShapeHandleValid(vitmap, shape))
     {
-        if (&vitmap->shapes[i] == shape)
-        {
-            index = i;
-            break;
-        }
+        return NULL;
     }
-    if (index == -1)
+    return &vitmap->shapes[shape.slot];
+}
+
+ShapeHandle getShapeHandleAt(const Vitmap* vitmap, int orderIndex)
+{
+    if (orderIndex < 0 || orderIndex >= vitmap->numShapes)
     {
-        return;
+        return INVALID_SHAPE_HANDLE;
     }
-    // Remove the shape
-    for (int i = index; i < vitmap->numShapes - 1; i++)
+    int slot = vitmap->order[orderIndex];
+    return (ShapeHandle){slot, vitmap->slots[slot].generation};
+}
+
+int getShapeOrderIndex(const Vitmap* vitmap, ShapeHandle shape)
+{
+    if (!isShapeHandleValid(vitmap, shape))
     {
-        vitmap->shapes[i] = vitmap->shapes[i + 1];
+        return -1;
     }
-    vitmap->numShapes--;
-    // Reallocate memory
-    vitmap->shapes = (Shape*)realloc(vitmap->shapes, vitmap->numShapes * sizeof(Shape));
+    return vitmap->slots[shape.slot].orderIndex;
 }
 
-// Returns a pointer to the new location of where your shape is at
-Shape* reorderShapeInVitmap(Vitmap* vitmap, Shape* shape, int direction)
+PointHandle getPointHandle(const Vitmap* vitmap, ShapeHandle shape, int index)
 {
-    // Swap pointers with the shape before or after it in the vitmap's shape list
-    int index = -1;
-    for (int i = 0; i < vitmap->numShapes; i++)
+    const Shape* target = getShape(vitmap, shape);
+    if (target == NULL || index < 0 || index >= target->numPoints)
     {
-        if (&vitmap->shapes[i] == shape)
-        {
-            index = i;
-            break;
-        }
+        return INVALID_POINT_HANDLE;
     }
-    if (index == -1)
+    return (PointHandle){shape, index, target->pointGeneration};
+}
+
+// Returns NULL for stale handles. Read only, use editPoint to move the point.
+const Vector2* getPoint(const Vitmap* vitmap, PointHandle point)
+{
+    const Shape* shape = getShape(vitmap, point.shape);
+    if (shape == NULL || point.generation != shape->pointGeneration
+        || point.index < 0 || point.index >= shape->numPoints)
     {
-        return shape;
+        return NULL;
     }
-    if (direction == 1 && index < vitmap->numShapes - 1)
+    return &shape->points[point.index];
+}
+
+// Splits the shape off from any frame it is shared with. The color and mesh can
+// be written through the result, the points need editShapePoints or editPoint.
+Shape* editShape(Vitmap* vitmap, ShapeHandle shape)
+{
+    if (!isShapeHandleValid(vitmap, shape) || !unshareShapeTable(vitmap))
     {
-        Shape temp = vitmap->shapes[index];
-        vitmap->shapes[index] = vitmap->shapes[index + 1];
-        vitmap->shapes[index + 1] = temp;
-        return &vitmap->shapes[index + 1];
+        return NULL;
     }
-    else if (direction == -1 && index > 0)
+    return &vitmap->shapes[shape.slot];
+}
+
+Vector2* editShapePoints(Vitmap* vitmap, ShapeHandle shapeHandle)
+{
+    Shape* shape = editShape(vitmap, shapeHandle);
+    if (shape == NULL || !unshareShapePoints(vitmap, shape))
     {
-        Shape temp = vitmap->shapes[index];
-        vitmap->shapes[index] = vitmap->shapes[index - 1];
-        vitmap->shapes[index - 1] = temp;
-        return &vitmap->shapes[index - 1];
+        return NULL;
     }
-    return shape;
+    return shape->points;
 }
 
-Vitmap* addFrameToAnimation(VitmapAnimation* animation, Vitmap frame)
+Vector2* editPoint(Vitmap* vitmap, PointHandle point)
 {
-    animation->frames = (Vitmap*)realloc(animation->frames, (animation->numFrames + 1) * sizeof(Vitmap));
-    animation->frames[animation->numFrames] = frame;
-    animation->numFrames++;
-    return &animation->frames[animation->numFrames];
+    if (getPoint(vitmap, point) == NULL)
+    {
+        return NULL;
+    }
+    Vector2* points = editShapePoints(vitmap, point.shape);
+    return points != NULL ? &points[point.index] : NULL;
 }
 
-void saveAnimationToFile(VitmapAnimation* animation, const char* filename)
+PointHandle addPointToShape(Vitmap* vitmap, ShapeHandle shapeHandle, Vector2 point)
 {
-    // Open the file in binary write mode
-    FILE* file = fopen(filename, "wb");
-    if (file == NULL)
+    Shape* shape = editShape(vitmap, shapeHandle);
+    if (shape == NULL || !unshareShapePoints(vitmap, shape))
     {
-        printf("Failed to open file for writing.\n");
-        return;
+        return INVALID_POINT_HANDLE;
     }
-
-    // Write the number of frames in the animation
-    fwrite(&(animation->numFrames), sizeof(int), 1, file);
-
-    // Write each frame in the animation
-    for (int i = 0; i < animation->numFrames; i++)
+    VITMAP_TRACE("Adding point to shape %d, current count: %d", shapeHandle.slot, shape->numPoints);
+    if (shape->numPoints == shape->pointCapacity)
     {
-        Vitmap* frame = &(animation->frames[i]);
-
-        // Write the number of shapes in the frame
-        fwrite(&(frame->numShapes), sizeof(int), 1, file);
-
-        // Write each shape in the frame
-        for (int j = 0; j < frame->numShapes; j++)
-        {
-            Shape* shape = &(frame->shapes[j]);
-
-            // Write the number of points in the shape
-            fwrite(&(shape->numPoints), sizeof(int), 1, file);
-
-            // Write the points of the shape
-            fwrite(shape->points, sizeof(Vector2), shape->numPoints, file);
-
-            // Write the color of the shape
-            fwrite(&(shape->color), sizeof(Color), 1, file);
+        int newCapacity = shape->pointCapacity > 0 ? shape->pointCapacity * 2 : 4;
+        Vector2* newPoints = growSharedBlock(getVitmapArena(vitmap), shape->points,
+            shape->pointCapacity * sizeof(Vector2), newCapacity * sizeof(Vector2));
+        if (newPoints == NULL) {
+            return INVALID_POINT_HANDLE;
         }
+        shape->points = newPoints;
+        shape->pointCapacity = newCapacity;
     }
-    // Close the file
-    fclose(file);
-    
-    printf("Animation saved successfully.\n");
+    // Appending leaves the other points where they were, so their handles stay valid
+    shape->points[shape->numPoints] = point;
+    shape->numPoints++;
+    return (PointHandle){shapeHandle, shape->numPoints - 1, shape->pointGeneration};
 }
 
-VitmapAnimation loadAnimationFromFile(const char* filename)
+void removePointFromShape(Vitmap* vitmap, PointHandle point)
 {
-    VitmapAnimation animation = *createVitmapAnimation();
-
-    // Open the file in binary read mode
-    FILE* file = fopen(filename, "rb");
-    if (file == NULL)
+    if (editPoint(vitmap, point) == NULL)
     {
-        printf("Failed to open file for reading.\n");
-        return animation;
+        return;
     }
-
-    // Read the number of frames in the animation
-    int numFramesInTheFile = 0;
-    fread(&numFramesInTheFile, sizeof(int), 1, file);
-    printf("Number of frames in the file: %d\n", numFramesInTheFile);
-    // Read each vitmap in the animation
-    for (int i = 0; i < numFramesInTheFile; i++)
-    {
-        Vitmap* frame = createVitmap();
-
-        // Read the number of shapes in the frame
-        int numShapesInHere = 0;
-        fread(&numShapesInHere, sizeof(int), 1, file);
-        printf("Number of shapes in this frame: %d\n", numShapesInHere);
-        // Read each shape in the frame
-        for (int j = 0; j < numShapesInHere; j++)
-        {
-            addShapeToVitmap(frame);
-            Shape* shape = &(frame->shapes[frame->numShapes - 1]);
-            
-            // Read the number of points in the shape
-            int numPointsInHere = 0;
-            fread(&(numPointsInHere), sizeof(int), 1, file);
-            printf("Number of points in this shape: %d\n", numPointsInHere);
-            for (int j = 0; j < numPointsInHere; j++)
+    Shape* shape = &vitmap->shapes[point.shape.slot];
+    // Contours after the point start one earlier, and one left empty goes away
+    if (shape->numContours > 1)
+    {
+        int* starts = allocateFromVitmapArena(vitmap->arena, (shape->numContours - 1) * sizeof(int));
+        if (starts == NULL) {
+            return;
+        }
+        int numStarts = 0;
+        for (int i = 0; i < shape->numContours - 1; i++)
+        {
+            int start = shape->contourStarts[i] - (shape->contourStarts[i] > point.index ? 1 : 0);
+            int previous = numStarts > 0 ? starts[numStarts - 1] : 0;
+            if (start > previous && start < shape->numPoints - 1)
             {
-                Vector2 pointToAdd = {0.0f, 0.0f};
-                fread(&pointToAdd, sizeof(Vector2), 1, file);
-                addPointToShape(shape, pointToAdd);
+                starts[numStarts++] = start;
             }
-            
-            // Read the color of the shape
-            fread(&(shape->color), sizeof(Color), 1, file);
         }
-
-        addFrameToAnimation(&animation, *frame);
+        shape->contourStarts = numStarts > 0 ? starts : NULL;
+        shape->numContours = numStarts + 1;
     }
-
-    // Close the file
-    fclose(file);
-    
-    printf("Animation loaded successfully.\n");
-    
-    return animation;
+    // The point's own curve goes with it, the ones after it move down one
+    if (shape->numCurves > 0)
+    {
+        ShapeCurve* curves = allocateFromVitmapArena(vitmap->arena, shape->numCurves * sizeof(ShapeCurve));
+        if (curves == NULL) {
+            return;
+        }
+        int numCurves = 0;
+        for (int i = 0; i < shape->numCurves; i++)
+        {
+            if (shape->curves[i].point != point.index)
+            {
+                curves[numCurves] = shape->curves[i];
+                curves[numCurves].point -= curves[numCurves].point > point.index ? 1 : 0;
+                numCurves++;
+            }
+        }
+        shape->curves = numCurves > 0 ? curves : NULL;
+        shape->numCurves = numCurves;
+    }
+    // Remove the point, the freed slot stays as spare capacity
+    for (int i = point.index; i < shape->numPoints - 1; i++)
+    {
+        shape->points[i] = shape->points[i + 1];
+    }
+    shape->numPoints--;
+    shape->pointGeneration++;
 }
 
-void saveVitmapToFile(Vitmap* vitmap, const char* filename)
+bool addContourToShape(Vitmap* vitmap, ShapeHandle shapeHandle)
 {
-    // Open the file in binary write mode
-    FILE* file = fopen(filename, "wb");
-    if (file == NULL)
+    Shape* shape = editShape(vitmap, shapeHandle);
+    if (shape == NULL)
     {
-        printf("Failed to open file for writing.\n");
-        return;
+        return false;
     }
-    
-    // Write the number of shapes in the Vitmap
-    fwrite(&(vitmap->numShapes), sizeof(int), 1, file);
-    
-    // Write each shape in the Vitmap
-    for (int i = 0; i < vitmap->numShapes; i++)
+    int lastCount = 0;
+    getShapeContour(shape, shape->numContours - 1, &lastCount);
+    if (lastCount == 0)
     {
-        Shape* shape = &(vitmap->shapes[i]);
-        
-        // Write the number of points in the shape
-        fwrite(&(shape->numPoints), sizeof(int), 1, file);
-        
-        // Write the points of the shape
-        fwrite(shape->points, sizeof(Vector2), shape->numPoints, file);
-        
-        // Write the color of the shape
-        fwrite(&(shape->color), sizeof(Color), 1, file);
-    }
-    
-    // Close the file
-    fclose(file);
-    
-    printf("Vitmap saved successfully.\n");
+        return true;
+    }
+    // A new array, copies of the shape in other frames may still read the old one
+    int* starts = allocateFromVitmapArena(getVitmapArena(vitmap), shape->numContours * sizeof(int));
+    if (starts == NULL) {
+        return false;
+    }
+    if (shape->numContours > 1)
+    {
+        memcpy(starts, shape->contourStarts, (shape->numContours - 1) * sizeof(int));
+    }
+    starts[shape->numContours - 1] = shape->numPoints;
+    shape->contourStarts = starts;
+    shape->numContours++;
+    return true;
 }
 
-Vitmap loadVitmapFromFile(const char* filename)
+void setShapeWindingRule(Vitmap* vitmap, ShapeHandle shapeHandle, VitmapWindingRule rule)
 {
-    Vitmap vitmap = *createVitmap();
-    
-    // Open the file in binary read mode
-    FILE* file = fopen(filename, "rb");
-    if (file == NULL)
+    Shape* shape = editShape(vitmap, shapeHandle);
+    if (shape != NULL)
     {
-        printf("Failed to open file for reading.\n");
-        return vitmap;
+        shape->windingRule = rule;
     }
-    
-    // Read the number of shapes in the Vitmap
-    int numShapesInTheFile = 0;
-    fread(&numShapesInTheFile, sizeof(int), 1, file);
-    printf("Number of shapes: %d\n", vitmap.numShapes);
-    // Read each shape in the Vitmap
-    for (int i = 0; i < numShapesInTheFile; i++)
+}
+
+bool setShapeCurve(Vitmap* vitmap, PointHandle point, VitmapCurveKind kind, Vector2 control0, Vector2 control1)
+{
+    if (getPoint(vitmap, point) == NULL)
     {
-        addShapeToVitmap(&vitmap);
-        Shape* shape = &(vitmap.shapes[vitmap.numShapes - 1]);
-        
-        // Read the number of points in the shape
-        int numPointsInHere = 0;
-        fread(&(numPointsInHere), sizeof(int), 1, file);
-        for (int j = 0; j < numPointsInHere; j++)
+        return false;
+    }
+    Shape* shape = editShape(vitmap, point.shape);
+    if (shape == NULL)
+    {
+        return false;
+    }
+    // A new array in point order, copies of the shape in other frames may still read the old one
+    ShapeCurve* curves = allocateFromVitmapArena(getVitmapArena(vitmap), (shape->numCurves + 1) * sizeof(ShapeCurve));
+    if (curves == NULL) {
+        return false;
+    }
+    int numCurves = 0;
+    bool placed = kind == VITMAP_CURVE_LINE;
+    for (int i = 0; i <= shape->numCurves; i++)
+    {
+        if (!placed && (i == shape->numCurves || shape->curves[i].point >= point.index))
+        {
+            curves[numCurves++] = (ShapeCurve){point.index, kind, {control0, control1}};
+            placed = true;
+        }
+        if (i < shape->numCurves && shape->curves[i].point != point.index)
         {
-            Vector2 pointToAdd = {0.0f, 0.0f};
-            fread(&pointToAdd, sizeof(Vector2), 1, file);
-            addPointToShape(shape, pointToAdd);
+            curves[numCurves++] = shape->curves[i];
         }
-        
-        // Read the color of the shape
-        fread(&(shape->color), sizeof(Color), 1, file);
     }
-    
-    // Close the file
-    fclose(file);
-    
-    printf("Vitmap loaded successfully.\n");
-    
-    return vitmap;
+    shape->curves = numCurves > 0 ? curves : NULL;
+    shape->numCurves = numCurves;
+    return true;
 }
 
-void bakeShape(Shape* shape)
+// Shapes, slots and the order array always share one capacity
+static bool reserveShapeSlot(Vitmap* vitmap)
 {
-    TESStesselator** tess = &shape->tesselation;
-    if (*tess != NULL)
+    if (!unshareShapeTable(vitmap))
+    {
+        return false;
+    }
+    if (vitmap->freeSlot >= 0 || vitmap->numSlots < vitmap->shapeCapacity)
     {
-        tessDeleteTess(*tess);
+        return true;
+    }
+    // Grow geometrically so adding shapes stays cheap
+    VitmapArena* arena = getVitmapArena(vitmap);
+    int oldCapacity = vitmap->shapeCapacity;
+    int newCapacity = oldCapacity > 0 ? oldCapacity * 2 : 8;
+    Shape* newShapes = growSharedBlock(arena, vitmap->shapes,
+        oldCapacity * sizeof(Shape), newCapacity * sizeof(Shape));
+    ShapeSlot* newSlots = growVitmapArenaAllocation(arena, vitmap->slots,
+        oldCapacity * sizeof(ShapeSlot), newCapacity * sizeof(ShapeSlot));
+    int* newOrder = growVitmapArenaAllocation(arena, vitmap->order,
+        oldCapacity * sizeof(int), newCapacity * sizeof(int));
+    if (newShapes == NULL || newSlots == NULL || newOrder == NULL) {
+        // Handle allocation failure
+        return false;
     }
-    *tess = tessNewTess(NULL);
-    tessSetOption(*tess, TESS_CONSTRAINED_DELAUNAY_TRIANGULATION, 1);
-    tessAddContour(*tess, 2, shape->points, sizeof(Vector2), shape->numPoints);
-    tessTesselate(*tess, TESS_WINDING_ODD, TESS_POLYGONS, 3, 2, NULL);
+    vitmap->shapes = newShapes;
+    vitmap->slots = newSlots;
+    vitmap->order = newOrder;
+    vitmap->shapeCapacity = newCapacity;
+    return true;
 }
 
-void bakeVitmap(Vitmap* vitmap)
+// The new shape goes on top of the draw order
+ShapeHandle addShapeToVitmap(Vitmap* vitmap)
 {
-    // Bake all the shapes
-    for (int i = 0; i < vitmap->numShapes; i++)
+    if (!reserveShapeSlot(vitmap))
     {
-        Shape* shape = &(vitmap->shapes[i]);
-        bakeShape(shape);
+        return INVALID_SHAPE_HANDLE;
+    }
+
+    // Reuse a freed slot if there is one, its generation already moved on
+    int slot;
+    if (vitmap->freeSlot >= 0)
+    {
+        slot = vitmap->freeSlot;
+        vitmap->freeSlot = vitmap->slots[slot].nextFree;
+    }
+    else
+    {
+        slot = vitmap->numSlots;
+        vitmap->numSlots++;
+        vitmap->slots[slot].generation = 1;
     }
+    vitmap->slots[slot].orderIndex = vitmap->numShapes;
+    vitmap->slots[slot].nextFree = -1;
+    vitmap->order[vitmap->numShapes] = slot;
+    vitmap->numShapes++;
+
+    Shape* newShape = &vitmap->shapes[slot];
+    initShape(newShape);
+    newShape->color = (Color){0, 0, 0, 255};
+    return (ShapeHandle){slot, vitmap->slots[slot].generation};
 }
 
-Vitmap* loadAndBakeVitmap(const char* filename)
+void removeShapeFromVitmap(Vitmap* vitmap, ShapeHandle shape)
 {
-    Vitmap* vitmap = malloc(sizeof *vitmap);
-    *vitmap = loadVitmapFromFile(filename);
-    bakeVitmap(vitmap);
-    return vitmap;
+    int index = getShapeOrderIndex(vitmap, shape);
+    if (index == -1 || !unshareShapeTable(vitmap))
+    {
+        return;
+    }
+    releaseSharedBlock(vitmap->shapes[shape.slot].points);
+    // Close the gap in the draw order, its points stay in the arena until the vitmap is unloaded
+    for (int i = index; i < vitmap->numShapes - 1; i++)
+    {
+        vitmap->order[i] = vitmap->order[i + 1];
+        vitmap->slots[vitmap->order[i]].orderIndex = i;
+    }
+    vitmap->numShapes--;
+
+    // Bumping the generation is what makes outstanding handles stale
+    ShapeSlot* slot = &vitmap->slots[shape.slot];
+    slot->generation++;
+    slot->orderIndex = -1;
+    slot->nextFree = vitmap->freeSlot;
+    vitmap->freeSlot = shape.slot;
 }
 
-void drawShape(Shape* shape, Vector2 position, Vector2 scale, float rotation)
+// The copy goes right above the original and shares its points until either
+// of them is edited
+ShapeHandle duplicateShapeInVitmap(Vitmap* vitmap, ShapeHandle shape)
 {
-    // TODO: Implement transforms
-    // TODO: Bake the shape if the tesselator is NULL
-    const TESSreal *vertices = tessGetVertices(shape->tesselation);
-    int indexCount = tessGetElementCount(shape->tesselation) * 3;
-    const TESSindex *indices = tessGetElements(shape->tesselation);
-    for (int i = 0; i < indexCount; i += 3)
+    if (!isShapeHandleValid(vitmap, shape))
     {
-        Vector2 triReadVerts[3] = {
-            (Vector2){vertices[indices[i] * 2],     vertices[indices[i] * 2 + 1]},
-            (Vector2){vertices[indices[i + 1] * 2], vertices[indices[i + 1] * 2 + 1]},
-            (Vector2){vertices[indices[i + 2] * 2], vertices[indices[i + 2] * 2 + 1]},
-        };
-        DrawTriangle(
-            Vector2Add(Vector2Multiply(triReadVerts[0], scale), position),
-            Vector2Add(Vector2Multiply(triReadVerts[1], scale), position),
-            Vector2Add(Vector2Multiply(triReadVerts[2], scale), position),
-            shape->color);
+        return INVALID_SHAPE_HANDLE;
+    }
+    ShapeHandle copy = addShapeToVitmap(vitmap);
+    if (!isShapeHandleValid(vitmap, copy))
+    {
+        return INVALID_SHAPE_HANDLE;
+    }
+    Shape* newShape = &vitmap->shapes[copy.slot];
+    *newShape = vitmap->shapes[shape.slot];
+    newShape->pointGeneration = 0;
+    retainSharedBlock(newShape->points);
+    int index = getShapeOrderIndex(vitmap, shape);
+    while (getShapeOrderIndex(vitmap, copy) > index + 1)
+    {
+        reorderShapeInVitmap(vitmap, copy, -1);
     }
+    return copy;
 }
 
-void drawVitmap(Vitmap *vitmap, Vector2 position, Vector2 scale, float rotation)
+// Moves the shape one step up (1) or down (-1) the draw order. Returns false if
+// it was already at that end. The handle stays valid either way.
+bool reorderShapeInVitmap(Vitmap* vitmap, ShapeHandle shape, int direction)
 {
-    for (int i = 0; i < vitmap->numShapes; i++)
+    int index = getShapeOrderIndex(vitmap, shape);
+    if (index == -1 || (direction != 1 && direction != -1))
     {
-        Shape* shape = &vitmap->shapes[i];
-        drawShape(shape, position, scale, rotation);
+        return false;
     }
+    int other = index + direction;
+    if (other < 0 || other >= vitmap->numShapes || !unshareShapeTable(vitmap))
+    {
+        return false;
+    }
+    int temp = vitmap->order[index];
+    vitmap->order[index] = vitmap->order[other];
+    vitmap->order[other] = temp;
+    vitmap->slots[vitmap->order[index]].orderIndex = index;
+    vitmap->slots[vitmap->order[other]].orderIndex = other;
+    return true;
 }
 
-void moveShape(Shape* shape, Vector2 deltaPos)
+static Vitmap* reserveFrameInAnimation(VitmapAnimation* animation)
 {
-    for (int i = 0; i < shape->numPoints; i++)
+    if (animation->numFrames == animation->frameCapacity)
     {
-        shape->points[i] = Vector2Add(shape->points[i], deltaPos);
+        int newCapacity = animation->frameCapacity > 0 ? animation->frameCapacity * 2 : 4;
+        Vitmap* newFrames = growVitmapArenaAllocation(getAnimationArena(animation), animation->frames,
+            animation->frameCapacity * sizeof(Vitmap), newCapacity * sizeof(Vitmap));
+        if (newFrames == NULL) {
+            return NULL;
+        }
+        animation->frames = newFrames;
+        animation->frameCapacity = newCapacity;
     }
+    Vitmap* frame = &animation->frames[animation->numFrames];
+    initVitmap(frame);
+    frame->arena = animation->arena;
+    animation->numFrames++;
+    return frame;
 }
 
-void moveVitmap(Vitmap* vitmap, Vector2 deltaPos)
+// Copies a vitmap that lives in some other arena into the one the frame
+// already points at, meshes included. Nothing is shared with the source.
+static bool copyShapeMesh(VitmapArena* arena, ShapeMesh* to, const ShapeMesh* from)
 {
-    for (int i = 0; i < vitmap->numShapes; i++)
-    {
-        Shape* shape = &vitmap->shapes[i];
-        moveShape(shape, deltaPos);
+    Vector2* vertices = allocateFromVitmapArena(arena, from->numVertices * sizeof(Vector2));
+    int* indices = allocateFromVitmapArena(arena, from->numIndices * sizeof(int));
+    if (vertices == NULL || indices == NULL) {
+        return false;
+    }
+    memcpy(vertices, from->vertices, from->numVertices * sizeof(Vector2));
+    memcpy(indices, from->indices, from->numIndices * sizeof(int));
+    *to = *from;
+    to->vertices = vertices;
+    to->indices = indices;
+    return true;
+}
+
+// Everything the shape points at is copied, trimmed to what it uses
+static bool copyShapeIntoArena(VitmapArena* arena, Shape* to, const Shape* from)
+{
+    initShape(to);
+    to->color = from->color;
+    to->paletteIndex = from->paletteIndex;
+    to->offset = from->offset;
+    to->pointGeneration = from->pointGeneration;
+    to->points = allocateSharedBlock(arena, from->numPoints * sizeof(Vector2));
+    if (to->points == NULL) {
+        return false;
     }
-}
\ No newline at end of file
+    memcpy(to->points, from->points, from->numPoints * sizeof(Vector2));
+    to->numPoints = from->numPoints;
+    to->pointCapacity = from->numPoints;
+    to->windingRule = from->windingRule;
+    if (from->numContours > 1)
+    {
+        int* starts = allocateFromVitmapArena(arena, (from->numContours - 1) * sizeof(int));
+        if (starts == NULL) {
+            return false;
+        }
+        memcpy(starts, from->contourStarts, (from->numContours - 1) * sizeof(int));
+        to->contourStarts = starts;
+        to->numContours = from->numContours;
+    }
+    if (from->numCurves > 0)
+    {
+        ShapeCurve* curves = allocateFromVitmapArena(arena, from->numCurves * sizeof(ShapeCurve));
+        if (curves == NULL) {
+            return false;
+        }
+        memcpy(curves, from->curves, from->numCurves * sizeof(ShapeCurve));
+        to->curves = curves;
+        to->numCurves = from->numCurves;
+    }
+    if (from->mesh != NULL)
+    {
+        to->mesh = allocateFromVitmapArena(arena, sizeof(ShapeMesh));
+        if (to->mesh == NULL || !copyShapeMesh(arena, to->mesh, from->mesh)) {
+            return false;
+        }
+    }
+    if (from->stroke != NULL)
+    {
+        to->stroke = allocateFromVitmapArena(arena, sizeof(ShapeStroke));
+        if (to->stroke == NULL || !copyShapeMesh(arena, &to->stroke->mesh, &from->stroke->mesh)) {
+            return false;
+        }
+        to->stroke->style = from->stroke->style;
+    }
+    return true;
+}
+
+static bool copyVitmapIntoArena(Vitmap* frame, const Vitmap* source)
+{
+    VitmapArena* arena = frame->arena;
+    int numShapes = source->numShapes;
+    frame->shapes = allocateSharedBlock(arena, numShapes * sizeof(Shape));
+    frame->slots = allocateFromVitmapArena(arena, numShapes * sizeof(ShapeSlot));
+    frame->order = allocateFromVitmapArena(arena, numShapes * sizeof(int));
+    if (frame->shapes == NULL || frame->slots == NULL || frame->order == NULL) {
+        return false;
+    }
+    frame->shapeCapacity = numShapes;
+    frame->offset = source->offset;
+    if (source->numPaletteColors > 0)
+    {
+        Color* palette = allocateFromVitmapArena(arena, source->numPaletteColors * sizeof(Color));
+        if (palette == NULL) {
+            return false;
+        }
+        memcpy(palette, source->palette, source->numPaletteColors * sizeof(Color));
+        frame->palette = palette;
+        frame->numPaletteColors = source->numPaletteColors;
+    }
+    // Compacted into draw order, so old handles do not carry over
+    for (int i = 0; i < numShapes; i++)
+    {
+        if (!copyShapeIntoArena(arena, &frame->shapes[i], getVitmapShape(source, i)))
+        {
+            return false;
+        }
+        frame->slots[i] = (ShapeSlot){1, i, -1};
+        frame->order[i] = i;
+        frame->numSlots++;
+        frame->numShapes++;
+    }
+    return true;
+}
+
+// Roughly what compactVitmap would copy, shared block headers and alignment included
+static size_t getVitmapLiveBytes(const Vitmap* vitmap)
+{
+    size_t bytes = vitmap->shapeCapacity * (sizeof(Shape) + sizeof(ShapeSlot) + sizeof(int)) + 64
+        + vitmap->numPaletteColors * sizeof(Color);
+    for (int i = 0; i < vitmap->numShapes; i++)
+    {
+        const Shape* shape = getVitmapShape(vitmap, i);
+        bytes += SHARED_BLOCK_HEADER_SIZE + shape->numPoints * sizeof(Vector2) + 16
+            + (shape->numContours > 1 ? (shape->numContours - 1) * sizeof(int) + 16 : 0)
+            + shape->numCurves * sizeof(ShapeCurve);
+        if (shape->mesh != NULL)
+        {
+            bytes += sizeof(ShapeMesh) + shape->mesh->numVertices * sizeof(Vector2) + shape->mesh->numIndices * sizeof(int) + 48;
+        }
+        if (shape->stroke != NULL)
+        {
+            bytes += sizeof(ShapeStroke) + shape->stroke->mesh.numVertices * sizeof(Vector2)
+                + shape->stroke->mesh.numIndices * sizeof(int) + 48;
+        }
+    }
+    return bytes;
+}
+
+// Slots, generations and draw order are copied as they are, so handles stay valid
+bool compactVitmap(Vitmap* vitmap)
+{
+    // Anything else reading the shape table, such as a snapshot, reads the old arena
+    if (!vitmap->ownsArena || vitmap->arena == NULL || isSharedBlock(vitmap->shapes))
+    {
+        return false;
+    }
+    VITMAP_SPAN_BEGIN(span, "compactVitmap");
+    VitmapArena* old = vitmap->arena;
+    VitmapArena* arena = createVitmapArena(old->chunkSize);
+    if (arena == NULL) {
+        VITMAP_SPAN_END(span);
+        return false;
+    }
+    Vitmap compacted = *vitmap;
+    compacted.arena = arena;
+    int capacity = vitmap->shapeCapacity;
+    compacted.shapes = capacity > 0 ? allocateSharedBlock(arena, capacity * sizeof(Shape)) : NULL;
+    compacted.slots = capacity > 0 ? allocateFromVitmapArena(arena, capacity * sizeof(ShapeSlot)) : NULL;
+    compacted.order = capacity > 0 ? allocateFromVitmapArena(arena, capacity * sizeof(int)) : NULL;
+    bool ok = capacity == 0 || (compacted.shapes != NULL && compacted.slots != NULL && compacted.order != NULL);
+    if (ok && vitmap->numPaletteColors > 0)
+    {
+        Color* palette = allocateFromVitmapArena(arena, vitmap->numPaletteColors * sizeof(Color));
+        ok = palette != NULL;
+        if (ok)
+        {
+            memcpy(palette, vitmap->palette, vitmap->numPaletteColors * sizeof(Color));
+            compacted.palette = palette;
+        }
+    }
+    if (ok && capacity > 0)
+    {
+        memcpy(compacted.slots, vitmap->slots, vitmap->numSlots * sizeof(ShapeSlot));
+        memcpy(compacted.order, vitmap->order, vitmap->numShapes * sizeof(int));
+        // Free slots keep nothing, their shapes are initialized again on reuse
+        for (int i = 0; i < vitmap->numSlots; i++)
+        {
+            initShape(&compacted.shapes[i]);
+        }
+    }
+    for (int i = 0; ok && i < vitmap->numShapes; i++)
+    {
+        int slot = vitmap->order[i];
+        ok = copyShapeIntoArena(arena, &compacted.shapes[slot], &vitmap->shapes[slot]);
+    }
+    if (!ok)
+    {
+        destroyVitmapArena(arena);
+        VITMAP_WARNING("Out of memory compacting a vitmap, it keeps its old memory.");
+        VITMAP_SPAN_END(span);
+        return false;
+    }
+    VITMAP_DEBUG("Compacted vitmap from %zu to %zu bytes", old->bytesReserved, arena->bytesReserved);
+    destroyVitmapArena(old);
+    *vitmap = compacted;
+    VITMAP_SPAN_END(span);
+    return true;
+}
+
+// The animation takes ownership of the frame. Its arena is merged into the
+// animation's, so the frame must not be unloaded separately afterwards.
+// Passing a frame of this animation by value shares its geometry like
+// duplicateFrameInAnimation does, and a frame of another animation is copied.
+Vitmap* addFrameToAnimation(VitmapAnimation* animation, Vitmap frame)
+{
+    Vitmap* newFrame = reserveFrameInAnimation(animation);
+    if (newFrame == NULL) {
+        return NULL;
+    }
+    if (frame.ownsArena)
+    {
+        adoptVitmapArena(animation->arena, frame.arena);
+    }
+    else if (frame.arena == animation->arena)
+    {
+        retainSharedBlock(frame.shapes);
+    }
+    else if (frame.arena != NULL)
+    {
+        if (!copyVitmapIntoArena(newFrame, &frame))
+        {
+            VITMAP_ERROR("Out of memory copying a frame into the animation.");
+        }
+        return newFrame;
+    }
+    frame.arena = animation->arena;
+    frame.ownsArena = false;
+    *newFrame = frame;
+    return newFrame;
+}
+
+// O(1), the new frame is appended and shares the source frame's shapes and
+// points until one of the two is edited
+Vitmap* duplicateFrameInAnimation(VitmapAnimation* animation, int index)
+{
+    if (index < 0 || index >= animation->numFrames)
+    {
+        return NULL;
+    }
+    // Shared blocks have to outlive both frames, so a frame that still owns
+    // its arena hands it over to the animation first
+    Vitmap* source = &animation->frames[index];
+    if (source->ownsArena)
+    {
+        adoptVitmapArena(getAnimationArena(animation), source->arena);
+        source->arena = animation->arena;
+        source->ownsArena = false;
+    }
+    Vitmap* newFrame = reserveFrameInAnimation(animation);
+    if (newFrame == NULL) {
+        return NULL;
+    }
+    // The frames array may have moved
+    *newFrame = animation->frames[index];
+    retainSharedBlock(newFrame->shapes);
+    return newFrame;
+}
+
+Vitmap* addEmptyFrameToAnimation(VitmapAnimation* animation)
+{
+    return reserveFrameInAnimation(animation);
+}
+
+VitmapSnapshot takeVitmapSnapshot(const Vitmap* vitmap)
+{
+    retainSharedBlock(vitmap->shapes);
+    return (VitmapSnapshot){vitmap->shapes, vitmap->palette, vitmap->numShapes, vitmap->numPaletteColors, vitmap->offset};
+}
+
+void releaseVitmapSnapshot(VitmapSnapshot* snapshot)
+{
+    releaseSharedBlock(snapshot->shapes);
+    snapshot->shapes = NULL;
+}
+
+// Every edit goes through editShape or one of the functions built on it, which
+// copy a shape table the snapshot still holds, and palettes are replaced whole
+bool isVitmapUnchangedSince(const Vitmap* vitmap, const VitmapSnapshot* snapshot)
+{
+    return vitmap->shapes == snapshot->shapes && vitmap->palette == snapshot->palette
+        && vitmap->numShapes == snapshot->numShapes && vitmap->numPaletteColors == snapshot->numPaletteColors
+        && vitmap->offset.x == snapshot->offset.x && vitmap->offset.y == snapshot->offset.y;
+}
+
+// FNV-1a, for set names and frame contents
+static unsigned int hashSetBytes(unsigned int hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static unsigned int hashSetName(const char* name)
+{
+    return hashSetBytes(2166136261u, name, strlen(name));
+}
+
+// Covers what a frame saves as, so frames that save the same share a pool slot
+static unsigned int hashSetFrame(const Vitmap* frame)
+{
+    unsigned int hash = hashSetBytes(2166136261u, &frame->numPaletteColors, sizeof(int));
+    if (frame->numPaletteColors > 0)
+    {
+        hash = hashSetBytes(hash, frame->palette, frame->numPaletteColors * sizeof(Color));
+    }
+    hash = hashSetBytes(hash, &frame->numShapes, sizeof(int));
+    for (int i = 0; i < frame->numShapes; i++)
+    {
+        const Shape* shape = getVitmapShape(frame, i);
+        Vector2 offset = getShapeOffset(frame, shape);
+        hash = hashSetBytes(hash, &shape->numPoints, sizeof(int));
+        for (int j = 0; j < shape->numPoints; j++)
+        {
+            Vector2 point = {shape->points[j].x + offset.x, shape->points[j].y + offset.y};
+            hash = hashSetBytes(hash, &point, sizeof(Vector2));
+        }
+        hash = hashSetBytes(hash, &shape->color, sizeof(Color));
+        hash = hashSetBytes(hash, &shape->paletteIndex, sizeof(int));
+        hash = hashSetBytes(hash, &shape->windingRule, sizeof(VitmapWindingRule));
+        hash = hashSetBytes(hash, &shape->numContours, sizeof(int));
+        if (shape->numContours > 1)
+        {
+            hash = hashSetBytes(hash, shape->contourStarts, (shape->numContours - 1) * sizeof(int));
+        }
+        // Controls move with the offset like the points
+        hash = hashSetBytes(hash, &shape->numCurves, sizeof(int));
+        for (int j = 0; j < shape->numCurves; j++)
+        {
+            const ShapeCurve* curve = &shape->curves[j];
+            Vector2 controls[2] = {
+                {curve->controls[0].x + offset.x, curve->controls[0].y + offset.y},
+                {curve->controls[1].x + offset.x, curve->controls[1].y + offset.y}
+            };
+            hash = hashSetBytes(hash, &curve->point, sizeof(int));
+            hash = hashSetBytes(hash, &curve->kind, sizeof(VitmapCurveKind));
+            hash = hashSetBytes(hash, controls, sizeof controls);
+        }
+    }
+    return hash;
+}
+
+static bool setFramesMatch(const Vitmap* a, const Vitmap* b)
+{
+    if (a->numShapes != b->numShapes || a->numPaletteColors != b->numPaletteColors
+        || (a->numPaletteColors > 0 && memcmp(a->palette, b->palette, a->numPaletteColors * sizeof(Color)) != 0))
+    {
+        return false;
+    }
+    for (int i = 0; i < a->numShapes; i++)
+    {
+        const Shape* shapeA = getVitmapShape(a, i);
+        const Shape* shapeB = getVitmapShape(b, i);
+        if (shapeA->numPoints != shapeB->numPoints || shapeA->paletteIndex != shapeB->paletteIndex
+            || memcmp(&shapeA->color, &shapeB->color, sizeof(Color)) != 0
+            || shapeA->windingRule != shapeB->windingRule || shapeA->numContours != shapeB->numContours
+            || (shapeA->numContours > 1 && memcmp(shapeA->contourStarts, shapeB->contourStarts, (shapeA->numContours - 1) * sizeof(int)) != 0)
+            || shapeA->numCurves != shapeB->numCurves)
+        {
+            return false;
+        }
+        Vector2 offsetA = getShapeOffset(a, shapeA);
+        Vector2 offsetB = getShapeOffset(b, shapeB);
+        for (int j = 0; j < shapeA->numCurves; j++)
+        {
+            const ShapeCurve* curveA = &shapeA->curves[j];
+            const ShapeCurve* curveB = &shapeB->curves[j];
+            if (curveA->point != curveB->point || curveA->kind != curveB->kind)
+            {
+                return false;
+            }
+            for (int k = 0; k < 2; k++)
+            {
+                if (curveA->controls[k].x + offsetA.x != curveB->controls[k].x + offsetB.x
+                    || curveA->controls[k].y + offsetA.y != curveB->controls[k].y + offsetB.y)
+                {
+                    return false;
+                }
+            }
+        }
+        for (int j = 0; j < shapeA->numPoints; j++)
+        {
+            if (shapeA->points[j].x + offsetA.x != shapeB->points[j].x + offsetB.x
+                || shapeA->points[j].y + offsetA.y != shapeB->points[j].y + offsetB.y)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Linear probing, the capacity is a power of two and at most half full
+static void insertSetFrame(VitmapAnimationSet* set, int frame)
+{
+    unsigned int mask = (unsigned int)set->frameIndexCapacity - 1;
+    unsigned int i = set->frameHashes[frame] & mask;
+    while (set->frameIndex[i] >= 0)
+    {
+        i = (i + 1) & mask;
+    }
+    set->frameIndex[i] = frame;
+}
+
+static int findSetFrame(const VitmapAnimationSet* set, const Vitmap* frame, unsigned int hash)
+{
+    unsigned int mask = (unsigned int)set->frameIndexCapacity - 1;
+    for (unsigned int i = hash & mask; set->frameIndex[i] >= 0; i = (i + 1) & mask)
+    {
+        int candidate = set->frameIndex[i];
+        if (set->frameHashes[candidate] == hash && setFramesMatch(&set->pool.frames[candidate], frame))
+        {
+            return candidate;
+        }
+    }
+    return -1;
+}
+
+// Makes room for numFrames pool frames. Sets decoded from a file have no
+// frame hashes yet, so the first call hashes the whole pool.
+static bool growSetFrameIndex(VitmapAnimationSet* set, int numFrames)
+{
+    if (set->frameIndex != NULL && numFrames * 2 <= set->frameIndexCapacity)
+    {
+        return true;
+    }
+    int newCapacity = set->frameIndexCapacity > 0 ? set->frameIndexCapacity : 16;
+    while (newCapacity < numFrames * 2)
+    {
+        newCapacity *= 2;
+    }
+    VitmapArena* arena = getAnimationArena(&set->pool);
+    int* frameIndex = allocateFromVitmapArena(arena, newCapacity * sizeof(int));
+    unsigned int* frameHashes = growVitmapArenaAllocation(arena, set->frameHashes,
+        set->frameIndexCapacity / 2 * sizeof(unsigned int), newCapacity / 2 * sizeof(unsigned int));
+    if (frameIndex == NULL || frameHashes == NULL) {
+        return false;
+    }
+    bool hashed = set->frameIndex != NULL;
+    memset(frameIndex, 0xff, newCapacity * sizeof(int));
+    set->frameIndex = frameIndex;
+    set->frameHashes = frameHashes;
+    set->frameIndexCapacity = newCapacity;
+    for (int i = 0; i < set->pool.numFrames; i++)
+    {
+        if (!hashed)
+        {
+            set->frameHashes[i] = hashSetFrame(&set->pool.frames[i]);
+        }
+        insertSetFrame(set, i);
+    }
+    return true;
+}
+
+static void insertSetName(VitmapAnimationSet* set, int animation)
+{
+    unsigned int mask = (unsigned int)set->nameIndexCapacity - 1;
+    unsigned int i = hashSetName(set->animations[animation].name) & mask;
+    while (set->nameIndex[i] >= 0)
+    {
+        i = (i + 1) & mask;
+    }
+    set->nameIndex[i] = animation;
+}
+
+static bool growSetAnimations(VitmapAnimationSet* set)
+{
+    VitmapArena* arena = getAnimationArena(&set->pool);
+    if (set->numAnimations == set->animationCapacity)
+    {
+        int newCapacity = set->animationCapacity > 0 ? set->animationCapacity * 2 : 8;
+        VitmapSetAnimation* animations = growVitmapArenaAllocation(arena, set->animations,
+            set->animationCapacity * sizeof(VitmapSetAnimation), newCapacity * sizeof(VitmapSetAnimation));
+        if (animations == NULL) {
+            return false;
+        }
+        set->animations = animations;
+        set->animationCapacity = newCapacity;
+    }
+    if ((set->numAnimations + 1) * 2 > set->nameIndexCapacity)
+    {
+        int newCapacity = set->nameIndexCapacity > 0 ? set->nameIndexCapacity * 2 : 16;
+        int* nameIndex = allocateFromVitmapArena(arena, newCapacity * sizeof(int));
+        if (nameIndex == NULL) {
+            return false;
+        }
+        memset(nameIndex, 0xff, newCapacity * sizeof(int));
+        set->nameIndex = nameIndex;
+        set->nameIndexCapacity = newCapacity;
+        for (int i = 0; i < set->numAnimations; i++)
+        {
+            insertSetName(set, i);
+        }
+    }
+    return true;
+}
+
+int findAnimationInSet(const VitmapAnimationSet* set, const char* name)
+{
+    if (set->nameIndexCapacity == 0)
+    {
+        return -1;
+    }
+    unsigned int mask = (unsigned int)set->nameIndexCapacity - 1;
+    for (unsigned int i = hashSetName(name) & mask; set->nameIndex[i] >= 0; i = (i + 1) & mask)
+    {
+        if (strcmp(set->animations[set->nameIndex[i]].name, name) == 0)
+        {
+            return set->nameIndex[i];
+        }
+    }
+    return -1;
+}
+
+Vitmap* getAnimationSetFrame(const VitmapAnimationSet* set, int animation, int frame)
+{
+    if (animation < 0 || animation >= set->numAnimations || frame < 0 || frame >= set->animations[animation].numFrames)
+    {
+        return NULL;
+    }
+    return &set->pool.frames[set->animations[animation].frames[frame]];
+}
+
+// Adds an animation whose frames are already in the pool, taking ownership of name and frames
+static int addPooledAnimationToSet(VitmapAnimationSet* set, char* name, int* frames, int numFrames)
+{
+    if (!growSetAnimations(set))
+    {
+        return -1;
+    }
+    set->animations[set->numAnimations] = (VitmapSetAnimation){name, frames, numFrames};
+    insertSetName(set, set->numAnimations);
+    return set->numAnimations++;
+}
+
+int addAnimationToSet(VitmapAnimationSet* set, const char* name, const VitmapAnimation* animation)
+{
+    if (findAnimationInSet(set, name) >= 0)
+    {
+        VITMAP_ERROR("Animation set already has an animation named %s.", name);
+        return -1;
+    }
+    VitmapArena* arena = getAnimationArena(&set->pool);
+    if (arena == NULL || !growSetFrameIndex(set, set->pool.numFrames + animation->numFrames))
+    {
+        VITMAP_ERROR("Out of memory adding %s to the animation set.", name);
+        return -1;
+    }
+    size_t nameSize = strlen(name) + 1;
+    char* nameCopy = allocateFromVitmapArena(arena, nameSize);
+    int* frames = allocateFromVitmapArena(arena, animation->numFrames * sizeof(int));
+    if (nameCopy == NULL || frames == NULL)
+    {
+        VITMAP_ERROR("Out of memory adding %s to the animation set.", name);
+        return -1;
+    }
+    memcpy(nameCopy, name, nameSize);
+
+    int numShared = 0;
+    for (int i = 0; i < animation->numFrames; i++)
+    {
+        const Vitmap* source = &animation->frames[i];
+        unsigned int hash = hashSetFrame(source);
+        int index = findSetFrame(set, source, hash);
+        if (index >= 0)
+        {
+            numShared++;
+        }
+        else
+        {
+            Vitmap* copy = reserveFrameInAnimation(&set->pool);
+            if (copy == NULL || !copyVitmapIntoArena(copy, source))
+            {
+                VITMAP_ERROR("Out of memory adding %s to the animation set.", name);
+                return -1;
+            }
+            index = set->pool.numFrames - 1;
+            set->frameHashes[index] = hash;
+            insertSetFrame(set, index);
+        }
+        frames[i] = index;
+    }
+    int added = addPooledAnimationToSet(set, nameCopy, frames, animation->numFrames);
+    VITMAP_DEBUG("Animation %s: %d frames, %d already in the set", name, animation->numFrames, numShared);
+    return added;
+}
+
+static const char vitmapFileMagic[4] = {'V', 'M', 'A', 'P'};
+static const char animationFileMagic[4] = {'V', 'A', 'N', 'I'};
+static const char animationSetFileMagic[4] = {'V', 'S', 'E', 'T'};
+
+// Where the save functions write to, a file or a growing buffer. The
+// counterpart of VitmapReader.
+typedef struct VitmapWriter
+{
+    FILE* file;             // NULL to write into data
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+} VitmapWriter;
+
+// Same contract as fwrite
+static size_t writeToVitmapWriter(const void* data, size_t size, size_t count, VitmapWriter* writer)
+{
+    if (writer->file != NULL)
+    {
+        return fwrite(data, size, count, writer->file);
+    }
+    size_t bytes = size * count;
+    if (writer->size + bytes > writer->capacity)
+    {
+        size_t capacity = writer->capacity > 0 ? writer->capacity : 256;
+        while (capacity < writer->size + bytes)
+        {
+            capacity *= 2;
+        }
+        unsigned char* grown = realloc(writer->data, capacity);
+        if (grown == NULL) {
+            return 0;
+        }
+        writer->data = grown;
+        writer->capacity = capacity;
+    }
+    memcpy(writer->data + writer->size, data, bytes);
+    writer->size += bytes;
+    return count;
+}
+
+static bool writeVitmapFileHeader(VitmapWriter* writer, const char magic[4], int version)
+{
+    if (version == VITMAP_FORMAT_LEGACY)
+    {
+        return true;
+    }
+    return writeToVitmapWriter(magic, 1, 4, writer) == 4
+        && writeToVitmapWriter(&version, sizeof(int), 1, writer) == 1;
+}
+
+static bool writeVitmapBody(VitmapWriter* writer, Vitmap* vitmap, int version)
+{
+    // Version 2 starts with the palette
+    if (version >= 2)
+    {
+        if (writeToVitmapWriter(&(vitmap->numPaletteColors), sizeof(int), 1, writer) != 1)
+        {
+            return false;
+        }
+        if (vitmap->numPaletteColors > 0 && writeToVitmapWriter(vitmap->palette, sizeof(Color), vitmap->numPaletteColors, writer) != (size_t)vitmap->numPaletteColors)
+        {
+            return false;
+        }
+    }
+
+    // Write the number of shapes in the Vitmap
+    if (writeToVitmapWriter(&(vitmap->numShapes), sizeof(int), 1, writer) != 1)
+    {
+        return false;
+    }
+
+    // Write each shape in the Vitmap, in draw order
+    for (int i = 0; i < vitmap->numShapes; i++)
+    {
+        const Shape* shape = getVitmapShape(vitmap, i);
+
+        // Write the number of points, the points, then the color of the shape.
+        // The file has no offsets, moved points are written where they are drawn.
+        Vector2 offset = getShapeOffset(vitmap, shape);
+        if (writeToVitmapWriter(&(shape->numPoints), sizeof(int), 1, writer) != 1)
+        {
+            return false;
+        }
+        if (offset.x == 0.0f && offset.y == 0.0f)
+        {
+            if (shape->numPoints > 0 && writeToVitmapWriter(shape->points, sizeof(Vector2), shape->numPoints, writer) != (size_t)shape->numPoints)
+            {
+                return false;
+            }
+        }
+        else
+        {
+            for (int j = 0; j < shape->numPoints; j++)
+            {
+                Vector2 point = {shape->points[j].x + offset.x, shape->points[j].y + offset.y};
+                if (writeToVitmapWriter(&point, sizeof(Vector2), 1, writer) != 1)
+                {
+                    return false;
+                }
+            }
+        }
+        // Older versions have no palette, shapes are written in the color they show
+        Color color = version >= 2 ? shape->color : getShapeColor(shape, vitmap->palette, vitmap->numPaletteColors);
+        if (writeToVitmapWriter(&color, sizeof(Color), 1, writer) != 1)
+        {
+            return false;
+        }
+        if (version >= 2 && writeToVitmapWriter(&(shape->paletteIndex), sizeof(int), 1, writer) != 1)
+        {
+            return false;
+        }
+        // Version 3 ends each shape with its winding rule and where its contours start
+        if (version >= 3)
+        {
+            int windingRule = shape->windingRule;
+            if (writeToVitmapWriter(&windingRule, sizeof(int), 1, writer) != 1 || writeToVitmapWriter(&(shape->numContours), sizeof(int), 1, writer) != 1)
+            {
+                return false;
+            }
+            if (shape->numContours > 1 && writeToVitmapWriter(shape->contourStarts, sizeof(int), shape->numContours - 1, writer) != (size_t)(shape->numContours - 1))
+            {
+                return false;
+            }
+        }
+        else if (shape->numContours > 1)
+        {
+            VITMAP_ERROR("Shapes with holes need format version 3 or later.");
+            return false;
+        }
+        // Version 4 follows with the curved edges, their controls moved like the points
+        if (version >= 4)
+        {
+            if (writeToVitmapWriter(&(shape->numCurves), sizeof(int), 1, writer) != 1)
+            {
+                return false;
+            }
+            for (int j = 0; j < shape->numCurves; j++)
+            {
+                const ShapeCurve* curve = &shape->curves[j];
+                int kind = curve->kind;
+                Vector2 controls[2] = {
+                    {curve->controls[0].x + offset.x, curve->controls[0].y + offset.y},
+                    {curve->controls[1].x + offset.x, curve->controls[1].y + offset.y}
+                };
+                if (writeToVitmapWriter(&(curve->point), sizeof(int), 1, writer) != 1 || writeToVitmapWriter(&kind, sizeof(int), 1, writer) != 1
+                    || writeToVitmapWriter(controls, sizeof(Vector2), 2, writer) != 2)
+                {
+                    return false;
+                }
+            }
+        }
+        else if (shape->numCurves > 0)
+        {
+            VITMAP_ERROR("Shapes with curves need format version 4 or later.");
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool writeAnimation(VitmapWriter* writer, VitmapAnimation* animation, int version)
+{
+    bool ok = writeVitmapFileHeader(writer, animationFileMagic, version);
+
+    // Write the number of frames in the animation
+    ok = ok && writeToVitmapWriter(&(animation->numFrames), sizeof(int), 1, writer) == 1;
+
+    // Write each frame in the animation
+    for (int i = 0; ok && i < animation->numFrames; i++)
+    {
+        ok = writeVitmapBody(writer, &(animation->frames[i]), version);
+    }
+    return ok;
+}
+
+unsigned char* encodeAnimation(VitmapAnimation* animation, int version, int* sizeOut)
+{
+    *sizeOut = 0;
+    if (version < VITMAP_FORMAT_LEGACY || version > VITMAP_FORMAT_VERSION)
+    {
+        VITMAP_ERROR("Unsupported animation format version %d.", version);
+        return NULL;
+    }
+    VitmapWriter writer = {NULL, NULL, 0, 0};
+    if (!writeAnimation(&writer, animation, version) || writer.size > INT_MAX)
+    {
+        free(writer.data);
+        return NULL;
+    }
+    *sizeOut = (int)writer.size;
+    return writer.data;
+}
+
+unsigned char* encodeVitmapFrame(Vitmap* frame, int version, int* sizeOut)
+{
+    *sizeOut = 0;
+    if (version < VITMAP_FORMAT_LEGACY || version > VITMAP_FORMAT_VERSION)
+    {
+        VITMAP_ERROR("Unsupported vitmap format version %d.", version);
+        return NULL;
+    }
+    VitmapWriter writer = {NULL, NULL, 0, 0};
+    if (!writeVitmapBody(&writer, frame, version) || writer.size > INT_MAX)
+    {
+        free(writer.data);
+        return NULL;
+    }
+    *sizeOut = (int)writer.size;
+    return writer.data;
+}
+
+bool saveAnimationToFileVersion(VitmapAnimation* animation, const char* filename, int version)
+{
+    if (version < VITMAP_FORMAT_LEGACY || version > VITMAP_FORMAT_VERSION)
+    {
+        VITMAP_ERROR("Unsupported animation format version %d.", version);
+        return false;
+    }
+
+    // Open the file in binary write mode
+    FILE* file = fopen(filename, "wb");
+    if (file == NULL)
+    {
+        VITMAP_ERROR("Failed to open %s for writing.", filename);
+        return false;
+    }
+
+    VitmapWriter writer = {file, NULL, 0, 0};
+    bool ok = writeAnimation(&writer, animation, version);
+
+    // Close the file
+    if (fclose(file) != 0)
+    {
+        ok = false;
+    }
+    if (!ok)
+    {
+        VITMAP_ERROR("Failed to write animation to %s.", filename);
+    }
+    return ok;
+}
+
+void saveAnimationToFile(VitmapAnimation* animation, const char* filename)
+{
+    if (saveAnimationToFileVersion(animation, filename, VITMAP_FORMAT_VERSION))
+    {
+        VITMAP_INFO("Animation saved to %s.", filename);
+    }
+}
+
+// The pool is written like an animation's frames, then each animation as its
+// name and the pool frames it plays
+bool saveAnimationSetToFileVersion(VitmapAnimationSet* set, const char* filename, int version)
+{
+    if (version < 1 || version > VITMAP_FORMAT_VERSION)
+    {
+        VITMAP_ERROR("Unsupported animation set format version %d.", version);
+        return false;
+    }
+
+    FILE* file = fopen(filename, "wb");
+    if (file == NULL)
+    {
+        VITMAP_ERROR("Failed to open %s for writing.", filename);
+        return false;
+    }
+
+    VitmapWriter writer = {file, NULL, 0, 0};
+    bool ok = writeVitmapFileHeader(&writer, animationSetFileMagic, version)
+        && fwrite(&(set->pool.numFrames), sizeof(int), 1, file) == 1;
+    for (int i = 0; ok && i < set->pool.numFrames; i++)
+    {
+        ok = writeVitmapBody(&writer, &(set->pool.frames[i]), version);
+    }
+    ok = ok && fwrite(&(set->numAnimations), sizeof(int), 1, file) == 1;
+    for (int i = 0; ok && i < set->numAnimations; i++)
+    {
+        const VitmapSetAnimation* animation = &set->animations[i];
+        int nameLength = (int)strlen(animation->name);
+        ok = fwrite(&nameLength, sizeof(int), 1, file) == 1
+            && fwrite(animation->name, 1, nameLength, file) == (size_t)nameLength
+            && fwrite(&(animation->numFrames), sizeof(int), 1, file) == 1
+            && (animation->numFrames == 0 || fwrite(animation->frames, sizeof(int), animation->numFrames, file) == (size_t)animation->numFrames);
+    }
+
+    if (fclose(file) != 0)
+    {
+        ok = false;
+    }
+    if (!ok)
+    {
+        VITMAP_ERROR("Failed to write animation set to %s.", filename);
+    }
+    return ok;
+}
+
+void saveAnimationSetToFile(VitmapAnimationSet* set, const char* filename)
+{
+    if (saveAnimationSetToFileVersion(set, filename, VITMAP_FORMAT_VERSION))
+    {
+        VITMAP_INFO("Animation set saved to %s.", filename);
+    }
+}
+
+bool saveVitmapToFileVersion(Vitmap* vitmap, const char* filename, int version)
+{
+    if (version < VITMAP_FORMAT_LEGACY || version > VITMAP_FORMAT_VERSION)
+    {
+        VITMAP_ERROR("Unsupported vitmap format version %d.", version);
+        return false;
+    }
+
+    // Open the file in binary write mode
+    FILE* file = fopen(filename, "wb");
+    if (file == NULL)
+    {
+        VITMAP_ERROR("Failed to open %s for writing.", filename);
+        return false;
+    }
+
+    VitmapWriter writer = {file, NULL, 0, 0};
+    bool ok = writeVitmapFileHeader(&writer, vitmapFileMagic, version)
+        && writeVitmapBody(&writer, vitmap, version);
+
+    // Close the file
+    if (fclose(file) != 0)
+    {
+        ok = false;
+    }
+    if (!ok)
+    {
+        VITMAP_ERROR("Failed to write vitmap to %s.", filename);
+    }
+    return ok;
+}
+
+void saveVitmapToFile(Vitmap* vitmap, const char* filename)
+{
+    if (saveVitmapToFileVersion(vitmap, filename, VITMAP_FORMAT_VERSION))
+    {
+        VITMAP_INFO("Vitmap saved to %s.", filename);
+    }
+}
+
+unsigned char* loadVitmapFileData(const char* filename, int* sizeOut)
+{
+    *sizeOut = 0;
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL)
+    {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (size < 0 || size > INT_MAX)
+    {
+        fclose(file);
+        return NULL;
+    }
+    // Always hand back a valid pointer, even for an empty file
+    unsigned char* data = malloc(size > 0 ? (size_t)size : 1);
+    if (data == NULL || fread(data, 1, (size_t)size, file) != (size_t)size)
+    {
+        free(data);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+    *sizeOut = (int)size;
+    return data;
+}
+
+// Bounds-checked cursor over an in-memory file
+typedef struct VitmapReader
+{
+    const unsigned char* data;
+    int size;
+    int pos;
+} VitmapReader;
+
+static bool readFromVitmapReader(VitmapReader* reader, void* out, int bytes)
+{
+    if (bytes < 0 || reader->size - reader->pos < bytes)
+    {
+        return false;
+    }
+    memcpy(out, reader->data + reader->pos, (size_t)bytes);
+    reader->pos += bytes;
+    return true;
+}
+
+static int remainingInVitmapReader(const VitmapReader* reader)
+{
+    return reader->size - reader->pos;
+}
+
+int readVitmapFileHeader(const unsigned char* data, int size, VitmapFileKind* kindOut)
+{
+    VitmapFileKind kind = VITMAP_FILE_UNKNOWN;
+    int version = VITMAP_FORMAT_LEGACY;
+    if (size >= 8)
+    {
+        if (memcmp(data, vitmapFileMagic, 4) == 0)
+        {
+            kind = VITMAP_FILE_VITMAP;
+        }
+        else if (memcmp(data, animationFileMagic, 4) == 0)
+        {
+            kind = VITMAP_FILE_ANIMATION;
+        }
+        else if (memcmp(data, animationSetFileMagic, 4) == 0)
+        {
+            kind = VITMAP_FILE_ANIMATION_SET;
+        }
+        if (kind != VITMAP_FILE_UNKNOWN)
+        {
+            memcpy(&version, data + 4, sizeof(int));
+        }
+    }
+    if (kindOut != NULL)
+    {
+        *kindOut = kind;
+    }
+    return version;
+}
+
+static bool readShapeContours(VitmapReader* reader, Vitmap* vitmap, Shape* shape, const char** error)
+{
+    int windingRule = 0;
+    int numContours = 0;
+    if (!readFromVitmapReader(reader, &windingRule, sizeof(int)) || !readFromVitmapReader(reader, &numContours, sizeof(int)))
+    {
+        *error = "truncated contours";
+        return false;
+    }
+    if (windingRule < VITMAP_WINDING_ODD || windingRule > VITMAP_WINDING_POSITIVE)
+    {
+        *error = "unknown winding rule";
+        return false;
+    }
+    if (numContours < 1 || numContours - 1 > remainingInVitmapReader(reader) / (int)sizeof(int))
+    {
+        *error = "contour count out of range";
+        return false;
+    }
+    shape->windingRule = (VitmapWindingRule)windingRule;
+    if (numContours == 1)
+    {
+        return true;
+    }
+    int* starts = allocateFromVitmapArena(vitmap->arena, (numContours - 1) * sizeof(int));
+    if (starts == NULL)
+    {
+        *error = "out of memory";
+        return false;
+    }
+    readFromVitmapReader(reader, starts, (numContours - 1) * (int)sizeof(int));
+    for (int i = 0; i < numContours - 1; i++)
+    {
+        int previous = i > 0 ? starts[i - 1] : 0;
+        if (starts[i] < previous || starts[i] > shape->numPoints)
+        {
+            *error = "contour start out of range";
+            return false;
+        }
+    }
+    shape->contourStarts = starts;
+    shape->numContours = numContours;
+    return true;
+}
+
+// Each curve is its point, its kind and two controls
+#define CURVE_FILE_SIZE (2 * (int)sizeof(int) + 2 * (int)sizeof(Vector2))
+
+static bool readShapeCurves(VitmapReader* reader, Vitmap* vitmap, Shape* shape, const char** error)
+{
+    int numCurves = 0;
+    if (!readFromVitmapReader(reader, &numCurves, sizeof(int)))
+    {
+        *error = "truncated curves";
+        return false;
+    }
+    if (numCurves < 0 || numCurves > shape->numPoints || numCurves > remainingInVitmapReader(reader) / CURVE_FILE_SIZE)
+    {
+        *error = "curve count out of range";
+        return false;
+    }
+    if (numCurves == 0)
+    {
+        return true;
+    }
+    ShapeCurve* curves = allocateFromVitmapArena(vitmap->arena, numCurves * sizeof(ShapeCurve));
+    if (curves == NULL)
+    {
+        *error = "out of memory";
+        return false;
+    }
+    for (int i = 0; i < numCurves; i++)
+    {
+        int kind = 0;
+        readFromVitmapReader(reader, &curves[i].point, sizeof(int));
+        readFromVitmapReader(reader, &kind, sizeof(int));
+        readFromVitmapReader(reader, curves[i].controls, 2 * sizeof(Vector2));
+        if (kind != VITMAP_CURVE_QUADRATIC && kind != VITMAP_CURVE_CUBIC)
+        {
+            *error = "unknown curve kind";
+            return false;
+        }
+        // Sorted, so a lookup can bisect
+        int previous = i > 0 ? curves[i - 1].point : -1;
+        if (curves[i].point <= previous || curves[i].point >= shape->numPoints)
+        {
+            *error = "curve point out of range";
+            return false;
+        }
+        curves[i].kind = (VitmapCurveKind)kind;
+    }
+    shape->curves = curves;
+    shape->numCurves = numCurves;
+    return true;
+}
+
+// Reads one vitmap into the arena the vitmap already points at. Shapes and
+// points are allocated at their exact sizes, since the counts come first.
+static bool readVitmapBody(VitmapReader* reader, Vitmap* vitmap, int version, const char** error)
+{
+    if (version >= 2)
+    {
+        int numColors = 0;
+        if (!readFromVitmapReader(reader, &numColors, sizeof(int)))
+        {
+            *error = "truncated palette size";
+            return false;
+        }
+        if (numColors < 0 || numColors > remainingInVitmapReader(reader) / (int)sizeof(Color))
+        {
+            *error = "palette size out of range";
+            return false;
+        }
+        Color* palette = allocateFromVitmapArena(vitmap->arena, numColors * sizeof(Color));
+        if (numColors > 0 && palette == NULL)
+        {
+            *error = "out of memory";
+            return false;
+        }
+        if (numColors > 0)
+        {
+            readFromVitmapReader(reader, palette, numColors * (int)sizeof(Color));
+            vitmap->palette = palette;
+            vitmap->numPaletteColors = numColors;
+        }
+    }
+
+    // Read the number of shapes in the Vitmap. Every shape takes at least a
+    // point count and a color, which bounds how many there can really be.
+    int numShapesInTheFile = 0;
+    if (!readFromVitmapReader(reader, &numShapesInTheFile, sizeof(int)))
+    {
+        *error = "truncated shape count";
+        return false;
+    }
+    if (numShapesInTheFile < 0 || numShapesInTheFile > remainingInVitmapReader(reader) / 8)
+    {
+        *error = "shape count out of range";
+        return false;
+    }
+    vitmap->shapes = allocateSharedBlock(vitmap->arena, numShapesInTheFile * sizeof(Shape));
+    vitmap->slots = allocateFromVitmapArena(vitmap->arena, numShapesInTheFile * sizeof(ShapeSlot));
+    vitmap->order = allocateFromVitmapArena(vitmap->arena, numShapesInTheFile * sizeof(int));
+    if (vitmap->shapes == NULL || vitmap->slots == NULL || vitmap->order == NULL)
+    {
+        *error = "out of memory";
+        return false;
+    }
+    vitmap->shapeCapacity = numShapesInTheFile;
+
+    // Read each shape in the Vitmap
+    for (int i = 0; i < numShapesInTheFile; i++)
+    {
+        Shape* shape = &(vitmap->shapes[i]);
+        initShape(shape);
+
+        int numPointsInHere = 0;
+        if (!readFromVitmapReader(reader, &numPointsInHere, sizeof(int)))
+        {
+            *error = "truncated point count";
+            return false;
+        }
+        if (numPointsInHere < 0 || numPointsInHere > (remainingInVitmapReader(reader) - (int)sizeof(Color)) / (int)sizeof(Vector2))
+        {
+            *error = "point count out of range";
+            return false;
+        }
+        shape->points = allocateSharedBlock(vitmap->arena, numPointsInHere * sizeof(Vector2));
+        if (shape->points == NULL)
+        {
+            *error = "out of memory";
+            return false;
+        }
+        // Loaded shapes fill the slots in file order
+        vitmap->slots[i] = (ShapeSlot){1, i, -1};
+        vitmap->order[i] = i;
+        vitmap->numShapes++;
+        vitmap->numSlots++;
+        readFromVitmapReader(reader, shape->points, numPointsInHere * (int)sizeof(Vector2));
+        shape->numPoints = numPointsInHere;
+        shape->pointCapacity = numPointsInHere;
+        if (!readFromVitmapReader(reader, &(shape->color), sizeof(Color)))
+        {
+            *error = "truncated shape color";
+            return false;
+        }
+        // An index past the palette is fine, a palette passed in when drawing may be bigger
+        if (version >= 2 && !readFromVitmapReader(reader, &(shape->paletteIndex), sizeof(int)))
+        {
+            *error = "truncated palette index";
+            return false;
+        }
+        if (shape->paletteIndex < -1)
+        {
+            *error = "palette index out of range";
+            return false;
+        }
+        if (version >= 3 && !readShapeContours(reader, vitmap, shape, error))
+        {
+            return false;
+        }
+        if (version >= 4 && !readShapeCurves(reader, vitmap, shape, error))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool checkVitmapFileHeader(VitmapReader* reader, VitmapFileKind expected, int* versionOut, const char** error)
+{
+    VitmapFileKind kind = VITMAP_FILE_UNKNOWN;
+    int version = readVitmapFileHeader(reader->data, reader->size, &kind);
+    *versionOut = version;
+    if (kind == VITMAP_FILE_UNKNOWN && expected == VITMAP_FILE_ANIMATION_SET)
+    {
+        *error = "file is not an animation set";
+        return false;
+    }
+    if (kind == VITMAP_FILE_UNKNOWN)
+    {
+        // Legacy files have no header, the body starts right away
+        return true;
+    }
+    if (kind != expected)
+    {
+        if (kind == VITMAP_FILE_ANIMATION_SET || expected == VITMAP_FILE_ANIMATION_SET)
+        {
+            *error = kind == VITMAP_FILE_ANIMATION_SET ? "file is an animation set" : "file is not an animation set";
+        }
+        else
+        {
+            *error = expected == VITMAP_FILE_VITMAP ? "file is an animation, not a vitmap" : "file is a vitmap, not an animation";
+        }
+        return false;
+    }
+    if (version < 1 || version > VITMAP_FORMAT_VERSION)
+    {
+        *error = "unsupported format version";
+        return false;
+    }
+    reader->pos = 8;
+    return true;
+}
+
+// Smaller animations are not worth spreading over the job system
+#define DECODE_MIN_PARALLEL_FRAMES 4
+
+// One arena chunk comfortably holds a decoded file, so a load costs a handful of allocations
+static VitmapArena* createArenaForFile(int size)
+{
+    size_t chunkSize = (size_t)size * 2;
+    return createVitmapArena(chunkSize > VITMAP_ARENA_DEFAULT_CHUNK_SIZE ? chunkSize : VITMAP_ARENA_DEFAULT_CHUNK_SIZE);
+}
+
+// On failure the vitmap keeps whatever was decoded, and still has to be unloaded
+bool decodeVitmap(const unsigned char* data, int size, Vitmap* vitmapOut, const char** errorOut)
+{
+    VITMAP_SPAN_BEGIN(span, "decodeVitmap");
+    const char* error = NULL;
+    int version = VITMAP_FORMAT_LEGACY;
+    VitmapReader reader = {data, size, 0};
+    initVitmap(vitmapOut);
+    vitmapOut->arena = createArenaForFile(size);
+    vitmapOut->ownsArena = true;
+    bool ok = vitmapOut->arena != NULL
+        && checkVitmapFileHeader(&reader, VITMAP_FILE_VITMAP, &version, &error)
+        && readVitmapBody(&reader, vitmapOut, version, &error);
+    if (vitmapOut->arena == NULL)
+    {
+        error = "out of memory";
+    }
+    if (ok && remainingInVitmapReader(&reader) != 0)
+    {
+        error = "trailing bytes after last shape";
+        ok = false;
+    }
+    if (errorOut != NULL)
+    {
+        *errorOut = error;
+    }
+    VITMAP_SPAN_END(span);
+    return ok;
+}
+
+// Skips one vitmap body, checking only that its counts fit the data
+static bool skipVitmapBody(VitmapReader* reader, int version)
+{
+    int count = 0;
+    if (version >= 2)
+    {
+        if (!readFromVitmapReader(reader, &count, sizeof(int)) || count < 0
+            || count > remainingInVitmapReader(reader) / (int)sizeof(Color))
+        {
+            return false;
+        }
+        reader->pos += count * (int)sizeof(Color);
+    }
+    if (!readFromVitmapReader(reader, &count, sizeof(int)) || count < 0)
+    {
+        return false;
+    }
+    int colorSize = (int)sizeof(Color) + (version >= 2 ? (int)sizeof(int) : 0) + (version >= 3 ? 2 * (int)sizeof(int) : 0);
+    for (int i = 0; i < count; i++)
+    {
+        int numPoints = 0;
+        if (!readFromVitmapReader(reader, &numPoints, sizeof(int)) || numPoints < 0
+            || numPoints > (remainingInVitmapReader(reader) - colorSize) / (int)sizeof(Vector2))
+        {
+            return false;
+        }
+        reader->pos += numPoints * (int)sizeof(Vector2) + colorSize;
+        if (version >= 3)
+        {
+            // The contour count is the last int of the shape, its starts follow
+            int numContours = 0;
+            memcpy(&numContours, reader->data + reader->pos - sizeof(int), sizeof(int));
+            if (numContours < 1 || numContours - 1 > remainingInVitmapReader(reader) / (int)sizeof(int))
+            {
+                return false;
+            }
+            reader->pos += (numContours - 1) * (int)sizeof(int);
+        }
+        if (version >= 4)
+        {
+            int numCurves = 0;
+            if (!readFromVitmapReader(reader, &numCurves, sizeof(int)) || numCurves < 0
+                || numCurves > remainingInVitmapReader(reader) / CURVE_FILE_SIZE)
+            {
+                return false;
+            }
+            reader->pos += numCurves * CURVE_FILE_SIZE;
+        }
+    }
+    return true;
+}
+
+typedef struct FrameDecode
+{
+    const unsigned char* data;
+    int start;
+    int end;
+    int version;
+    Vitmap frame;
+    const char* error;
+} FrameDecode;
+
+static void decodeFrameRange(void* userData, int begin, int end)
+{
+    FrameDecode* frames = userData;
+    for (int i = begin; i < end; i++)
+    {
+        FrameDecode* decode = &frames[i];
+        VitmapReader reader = {decode->data + decode->start, decode->end - decode->start, 0};
+        initVitmap(&decode->frame);
+        decode->frame.arena = createVitmapArena((size_t)(decode->end - decode->start) * 2 + 1024);
+        decode->frame.ownsArena = true;
+        if (decode->frame.arena == NULL)
+        {
+            decode->error = "out of memory";
+            continue;
+        }
+        readVitmapBody(&reader, &decode->frame, decode->version, &decode->error);
+    }
+}
+
+// Finds where each frame starts with a quick scan, then decodes the frames on
+// the job system, each into an arena of its own that the animation adopts in
+// frame order. Returns false if the scan fails, without touching the
+// animation, so the caller can decode frame by frame and report why.
+static bool decodeFramesWithJobs(VitmapReader* reader, VitmapAnimation* animation, int numFrames, int version,
+    bool* okOut, const char** error)
+{
+    FrameDecode* frames = malloc(numFrames * sizeof(FrameDecode));
+    if (frames == NULL) {
+        return false;
+    }
+    VitmapReader scan = *reader;
+    for (int i = 0; i < numFrames; i++)
+    {
+        frames[i] = (FrameDecode){reader->data, scan.pos, 0, version, {0}, NULL};
+        if (!skipVitmapBody(&scan, version))
+        {
+            free(frames);
+            return false;
+        }
+        frames[i].end = scan.pos;
+    }
+    runVitmapJobsFor(numFrames, 1, decodeFrameRange, frames);
+
+    // Frames after the first bad one are dropped
+    bool ok = true;
+    for (int i = 0; i < numFrames; i++)
+    {
+        if (ok && frames[i].error == NULL)
+        {
+            addFrameToAnimation(animation, frames[i].frame);
+            VITMAP_DEBUG("Frame %d: %d shapes", i, frames[i].frame.numShapes);
+            continue;
+        }
+        if (ok)
+        {
+            *error = frames[i].error;
+            ok = false;
+        }
+        unloadVitmap(&frames[i].frame);
+    }
+    reader->pos = scan.pos;
+    *okOut = ok;
+    free(frames);
+    return true;
+}
+
+// The frame count and every frame after it, as animation and set files both store them
+static bool readAnimationFrames(VitmapReader* reader, VitmapAnimation* animation, int version, const char** error)
+{
+    // Read the number of frames in the animation, each one is at least a shape count
+    int numFramesInTheFile = 0;
+    if (!readFromVitmapReader(reader, &numFramesInTheFile, sizeof(int)))
+    {
+        *error = "truncated frame count";
+        return false;
+    }
+    if (numFramesInTheFile < 0 || numFramesInTheFile > remainingInVitmapReader(reader) / 4)
+    {
+        *error = "frame count out of range";
+        return false;
+    }
+
+    bool ok = true;
+    animation->frames = allocateFromVitmapArena(animation->arena, numFramesInTheFile * sizeof(Vitmap));
+    animation->frameCapacity = numFramesInTheFile;
+    bool decoded = numFramesInTheFile >= DECODE_MIN_PARALLEL_FRAMES && getVitmapJobThreadCount() > 1
+        && decodeFramesWithJobs(reader, animation, numFramesInTheFile, version, &ok, error);
+
+    // Otherwise read each vitmap in the animation straight into the animation's arena
+    for (int i = 0; ok && !decoded && i < numFramesInTheFile; i++)
+    {
+        Vitmap* frame = addEmptyFrameToAnimation(animation);
+        ok = readVitmapBody(reader, frame, version, error);
+        VITMAP_DEBUG("Frame %d: %d shapes", i, frame->numShapes);
+    }
+    return ok;
+}
+
+bool decodeAnimation(const unsigned char* data, int size, VitmapAnimation* animationOut, const char** errorOut)
+{
+    const char* error = NULL;
+    VitmapReader reader = {data, size, 0};
+    initVitmapAnimation(animationOut);
+    animationOut->arena = createArenaForFile(size);
+    if (animationOut->arena == NULL)
+    {
+        if (errorOut != NULL)
+        {
+            *errorOut = "out of memory";
+        }
+        return false;
+    }
+
+    VITMAP_SPAN_BEGIN(span, "decodeAnimation");
+    int version = VITMAP_FORMAT_LEGACY;
+    bool ok = checkVitmapFileHeader(&reader, VITMAP_FILE_ANIMATION, &version, &error)
+        && readAnimationFrames(&reader, animationOut, version, &error);
+    if (ok && remainingInVitmapReader(&reader) != 0)
+    {
+        error = "trailing bytes after last frame";
+        ok = false;
+    }
+    if (errorOut != NULL)
+    {
+        *errorOut = error;
+    }
+    VITMAP_SPAN_END(span);
+    return ok;
+}
+
+// Decodes into the animation's arena, so the old frame's memory stays until the animation goes
+bool decodeAnimationFrame(const unsigned char* data, int size, int version, VitmapAnimation* animation, int index, const char** errorOut)
+{
+    const char* error = NULL;
+    bool ok = false;
+    if (index < 0 || index > animation->numFrames || version < VITMAP_FORMAT_LEGACY || version > VITMAP_FORMAT_VERSION)
+    {
+        error = "frame index or version out of range";
+    }
+    else if (getAnimationArena(animation) == NULL)
+    {
+        error = "out of memory";
+    }
+    else
+    {
+        VitmapReader reader = {data, size, 0};
+        Vitmap frame;
+        initVitmap(&frame);
+        frame.arena = animation->arena;
+        ok = readVitmapBody(&reader, &frame, version, &error);
+        if (ok && remainingInVitmapReader(&reader) != 0)
+        {
+            error = "trailing bytes after last shape";
+            ok = false;
+        }
+        Vitmap* target = ok && index == animation->numFrames ? reserveFrameInAnimation(animation) : &animation->frames[index];
+        if (ok && target == NULL)
+        {
+            error = "out of memory";
+            ok = false;
+        }
+        if (ok)
+        {
+            unloadVitmap(target);
+            *target = frame;
+        }
+    }
+    if (errorOut != NULL)
+    {
+        *errorOut = error;
+    }
+    return ok;
+}
+
+VitmapAnimation loadAnimationFromFile(const char* filename)
+{
+    VITMAP_SPAN_BEGIN(span, "loadAnimationFromFile");
+    VitmapAnimation animation;
+    initVitmapAnimation(&animation);
+
+    int size = 0;
+    unsigned char* data = loadVitmapFileData(filename, &size);
+    if (data == NULL)
+    {
+        VITMAP_ERROR("Failed to open %s for reading.", filename);
+        VITMAP_SPAN_END(span);
+        return animation;
+    }
+
+    const char* error = NULL;
+    if (decodeAnimation(data, size, &animation, &error))
+    {
+        VITMAP_INFO("Animation loaded from %s, %d frames.", filename, animation.numFrames);
+    }
+    else
+    {
+        VITMAP_ERROR("Failed to load animation %s: %s", filename, error);
+    }
+    free(data);
+    VITMAP_SPAN_END(span);
+
+    return animation;
+}
+
+// Each animation's name and the pool frames it plays, checked against the pool
+static bool readSetAnimations(VitmapReader* reader, VitmapAnimationSet* set, const char** error)
+{
+    // Each animation is at least a name length and a frame count
+    int numAnimations = 0;
+    if (!readFromVitmapReader(reader, &numAnimations, sizeof(int)))
+    {
+        *error = "truncated animation count";
+        return false;
+    }
+    if (numAnimations < 0 || numAnimations > remainingInVitmapReader(reader) / 8)
+    {
+        *error = "animation count out of range";
+        return false;
+    }
+    for (int i = 0; i < numAnimations; i++)
+    {
+        int nameLength = 0;
+        if (!readFromVitmapReader(reader, &nameLength, sizeof(int)))
+        {
+            *error = "truncated animation name";
+            return false;
+        }
+        if (nameLength <= 0 || nameLength > remainingInVitmapReader(reader))
+        {
+            *error = "animation name length out of range";
+            return false;
+        }
+        char* name = allocateFromVitmapArena(set->pool.arena, nameLength + 1);
+        if (name == NULL)
+        {
+            *error = "out of memory";
+            return false;
+        }
+        readFromVitmapReader(reader, name, nameLength);
+        name[nameLength] = '\0';
+        if ((int)strlen(name) != nameLength)
+        {
+            *error = "animation name has a null byte";
+            return false;
+        }
+        if (findAnimationInSet(set, name) >= 0)
+        {
+            *error = "duplicate animation name";
+            return false;
+        }
+
+        int numFrames = 0;
+        if (!readFromVitmapReader(reader, &numFrames, sizeof(int)))
+        {
+            *error = "truncated frame count";
+            return false;
+        }
+        if (numFrames < 0 || numFrames > remainingInVitmapReader(reader) / 4)
+        {
+            *error = "frame count out of range";
+            return false;
+        }
+        int* frames = allocateFromVitmapArena(set->pool.arena, numFrames * sizeof(int));
+        if (frames == NULL)
+        {
+            *error = "out of memory";
+            return false;
+        }
+        readFromVitmapReader(reader, frames, numFrames * sizeof(int));
+        for (int j = 0; j < numFrames; j++)
+        {
+            if (frames[j] < 0 || frames[j] >= set->pool.numFrames)
+            {
+                *error = "frame index out of range";
+                return false;
+            }
+        }
+        if (addPooledAnimationToSet(set, name, frames, numFrames) < 0)
+        {
+            *error = "out of memory";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool decodeAnimationSet(const unsigned char* data, int size, VitmapAnimationSet* setOut, const char** errorOut)
+{
+    const char* error = NULL;
+    VitmapReader reader = {data, size, 0};
+    initVitmapAnimationSet(setOut);
+    setOut->pool.arena = createArenaForFile(size);
+    if (setOut->pool.arena == NULL)
+    {
+        if (errorOut != NULL)
+        {
+            *errorOut = "out of memory";
+        }
+        return false;
+    }
+
+    VITMAP_SPAN_BEGIN(span, "decodeAnimationSet");
+    int version = VITMAP_FORMAT_LEGACY;
+    bool ok = checkVitmapFileHeader(&reader, VITMAP_FILE_ANIMATION_SET, &version, &error)
+        && readAnimationFrames(&reader, &setOut->pool, version, &error)
+        && readSetAnimations(&reader, setOut, &error);
+    if (ok && remainingInVitmapReader(&reader) != 0)
+    {
+        error = "trailing bytes after last animation";
+        ok = false;
+    }
+    if (errorOut != NULL)
+    {
+        *errorOut = error;
+    }
+    VITMAP_SPAN_END(span);
+    return ok;
+}
+
+VitmapAnimationSet loadAnimationSetFromFile(const char* filename)
+{
+    VITMAP_SPAN_BEGIN(span, "loadAnimationSetFromFile");
+    VitmapAnimationSet set;
+    initVitmapAnimationSet(&set);
+
+    int size = 0;
+    unsigned char* data = loadVitmapFileData(filename, &size);
+    if (data == NULL)
+    {
+        VITMAP_ERROR("Failed to open %s for reading.", filename);
+        VITMAP_SPAN_END(span);
+        return set;
+    }
+
+    const char* error = NULL;
+    if (decodeAnimationSet(data, size, &set, &error))
+    {
+        VITMAP_INFO("Animation set loaded from %s, %d animations over %d frames.", filename, set.numAnimations, set.pool.numFrames);
+    }
+    else
+    {
+        VITMAP_ERROR("Failed to load animation set %s: %s", filename, error);
+    }
+    free(data);
+    VITMAP_SPAN_END(span);
+
+    return set;
+}
+
+Vitmap loadVitmapFromFile(const char* filename)
+{
+    VITMAP_SPAN_BEGIN(span, "loadVitmapFromFile");
+    Vitmap vitmap;
+    initVitmap(&vitmap);
+
+    int size = 0;
+    unsigned char* data = loadVitmapFileData(filename, &size);
+    if (data == NULL)
+    {
+        VITMAP_ERROR("Failed to open %s for reading.", filename);
+        VITMAP_SPAN_END(span);
+        return vitmap;
+    }
+
+    const char* error = NULL;
+    if (decodeVitmap(data, size, &vitmap, &error))
+    {
+        VITMAP_INFO("Vitmap loaded from %s, %d shapes.", filename, vitmap.numShapes);
+    }
+    else
+    {
+        VITMAP_ERROR("Failed to load vitmap %s: %s", filename, error);
+    }
+    free(data);
+    VITMAP_SPAN_END(span);
+
+    return vitmap;
+}
+
+// Twice the signed area, positive for counter clockwise in y up coordinates
+static float getContourArea(const Vector2* points, int count)
+{
+    float area = 0.0f;
+    for (int i = 0, j = count - 1; i < count; j = i++)
+    {
+        area += points[j].x * points[i].y - points[i].x * points[j].y;
+    }
+    return area;
+}
+
+static float getTurn(Vector2 a, Vector2 b, Vector2 c)
+{
+    return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+}
+
+static float getDistanceSquared(Vector2 a, Vector2 b)
+{
+    return (a.x - b.x) * (a.x - b.x) + (a.y - b.y) * (a.y - b.y);
+}
+
+// Curves
+
+// Most straight edges one curve is flattened into, however close it has to be
+#define CURVE_MAX_SEGMENTS 64
+
+static const ShapeCurve* findShapeCurve(const Shape* shape, int point)
+{
+    int low = 0;
+    int high = shape->numCurves;
+    while (low < high)
+    {
+        int middle = (low + high) / 2;
+        if (shape->curves[middle].point < point)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low < shape->numCurves && shape->curves[low].point == point ? &shape->curves[low] : NULL;
+}
+
+// Wang's formula: evenly spaced steps stay within tolerance of the curve once
+// there are enough of them for its largest second difference
+static int getCurveSegmentCount(Vector2 from, const ShapeCurve* curve, Vector2 to, float tolerance)
+{
+    Vector2 c0 = curve->controls[0];
+    Vector2 c1 = curve->kind == VITMAP_CURVE_CUBIC ? curve->controls[1] : to;
+    float dx = from.x - 2.0f * c0.x + c1.x;
+    float dy = from.y - 2.0f * c0.y + c1.y;
+    float difference = sqrtf(dx * dx + dy * dy);
+    float factor = 0.25f;   // d(d - 1) / 8 for a curve of degree d
+    if (curve->kind == VITMAP_CURVE_CUBIC)
+    {
+        dx = c0.x - 2.0f * c1.x + to.x;
+        dy = c0.y - 2.0f * c1.y + to.y;
+        difference = fmaxf(difference, sqrtf(dx * dx + dy * dy));
+        factor = 0.75f;
+    }
+    if (difference <= 0.0f)
+    {
+        return 1;
+    }
+    float segments = ceilf(sqrtf(factor * difference / tolerance));
+    return segments < CURVE_MAX_SEGMENTS ? (segments > 1.0f ? (int)segments : 1) : CURVE_MAX_SEGMENTS;
+}
+
+static Vector2 getCurvePoint(Vector2 from, const ShapeCurve* curve, Vector2 to, float t)
+{
+    float u = 1.0f - t;
+    Vector2 c0 = curve->controls[0];
+    if (curve->kind == VITMAP_CURVE_QUADRATIC)
+    {
+        return (Vector2){
+            u * u * from.x + 2.0f * u * t * c0.x + t * t * to.x,
+            u * u * from.y + 2.0f * u * t * c0.y + t * t * to.y
+        };
+    }
+    Vector2 c1 = curve->controls[1];
+    return (Vector2){
+        u * u * u * from.x + 3.0f * u * u * t * c0.x + 3.0f * u * t * t * c1.x + t * t * t * to.x,
+        u * u * u * from.y + 3.0f * u * u * t * c0.y + 3.0f * u * t * t * c1.y + t * t * t * to.y
+    };
+}
+
+// Points one contour flattens to, if out is NULL only counted. Every point
+// is kept and each curve adds the points inside it.
+static int flattenContour(const Shape* shape, int contour, float tolerance, Vector2* out)
+{
+    int count = 0;
+    int start = getShapeContour(shape, contour, &count);
+    int numPoints = 0;
+    for (int i = start; i < start + count; i++)
+    {
+        if (out != NULL)
+        {
+            out[numPoints] = shape->points[i];
+        }
+        numPoints++;
+        const ShapeCurve* curve = shape->numCurves > 0 ? findShapeCurve(shape, i) : NULL;
+        if (curve == NULL)
+        {
+            continue;
+        }
+        Vector2 from = shape->points[i];
+        Vector2 to = shape->points[i + 1 < start + count ? i + 1 : start];
+        int segments = getCurveSegmentCount(from, curve, to, tolerance);
+        for (int j = 1; j < segments; j++)
+        {
+            if (out != NULL)
+            {
+                out[numPoints] = getCurvePoint(from, curve, to, (float)j / segments);
+            }
+            numPoints++;
+        }
+    }
+    return numPoints;
+}
+
+int flattenShape(const Shape* shape, float tolerance, VitmapArena* arena, Vector2** pointsOut, int** contourStartsOut)
+{
+    int numPoints = 0;
+    for (int i = 0; i < shape->numContours; i++)
+    {
+        numPoints += flattenContour(shape, i, tolerance, NULL);
+    }
+    Vector2* points = allocateFromVitmapArena(arena, (numPoints + 1) * sizeof(Vector2));
+    int* starts = allocateFromVitmapArena(arena, shape->numContours * sizeof(int));
+    *pointsOut = starts != NULL ? points : NULL;
+    *contourStartsOut = starts;
+    if (points == NULL || starts == NULL) {
+        return 0;
+    }
+    numPoints = 0;
+    for (int i = 0; i < shape->numContours; i++)
+    {
+        if (i > 0)
+        {
+            starts[i - 1] = numPoints;
+        }
+        numPoints += flattenContour(shape, i, tolerance, &points[numPoints]);
+    }
+    return numPoints;
+}
+
+float getVitmapCurveScale(float pixelsPerUnit)
+{
+    float scale = 1.0f / 64.0f;
+    while (scale < pixelsPerUnit && scale < 65536.0f)
+    {
+        scale *= 2.0f;
+    }
+    return scale;
+}
+
+// Furthest a flattened curve may stray, in the shape's units
+static float getCurveTolerance(const VitmapBakeOptions* options)
+{
+    return options->pixelsPerUnit > 0.0f ? options->curveTolerance / options->pixelsPerUnit : options->curveTolerance;
+}
+
+static int getEdgeWinding(Vector2 a, Vector2 b, Vector2 point)
+{
+    // Edges going up with the point on their left wind it once counter-clockwise,
+    // edges going down with the point on their right once clockwise
+    if (a.y <= point.y && b.y > point.y && getTurn(a, b, point) > 0.0f)
+    {
+        return 1;
+    }
+    if (a.y > point.y && b.y <= point.y && getTurn(a, b, point) < 0.0f)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+int getShapeWinding(const Shape* shape, Vector2 point)
+{
+    // Curves are followed as closely as the default bake flattens them
+    const VitmapBakeOptions options = VITMAP_DEFAULT_BAKE_OPTIONS;
+    float tolerance = getCurveTolerance(&options);
+    int winding = 0;
+    for (int c = 0; c < shape->numContours; c++)
+    {
+        int count = 0;
+        int start = getShapeContour(shape, c, &count);
+        for (int i = start; i < start + count; i++)
+        {
+            Vector2 a = shape->points[i];
+            Vector2 b = shape->points[i + 1 < start + count ? i + 1 : start];
+            const ShapeCurve* curve = shape->numCurves > 0 ? findShapeCurve(shape, i) : NULL;
+            int segments = curve != NULL ? getCurveSegmentCount(a, curve, b, tolerance) : 1;
+            Vector2 from = a;
+            for (int j = 1; j <= segments; j++)
+            {
+                Vector2 to = j < segments ? getCurvePoint(a, curve, b, (float)j / segments) : b;
+                winding += getEdgeWinding(from, to, point);
+                from = to;
+            }
+        }
+    }
+    return winding;
+}
+
+// Welds and drops points in place, returning how many are left. Fewer than
+// three means the contour had no area to begin with.
+static int cleanContour(Vector2* points, int count, const VitmapBakeOptions* options)
+{
+    float weld = options->weldDistance * options->weldDistance;
+    int kept = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (kept == 0 || getDistanceSquared(points[i], points[kept - 1]) > weld)
+        {
+            points[kept++] = points[i];
+        }
+    }
+    while (kept > 1 && getDistanceSquared(points[kept - 1], points[0]) <= weld)
+    {
+        kept--;
+    }
+    if (options->collinearTolerance < 0.0f)
+    {
+        return kept;
+    }
+    // Dropping a point can leave its neighbours collinear, so go round until nothing changes
+    bool changed = true;
+    while (changed && kept >= 3)
+    {
+        changed = false;
+        int out = 0;
+        for (int i = 0; i < kept; i++)
+        {
+            Vector2 previous = out > 0 ? points[out - 1] : points[kept - 1];
+            Vector2 next = points[(i + 1) % kept];
+            float length = sqrtf(getDistanceSquared(previous, next));
+            if (length > 0.0f && fabsf(getTurn(previous, next, points[i])) / length <= options->collinearTolerance)
+            {
+                changed = true;
+                continue;
+            }
+            points[out++] = points[i];
+        }
+        kept = out;
+    }
+    return kept;
+}
+
+// Only proper crossings count, between edges of one contour or of two.
+// Edges that touch or overlap do not.
+static bool hasSelfIntersection(const Vector2* points, int numPoints, const int* starts, int numContours)
+{
+    for (int c = 0; c < numContours; c++)
+    {
+        int start = c > 0 ? starts[c - 1] : 0;
+        int end = c + 1 < numContours ? starts[c] : numPoints;
+        for (int i = start; i < end; i++)
+        {
+            Vector2 a = points[i];
+            Vector2 b = points[i + 1 < end ? i + 1 : start];
+            // The rest of this contour past the next edge, then every later one
+            for (int d = c; d < numContours; d++)
+            {
+                int otherStart = d > 0 ? starts[d - 1] : 0;
+                int otherEnd = d + 1 < numContours ? starts[d] : numPoints;
+                for (int j = d == c ? i + 2 : otherStart; j < otherEnd; j++)
+                {
+                    if (d == c && i == start && j == end - 1)
+                    {
+                        continue;
+                    }
+                    Vector2 e = points[j];
+                    Vector2 f = points[j + 1 < otherEnd ? j + 1 : otherStart];
+                    if (getTurn(e, f, a) * getTurn(e, f, b) < 0.0f && getTurn(a, b, e) * getTurn(a, b, f) < 0.0f)
+                    {
+                        return true;
+                    }
+                }
+            }
+        }
+    }
+    return false;
+}
+
+// A polygon with holes needs two more triangles per hole
+static int getPolygonTriangleCount(int numPoints, int numContours)
+{
+    return numPoints >= 3 ? numPoints + 2 * (numContours - 1) - 2 : 0;
+}
+
+// Stats are shared by every job of a parallel bake
+static void addBakeStats(VitmapBakeStats* stats, int pointsRemoved, int trianglesSaved, int shapesDropped, int shapesSplit)
+{
+    if (stats == NULL)
+    {
+        return;
+    }
+    __atomic_fetch_add(&stats->numPointsRemoved, pointsRemoved, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->numTrianglesSaved, trianglesSaved, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->numShapesDropped, shapesDropped, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->numShapesSplit, shapesSplit, __ATOMIC_RELAXED);
+}
+
+// Flattens and cleans every contour of the shape into scratch and drops the
+// ones left with no area. startsOut gets where each kept contour after the
+// first begins, and flattenedOut how many points there were before cleaning.
+static int cleanShapeContours(const Shape* shape, const VitmapBakeOptions* options, VitmapArena* scratch,
+    Vector2** pointsOut, int** startsOut, int* numContoursOut, int* flattenedOut)
+{
+    float tolerance = getCurveTolerance(options);
+    int flattened = 0;
+    for (int i = 0; i < shape->numContours; i++)
+    {
+        flattened += flattenContour(shape, i, tolerance, NULL);
+    }
+    Vector2* points = allocateFromVitmapArena(scratch, (flattened + 1) * sizeof(Vector2));
+    int* starts = allocateFromVitmapArena(scratch, shape->numContours * sizeof(int));
+    *pointsOut = points;
+    *startsOut = starts;
+    *numContoursOut = 0;
+    *flattenedOut = flattened;
+    if (points == NULL || starts == NULL) {
+        return 0;
+    }
+    int numPoints = 0;
+    int numContours = 0;
+    for (int i = 0; i < shape->numContours; i++)
+    {
+        int count = flattenContour(shape, i, tolerance, &points[numPoints]);
+        int kept = cleanContour(&points[numPoints], count, options);
+        if (kept >= 3)
+        {
+            if (numContours > 0)
+            {
+                starts[numContours - 1] = numPoints;
+            }
+            numContours++;
+            numPoints += kept;
+        }
+    }
+    *numContoursOut = numContours;
+    return numPoints;
+}
+
+static const int tessWindingRules[] = {TESS_WINDING_ODD, TESS_WINDING_NONZERO, TESS_WINDING_POSITIVE};
+
+// Positive winding is counted around +z, which makes it the sign of
+// getContourArea. The other rules leave libtess2 to pick the normal.
+static const TESSreal* getTessNormal(VitmapWindingRule rule)
+{
+    static const TESSreal up[3] = {0.0f, 0.0f, 1.0f};
+    return rule == VITMAP_WINDING_POSITIVE ? up : NULL;
+}
+
+// Contours still being drawn, with fewer than three points, are left out
+static void addContoursToTess(TESStesselator* tess, const Vector2* points, int numPoints, const int* starts, int numContours)
+{
+    for (int i = 0; i < numContours; i++)
+    {
+        int start = i > 0 ? starts[i - 1] : 0;
+        int end = i + 1 < numContours ? starts[i] : numPoints;
+        if (end - start >= 3)
+        {
+            tessAddContour(tess, 2, &points[start], sizeof(Vector2), end - start);
+        }
+    }
+}
+
+// libtess2 makes many small allocations per tessellation. Serving them from a
+// scratch arena that is reset between shapes skips nearly all malloc calls.
+// Each block remembers its size in front of it so realloc can copy.
+#define TESS_SCRATCH_HEADER 16
+
+// Shapes handed to each job when a vitmap bakes on the job system
+#define BAKE_SHAPES_PER_JOB 16
+
+static void* allocateTessScratch(void* userData, unsigned int size)
+{
+    unsigned char* block = allocateFromVitmapArena(userData, size + TESS_SCRATCH_HEADER);
+    if (block == NULL) {
+        return NULL;
+    }
+    *(size_t*)block = size;
+    return block + TESS_SCRATCH_HEADER;
+}
+
+static void* reallocateTessScratch(void* userData, void* ptr, unsigned int size)
+{
+    if (ptr == NULL)
+    {
+        return allocateTessScratch(userData, size);
+    }
+    size_t oldSize = *(size_t*)((unsigned char*)ptr - TESS_SCRATCH_HEADER);
+    if (size <= oldSize)
+    {
+        return ptr;
+    }
+    void* moved = allocateTessScratch(userData, size);
+    if (moved != NULL)
+    {
+        memcpy(moved, ptr, oldSize);
+    }
+    return moved;
+}
+
+static void freeTessScratch(void* userData, void* ptr)
+{
+    // Everything goes away when the scratch arena is reset
+    (void)userData;
+    (void)ptr;
+}
+
+// Every contour is stroked on its own, into one mesh, along its curves flattened to tolerance
+static bool tessellateShapeStroke(const Shape* shape, const VitmapStrokeStyle* style, float tolerance, VitmapArena* scratch,
+    ShapeMesh* meshOut)
+{
+    if (shape->numContours == 1 && shape->numCurves == 0)
+    {
+        return tessellateStroke(shape->points, shape->numPoints, style, scratch, meshOut);
+    }
+    Vector2* points = NULL;
+    int* starts = NULL;
+    int numPoints = flattenShape(shape, tolerance, scratch, &points, &starts);
+    ShapeMesh* contours = allocateFromVitmapArena(scratch, shape->numContours * sizeof(ShapeMesh));
+    if (points == NULL || contours == NULL) {
+        return false;
+    }
+    int numVertices = 0;
+    int numIndices = 0;
+    for (int i = 0; i < shape->numContours; i++)
+    {
+        int start = i > 0 ? starts[i - 1] : 0;
+        int end = i + 1 < shape->numContours ? starts[i] : numPoints;
+        if (!tessellateStroke(&points[start], end - start, style, scratch, &contours[i]))
+        {
+            return false;
+        }
+        numVertices += contours[i].numVertices;
+        numIndices += contours[i].numIndices;
+    }
+    *meshOut = (ShapeMesh){NULL, 0, NULL, 0, {0.0f, 0.0f}, {0.0f, 0.0f}};
+    if (numVertices == 0)
+    {
+        return true;
+    }
+    meshOut->vertices = allocateFromVitmapArena(scratch, numVertices * sizeof(Vector2));
+    meshOut->indices = allocateFromVitmapArena(scratch, numIndices * sizeof(int));
+    if (meshOut->vertices == NULL || meshOut->indices == NULL) {
+        return false;
+    }
+    for (int i = 0; i < shape->numContours; i++)
+    {
+        const ShapeMesh* contour = &contours[i];
+        if (contour->numVertices == 0)
+        {
+            continue;
+        }
+        if (meshOut->numVertices == 0)
+        {
+            meshOut->boundsMin = contour->boundsMin;
+            meshOut->boundsMax = contour->boundsMax;
+        }
+        meshOut->boundsMin.x = fminf(meshOut->boundsMin.x, contour->boundsMin.x);
+        meshOut->boundsMin.y = fminf(meshOut->boundsMin.y, contour->boundsMin.y);
+        meshOut->boundsMax.x = fmaxf(meshOut->boundsMax.x, contour->boundsMax.x);
+        meshOut->boundsMax.y = fmaxf(meshOut->boundsMax.y, contour->boundsMax.y);
+        for (int j = 0; j < contour->numIndices; j++)
+        {
+            meshOut->indices[meshOut->numIndices + j] = contour->indices[j] + meshOut->numVertices;
+        }
+        memcpy(&meshOut->vertices[meshOut->numVertices], contour->vertices, contour->numVertices * sizeof(Vector2));
+        meshOut->numVertices += contour->numVertices;
+        meshOut->numIndices += contour->numIndices;
+    }
+    return true;
+}
+
+// Strokes are built in the scratch arena too and copied out under the same lock
+static void bakeStrokeWithScratch(Vitmap* vitmap, Shape* shape, const VitmapStrokeStyle* style, float tolerance,
+    VitmapArena* scratch, VitmapMutex* arenaLock)
+{
+    ShapeMesh built;
+    bool tessellated = tessellateShapeStroke(shape, style, tolerance, scratch, &built);
+    if (arenaLock != NULL)
+    {
+        lockVitmapMutex(arenaLock);
+    }
+    VitmapArena* arena = getVitmapArena(vitmap);
+    ShapeStroke* stroke = arena != NULL ? allocateFromVitmapArena(arena, sizeof(ShapeStroke)) : NULL;
+    bool copied = stroke != NULL && tessellated && copyShapeMesh(arena, &stroke->mesh, &built);
+    if (arenaLock != NULL)
+    {
+        unlockVitmapMutex(arenaLock);
+    }
+    if (copied)
+    {
+        stroke->style = *style;
+        shape->stroke = stroke;
+    }
+    resetVitmapArena(scratch);
+}
+
+// arenaLock guards the vitmap's arena while several shapes bake at once, and
+// is NULL when baking on one thread. Tessellating needs only the scratch arena,
+// so the lock is held just for the allocations the result is copied into.
+static void bakeShapeWithScratch(Vitmap* vitmap, Shape* shape, const VitmapBakeOptions* options, VitmapBakeStats* stats,
+    VitmapArena* scratch, VitmapMutex* arenaLock)
+{
+    // The cleanup works on a flattened copy, the tessellator never sees curves, repeats or collinear runs
+    Vector2* points = NULL;
+    int* starts = NULL;
+    int numContours = 0;
+    int flattened = shape->numPoints;
+    int numPoints = shape->numPoints >= 3
+        ? cleanShapeContours(shape, options, scratch, &points, &starts, &numContours, &flattened) : 0;
+    // A mesh baked from the same points by an earlier run skips the tessellator
+    ShapeMesh cached;
+    bool isCached = numPoints >= 3
+        && findCachedVitmapBake(points, numPoints, starts, numContours, shape->windingRule, options->minArea, scratch, &cached);
+    TESStesselator* tess = NULL;
+    bool tessellated = isCached;
+    if (numPoints >= 3 && !isCached)
+    {
+        TESSalloc tessAlloc = {
+            allocateTessScratch, reallocateTessScratch, freeTessScratch, scratch,
+            512, 512, 256, 512, 256, 0
+        };
+        tess = tessNewTess(&tessAlloc);
+        if (tess != NULL)
+        {
+            tessSetOption(tess, TESS_CONSTRAINED_DELAUNAY_TRIANGULATION, 1);
+            addContoursToTess(tess, points, numPoints, starts, numContours);
+            tessellated = tessTesselate(tess, tessWindingRules[shape->windingRule], TESS_POLYGONS, 3, 2, getTessNormal(shape->windingRule));
+        }
+    }
+    const Vector2* tessVertices = isCached ? cached.vertices : tessellated ? (const Vector2*)tessGetVertices(tess) : NULL;
+    const int* elements = isCached ? cached.indices : tessellated ? tessGetElements(tess) : NULL;
+    int numVertices = isCached ? cached.numVertices : tessellated ? tessGetVertexCount(tess) : 0;
+    int numIndices = isCached ? cached.numIndices : tessellated ? tessGetElementCount(tess) * 3 : 0;
+    // Summed from the triangles, since a shape that crosses itself can have a signed area of zero
+    if (numIndices > 0 && options->minArea > 0.0f && !isCached)
+    {
+        float area = 0.0f;
+        for (int i = 0; i < numIndices; i += 3)
+        {
+            area += fabsf(getTurn(tessVertices[elements[i]], tessVertices[elements[i + 1]], tessVertices[elements[i + 2]])) * 0.5f;
+        }
+        if (area <= options->minArea)
+        {
+            numVertices = 0;
+            numIndices = 0;
+        }
+    }
+    if (shape->numPoints >= 3)
+    {
+        int before = getPolygonTriangleCount(flattened, shape->numContours);
+        addBakeStats(stats, flattened - numPoints, before - numIndices / 3, numIndices == 0 ? 1 : 0, 0);
+    }
+
+    // Copy the result out of the scratch arena into the vitmap's
+    if (arenaLock != NULL)
+    {
+        lockVitmapMutex(arenaLock);
+    }
+    VitmapArena* arena = getVitmapArena(vitmap);
+    ShapeMesh* mesh = allocateFromVitmapArena(arena, sizeof(ShapeMesh));
+    Vector2* vertices = numVertices > 0 ? allocateFromVitmapArena(arena, numVertices * sizeof(Vector2)) : NULL;
+    int* indices = numIndices > 0 ? allocateFromVitmapArena(arena, numIndices * sizeof(int)) : NULL;
+    if (arenaLock != NULL)
+    {
+        unlockVitmapMutex(arenaLock);
+    }
+    if (mesh != NULL)
+    {
+        mesh->vertices = NULL;
+        mesh->numVertices = 0;
+        mesh->indices = NULL;
+        mesh->numIndices = 0;
+        mesh->boundsMin = (Vector2){0.0f, 0.0f};
+        mesh->boundsMax = (Vector2){0.0f, 0.0f};
+        if (vertices != NULL && indices != NULL)
+        {
+            memcpy(vertices, tessVertices, numVertices * sizeof(Vector2));
+            memcpy(indices, elements, numIndices * sizeof(int));
+            mesh->vertices = vertices;
+            mesh->indices = indices;
+            mesh->numVertices = numVertices;
+            mesh->numIndices = numIndices;
+            // Bounds for collision queries to reject the shape early
+            for (int i = 0; i < numVertices; i++)
+            {
+                Vector2 vertex = vertices[i];
+                if (i == 0 || vertex.x < mesh->boundsMin.x) mesh->boundsMin.x = vertex.x;
+                if (i == 0 || vertex.y < mesh->boundsMin.y) mesh->boundsMin.y = vertex.y;
+                if (i == 0 || vertex.x > mesh->boundsMax.x) mesh->boundsMax.x = vertex.x;
+                if (i == 0 || vertex.y > mesh->boundsMax.y) mesh->boundsMax.y = vertex.y;
+            }
+        }
+        // A rebake leaves the old mesh in the arena, it goes when the vitmap does
+        shape->mesh = mesh;
+        if (tessellated && !isCached && mesh->numIndices == numIndices)
+        {
+            storeCachedVitmapBake(points, numPoints, starts, numContours, shape->windingRule, options->minArea, mesh);
+        }
+    }
+    if (tess != NULL)
+    {
+        tessDeleteTess(tess);
+    }
+    resetVitmapArena(scratch);
+    if (shape->stroke != NULL)
+    {
+        bakeStrokeWithScratch(vitmap, shape, &shape->stroke->style, getCurveTolerance(options), scratch, arenaLock);
+    }
+}
+
+void bakeShape(Vitmap* vitmap, ShapeHandle shapeHandle)
+{
+    Shape* shape = editShape(vitmap, shapeHandle);
+    if (shape == NULL)
+    {
+        return;
+    }
+    VitmapArena* scratch = createVitmapArena(64 * 1024);
+    if (scratch == NULL) {
+        return;
+    }
+    VITMAP_SPAN_BEGIN(span, "bakeShape");
+    const VitmapBakeOptions options = VITMAP_DEFAULT_BAKE_OPTIONS;
+    bakeShapeWithScratch(vitmap, shape, &options, NULL, scratch, NULL);
+    VITMAP_SPAN_END(span);
+    destroyVitmapArena(scratch);
+}
+
+void bakeShapeStroke(Vitmap* vitmap, ShapeHandle shapeHandle, const VitmapStrokeStyle* style)
+{
+    Shape* shape = editShape(vitmap, shapeHandle);
+    if (shape == NULL)
+    {
+        return;
+    }
+    VitmapArena* scratch = createVitmapArena(64 * 1024);
+    if (scratch == NULL) {
+        return;
+    }
+    const VitmapBakeOptions options = VITMAP_DEFAULT_BAKE_OPTIONS;
+    bakeStrokeWithScratch(vitmap, shape, style, getCurveTolerance(&options), scratch, NULL);
+    destroyVitmapArena(scratch);
+}
+
+void bakeVitmapStrokes(Vitmap* vitmap, const VitmapStrokeStyle* style)
+{
+    if (!unshareShapeTable(vitmap) || getVitmapArena(vitmap) == NULL)
+    {
+        return;
+    }
+    VITMAP_SPAN_BEGIN(span, "bakeVitmapStrokes");
+    const VitmapBakeOptions options = VITMAP_DEFAULT_BAKE_OPTIONS;
+    VitmapArena* scratch = createVitmapArena(64 * 1024);
+    if (scratch != NULL)
+    {
+        for (int i = 0; i < vitmap->numShapes; i++)
+        {
+            bakeStrokeWithScratch(vitmap, &vitmap->shapes[vitmap->order[i]], style, getCurveTolerance(&options), scratch, NULL);
+        }
+        destroyVitmapArena(scratch);
+    }
+    VITMAP_SPAN_END(span);
+}
+
+typedef struct BakeJob
+{
+    Vitmap* vitmap;
+    const VitmapBakeOptions* options;
+    VitmapBakeStats* stats;
+    VitmapMutex arenaLock;
+} BakeJob;
+
+// Each batch of shapes gets a scratch arena of its own
+static void bakeShapeRange(void* userData, int begin, int end)
+{
+    BakeJob* bake = userData;
+    VitmapArena* scratch = createVitmapArena(64 * 1024);
+    if (scratch == NULL) {
+        return;
+    }
+    for (int i = begin; i < end; i++)
+    {
+        Shape* shape = &bake->vitmap->shapes[bake->vitmap->order[i]];
+        bakeShapeWithScratch(bake->vitmap, shape, bake->options, bake->stats, scratch, &bake->arenaLock);
+    }
+    destroyVitmapArena(scratch);
+}
+
+void bakeVitmap(Vitmap* vitmap)
+{
+    const VitmapBakeOptions options = VITMAP_DEFAULT_BAKE_OPTIONS;
+    bakeVitmapWithOptions(vitmap, &options, NULL);
+}
+
+void bakeVitmapWithOptions(Vitmap* vitmap, const VitmapBakeOptions* options, VitmapBakeStats* statsOut)
+{
+    // Meshes are stored in the shapes, so a shared shape table is split first
+    if (!unshareShapeTable(vitmap) || getVitmapArena(vitmap) == NULL)
+    {
+        return;
+    }
+    VITMAP_SPAN_BEGIN(span, "bakeVitmap");
+    BakeJob bake = {vitmap, options, statsOut, {NULL}};
+    if (vitmap->numShapes >= BAKE_SHAPES_PER_JOB * 2 && getVitmapJobThreadCount() > 1 && initVitmapMutex(&bake.arenaLock))
+    {
+        runVitmapJobsFor(vitmap->numShapes, BAKE_SHAPES_PER_JOB, bakeShapeRange, &bake);
+        destroyVitmapMutex(&bake.arenaLock);
+    }
+    else
+    {
+        // Bake all the shapes, sharing one scratch arena between them
+        VitmapArena* scratch = createVitmapArena(64 * 1024);
+        if (scratch != NULL)
+        {
+            for (int i = 0; i < vitmap->numShapes; i++)
+            {
+                Shape* shape = &vitmap->shapes[vitmap->order[i]];
+                bakeShapeWithScratch(vitmap, shape, options, statsOut, scratch, NULL);
+            }
+            destroyVitmapArena(scratch);
+        }
+    }
+    VITMAP_SPAN_END(span);
+}
+
+// Free the result with destroyVitmap
+Vitmap* loadAndBakeVitmap(const char* filename)
+{
+    Vitmap* vitmap = createVitmap();
+    if (vitmap == NULL) {
+        return NULL;
+    }
+    *vitmap = loadVitmapFromFile(filename);
+    bakeVitmap(vitmap);
+    return vitmap;
+}
+
+// Moving only touches the offset, so the points and the baked mesh stay valid
+// and a shape shared with other frames keeps sharing its points
+void moveShape(Vitmap* vitmap, ShapeHandle shape, Vector2 deltaPos)
+{
+    Shape* target = editShape(vitmap, shape);
+    if (target == NULL)
+    {
+        return;
+    }
+    target->offset.x += deltaPos.x;
+    target->offset.y += deltaPos.y;
+}
+
+void moveVitmap(Vitmap* vitmap, Vector2 deltaPos)
+{
+    vitmap->offset.x += deltaPos.x;
+    vitmap->offset.y += deltaPos.y;
+}
+
+// Adds delta to the points and the mesh of a shape in an unshared table and
+// clears its offset. The mesh is translated into a new vertex array, since
+// other frames may still draw the old one, so no rebake is needed.
+static void translateShapeStorage(Vitmap* vitmap, Shape* shape, Vector2 delta)
+{
+    if (delta.x == 0.0f && delta.y == 0.0f)
+    {
+        shape->offset = delta;
+        return;
+    }
+    if (!unshareShapePoints(vitmap, shape))
+    {
+        return;
+    }
+    shape->offset = (Vector2){0.0f, 0.0f};
+    for (int i = 0; i < shape->numPoints; i++)
+    {
+        shape->points[i].x += delta.x;
+        shape->points[i].y += delta.y;
+    }
+    if (shape->mesh != NULL)
+    {
+        const ShapeMesh* oldMesh = shape->mesh;
+        ShapeMesh* mesh = allocateFromVitmapArena(vitmap->arena, sizeof(ShapeMesh));
+        Vector2* vertices = allocateFromVitmapArena(vitmap->arena, oldMesh->numVertices * sizeof(Vector2));
+        if (mesh == NULL || vertices == NULL)
+        {
+            shape->mesh = NULL;
+            return;
+        }
+        for (int i = 0; i < oldMesh->numVertices; i++)
+        {
+            vertices[i] = (Vector2){oldMesh->vertices[i].x + delta.x, oldMesh->vertices[i].y + delta.y};
+        }
+        *mesh = *oldMesh;
+        mesh->vertices = vertices;
+        mesh->boundsMin = (Vector2){oldMesh->boundsMin.x + delta.x, oldMesh->boundsMin.y + delta.y};
+        mesh->boundsMax = (Vector2){oldMesh->boundsMax.x + delta.x, oldMesh->boundsMax.y + delta.y};
+        shape->mesh = mesh;
+    }
+    if (shape->stroke != NULL)
+    {
+        const ShapeStroke* oldStroke = shape->stroke;
+        ShapeStroke* stroke = allocateFromVitmapArena(vitmap->arena, sizeof(ShapeStroke));
+        Vector2* vertices = allocateFromVitmapArena(vitmap->arena, oldStroke->mesh.numVertices * sizeof(Vector2));
+        if (stroke == NULL || vertices == NULL)
+        {
+            shape->stroke = NULL;
+            return;
+        }
+        for (int i = 0; i < oldStroke->mesh.numVertices; i++)
+        {
+            vertices[i] = (Vector2){oldStroke->mesh.vertices[i].x + delta.x, oldStroke->mesh.vertices[i].y + delta.y};
+        }
+        *stroke = *oldStroke;
+        stroke->mesh.vertices = vertices;
+        stroke->mesh.boundsMin = (Vector2){oldStroke->mesh.boundsMin.x + delta.x, oldStroke->mesh.boundsMin.y + delta.y};
+        stroke->mesh.boundsMax = (Vector2){oldStroke->mesh.boundsMax.x + delta.x, oldStroke->mesh.boundsMax.y + delta.y};
+        shape->stroke = stroke;
+    }
+}
+
+// Folds the shape's own offset into its points. The vitmap's offset stays.
+void applyShapeTransform(Vitmap* vitmap, ShapeHandle shape)
+{
+    const Shape* current = getShape(vitmap, shape);
+    if (current == NULL || (current->offset.x == 0.0f && current->offset.y == 0.0f))
+    {
+        return;
+    }
+    Shape* target = editShape(vitmap, shape);
+    if (target != NULL)
+    {
+        translateShapeStorage(vitmap, target, target->offset);
+    }
+}
+
+// Folds every offset into the points. Frames without offsets are left alone,
+// so calling this does not split a frame that is shared.
+void applyVitmapTransform(Vitmap* vitmap)
+{
+    bool moved = vitmap->offset.x != 0.0f || vitmap->offset.y != 0.0f;
+    for (int i = 0; !moved && i < vitmap->numShapes; i++)
+    {
+        const Shape* shape = getVitmapShape(vitmap, i);
+        moved = shape->offset.x != 0.0f || shape->offset.y != 0.0f;
+    }
+    if (!moved || !unshareShapeTable(vitmap))
+    {
+        return;
+    }
+    for (int i = 0; i < vitmap->numShapes; i++)
+    {
+        Shape* shape = &vitmap->shapes[vitmap->order[i]];
+        translateShapeStorage(vitmap, shape, getShapeOffset(vitmap, shape));
+    }
+    vitmap->offset = (Vector2){0.0f, 0.0f};
+}
+// Copies the colors into the vitmap's arena. The old palette is left as it
+// is, so frames that shared it keep theirs.
+bool setVitmapPalette(Vitmap* vitmap, const Color* colors, int numColors)
+{
+    if (numColors <= 0)
+    {
+        vitmap->palette = NULL;
+        vitmap->numPaletteColors = 0;
+        return true;
+    }
+    Color* palette = allocateFromVitmapArena(getVitmapArena(vitmap), numColors * sizeof(Color));
+    if (palette == NULL) {
+        return false;
+    }
+    memcpy(palette, colors, numColors * sizeof(Color));
+    vitmap->palette = palette;
+    vitmap->numPaletteColors = numColors;
+    return true;
+}
+
+// Destructible terrain. A cut is subtracted from a shape with a libtess2
+// boolean: the shape's boundary winds positive, the cut is added winding the
+// other way, and only the region still at positive winding is kept.
+
+// Segments used for a carved circle, scaled with its radius
+#define CARVE_MIN_CIRCLE_SEGMENTS 8
+#define CARVE_MAX_CIRCLE_SEGMENTS 96
+
+typedef struct CarveContour
+{
+    const Vector2* points;
+    int count;
+    float area;
+    int parent;             // Innermost contour around this one, -1 for none
+    bool isHole;
+} CarveContour;
+
+// An outer contour followed by the holes directly inside it
+typedef struct CarvePiece
+{
+    Vector2* points;
+    int numPoints;
+    int* contourStarts;
+    int numContours;
+} CarvePiece;
+
+static bool isPointInContour(const Vector2* points, int count, Vector2 point)
+{
+    bool inside = false;
+    for (int i = 0, j = count - 1; i < count; j = i++)
+    {
+        if ((points[i].y > point.y) != (points[j].y > point.y)
+            && point.x < (points[j].x - points[i].x) * (point.y - points[i].y) / (points[j].y - points[i].y) + points[i].x)
+        {
+            inside = !inside;
+        }
+    }
+    return inside;
+}
+
+// Touching counts as crossing, at worst that costs one needless boolean
+static bool doSegmentsCross(Vector2 a, Vector2 b, Vector2 c, Vector2 d)
+{
+    return getTurn(c, d, a) * getTurn(c, d, b) <= 0.0f && getTurn(a, b, c) * getTurn(a, b, d) <= 0.0f;
+}
+
+// Cheap exact test so shapes that only share a bounding box with the cut skip
+// the boolean and keep their mesh
+static bool doesCutTouchContour(const Vector2* points, int count, const Vector2* cut, int numCut,
+    Vector2 cutMin, Vector2 cutMax)
+{
+    for (int i = 0, j = count - 1; i < count; j = i++)
+    {
+        Vector2 a = points[j];
+        Vector2 b = points[i];
+        if (fmaxf(a.x, b.x) < cutMin.x || fminf(a.x, b.x) > cutMax.x
+            || fmaxf(a.y, b.y) < cutMin.y || fminf(a.y, b.y) > cutMax.y)
+        {
+            continue;
+        }
+        for (int k = 0, l = numCut - 1; k < numCut; l = k++)
+        {
+            if (doSegmentsCross(a, b, cut[l], cut[k]))
+            {
+                return true;
+            }
+        }
+    }
+    // No edges cross, so either one lies inside the other or they are apart
+    return isPointInContour(points, count, cut[0]) || isPointInContour(cut, numCut, points[0]);
+}
+
+// Moves the shape at one draw order position to another, shifting the ones between
+static void moveShapeInOrder(Vitmap* vitmap, int from, int to)
+{
+    int slot = vitmap->order[from];
+    int step = to > from ? 1 : -1;
+    for (int i = from; i != to; i += step)
+    {
+        vitmap->order[i] = vitmap->order[i + step];
+        vitmap->slots[vitmap->order[i]].orderIndex = i;
+    }
+    vitmap->order[to] = slot;
+    vitmap->slots[slot].orderIndex = to;
+}
+
+// Islands inside a hole are outer contours of their own and become separate pieces
+static bool gatherCarvePiece(Vitmap* vitmap, const CarveContour* contours, int numContours, int outer, CarvePiece* piece)
+{
+    int total = contours[outer].count;
+    int numHoles = 0;
+    for (int i = 0; i < numContours; i++)
+    {
+        if (contours[i].isHole && contours[i].parent == outer)
+        {
+            total += contours[i].count;
+            numHoles++;
+        }
+    }
+    VitmapArena* arena = getVitmapArena(vitmap);
+    piece->points = allocateSharedBlock(arena, total * sizeof(Vector2));
+    piece->contourStarts = numHoles > 0 ? allocateFromVitmapArena(arena, numHoles * sizeof(int)) : NULL;
+    if (piece->points == NULL || (numHoles > 0 && piece->contourStarts == NULL)) {
+        return false;
+    }
+    piece->numPoints = contours[outer].count;
+    piece->numContours = 1;
+    memcpy(piece->points, contours[outer].points, piece->numPoints * sizeof(Vector2));
+    for (int i = 0; i < numContours; i++)
+    {
+        if (contours[i].isHole && contours[i].parent == outer)
+        {
+            piece->contourStarts[piece->numContours - 1] = piece->numPoints;
+            memcpy(&piece->points[piece->numPoints], contours[i].points, contours[i].count * sizeof(Vector2));
+            piece->numPoints += contours[i].count;
+            piece->numContours++;
+        }
+    }
+    return true;
+}
+
+// Swaps a shape for the boundary contours in tess, which it deletes. Each
+// outer contour becomes a piece with its holes as extra contours, the first in
+// place of the shape and the rest right above it. No contours removes the shape.
+static bool replaceShapeWithBoundary(Vitmap* vitmap, ShapeHandle handle, TESStesselator* tess,
+    const VitmapBakeOptions* options, VitmapBakeStats* stats, VitmapArena* scratch)
+{
+    // Sort the boundary into outer contours and the holes inside them, by how
+    // many other contours each one sits in
+    const Vector2* vertices = (const Vector2*)tessGetVertices(tess);
+    const TESSindex* elements = tessGetElements(tess);
+    int numElements = tessGetElementCount(tess);
+    CarveContour* contours = allocateFromVitmapArena(scratch, (numElements + 1) * sizeof(CarveContour));
+    if (contours == NULL) {
+        tessDeleteTess(tess);
+        resetVitmapArena(scratch);
+        return false;
+    }
+    int numContours = 0;
+    for (int i = 0; i < numElements; i++)
+    {
+        if (elements[i * 2 + 1] >= 3)
+        {
+            CarveContour* contour = &contours[numContours++];
+            contour->points = &vertices[elements[i * 2]];
+            contour->count = elements[i * 2 + 1];
+            contour->area = fabsf(getContourArea(contour->points, contour->count));
+        }
+    }
+    int numPieces = 0;
+    for (int i = 0; i < numContours; i++)
+    {
+        int depth = 0;
+        contours[i].parent = -1;
+        for (int j = 0; j < numContours; j++)
+        {
+            if (j != i && isPointInContour(contours[j].points, contours[j].count, contours[i].points[0]))
+            {
+                depth++;
+                if (contours[i].parent == -1 || contours[j].area < contours[contours[i].parent].area)
+                {
+                    contours[i].parent = j;
+                }
+            }
+        }
+        contours[i].isHole = depth % 2 == 1;
+        numPieces += contours[i].isHole ? 0 : 1;
+    }
+
+    // Every outer contour becomes a piece, holes included, ready to be
+    // swapped in once the tessellator is gone
+    CarvePiece* pieces = allocateFromVitmapArena(scratch, (numPieces + 1) * sizeof(CarvePiece));
+    if (pieces == NULL) {
+        tessDeleteTess(tess);
+        resetVitmapArena(scratch);
+        return false;
+    }
+    numPieces = 0;
+    for (int i = 0; i < numContours; i++)
+    {
+        if (!contours[i].isHole)
+        {
+            numPieces += gatherCarvePiece(vitmap, contours, numContours, i, &pieces[numPieces]) ? 1 : 0;
+        }
+    }
+    tessDeleteTess(tess);
+
+    if (numPieces == 0)
+    {
+        resetVitmapArena(scratch);
+        removeShapeFromVitmap(vitmap, handle);
+        return true;
+    }
+    Shape* target = editShape(vitmap, handle);
+    if (target == NULL)
+    {
+        resetVitmapArena(scratch);
+        return false;
+    }
+    // The old points and mesh stay in the arena until carveVitmap compacts it
+    releaseSharedBlock(target->points);
+    target->points = pieces[0].points;
+    target->numPoints = pieces[0].numPoints;
+    target->pointCapacity = pieces[0].numPoints;
+    target->contourStarts = pieces[0].contourStarts;
+    target->numContours = pieces[0].numContours;
+    // The boundary never overlaps itself, so the odd rule fills it whatever the old rule was
+    target->windingRule = VITMAP_WINDING_ODD;
+    target->curves = NULL;
+    target->numCurves = 0;
+    target->pointGeneration++;
+    bool baked = target->mesh != NULL;
+    target->mesh = NULL;
+    // A stroke comes back with the rebake, without one it would outline the old points
+    target->stroke = baked ? target->stroke : NULL;
+    Shape piece = *target;
+
+    // Split off pieces go right above the original, in the same color and offset
+    int index = getShapeOrderIndex(vitmap, handle);
+    int numInserted = 1;
+    for (int i = 1; i < numPieces; i++)
+    {
+        ShapeHandle pieceHandle = addShapeToVitmap(vitmap);
+        if (!isShapeHandleValid(vitmap, pieceHandle))
+        {
+            break;
+        }
+        Shape* newShape = &vitmap->shapes[pieceHandle.slot];
+        *newShape = piece;
+        newShape->points = pieces[i].points;
+        newShape->numPoints = pieces[i].numPoints;
+        newShape->pointCapacity = pieces[i].numPoints;
+        newShape->contourStarts = pieces[i].contourStarts;
+        newShape->numContours = pieces[i].numContours;
+        newShape->pointGeneration = 0;
+        moveShapeInOrder(vitmap, vitmap->numShapes - 1, index + numInserted);
+        numInserted++;
+    }
+    resetVitmapArena(scratch);
+
+    // Only the pieces are tessellated again, every other mesh stays as it was
+    for (int i = 0; baked && i < numInserted; i++)
+    {
+        bakeShapeWithScratch(vitmap, &vitmap->shapes[vitmap->order[index + i]], options, stats, scratch, NULL);
+    }
+    return true;
+}
+
+// Returns true if the shape was cut or removed. The cut is in vitmap space.
+static bool carveShape(Vitmap* vitmap, ShapeHandle handle, const Vector2* worldCut, int numCut,
+    Vector2 worldMin, Vector2 worldMax, VitmapArena* scratch)
+{
+    const Shape* shape = getShape(vitmap, handle);
+    if (shape == NULL || shape->numPoints < 3)
+    {
+        return false;
+    }
+
+    // Curves are cut as the default bake flattens them, and come out as straight edges
+    const VitmapBakeOptions options = VITMAP_DEFAULT_BAKE_OPTIONS;
+    Vector2* points = shape->points;
+    int numPoints = shape->numPoints;
+    const int* starts = shape->contourStarts;
+    if (shape->numCurves > 0)
+    {
+        int* flattenedStarts = NULL;
+        numPoints = flattenShape(shape, getCurveTolerance(&options), scratch, &points, &flattenedStarts);
+        starts = flattenedStarts;
+        if (points == NULL) {
+            resetVitmapArena(scratch);
+            return false;
+        }
+    }
+
+    // Reject on bounds first, in the shape's own space
+    Vector2 offset = getShapeOffset(vitmap, shape);
+    Vector2 cutMin = {worldMin.x - offset.x, worldMin.y - offset.y};
+    Vector2 cutMax = {worldMax.x - offset.x, worldMax.y - offset.y};
+    Vector2 shapeMin = points[0];
+    Vector2 shapeMax = points[0];
+    if (shape->mesh != NULL && shape->mesh->numVertices > 0)
+    {
+        shapeMin = shape->mesh->boundsMin;
+        shapeMax = shape->mesh->boundsMax;
+    }
+    else
+    {
+        for (int i = 1; i < numPoints; i++)
+        {
+            shapeMin.x = fminf(shapeMin.x, points[i].x);
+            shapeMin.y = fminf(shapeMin.y, points[i].y);
+            shapeMax.x = fmaxf(shapeMax.x, points[i].x);
+            shapeMax.y = fmaxf(shapeMax.y, points[i].y);
+        }
+    }
+    if (shapeMax.x < cutMin.x || shapeMin.x > cutMax.x || shapeMax.y < cutMin.y || shapeMin.y > cutMax.y)
+    {
+        resetVitmapArena(scratch);
+        return false;
+    }
+
+    Vector2* cut = allocateFromVitmapArena(scratch, numCut * sizeof(Vector2));
+    if (cut == NULL) {
+        resetVitmapArena(scratch);
+        return false;
+    }
+    for (int i = 0; i < numCut; i++)
+    {
+        cut[i] = (Vector2){worldCut[i].x - offset.x, worldCut[i].y - offset.y};
+    }
+    bool touches = false;
+    for (int i = 0; i < shape->numContours && !touches; i++)
+    {
+        int start = i > 0 ? starts[i - 1] : 0;
+        int end = i + 1 < shape->numContours ? starts[i] : numPoints;
+        touches = end - start >= 3 && doesCutTouchContour(&points[start], end - start, cut, numCut, cutMin, cutMax);
+    }
+    if (!touches)
+    {
+        resetVitmapArena(scratch);
+        return false;
+    }
+
+    TESSalloc tessAlloc = {
+        allocateTessScratch, reallocateTessScratch, freeTessScratch, scratch,
+        512, 512, 256, 512, 256, 0
+    };
+    TESStesselator* tess = tessNewTess(&tessAlloc);
+    if (tess == NULL) {
+        resetVitmapArena(scratch);
+        return false;
+    }
+    // A single contour is its own boundary. Holes and the other winding rules
+    // are resolved into one first, so the boolean only has to know positive.
+    float shapeArea = 0.0f;
+    if (shape->numContours == 1 && shape->windingRule == VITMAP_WINDING_ODD)
+    {
+        shapeArea = getContourArea(points, numPoints);
+        tessAddContour(tess, 2, points, sizeof(Vector2), numPoints);
+    }
+    else
+    {
+        TESStesselator* fill = tessNewTess(&tessAlloc);
+        bool filled = fill != NULL;
+        if (filled)
+        {
+            addContoursToTess(fill, points, numPoints, starts, shape->numContours);
+            filled = tessTesselate(fill, tessWindingRules[shape->windingRule], TESS_BOUNDARY_CONTOURS, 3, 2,
+                getTessNormal(shape->windingRule));
+        }
+        const Vector2* vertices = filled ? (const Vector2*)tessGetVertices(fill) : NULL;
+        const TESSindex* elements = filled ? tessGetElements(fill) : NULL;
+        for (int i = 0; filled && i < tessGetElementCount(fill); i++)
+        {
+            shapeArea += getContourArea(&vertices[elements[i * 2]], elements[i * 2 + 1]);
+            tessAddContour(tess, 2, &vertices[elements[i * 2]], sizeof(Vector2), elements[i * 2 + 1]);
+        }
+        if (fill != NULL)
+        {
+            tessDeleteTess(fill);
+        }
+        if (!filled)
+        {
+            tessDeleteTess(tess);
+            resetVitmapArena(scratch);
+            return false;
+        }
+    }
+
+    // Wind the cut against the shape. Flipping the normal for a clockwise
+    // boundary makes it the positive one either way.
+    if ((shapeArea > 0.0f) == (getContourArea(cut, numCut) > 0.0f))
+    {
+        for (int i = 0, j = numCut - 1; i < j; i++, j--)
+        {
+            Vector2 swap = cut[i];
+            cut[i] = cut[j];
+            cut[j] = swap;
+        }
+    }
+    const TESSreal normal[3] = {0.0f, 0.0f, shapeArea > 0.0f ? 1.0f : -1.0f};
+    tessAddContour(tess, 2, cut, sizeof(Vector2), numCut);
+    if (!tessTesselate(tess, TESS_WINDING_POSITIVE, TESS_BOUNDARY_CONTOURS, 3, 2, normal))
+    {
+        tessDeleteTess(tess);
+        resetVitmapArena(scratch);
+        return false;
+    }
+    return replaceShapeWithBoundary(vitmap, handle, tess, &options, NULL, scratch);
+}
+
+int carveVitmap(Vitmap* vitmap, const Vector2* cut, int numCut)
+{
+    if (numCut < 3)
+    {
+        return 0;
+    }
+    VitmapArena* scratch = createVitmapArena(64 * 1024);
+    if (scratch == NULL) {
+        return 0;
+    }
+    VITMAP_SPAN_BEGIN(span, "carveVitmap");
+    Vector2 cutMin = cut[0];
+    Vector2 cutMax = cut[0];
+    for (int i = 1; i < numCut; i++)
+    {
+        cutMin.x = fminf(cutMin.x, cut[i].x);
+        cutMin.y = fminf(cutMin.y, cut[i].y);
+        cutMax.x = fmaxf(cutMax.x, cut[i].x);
+        cutMax.y = fmaxf(cutMax.y, cut[i].y);
+    }
+    // Top down, so pieces inserted above a shape and shapes that are removed
+    // only shift positions that were already visited
+    int numCarved = 0;
+    for (int i = vitmap->numShapes - 1; i >= 0; i--)
+    {
+        if (carveShape(vitmap, getShapeHandleAt(vitmap, i), cut, numCut, cutMin, cutMax, scratch))
+        {
+            numCarved++;
+        }
+    }
+    // Cuts leave the old points and meshes behind in the arena. Once they
+    // outweigh what is still in use, copying the rest out keeps memory
+    // bounded however long the terrain takes damage, at a cost that averages
+    // out to a constant per byte cut.
+    VitmapArena* arena = vitmap->arena;
+    if (numCarved > 0 && vitmap->ownsArena && arena != NULL
+        && arena->bytesReserved > 2 * getVitmapLiveBytes(vitmap) + arena->chunkSize)
+    {
+        compactVitmap(vitmap);
+    }
+    VITMAP_SPAN_END(span);
+    destroyVitmapArena(scratch);
+    VITMAP_DEBUG("Carved %d shapes", numCarved);
+    return numCarved;
+}
+
+int carveVitmapCircle(Vitmap* vitmap, Vector2 center, float radius)
+{
+    // Enough segments to keep the edge within a quarter unit of the true circle
+    int segments = CARVE_MIN_CIRCLE_SEGMENTS;
+    if (radius > 0.25f)
+    {
+        segments = (int)ceilf(PI / acosf(1.0f - 0.25f / radius));
+    }
+    segments = segments < CARVE_MIN_CIRCLE_SEGMENTS ? CARVE_MIN_CIRCLE_SEGMENTS : segments;
+    segments = segments > CARVE_MAX_CIRCLE_SEGMENTS ? CARVE_MAX_CIRCLE_SEGMENTS : segments;
+    Vector2 points[CARVE_MAX_CIRCLE_SEGMENTS];
+    for (int i = 0; i < segments; i++)
+    {
+        float angle = 2.0f * PI * i / segments;
+        points[i] = (Vector2){center.x + cosf(angle) * radius, center.y + sinf(angle) * radius};
+    }
+    return carveVitmap(vitmap, points, segments);
+}
+
+// Cleanup
+
+static void cleanShape(Vitmap* vitmap, ShapeHandle handle, const VitmapBakeOptions* options, VitmapBakeStats* stats,
+    VitmapArena* scratch)
+{
+    const Shape* shape = getShape(vitmap, handle);
+    if (shape == NULL)
+    {
+        return;
+    }
+    VitmapWindingRule windingRule = shape->windingRule;
+    bool curved = shape->numCurves > 0;
+    Vector2* points = NULL;
+    int* starts = NULL;
+    int numContours = 0;
+    int before = 0;
+    int count = cleanShapeContours(shape, options, scratch, &points, &starts, &numContours, &before);
+    int trianglesBefore = getPolygonTriangleCount(before, shape->numContours);
+    if (points == NULL || starts == NULL) {
+        resetVitmapArena(scratch);
+        return;
+    }
+    bool crossing = numContours > 0 && hasSelfIntersection(points, count, starts, numContours);
+    // Holes add to the area instead of taking from it, so only shapes with every contour tiny go
+    float area = 0.0f;
+    for (int i = 0; i < numContours; i++)
+    {
+        int start = i > 0 ? starts[i - 1] : 0;
+        int end = i + 1 < numContours ? starts[i] : count;
+        area += fabsf(getContourArea(&points[start], end - start));
+    }
+    if (numContours == 0 || (!crossing && area * 0.5f <= options->minArea))
+    {
+        resetVitmapArena(scratch);
+        removeShapeFromVitmap(vitmap, handle);
+        addBakeStats(stats, before, trianglesBefore, 1, 0);
+        return;
+    }
+
+    if (crossing && options->resolveSelfIntersections)
+    {
+        TESSalloc tessAlloc = {
+            allocateTessScratch, reallocateTessScratch, freeTessScratch, scratch,
+            512, 512, 256, 512, 256, 0
+        };
+        TESStesselator* tess = tessNewTess(&tessAlloc);
+        if (tess == NULL) {
+            resetVitmapArena(scratch);
+            return;
+        }
+        // The shape's own rule is the one baking fills with, so the pieces look the same
+        addContoursToTess(tess, points, count, starts, numContours);
+        if (!tessTesselate(tess, tessWindingRules[windingRule], TESS_BOUNDARY_CONTOURS, 3, 2, getTessNormal(windingRule)))
+        {
+            tessDeleteTess(tess);
+            resetVitmapArena(scratch);
+            return;
+        }
+        int index = getShapeOrderIndex(vitmap, handle);
+        int numShapes = vitmap->numShapes;
+        if (!replaceShapeWithBoundary(vitmap, handle, tess, options, NULL, scratch))
+        {
+            return;
+        }
+        int numPieces = vitmap->numShapes - numShapes + 1;
+        int after = 0;
+        for (int i = 0; i < numPieces; i++)
+        {
+            const Shape* piece = getVitmapShape(vitmap, index + i);
+            after += getPolygonTriangleCount(piece->numPoints, piece->numContours);
+        }
+        addBakeStats(stats, 0, trianglesBefore - after, 0, 1);
+        return;
+    }
+
+    // Curved shapes keep their points, the cleanup of their flattened copy is redone at every bake
+    if (!curved && count < before)
+    {
+        Shape* target = editShape(vitmap, handle);
+        if (target == NULL || !unshareShapePoints(vitmap, target))
+        {
+            resetVitmapArena(scratch);
+            return;
+        }
+        int* contourStarts = NULL;
+        if (numContours > 1)
+        {
+            contourStarts = allocateFromVitmapArena(getVitmapArena(vitmap), (numContours - 1) * sizeof(int));
+            if (contourStarts == NULL) {
+                resetVitmapArena(scratch);
+                return;
+            }
+            memcpy(contourStarts, starts, (numContours - 1) * sizeof(int));
+        }
+        memcpy(target->points, points, count * sizeof(Vector2));
+        target->numPoints = count;
+        target->contourStarts = contourStarts;
+        target->numContours = numContours;
+        target->pointGeneration++;
+        if (target->mesh != NULL)
+        {
+            resetVitmapArena(scratch);
+            bakeShapeWithScratch(vitmap, target, options, NULL, scratch, NULL);
+        }
+        addBakeStats(stats, before - count, trianglesBefore - getPolygonTriangleCount(count, numContours), 0, 0);
+    }
+    resetVitmapArena(scratch);
+}
+
+void cleanVitmap(Vitmap* vitmap, const VitmapBakeOptions* options, VitmapBakeStats* statsOut)
+{
+    if (!unshareShapeTable(vitmap) || getVitmapArena(vitmap) == NULL)
+    {
+        return;
+    }
+    VitmapArena* scratch = createVitmapArena(64 * 1024);
+    if (scratch == NULL) {
+        return;
+    }
+    VITMAP_SPAN_BEGIN(span, "cleanVitmap");
+    // Top down, so pieces inserted above a shape and shapes removed never shift the ones still to do
+    for (int i = vitmap->numShapes - 1; i >= 0; i--)
+    {
+        cleanShape(vitmap, getShapeHandleAt(vitmap, i), options, statsOut, scratch);
+    }
+    VITMAP_SPAN_END(span);
+    destroyVitmapArena(scratch);
+}
@@ -0,0 +1,178 @@
+#include <stdlib.h>
+#include <string.h>
+#include "include/vitmap_arena.h"
+
+#define ARENA_ALIGNMENT 16
+
+struct VitmapArenaChunk
+{
+    VitmapArenaChunk* next;
+    size_t size;
+    size_t used;
+    // Padding keeps the data that follows aligned
+    size_t padding;
+};
+
+static size_t alignArenaSize(size_t size)
+{
+    return (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+static unsigned char* getChunkData(VitmapArenaChunk* chunk)
+{
+    return (unsigned char*)(chunk + 1);
+}
+
+static VitmapArenaChunk* createArenaChunk(VitmapArena* arena, size_t size)
+{
+    VitmapArenaChunk* chunk = malloc(sizeof(VitmapArenaChunk) + size);
+    if (chunk == NULL) {
+        return NULL;
+    }
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+    arena->bytesReserved += size;
+    return chunk;
+}
+
+VitmapArena* createVitmapArena(size_t chunkSize)
+{
+    VitmapArena* arena = malloc(sizeof *arena);
+    if (arena == NULL) {
+        return NULL;
+    }
+    arena->head = NULL;
+    arena->chunkSize = chunkSize > 0 ? alignArenaSize(chunkSize) : VITMAP_ARENA_DEFAULT_CHUNK_SIZE;
+    arena->bytesReserved = 0;
+    return arena;
+}
+
+void destroyVitmapArena(VitmapArena* arena)
+{
+    if (arena == NULL)
+    {
+        return;
+    }
+    VitmapArenaChunk* chunk = arena->head;
+    while (chunk != NULL)
+    {
+        VitmapArenaChunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(arena);
+}
+
+// Drops every allocation but keeps the head chunk around for reuse
+void resetVitmapArena(VitmapArena* arena)
+{
+    if (arena->head == NULL)
+    {
+        return;
+    }
+    VitmapArenaChunk* chunk = arena->head->next;
+    while (chunk != NULL)
+    {
+        VitmapArenaChunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena->head->next = NULL;
+    arena->head->used = 0;
+    arena->bytesReserved = arena->head->size;
+}
+
+void* allocateFromVitmapArena(VitmapArena* arena, size_t size)
+{
+    size = alignArenaSize(size > 0 ? size : 1);
+    VitmapArenaChunk* head = arena->head;
+    if (head != NULL && head->size - head->used >= size)
+    {
+        void* allocation = getChunkData(head) + head->used;
+        head->used += size;
+        return allocation;
+    }
+
+    if (size > arena->chunkSize / 2 && head != NULL)
+    {
+        // Oversized requests get a chunk of their own behind the head, so the
+        // space left in the head chunk stays usable for small allocations
+        VitmapArenaChunk* chunk = createArenaChunk(arena, size);
+        if (chunk == NULL) {
+            return NULL;
+        }
+        chunk->used = size;
+        chunk->next = head->next;
+        head->next = chunk;
+        return getChunkData(chunk);
+    }
+
+    VitmapArenaChunk* chunk = createArenaChunk(arena, size > arena->chunkSize ? size : arena->chunkSize);
+    if (chunk == NULL) {
+        return NULL;
+    }
+    chunk->next = head;
+    arena->head = chunk;
+    chunk->used = size;
+    return getChunkData(chunk);
+}
+
+// Grows in place when the allocation is the last one made from the head chunk,
+// otherwise moves it. The old block is not reclaimed until the arena is.
+void* growVitmapArenaAllocation(VitmapArena* arena, void* allocation, size_t oldSize, size_t newSize)
+{
+    if (allocation == NULL)
+    {
+        return allocateFromVitmapArena(arena, newSize);
+    }
+    if (newSize <= oldSize)
+    {
+        return allocation;
+    }
+    VitmapArenaChunk* head = arena->head;
+    size_t alignedOld = alignArenaSize(oldSize > 0 ? oldSize : 1);
+    size_t alignedNew = alignArenaSize(newSize);
+    if (head != NULL
+        && (unsigned char*)allocation + alignedOld == getChunkData(head) + head->used
+        && head->size - head->used >= alignedNew - alignedOld)
+    {
+        head->used += alignedNew - alignedOld;
+        return allocation;
+    }
+    void* moved = allocateFromVitmapArena(arena, newSize);
+    if (moved != NULL)
+    {
+        memcpy(moved, allocation, oldSize);
+    }
+    return moved;
+}
+
+// Moves all of other's chunks into arena and frees other, so one destroy call
+// covers both. Only other's chunk list is walked, to find its tail.
+void adoptVitmapArena(VitmapArena* arena, VitmapArena* other)
+{
+    if (other == NULL || other == arena)
+    {
+        return;
+    }
+    if (other->head != NULL)
+    {
+        VitmapArenaChunk* tail = other->head;
+        while (tail->next != NULL)
+        {
+            tail = tail->next;
+        }
+        if (arena->head == NULL)
+        {
+            arena->head = other->head;
+        }
+        else
+        {
+            tail->next = arena->head->next;
+            arena->head->next = other->head;
+        }
+    }
+    arena->bytesReserved += other->bytesReserved;
+    free(other);
+}
@@ -0,0 +1,457 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "include/vitmap_assets.h"
+#include "include/vitmap_jobs.h"
+#include "include/vitmap_log.h"
+#include "include/vitmap_platform.h"
+#include "include/vitmap_trace.h"
+
+#define ASSET_PATH_SIZE 1024
+
+typedef enum AssetKind
+{
+    ASSET_VITMAP,
+    ASSET_ANIMATION
+} AssetKind;
+
+typedef struct Asset Asset;
+struct Asset
+{
+    Vitmap vitmap;              // Handed out, releases find the asset from them
+    VitmapAnimation animation;
+    AssetKind kind;
+    unsigned int hash;
+    long long modified;         // File time and size when it was loaded
+    long long fileSize;
+    size_t bytes;
+    int references;
+    bool loading;               // Others asking for it wait until the first one has loaded it
+    bool failed;
+    bool stale;                 // Replaced after the file changed, unloaded on its last release
+    Asset* newer;               // In the unused list, or the stale list while still held
+    Asset* older;
+    char path[];
+};
+
+typedef struct AssetList
+{
+    Asset* newest;
+    Asset* oldest;
+} AssetList;
+
+struct VitmapAssetCache
+{
+    Asset** table;              // Open addressed by path, a power of two and at most half full
+    int numEntries;
+    int capacity;
+    AssetList unused;           // Loaded but not held, the oldest goes first when over budget
+    AssetList stale;
+    size_t unusedBudget;
+    VitmapAssetStats stats;
+    VitmapMutex lock;
+    VitmapCondition loaded;
+};
+
+// FNV-1a over the path and the kind, so a file can be loaded as either
+static unsigned int hashAssetKey(const char* path, AssetKind kind)
+{
+    unsigned int hash = 2166136261u;
+    for (const char* c = path; *c != '\0'; c++)
+    {
+        hash = (hash ^ (unsigned char)*c) * 16777619u;
+    }
+    return (hash ^ (unsigned int)kind) * 16777619u;
+}
+
+static void linkAsset(AssetList* list, Asset* asset)
+{
+    asset->older = list->newest;
+    asset->newer = NULL;
+    if (list->newest != NULL)
+    {
+        list->newest->newer = asset;
+    }
+    list->newest = asset;
+    if (list->oldest == NULL)
+    {
+        list->oldest = asset;
+    }
+}
+
+static void unlinkAsset(AssetList* list, Asset* asset)
+{
+    if (asset->newer != NULL)
+    {
+        asset->newer->older = asset->older;
+    }
+    else
+    {
+        list->newest = asset->older;
+    }
+    if (asset->older != NULL)
+    {
+        asset->older->newer = asset->newer;
+    }
+    else
+    {
+        list->oldest = asset->newer;
+    }
+    asset->newer = NULL;
+    asset->older = NULL;
+}
+
+static Asset* findAsset(VitmapAssetCache* cache, const char* path, AssetKind kind, unsigned int hash)
+{
+    unsigned int mask = (unsigned int)cache->capacity - 1;
+    for (unsigned int i = hash & mask; cache->capacity > 0 && cache->table[i] != NULL; i = (i + 1) & mask)
+    {
+        Asset* asset = cache->table[i];
+        if (asset->hash == hash && asset->kind == kind && strcmp(asset->path, path) == 0)
+        {
+            return asset;
+        }
+    }
+    return NULL;
+}
+
+static bool insertAsset(VitmapAssetCache* cache, Asset* asset)
+{
+    if ((cache->numEntries + 1) * 2 > cache->capacity)
+    {
+        int oldCapacity = cache->capacity;
+        Asset** old = cache->table;
+        int newCapacity = oldCapacity > 0 ? oldCapacity * 2 : 64;
+        Asset** table = calloc(newCapacity, sizeof(Asset*));
+        if (table == NULL) {
+            return false;
+        }
+        cache->table = table;
+        cache->capacity = newCapacity;
+        cache->numEntries = 0;
+        for (int i = 0; i < oldCapacity; i++)
+        {
+            if (old[i] != NULL)
+            {
+                insertAsset(cache, old[i]);
+            }
+        }
+        free(old);
+    }
+    unsigned int mask = (unsigned int)cache->capacity - 1;
+    unsigned int i = asset->hash & mask;
+    while (cache->table[i] != NULL)
+    {
+        i = (i + 1) & mask;
+    }
+    cache->table[i] = asset;
+    cache->numEntries++;
+    return true;
+}
+
+// Shifts the entries after the removed one back, so no probe sequence is cut short
+static void removeAsset(VitmapAssetCache* cache, Asset* asset)
+{
+    unsigned int mask = (unsigned int)cache->capacity - 1;
+    unsigned int hole = asset->hash & mask;
+    while (cache->table[hole] != asset)
+    {
+        hole = (hole + 1) & mask;
+    }
+    for (unsigned int i = (hole + 1) & mask; cache->table[i] != NULL; i = (i + 1) & mask)
+    {
+        unsigned int home = cache->table[i]->hash & mask;
+        if (((i - home) & mask) >= ((i - hole) & mask))
+        {
+            cache->table[hole] = cache->table[i];
+            hole = i;
+        }
+    }
+    cache->table[hole] = NULL;
+    cache->numEntries--;
+}
+
+static void unloadAsset(VitmapAssetCache* cache, Asset* asset)
+{
+    if (!asset->failed)
+    {
+        cache->stats.numAssets--;
+        cache->stats.bytes -= asset->bytes;
+    }
+    unloadVitmap(&asset->vitmap);
+    unloadAnimation(&asset->animation);
+    free(asset);
+}
+
+static void trimUnusedAssets(VitmapAssetCache* cache)
+{
+    while (cache->stats.unusedBytes > cache->unusedBudget && cache->unused.oldest != NULL)
+    {
+        Asset* asset = cache->unused.oldest;
+        unlinkAsset(&cache->unused, asset);
+        removeAsset(cache, asset);
+        cache->stats.unusedBytes -= asset->bytes;
+        cache->stats.evictions++;
+        unloadAsset(cache, asset);
+    }
+}
+
+static void releaseAssetLocked(VitmapAssetCache* cache, Asset* asset)
+{
+    if (--asset->references > 0)
+    {
+        return;
+    }
+    if (asset->stale)
+    {
+        unlinkAsset(&cache->stale, asset);
+        unloadAsset(cache, asset);
+    }
+    else if (asset->failed)
+    {
+        unloadAsset(cache, asset);
+    }
+    else
+    {
+        linkAsset(&cache->unused, asset);
+        cache->stats.unusedBytes += asset->bytes;
+        trimUnusedAssets(cache);
+    }
+}
+
+// Runs without the lock, nothing else touches the asset until loading is cleared.
+// Decoding and baking stay on this thread, because a job it picked up while
+// waiting could acquire this same asset and wait on it forever.
+static bool loadAsset(Asset* asset)
+{
+    VITMAP_SPAN_BEGIN(span, "loadAsset");
+    beginVitmapJobsInline();
+    const char* error = "cannot read file";
+    int size = 0;
+    unsigned char* data = loadVitmapFileData(asset->path, &size);
+    bool ok = data != NULL;
+    if (asset->kind == ASSET_VITMAP)
+    {
+        ok = ok && decodeVitmap(data, size, &asset->vitmap, &error);
+        if (ok)
+        {
+            bakeVitmap(&asset->vitmap);
+            asset->bytes = asset->vitmap.arena->bytesReserved;
+        }
+    }
+    else
+    {
+        ok = ok && decodeAnimation(data, size, &asset->animation, &error);
+        for (int i = 0; ok && i < asset->animation.numFrames; i++)
+        {
+            bakeVitmap(&asset->animation.frames[i]);
+        }
+        if (ok)
+        {
+            asset->bytes = asset->animation.arena->bytesReserved;
+        }
+    }
+    if (!ok)
+    {
+        VITMAP_ERROR("Failed to load %s: %s", asset->path, error);
+    }
+    free(data);
+    endVitmapJobsInline();
+    VITMAP_SPAN_END(span);
+    return ok;
+}
+
+static Asset* acquireAsset(VitmapAssetCache* cache, const char* path, AssetKind kind)
+{
+    char fullPath[ASSET_PATH_SIZE];
+    long long modified = 0;
+    long long fileSize = 0;
+    if (!getVitmapFullPath(path, fullPath, sizeof fullPath) || !getVitmapFileInfo(fullPath, &modified, &fileSize))
+    {
+        VITMAP_ERROR("Failed to open %s for reading.", path);
+        return NULL;
+    }
+    unsigned int hash = hashAssetKey(fullPath, kind);
+
+    lockVitmapMutex(&cache->lock);
+    Asset* asset = findAsset(cache, fullPath, kind, hash);
+    if (asset != NULL && !asset->loading && (asset->modified != modified || asset->fileSize != fileSize))
+    {
+        // Changed on disk. Whoever holds the old one keeps it until they let go.
+        removeAsset(cache, asset);
+        asset->stale = true;
+        if (asset->references > 0)
+        {
+            linkAsset(&cache->stale, asset);
+        }
+        else
+        {
+            unlinkAsset(&cache->unused, asset);
+            cache->stats.unusedBytes -= asset->bytes;
+            unloadAsset(cache, asset);
+        }
+        asset = NULL;
+    }
+    if (asset != NULL)
+    {
+        if (asset->references == 0)
+        {
+            unlinkAsset(&cache->unused, asset);
+            cache->stats.unusedBytes -= asset->bytes;
+        }
+        asset->references++;
+        cache->stats.hits++;
+        while (asset->loading)
+        {
+            waitVitmapCondition(&cache->loaded, &cache->lock);
+        }
+        if (asset->failed)
+        {
+            releaseAssetLocked(cache, asset);
+            asset = NULL;
+        }
+        unlockVitmapMutex(&cache->lock);
+        return asset;
+    }
+
+    size_t pathSize = strlen(fullPath) + 1;
+    asset = calloc(1, sizeof(Asset) + pathSize);
+    if (asset != NULL)
+    {
+        initVitmap(&asset->vitmap);
+        initVitmapAnimation(&asset->animation);
+        asset->kind = kind;
+        asset->hash = hash;
+        asset->modified = modified;
+        asset->fileSize = fileSize;
+        asset->references = 1;
+        asset->loading = true;
+        memcpy(asset->path, fullPath, pathSize);
+    }
+    if (asset == NULL || !insertAsset(cache, asset))
+    {
+        free(asset);
+        unlockVitmapMutex(&cache->lock);
+        VITMAP_ERROR("Out of memory loading %s.", path);
+        return NULL;
+    }
+    cache->stats.misses++;
+    unlockVitmapMutex(&cache->lock);
+
+    bool ok = loadAsset(asset);
+
+    lockVitmapMutex(&cache->lock);
+    asset->loading = false;
+    if (ok)
+    {
+        cache->stats.numAssets++;
+        cache->stats.bytes += asset->bytes;
+    }
+    else
+    {
+        // Out of the table so the next acquire tries again
+        asset->failed = true;
+        removeAsset(cache, asset);
+        releaseAssetLocked(cache, asset);
+        asset = NULL;
+    }
+    broadcastVitmapCondition(&cache->loaded);
+    unlockVitmapMutex(&cache->lock);
+    return asset;
+}
+
+VitmapAssetCache* createVitmapAssetCache(size_t unusedBudget)
+{
+    VitmapAssetCache* cache = calloc(1, sizeof *cache);
+    if (cache == NULL) {
+        return NULL;
+    }
+    if (!initVitmapMutex(&cache->lock))
+    {
+        free(cache);
+        return NULL;
+    }
+    if (!initVitmapCondition(&cache->loaded))
+    {
+        destroyVitmapMutex(&cache->lock);
+        free(cache);
+        return NULL;
+    }
+    cache->unusedBudget = unusedBudget;
+    return cache;
+}
+
+void destroyVitmapAssetCache(VitmapAssetCache* cache)
+{
+    if (cache == NULL)
+    {
+        return;
+    }
+    for (int i = 0; i < cache->capacity; i++)
+    {
+        if (cache->table[i] != NULL)
+        {
+            unloadAsset(cache, cache->table[i]);
+        }
+    }
+    while (cache->stale.oldest != NULL)
+    {
+        Asset* asset = cache->stale.oldest;
+        unlinkAsset(&cache->stale, asset);
+        unloadAsset(cache, asset);
+    }
+    free(cache->table);
+    destroyVitmapCondition(&cache->loaded);
+    destroyVitmapMutex(&cache->lock);
+    free(cache);
+}
+
+void setVitmapAssetBudget(VitmapAssetCache* cache, size_t unusedBudget)
+{
+    lockVitmapMutex(&cache->lock);
+    cache->unusedBudget = unusedBudget;
+    trimUnusedAssets(cache);
+    unlockVitmapMutex(&cache->lock);
+}
+
+VitmapAssetStats getVitmapAssetStats(VitmapAssetCache* cache)
+{
+    lockVitmapMutex(&cache->lock);
+    VitmapAssetStats stats = cache->stats;
+    unlockVitmapMutex(&cache->lock);
+    return stats;
+}
+
+Vitmap* acquireVitmapAsset(VitmapAssetCache* cache, const char* path)
+{
+    Asset* asset = acquireAsset(cache, path, ASSET_VITMAP);
+    return asset != NULL ? &asset->vitmap : NULL;
+}
+
+VitmapAnimation* acquireAnimationAsset(VitmapAssetCache* cache, const char* path)
+{
+    Asset* asset = acquireAsset(cache, path, ASSET_ANIMATION);
+    return asset != NULL ? &asset->animation : NULL;
+}
+
+void releaseVitmapAsset(VitmapAssetCache* cache, Vitmap* vitmap)
+{
+    if (vitmap == NULL)
+    {
+        return;
+    }
+    lockVitmapMutex(&cache->lock);
+    releaseAssetLocked(cache, (Asset*)((char*)vitmap - offsetof(Asset, vitmap)));
+    unlockVitmapMutex(&cache->lock);
+}
+
+void releaseAnimationAsset(VitmapAssetCache* cache, VitmapAnimation* animation)
+{
+    if (animation == NULL)
+    {
+        return;
+    }
+    lockVitmapMutex(&cache->lock);
+    releaseAssetLocked(cache, (Asset*)((char*)animation - offsetof(Asset, animation)));
+    unlockVitmapMutex(&cache->lock);
+}
@@ -0,0 +1,209 @@
+#include <stdlib.h>
+#include <string.h>
+#include "include/vitmap_bake.h"
+#include "include/vitmap_platform.h"
+#include "include/vitmap_trace.h"
+
+// Starting guess for the cost of a bake, refined as shapes are baked
+#define BAKE_INITIAL_SECONDS_PER_POINT 0.0000005
+#define BAKE_SECONDS_PER_SHAPE 0.000005
+
+VitmapBakeQueue createVitmapBakeQueue()
+{
+    VitmapBakeQueue queue = {NULL, 0, 0, 0, NULL, 0, 0, BAKE_INITIAL_SECONDS_PER_POINT};
+    return queue;
+}
+
+void unloadVitmapBakeQueue(VitmapBakeQueue* queue)
+{
+    free(queue->requests);
+    free(queue->queued);
+    *queue = createVitmapBakeQueue();
+}
+
+static unsigned int hashBakeRequest(const Vitmap* vitmap, ShapeHandle shape)
+{
+    size_t key = (size_t)vitmap ^ ((size_t)shape.slot * 0x9e3779b9u) ^ ((size_t)shape.generation << 16);
+    key ^= key >> 15;
+    key *= 0x2c1b3c6du;
+    return (unsigned int)(key ^ (key >> 13));
+}
+
+// Linear probing, the capacity is a power of two and at most half full
+static bool insertQueuedBake(VitmapBakeQueue* queue, Vitmap* vitmap, ShapeHandle shape)
+{
+    unsigned int mask = (unsigned int)queue->queuedCapacity - 1;
+    for (unsigned int i = hashBakeRequest(vitmap, shape) & mask;; i = (i + 1) & mask)
+    {
+        VitmapBakeRequest* entry = &queue->queued[i];
+        if (entry->vitmap == NULL)
+        {
+            *entry = (VitmapBakeRequest){vitmap, shape};
+            queue->numQueued++;
+            return true;
+        }
+        if (entry->vitmap == vitmap && entry->shape.slot == shape.slot && entry->shape.generation == shape.generation)
+        {
+            return false;
+        }
+    }
+}
+
+static bool growQueuedBakes(VitmapBakeQueue* queue)
+{
+    if ((queue->numQueued + 1) * 2 <= queue->queuedCapacity)
+    {
+        return true;
+    }
+    int oldCapacity = queue->queuedCapacity;
+    VitmapBakeRequest* old = queue->queued;
+    int newCapacity = oldCapacity > 0 ? oldCapacity * 2 : 64;
+    VitmapBakeRequest* queued = calloc(newCapacity, sizeof(VitmapBakeRequest));
+    if (queued == NULL) {
+        return false;
+    }
+    queue->queued = queued;
+    queue->queuedCapacity = newCapacity;
+    queue->numQueued = 0;
+    for (int i = 0; i < oldCapacity; i++)
+    {
+        if (old[i].vitmap != NULL)
+        {
+            insertQueuedBake(queue, old[i].vitmap, old[i].shape);
+        }
+    }
+    free(old);
+    return true;
+}
+
+static bool growBakeRequests(VitmapBakeQueue* queue)
+{
+    if (queue->count < queue->capacity)
+    {
+        return true;
+    }
+    int newCapacity = queue->capacity > 0 ? queue->capacity * 2 : 64;
+    VitmapBakeRequest* requests = malloc(newCapacity * sizeof(VitmapBakeRequest));
+    if (requests == NULL) {
+        return false;
+    }
+    // Unwrap the ring so the oldest request is first again
+    for (int i = 0; i < queue->count; i++)
+    {
+        requests[i] = queue->requests[(queue->head + i) % queue->capacity];
+    }
+    free(queue->requests);
+    queue->requests = requests;
+    queue->capacity = newCapacity;
+    queue->head = 0;
+    return true;
+}
+
+bool queueShapeBake(VitmapBakeQueue* queue, Vitmap* vitmap, ShapeHandle shape)
+{
+    const Shape* target = getShape(vitmap, shape);
+    if (target == NULL || target->mesh != NULL || !growQueuedBakes(queue) || !growBakeRequests(queue))
+    {
+        return false;
+    }
+    if (!insertQueuedBake(queue, vitmap, shape))
+    {
+        return false;
+    }
+    queue->requests[(queue->head + queue->count) % queue->capacity] = (VitmapBakeRequest){vitmap, shape};
+    queue->count++;
+    return true;
+}
+
+int queueVitmapBake(VitmapBakeQueue* queue, Vitmap* vitmap)
+{
+    int numQueued = 0;
+    for (int i = 0; i < vitmap->numShapes; i++)
+    {
+        if (queueShapeBake(queue, vitmap, getShapeHandleAt(vitmap, i)))
+        {
+            numQueued++;
+        }
+    }
+    return numQueued;
+}
+
+void cancelVitmapBakes(VitmapBakeQueue* queue, const Vitmap* vitmap)
+{
+    // Compact the ring and rebuild the set from what is left
+    int kept = 0;
+    for (int i = 0; i < queue->count; i++)
+    {
+        VitmapBakeRequest request = queue->requests[(queue->head + i) % queue->capacity];
+        if (request.vitmap != vitmap)
+        {
+            queue->requests[(queue->head + kept) % queue->capacity] = request;
+            kept++;
+        }
+    }
+    queue->count = kept;
+    if (queue->queued != NULL)
+    {
+        memset(queue->queued, 0, queue->queuedCapacity * sizeof(VitmapBakeRequest));
+    }
+    queue->numQueued = 0;
+    for (int i = 0; i < queue->count; i++)
+    {
+        VitmapBakeRequest request = queue->requests[(queue->head + i) % queue->capacity];
+        insertQueuedBake(queue, request.vitmap, request.shape);
+    }
+}
+
+int processVitmapBakeQueue(VitmapBakeQueue* queue, double budgetSeconds)
+{
+    VITMAP_SPAN_BEGIN(span, "processVitmapBakeQueue");
+    double start = getVitmapTime();
+    int numBaked = 0;
+    while (queue->count > 0)
+    {
+        VitmapBakeRequest request = queue->requests[queue->head];
+        const Shape* shape = getShape(request.vitmap, request.shape);
+        // Removed or baked some other way since it was queued
+        if (shape != NULL && shape->mesh == NULL)
+        {
+            double predicted = BAKE_SECONDS_PER_SHAPE + shape->numPoints * queue->secondsPerPoint;
+            double elapsed = getVitmapTime() - start;
+            if (elapsed + predicted > budgetSeconds && (numBaked > 0 || predicted <= budgetSeconds))
+            {
+                break;
+            }
+            int numPoints = shape->numPoints > 0 ? shape->numPoints : 1;
+            double bakeStart = getVitmapTime();
+            bakeShape(request.vitmap, request.shape);
+            double taken = getVitmapTime() - bakeStart;
+            // Quick to learn that bakes got slower, slow to trust that they got faster
+            double secondsPerPoint = taken / numPoints;
+            if (secondsPerPoint > queue->secondsPerPoint)
+            {
+                queue->secondsPerPoint = secondsPerPoint;
+            }
+            else
+            {
+                queue->secondsPerPoint = queue->secondsPerPoint * 0.9 + secondsPerPoint * 0.1;
+            }
+            numBaked++;
+            if (predicted > budgetSeconds)
+            {
+                queue->head = (queue->head + 1) % queue->capacity;
+                queue->count--;
+                break;
+            }
+        }
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
+    }
+    // Nothing is waiting, so the set can start over
+    if (queue->count == 0 && queue->numQueued > 0)
+    {
+        memset(queue->queued, 0, queue->queuedCapacity * sizeof(VitmapBakeRequest));
+        queue->numQueued = 0;
+        queue->head = 0;
+    }
+    VITMAP_SPAN_END(span);
+    return numBaked;
+}
@@ -0,0 +1,418 @@
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "include/vitmap_bake_cache.h"
+#include "include/vitmap_log.h"
+#include "include/vitmap_platform.h"
+
+#define BAKE_CACHE_PATH_SIZE 1024
+#define BAKE_CACHE_NAME_SIZE 64         // Room left in a path for the file name
+#define BAKE_CACHE_EXTENSION ".vbk"
+
+static const char bakeCacheMagic[4] = {'V', 'B', 'K', 'E'};
+
+// Written in front of the data, in this machine's byte order since the files never leave it
+typedef struct BakeCacheHeader
+{
+    char magic[4];
+    int version;
+    unsigned long long key;
+    int numPoints;          // The input points and contour starts follow, to rule out hash collisions
+    int numContours;
+    int windingRule;
+    int numVertices;
+    int numIndices;
+} BakeCacheHeader;
+
+typedef struct BakeCacheEntry
+{
+    unsigned long long key;     // 0 marks a free slot
+    size_t size;
+    unsigned long long lastUse;
+} BakeCacheEntry;
+
+typedef struct BakeCache
+{
+    bool isOpen;
+    char directory[BAKE_CACHE_PATH_SIZE - BAKE_CACHE_NAME_SIZE];
+    size_t maxBytes;
+    BakeCacheEntry* entries;    // Open addressed by key, a power of two and at most half full
+    int numEntries;
+    int capacity;
+    unsigned long long useCounter;
+    unsigned int tempCounter;
+    VitmapBakeCacheStats stats;
+    VitmapMutex lock;
+} BakeCache;
+
+static BakeCache bakeCache;
+
+// 64 bit FNV-1a
+static unsigned long long hashBakeBytes(unsigned long long hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static unsigned long long hashBakeInput(const Vector2* points, int numPoints, const int* contourStarts, int numContours,
+    VitmapWindingRule windingRule, float minArea)
+{
+    int version = VITMAP_BAKE_CACHE_VERSION;
+    int rule = windingRule;
+    unsigned long long hash = 14695981039346656037ULL;
+    hash = hashBakeBytes(hash, &version, sizeof version);
+    hash = hashBakeBytes(hash, &rule, sizeof rule);
+    hash = hashBakeBytes(hash, &minArea, sizeof minArea);
+    hash = hashBakeBytes(hash, &numPoints, sizeof numPoints);
+    hash = hashBakeBytes(hash, points, numPoints * sizeof(Vector2));
+    hash = hashBakeBytes(hash, &numContours, sizeof numContours);
+    hash = hashBakeBytes(hash, contourStarts, (numContours - 1) * sizeof(int));
+    return hash != 0 ? hash : 1;
+}
+
+static void getBakeCachePath(char* path, unsigned long long key)
+{
+    snprintf(path, BAKE_CACHE_PATH_SIZE, "%s/%016llx" BAKE_CACHE_EXTENSION, bakeCache.directory, key);
+}
+
+static BakeCacheEntry* findBakeCacheEntry(unsigned long long key)
+{
+    unsigned int mask = (unsigned int)bakeCache.capacity - 1;
+    for (unsigned int i = (unsigned int)key & mask; bakeCache.capacity > 0; i = (i + 1) & mask)
+    {
+        if (bakeCache.entries[i].key == key)
+        {
+            return &bakeCache.entries[i];
+        }
+        if (bakeCache.entries[i].key == 0)
+        {
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+static bool insertBakeCacheEntry(BakeCacheEntry entry)
+{
+    if ((bakeCache.numEntries + 1) * 2 > bakeCache.capacity)
+    {
+        int oldCapacity = bakeCache.capacity;
+        BakeCacheEntry* old = bakeCache.entries;
+        int newCapacity = oldCapacity > 0 ? oldCapacity * 2 : 256;
+        BakeCacheEntry* entries = calloc(newCapacity, sizeof(BakeCacheEntry));
+        if (entries == NULL) {
+            return false;
+        }
+        bakeCache.entries = entries;
+        bakeCache.capacity = newCapacity;
+        bakeCache.numEntries = 0;
+        for (int i = 0; i < oldCapacity; i++)
+        {
+            if (old[i].key != 0)
+            {
+                insertBakeCacheEntry(old[i]);
+            }
+        }
+        free(old);
+    }
+    unsigned int mask = (unsigned int)bakeCache.capacity - 1;
+    unsigned int i = (unsigned int)entry.key & mask;
+    while (bakeCache.entries[i].key != 0)
+    {
+        i = (i + 1) & mask;
+    }
+    bakeCache.entries[i] = entry;
+    bakeCache.numEntries++;
+    return true;
+}
+
+// Shifts the entries after the removed one back, so no probe sequence is cut short
+static void removeBakeCacheEntry(BakeCacheEntry* entry)
+{
+    unsigned int mask = (unsigned int)bakeCache.capacity - 1;
+    unsigned int hole = (unsigned int)(entry - bakeCache.entries);
+    for (unsigned int i = (hole + 1) & mask; bakeCache.entries[i].key != 0; i = (i + 1) & mask)
+    {
+        unsigned int home = (unsigned int)bakeCache.entries[i].key & mask;
+        if (((i - home) & mask) >= ((i - hole) & mask))
+        {
+            bakeCache.entries[hole] = bakeCache.entries[i];
+            hole = i;
+        }
+    }
+    bakeCache.entries[hole].key = 0;
+    bakeCache.numEntries--;
+}
+
+static int compareBakeCacheUse(const void* a, const void* b)
+{
+    unsigned long long x = ((const BakeCacheEntry*)a)->lastUse;
+    unsigned long long y = ((const BakeCacheEntry*)b)->lastUse;
+    return (x > y) - (x < y);
+}
+
+// Deletes the least recently used files until the cache is a tenth under its
+// cap, so trimming does not start again with the very next store
+static void trimBakeCache()
+{
+    if (bakeCache.stats.bytes <= bakeCache.maxBytes || bakeCache.numEntries == 0)
+    {
+        return;
+    }
+    BakeCacheEntry* byUse = malloc(bakeCache.numEntries * sizeof(BakeCacheEntry));
+    if (byUse == NULL) {
+        return;
+    }
+    int count = 0;
+    for (int i = 0; i < bakeCache.capacity; i++)
+    {
+        if (bakeCache.entries[i].key != 0)
+        {
+            byUse[count++] = bakeCache.entries[i];
+        }
+    }
+    qsort(byUse, count, sizeof(BakeCacheEntry), compareBakeCacheUse);
+    size_t target = bakeCache.maxBytes - bakeCache.maxBytes / 10;
+    char path[BAKE_CACHE_PATH_SIZE];
+    for (int i = 0; i < count && bakeCache.stats.bytes > target; i++)
+    {
+        getBakeCachePath(path, byUse[i].key);
+        remove(path);
+        removeBakeCacheEntry(findBakeCacheEntry(byUse[i].key));
+        bakeCache.stats.bytes -= byUse[i].size;
+        bakeCache.stats.evictions++;
+    }
+    free(byUse);
+}
+
+bool openVitmapBakeCache(const char* directory, size_t maxBytes)
+{
+    closeVitmapBakeCache();
+    if (strlen(directory) >= sizeof bakeCache.directory || !makeVitmapDirectory(directory))
+    {
+        VITMAP_WARNING("Cannot use %s as a bake cache", directory);
+        return false;
+    }
+    DIR* dir = opendir(directory);
+    if (dir == NULL || !initVitmapMutex(&bakeCache.lock))
+    {
+        VITMAP_WARNING("Cannot open bake cache %s", directory);
+        if (dir != NULL)
+        {
+            closedir(dir);
+        }
+        return false;
+    }
+    strcpy(bakeCache.directory, directory);
+    bakeCache.maxBytes = maxBytes;
+
+    // Files from earlier runs, with their modification times standing in for last use
+    struct dirent* item;
+    char path[BAKE_CACHE_PATH_SIZE];
+    while ((item = readdir(dir)) != NULL)
+    {
+        unsigned long long key = 0;
+        char extension[8] = "";
+        if (strlen(item->d_name) != 16 + strlen(BAKE_CACHE_EXTENSION)
+            || sscanf(item->d_name, "%16llx%7s", &key, extension) != 2
+            || strcmp(extension, BAKE_CACHE_EXTENSION) != 0 || key == 0)
+        {
+            continue;
+        }
+        struct stat info;
+        snprintf(path, sizeof path, "%s/%s", bakeCache.directory, item->d_name);
+        if (stat(path, &info) == 0 && findBakeCacheEntry(key) == NULL)
+        {
+            BakeCacheEntry entry = {key, (size_t)info.st_size, (unsigned long long)info.st_mtime};
+            if (insertBakeCacheEntry(entry))
+            {
+                bakeCache.stats.bytes += entry.size;
+            }
+        }
+    }
+    closedir(dir);
+
+    // Renumber by age, so this run's uses always count as newer
+    BakeCacheEntry* byTime = bakeCache.numEntries > 0 ? malloc(bakeCache.numEntries * sizeof(BakeCacheEntry)) : NULL;
+    if (byTime != NULL)
+    {
+        int count = 0;
+        for (int i = 0; i < bakeCache.capacity; i++)
+        {
+            if (bakeCache.entries[i].key != 0)
+            {
+                byTime[count++] = bakeCache.entries[i];
+            }
+        }
+        qsort(byTime, count, sizeof(BakeCacheEntry), compareBakeCacheUse);
+        for (int i = 0; i < count; i++)
+        {
+            findBakeCacheEntry(byTime[i].key)->lastUse = (unsigned long long)i + 1;
+        }
+        bakeCache.useCounter = (unsigned long long)count;
+        free(byTime);
+    }
+    bakeCache.isOpen = true;
+    trimBakeCache();
+    VITMAP_DEBUG("Opened bake cache %s with %d files, %zu bytes", directory, bakeCache.numEntries, bakeCache.stats.bytes);
+    return true;
+}
+
+void closeVitmapBakeCache()
+{
+    if (!bakeCache.isOpen)
+    {
+        return;
+    }
+    destroyVitmapMutex(&bakeCache.lock);
+    free(bakeCache.entries);
+    memset(&bakeCache, 0, sizeof bakeCache);
+}
+
+VitmapBakeCacheStats getVitmapBakeCacheStats()
+{
+    VitmapBakeCacheStats stats = {0, 0, 0, 0};
+    if (bakeCache.isOpen)
+    {
+        lockVitmapMutex(&bakeCache.lock);
+        stats = bakeCache.stats;
+        unlockVitmapMutex(&bakeCache.lock);
+    }
+    return stats;
+}
+
+static bool readBakeCacheFile(FILE* file, unsigned long long key, const Vector2* points, int numPoints,
+    const int* contourStarts, int numContours, VitmapWindingRule windingRule, VitmapArena* scratch, ShapeMesh* meshOut)
+{
+    BakeCacheHeader header;
+    if (fread(&header, sizeof header, 1, file) != 1 || memcmp(header.magic, bakeCacheMagic, 4) != 0
+        || header.version != VITMAP_BAKE_CACHE_VERSION || header.key != key || header.numPoints != numPoints
+        || header.numContours != numContours || header.windingRule != (int)windingRule
+        || header.numVertices < 0 || header.numIndices < 0 || header.numIndices % 3 != 0)
+    {
+        return false;
+    }
+    Vector2* storedPoints = allocateFromVitmapArena(scratch, numPoints * sizeof(Vector2));
+    int* storedStarts = allocateFromVitmapArena(scratch, numContours * sizeof(int));
+    Vector2* vertices = allocateFromVitmapArena(scratch, (header.numVertices + 1) * sizeof(Vector2));
+    int* indices = allocateFromVitmapArena(scratch, (header.numIndices + 1) * sizeof(int));
+    if (storedPoints == NULL || storedStarts == NULL || vertices == NULL || indices == NULL
+        || fread(storedPoints, sizeof(Vector2), numPoints, file) != (size_t)numPoints
+        || memcmp(storedPoints, points, numPoints * sizeof(Vector2)) != 0
+        || fread(storedStarts, sizeof(int), numContours - 1, file) != (size_t)(numContours - 1)
+        || (numContours > 1 && memcmp(storedStarts, contourStarts, (numContours - 1) * sizeof(int)) != 0)
+        || fread(vertices, sizeof(Vector2), header.numVertices, file) != (size_t)header.numVertices
+        || fread(indices, sizeof(int), header.numIndices, file) != (size_t)header.numIndices)
+    {
+        return false;
+    }
+    for (int i = 0; i < header.numIndices; i++)
+    {
+        if (indices[i] < 0 || indices[i] >= header.numVertices)
+        {
+            return false;
+        }
+    }
+    *meshOut = (ShapeMesh){vertices, header.numVertices, indices, header.numIndices, {0.0f, 0.0f}, {0.0f, 0.0f}};
+    return true;
+}
+
+bool findCachedVitmapBake(const Vector2* points, int numPoints, const int* contourStarts, int numContours,
+    VitmapWindingRule windingRule, float minArea, VitmapArena* scratch, ShapeMesh* meshOut)
+{
+    if (!bakeCache.isOpen)
+    {
+        return false;
+    }
+    unsigned long long key = hashBakeInput(points, numPoints, contourStarts, numContours, windingRule, minArea);
+    char path[BAKE_CACHE_PATH_SIZE];
+    getBakeCachePath(path, key);
+    FILE* file = fopen(path, "rb");
+    bool found = file != NULL
+        && readBakeCacheFile(file, key, points, numPoints, contourStarts, numContours, windingRule, scratch, meshOut);
+    if (file != NULL)
+    {
+        fclose(file);
+    }
+
+    lockVitmapMutex(&bakeCache.lock);
+    BakeCacheEntry* entry = findBakeCacheEntry(key);
+    if (found)
+    {
+        bakeCache.stats.hits++;
+        if (entry != NULL)
+        {
+            entry->lastUse = ++bakeCache.useCounter;
+        }
+    }
+    else
+    {
+        bakeCache.stats.misses++;
+    }
+    unlockVitmapMutex(&bakeCache.lock);
+    // Carries the use over to the next run
+    if (found)
+    {
+        touchVitmapFile(path);
+    }
+    return found;
+}
+
+void storeCachedVitmapBake(const Vector2* points, int numPoints, const int* contourStarts, int numContours,
+    VitmapWindingRule windingRule, float minArea, const ShapeMesh* mesh)
+{
+    if (!bakeCache.isOpen)
+    {
+        return;
+    }
+    unsigned long long key = hashBakeInput(points, numPoints, contourStarts, numContours, windingRule, minArea);
+    char path[BAKE_CACHE_PATH_SIZE];
+    char tempPath[BAKE_CACHE_PATH_SIZE + BAKE_CACHE_NAME_SIZE];
+    getBakeCachePath(path, key);
+    // Written under a name no other thread or process uses, then renamed into place whole
+    unsigned int temp = __atomic_fetch_add(&bakeCache.tempCounter, 1, __ATOMIC_RELAXED);
+    snprintf(tempPath, sizeof tempPath, "%s.%x.%x.tmp", path, temp, (unsigned int)(getVitmapTime() * 1e9));
+    FILE* file = fopen(tempPath, "wb");
+    if (file == NULL)
+    {
+        return;
+    }
+    BakeCacheHeader header = {{0}, VITMAP_BAKE_CACHE_VERSION, key, numPoints, numContours, windingRule,
+        mesh->numVertices, mesh->numIndices};
+    memcpy(header.magic, bakeCacheMagic, 4);
+    bool written = fwrite(&header, sizeof header, 1, file) == 1
+        && fwrite(points, sizeof(Vector2), numPoints, file) == (size_t)numPoints
+        && fwrite(contourStarts, sizeof(int), numContours - 1, file) == (size_t)(numContours - 1)
+        && fwrite(mesh->vertices, sizeof(Vector2), mesh->numVertices, file) == (size_t)mesh->numVertices
+        && fwrite(mesh->indices, sizeof(int), mesh->numIndices, file) == (size_t)mesh->numIndices;
+    written = fclose(file) == 0 && written;
+    if (!written || !replaceVitmapFile(tempPath, path))
+    {
+        remove(tempPath);
+        return;
+    }
+    size_t size = sizeof header + numPoints * sizeof(Vector2) + (numContours - 1) * sizeof(int) + mesh->numVertices * sizeof(Vector2) + mesh->numIndices * sizeof(int);
+
+    lockVitmapMutex(&bakeCache.lock);
+    BakeCacheEntry* entry = findBakeCacheEntry(key);
+    if (entry != NULL)
+    {
+        bakeCache.stats.bytes -= entry->size;
+        entry->size = size;
+        entry->lastUse = ++bakeCache.useCounter;
+        bakeCache.stats.bytes += size;
+    }
+    else if (insertBakeCacheEntry((BakeCacheEntry){key, size, ++bakeCache.useCounter}))
+    {
+        bakeCache.stats.bytes += size;
+    }
+    trimBakeCache();
+    unlockVitmapMutex(&bakeCache.lock);
+}
@@ -0,0 +1,177 @@
+#include <stdlib.h>
+#include "include/vitmap_batch.h"
+#include "include/vitmap_io.h"
+#include "include/vitmap_jobs.h"
+#include "include/vitmap_log.h"
+#include "include/vitmap_platform.h"
+#include "include/vitmap_trace.h"
+
+typedef struct LoadBatch LoadBatch;
+
+typedef struct BatchFile
+{
+    LoadBatch* batch;
+    int index;
+    unsigned char* data;
+    int size;
+} BatchFile;
+
+// Exactly one of vitmaps and animations is set
+struct LoadBatch
+{
+    const char* const* paths;
+    Vitmap* vitmaps;
+    VitmapAnimation* animations;
+    VitmapLoadResult* results;
+    BatchFile* files;
+    VitmapJob* root;
+};
+
+// Decodes straight into the output entry, and leaves it empty if that fails
+static bool decodeBatchFile(LoadBatch* batch, int index, const unsigned char* data, int size, const char** error)
+{
+    if (batch->vitmaps != NULL)
+    {
+        Vitmap* vitmap = &batch->vitmaps[index];
+        if (!decodeVitmap(data, size, vitmap, error))
+        {
+            unloadVitmap(vitmap);
+            return false;
+        }
+        bakeVitmap(vitmap);
+        return true;
+    }
+    VitmapAnimation* animation = &batch->animations[index];
+    if (!decodeAnimation(data, size, animation, error))
+    {
+        unloadAnimation(animation);
+        return false;
+    }
+    // The frames share the animation's arena, so they bake one at a time and
+    // only the shapes inside each frame are spread over the jobs
+    for (int i = 0; i < animation->numFrames; i++)
+    {
+        bakeVitmap(&animation->frames[i]);
+    }
+    return true;
+}
+
+// Runs as its own job once the file is read
+static void decodeBatchJob(void* userData)
+{
+    BatchFile* file = userData;
+    LoadBatch* batch = file->batch;
+    VITMAP_SPAN_BEGIN(span, "loadBatchFile");
+    double start = getVitmapTime();
+    VitmapLoadResult* result = &batch->results[file->index];
+    const char* error = "cannot read file";
+    bool read = file->data != NULL;
+    bool ok = read && decodeBatchFile(batch, file->index, file->data, file->size, &error);
+    free(file->data);
+    file->data = NULL;
+    result->status = ok ? VITMAP_LOAD_OK : read ? VITMAP_LOAD_INVALID : VITMAP_LOAD_UNREADABLE;
+    result->error = ok ? NULL : error;
+    result->bytes = file->size;
+    result->seconds = getVitmapTime() - start;
+    if (!ok)
+    {
+        VITMAP_ERROR("Failed to load %s: %s", batch->paths[file->index], error);
+    }
+    VITMAP_SPAN_END(span);
+}
+
+// Hands each file to a worker as soon as its read completes, so decoding
+// overlaps the reads still in flight
+static void onBatchFileRead(void* userData, int index, unsigned char* data, int size)
+{
+    LoadBatch* batch = userData;
+    BatchFile* file = &batch->files[index];
+    file->batch = batch;
+    file->index = index;
+    file->data = data;
+    file->size = size;
+    VitmapJob* job = batch->root != NULL ? createVitmapJob(decodeBatchJob, file, batch->root) : NULL;
+    if (job != NULL)
+    {
+        runVitmapJob(job);
+    }
+    else
+    {
+        decodeBatchJob(file);
+    }
+}
+
+static bool loadBatch(LoadBatch* batch, int count, VitmapLoadResult* resultsOut, VitmapBatchStats* statsOut)
+{
+    VITMAP_SPAN_BEGIN(span, "loadBatch");
+    double start = getVitmapTime();
+    VitmapBatchStats stats = {0, count, 0, 0.0};
+    VitmapLoadResult* results = resultsOut != NULL ? resultsOut : malloc(count > 0 ? count * sizeof(VitmapLoadResult) : 1);
+    BatchFile* files = malloc(count > 0 ? count * sizeof(BatchFile) : 1);
+    if (results == NULL || files == NULL) {
+        if (results != resultsOut)
+        {
+            free(results);
+        }
+        free(files);
+        if (statsOut != NULL)
+        {
+            *statsOut = stats;
+        }
+        VITMAP_SPAN_END(span);
+        return false;
+    }
+    batch->results = results;
+    batch->files = files;
+    // This thread keeps the reads coming while the workers decode and bake
+    batch->root = createVitmapJob(NULL, NULL, NULL);
+    VitmapIoBackend backend = readVitmapFiles(batch->paths, count, VITMAP_IO_AUTO, onBatchFileRead, batch);
+    if (batch->root != NULL)
+    {
+        runVitmapJob(batch->root);
+        waitVitmapJob(batch->root);
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        stats.numLoaded += results[i].status == VITMAP_LOAD_OK ? 1 : 0;
+        stats.bytesRead += results[i].bytes;
+    }
+    stats.numFailed = count - stats.numLoaded;
+    stats.seconds = getVitmapTime() - start;
+    VITMAP_INFO("Loaded %d of %d files, %lld bytes in %.3f ms with %s reads.", stats.numLoaded, count, stats.bytesRead,
+        stats.seconds * 1000.0, getVitmapIoBackendName(backend));
+    if (statsOut != NULL)
+    {
+        *statsOut = stats;
+    }
+    if (results != resultsOut)
+    {
+        free(results);
+    }
+    free(files);
+    VITMAP_SPAN_END(span);
+    return stats.numFailed == 0;
+}
+
+bool loadVitmapsBatch(const char* const* paths, int count, Vitmap* out,
+    VitmapLoadResult* resultsOut, VitmapBatchStats* statsOut)
+{
+    for (int i = 0; i < count; i++)
+    {
+        initVitmap(&out[i]);
+    }
+    LoadBatch batch = {paths, out, NULL, NULL, NULL, NULL};
+    return loadBatch(&batch, count, resultsOut, statsOut);
+}
+
+bool loadAnimationsBatch(const char* const* paths, int count, VitmapAnimation* out,
+    VitmapLoadResult* resultsOut, VitmapBatchStats* statsOut)
+{
+    for (int i = 0; i < count; i++)
+    {
+        initVitmapAnimation(&out[i]);
+    }
+    LoadBatch batch = {paths, NULL, out, NULL, NULL, NULL};
+    return loadBatch(&batch, count, resultsOut, statsOut);
+}
@@ -0,0 +1,140 @@
+// Optional raylib drawing for vitmaps. Everything else lives in the headless
+// core, which needs no window or GL context.
+
+#include "include/vitmap_draw.h"
+#include "include/vitmap_trace.h"
+#include "include/raymath.h"
+
+static VitmapBakeQueue* drawBakeQueue = NULL;
+static VitmapBakeFallback drawBakeFallback = VITMAP_BAKE_FALLBACK_NONE;
+
+void setVitmapDrawBakeQueue(VitmapBakeQueue* queue, VitmapBakeFallback fallback)
+{
+    drawBakeQueue = queue;
+    drawBakeFallback = fallback;
+}
+
+// Stand-in for a shape still waiting in the bake queue. A fan would fill the
+// holes in, so shapes with more than one contour are always outlined. Curved
+// edges are drawn straight until the bake comes.
+static void drawShapeFallback(const Shape* shape, Color color, Vector2 position, Vector2 scale)
+{
+    if (shape->numPoints < 2 || drawBakeFallback == VITMAP_BAKE_FALLBACK_NONE)
+    {
+        return;
+    }
+    bool outline = drawBakeFallback == VITMAP_BAKE_FALLBACK_OUTLINE || shape->numContours > 1;
+    for (int c = 0; c < shape->numContours; c++)
+    {
+        int count = 0;
+        const Vector2* points = &shape->points[getShapeContour(shape, c, &count)];
+        if (count < 2)
+        {
+            continue;
+        }
+        Vector2 first = Vector2Add(Vector2Multiply(points[0], scale), position);
+        Vector2 previous = first;
+        for (int i = 1; i < count; i++)
+        {
+            Vector2 point = Vector2Add(Vector2Multiply(points[i], scale), position);
+            if (outline)
+            {
+                DrawLineV(previous, point, color);
+            }
+            else if (i >= 2)
+            {
+                // raylib wants counter-clockwise triangles on screen, which is a negative cross product with y down
+                float cross = (previous.x - first.x) * (point.y - first.y) - (previous.y - first.y) * (point.x - first.x);
+                if (cross < 0.0f)
+                {
+                    DrawTriangle(first, previous, point, color);
+                }
+                else
+                {
+                    DrawTriangle(first, point, previous, color);
+                }
+            }
+            previous = point;
+        }
+        if (outline)
+        {
+            DrawLineV(previous, first, color);
+        }
+    }
+}
+
+// Fills and strokes both end up here, so raylib batches them together
+static void drawShapeMesh(const ShapeMesh* mesh, Color color, Vector2 position, Vector2 scale)
+{
+    const Vector2* vertices = mesh->vertices;
+    const int* indices = mesh->indices;
+    for (int i = 0; i < mesh->numIndices; i += 3)
+    {
+        DrawTriangle(
+            Vector2Add(Vector2Multiply(vertices[indices[i]], scale), position),
+            Vector2Add(Vector2Multiply(vertices[indices[i + 1]], scale), position),
+            Vector2Add(Vector2Multiply(vertices[indices[i + 2]], scale), position),
+            color);
+    }
+}
+
+static void drawShape(const Shape* shape, Color color, Vector2 position, Vector2 scale, float rotation)
+{
+    // TODO: Implement rotation
+    if (shape->mesh == NULL)
+    {
+        drawShapeFallback(shape, color, position, scale);
+        return;
+    }
+    drawShapeMesh(shape->mesh, color, position, scale);
+}
+
+void drawVitmap(Vitmap *vitmap, Vector2 position, Vector2 scale, float rotation)
+{
+    drawVitmapWithPalette(vitmap, position, scale, rotation, vitmap->palette, vitmap->numPaletteColors);
+}
+
+void drawVitmapWithPalette(Vitmap *vitmap, Vector2 position, Vector2 scale, float rotation, const Color* palette, int numColors)
+{
+    VITMAP_SPAN_BEGIN(span, "drawVitmap");
+    for (int i = 0; i < vitmap->numShapes; i++)
+    {
+        const Shape* shape = getVitmapShape(vitmap, i);
+        if (shape->mesh == NULL && shape->numPoints >= 3)
+        {
+            // Baked on first draw, right away or a bit at a time through the queue
+            ShapeHandle handle = getShapeHandleAt(vitmap, i);
+            if (drawBakeQueue != NULL)
+            {
+                queueShapeBake(drawBakeQueue, vitmap, handle);
+            }
+            else
+            {
+                bakeShape(vitmap, handle);
+                shape = getVitmapShape(vitmap, i);
+            }
+        }
+        // Fold the deferred move into the position, the mesh itself stays put
+        Vector2 offset = getShapeOffset(vitmap, shape);
+        Vector2 shapePosition = {position.x + offset.x * scale.x, position.y + offset.y * scale.y};
+        drawShape(shape, getShapeColor(shape, palette, numColors), shapePosition, scale, rotation);
+    }
+    VITMAP_SPAN_END(span);
+}
+
+void drawVitmapStrokes(Vitmap *vitmap, Vector2 position, Vector2 scale, Color color)
+{
+    VITMAP_SPAN_BEGIN(span, "drawVitmapStrokes");
+    for (int i = 0; i < vitmap->numShapes; i++)
+    {
+        const Shape* shape = getVitmapShape(vitmap, i);
+        if (shape->stroke == NULL)
+        {
+            continue;
+        }
+        Vector2 offset = getShapeOffset(vitmap, shape);
+        Vector2 shapePosition = {position.x + offset.x * scale.x, position.y + offset.y * scale.y};
+        drawShapeMesh(&shape->stroke->mesh, color, shapePosition, scale);
+    }
+    VITMAP_SPAN_END(span);
+}
@@ -0,0 +1,437 @@
+#if defined(__linux__)
+#define _GNU_SOURCE             // syscall, MAP_POPULATE
+#elif !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "include/vitmap.h"
+#include "include/vitmap_io.h"
+#include "include/vitmap_log.h"
+#include "include/vitmap_trace.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+const char* getVitmapIoBackendName(VitmapIoBackend backend)
+{
+    switch (backend)
+    {
+        case VITMAP_IO_URING: return "io_uring";
+        case VITMAP_IO_BLOCKING: return "blocking";
+        default: return "auto";
+    }
+}
+
+#ifndef _WIN32
+
+// Opens a file and makes room for all of it. Returns -1 if either fails.
+static int openFileForRead(const char* path, unsigned char** dataOut, int* sizeOut)
+{
+    *dataOut = NULL;
+    *sizeOut = 0;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size > INT_MAX)
+    {
+        close(fd);
+        return -1;
+    }
+    // Always hand back a valid pointer, even for an empty file
+    *dataOut = malloc(info.st_size > 0 ? (size_t)info.st_size : 1);
+    if (*dataOut == NULL) {
+        close(fd);
+        return -1;
+    }
+    *sizeOut = (int)info.st_size;
+    return fd;
+}
+
+static unsigned char* preadFile(const char* path, int* sizeOut)
+{
+    unsigned char* data;
+    int size;
+    int fd = openFileForRead(path, &data, &size);
+    if (fd < 0)
+    {
+        *sizeOut = 0;
+        return NULL;
+    }
+    int done = 0;
+    while (done < size)
+    {
+        ssize_t bytes = pread(fd, data + done, (size_t)(size - done), done);
+        if (bytes < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        // A file that got shorter since fstat fails like one that cannot be read
+        if (bytes <= 0)
+        {
+            break;
+        }
+        done += (int)bytes;
+    }
+    close(fd);
+    if (done < size)
+    {
+        free(data);
+        *sizeOut = 0;
+        return NULL;
+    }
+    *sizeOut = size;
+    return data;
+}
+
+#endif
+
+static void readFilesBlocking(const char* const* paths, int begin, int count, VitmapFileReadFunc func, void* userData)
+{
+    for (int i = begin; i < count; i++)
+    {
+        int size = 0;
+#ifdef _WIN32
+        unsigned char* data = loadVitmapFileData(paths[i], &size);
+#else
+        unsigned char* data = preadFile(paths[i], &size);
+#endif
+        func(userData, i, data, size);
+    }
+}
+
+#ifdef __linux__
+
+typedef struct UringQueue
+{
+    int fd;
+    unsigned entries;
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    void* sqRing;
+    size_t sqRingSize;
+    void* cqRing;
+    size_t cqRingSize;
+    size_t sqesSize;
+} UringQueue;
+
+// One file with a read in flight
+typedef struct UringRead
+{
+    int index;
+    int fd;
+    unsigned char* data;
+    int size;
+    int done;
+    struct iovec iov;
+} UringRead;
+
+static void destroyUringQueue(UringQueue* queue)
+{
+    if (queue->sqes != NULL && queue->sqes != MAP_FAILED)
+    {
+        munmap(queue->sqes, queue->sqesSize);
+    }
+    if (queue->cqRing != NULL && queue->cqRing != MAP_FAILED && queue->cqRing != queue->sqRing)
+    {
+        munmap(queue->cqRing, queue->cqRingSize);
+    }
+    if (queue->sqRing != NULL && queue->sqRing != MAP_FAILED)
+    {
+        munmap(queue->sqRing, queue->sqRingSize);
+    }
+    close(queue->fd);
+}
+
+// Sets up the rings by hand, so the library does not need liburing
+static bool createUringQueue(UringQueue* queue, unsigned entries)
+{
+    memset(queue, 0, sizeof *queue);
+    struct io_uring_params params;
+    memset(&params, 0, sizeof params);
+    queue->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (queue->fd < 0)
+    {
+        return false;
+    }
+    queue->entries = params.sq_entries;
+    queue->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    queue->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    // Newer kernels map both rings at once
+    bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMap && queue->cqRingSize > queue->sqRingSize)
+    {
+        queue->sqRingSize = queue->cqRingSize;
+    }
+    queue->sqRing = mmap(NULL, queue->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        queue->fd, IORING_OFF_SQ_RING);
+    if (queue->sqRing == MAP_FAILED)
+    {
+        destroyUringQueue(queue);
+        return false;
+    }
+    queue->cqRing = queue->sqRing;
+    if (!singleMap)
+    {
+        queue->cqRing = mmap(NULL, queue->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            queue->fd, IORING_OFF_CQ_RING);
+        if (queue->cqRing == MAP_FAILED)
+        {
+            destroyUringQueue(queue);
+            return false;
+        }
+    }
+    queue->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    queue->sqes = mmap(NULL, queue->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        queue->fd, IORING_OFF_SQES);
+    if (queue->sqes == MAP_FAILED)
+    {
+        destroyUringQueue(queue);
+        return false;
+    }
+
+    unsigned char* sqRing = queue->sqRing;
+    unsigned char* cqRing = queue->cqRing;
+    queue->sqHead = (unsigned*)(sqRing + params.sq_off.head);
+    queue->sqTail = (unsigned*)(sqRing + params.sq_off.tail);
+    queue->sqMask = (unsigned*)(sqRing + params.sq_off.ring_mask);
+    queue->sqArray = (unsigned*)(sqRing + params.sq_off.array);
+    queue->cqHead = (unsigned*)(cqRing + params.cq_off.head);
+    queue->cqTail = (unsigned*)(cqRing + params.cq_off.tail);
+    queue->cqMask = (unsigned*)(cqRing + params.cq_off.ring_mask);
+    queue->cqes = (struct io_uring_cqe*)(cqRing + params.cq_off.cqes);
+    return true;
+}
+
+// Queues a read of the rest of the file. There is always room, since every
+// slot has at most one read queued and the ring has an entry per slot.
+static void queueUringRead(UringQueue* queue, UringRead* read, unsigned slot)
+{
+    unsigned tail = *queue->sqTail;
+    unsigned entry = tail & *queue->sqMask;
+    struct io_uring_sqe* sqe = &queue->sqes[entry];
+    memset(sqe, 0, sizeof *sqe);
+    read->iov.iov_base = read->data + read->done;
+    read->iov.iov_len = (size_t)(read->size - read->done);
+    sqe->opcode = IORING_OP_READV;
+    sqe->fd = read->fd;
+    sqe->off = (unsigned long long)read->done;
+    sqe->addr = (unsigned long long)(uintptr_t)&read->iov;
+    sqe->len = 1;
+    sqe->user_data = slot;
+    queue->sqArray[entry] = entry;
+    __atomic_store_n(queue->sqTail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static int enterUring(UringQueue* queue, unsigned toSubmit, unsigned minComplete)
+{
+    int submitted;
+    do
+    {
+        submitted = (int)syscall(__NR_io_uring_enter, queue->fd, toSubmit, minComplete, IORING_ENTER_GETEVENTS, NULL, 0);
+    } while (submitted < 0 && errno == EINTR);
+    return submitted;
+}
+
+// Reads until the end of the list, or until the kernel refuses a submission.
+// Returns how many files were started; reads still in flight when it stops
+// are finished with pread, and fellBackOut is set.
+static int readFilesUring(UringQueue* queue, const char* const* paths, int count,
+    VitmapFileReadFunc func, void* userData, bool* fellBackOut)
+{
+    UringRead reads[VITMAP_IO_QUEUE_DEPTH];
+    unsigned freeSlots[VITMAP_IO_QUEUE_DEPTH];
+    unsigned numSlots = queue->entries < VITMAP_IO_QUEUE_DEPTH ? queue->entries : VITMAP_IO_QUEUE_DEPTH;
+    unsigned numFree = 0;
+    for (unsigned slot = numSlots; slot > 0; slot--)
+    {
+        freeSlots[numFree++] = slot - 1;
+    }
+    int next = 0;
+    unsigned inFlight = 0;
+    unsigned toSubmit = 0;
+    bool failed = false;
+
+    while (!failed && (next < count || inFlight > 0))
+    {
+        // Opening stays synchronous, only the reads, which wait on the disk, are queued
+        while (numFree > 0 && next < count)
+        {
+            int index = next++;
+            unsigned char* data;
+            int size;
+            int fd = openFileForRead(paths[index], &data, &size);
+            if (fd < 0 || size == 0)
+            {
+                if (fd >= 0)
+                {
+                    close(fd);
+                }
+                func(userData, index, data, size);
+                continue;
+            }
+            unsigned slot = freeSlots[--numFree];
+            reads[slot] = (UringRead){index, fd, data, size, 0, {NULL, 0}};
+            queueUringRead(queue, &reads[slot], slot);
+            inFlight++;
+            toSubmit++;
+        }
+        if (inFlight == 0)
+        {
+            continue;
+        }
+
+        int submitted = enterUring(queue, toSubmit, 1);
+        if (submitted < 0)
+        {
+            VITMAP_WARNING("io_uring_enter failed (%s), reading the rest with pread.", strerror(errno));
+            failed = true;
+            break;
+        }
+        toSubmit -= (unsigned)submitted;
+
+        unsigned head = *queue->cqHead;
+        unsigned tail = __atomic_load_n(queue->cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++)
+        {
+            struct io_uring_cqe* cqe = &queue->cqes[head & *queue->cqMask];
+            unsigned slot = (unsigned)cqe->user_data;
+            UringRead* read = &reads[slot];
+            // Short reads are queued again for the rest, a file that shrank fails
+            if (cqe->res == -EINTR || cqe->res == -EAGAIN || (cqe->res > 0 && read->done + cqe->res < read->size))
+            {
+                read->done += cqe->res > 0 ? cqe->res : 0;
+                queueUringRead(queue, read, slot);
+                toSubmit++;
+                continue;
+            }
+            bool ok = cqe->res > 0 && read->done + cqe->res == read->size;
+            close(read->fd);
+            if (!ok)
+            {
+                free(read->data);
+            }
+            func(userData, read->index, ok ? read->data : NULL, ok ? read->size : 0);
+            freeSlots[numFree++] = slot;
+            inFlight--;
+        }
+        __atomic_store_n(queue->cqHead, head, __ATOMIC_RELEASE);
+    }
+
+    if (failed)
+    {
+        // Nothing more is submitted, so wait out what the kernel already has
+        // before the buffers go, then read those files again
+        unsigned submittedCount = inFlight - toSubmit;
+        while (submittedCount > 0 && enterUring(queue, 0, submittedCount) >= 0)
+        {
+            unsigned head = *queue->cqHead;
+            unsigned tail = __atomic_load_n(queue->cqTail, __ATOMIC_ACQUIRE);
+            submittedCount -= tail - head;
+            __atomic_store_n(queue->cqHead, tail, __ATOMIC_RELEASE);
+        }
+        // The kernel may still be writing into the buffers it was not heard
+        // back from, so those are leaked rather than freed under it
+        if (submittedCount > 0)
+        {
+            VITMAP_WARNING("Failed to wait for %u io_uring reads, leaking their buffers.", submittedCount);
+        }
+        for (unsigned slot = 0; slot < numSlots; slot++)
+        {
+            bool isFree = false;
+            for (unsigned i = 0; i < numFree; i++)
+            {
+                isFree = isFree || freeSlots[i] == slot;
+            }
+            if (!isFree)
+            {
+                close(reads[slot].fd);
+                if (submittedCount == 0)
+                {
+                    free(reads[slot].data);
+                }
+                int size = 0;
+                unsigned char* data = preadFile(paths[reads[slot].index], &size);
+                func(userData, reads[slot].index, data, size);
+            }
+        }
+    }
+    *fellBackOut = failed;
+    return next;
+}
+
+#endif
+
+bool isVitmapIoUringAvailable()
+{
+#ifdef __linux__
+    // 0 untested, 1 available, 2 not
+    static int available = 0;
+    int state = __atomic_load_n(&available, __ATOMIC_ACQUIRE);
+    if (state == 0)
+    {
+        UringQueue queue;
+        state = createUringQueue(&queue, 1) ? 1 : 2;
+        if (state == 1)
+        {
+            destroyUringQueue(&queue);
+        }
+        else
+        {
+            VITMAP_DEBUG("io_uring unavailable (%s)", strerror(errno));
+        }
+        __atomic_store_n(&available, state, __ATOMIC_RELEASE);
+    }
+    return state == 1;
+#else
+    return false;
+#endif
+}
+
+VitmapIoBackend readVitmapFiles(const char* const* paths, int count, VitmapIoBackend backend,
+    VitmapFileReadFunc func, void* userData)
+{
+    VITMAP_SPAN_BEGIN(span, "readVitmapFiles");
+    int begin = 0;
+    VitmapIoBackend used = VITMAP_IO_BLOCKING;
+#ifdef __linux__
+    UringQueue queue;
+    if (backend != VITMAP_IO_BLOCKING && count > 0 && isVitmapIoUringAvailable()
+        && createUringQueue(&queue, VITMAP_IO_QUEUE_DEPTH))
+    {
+        bool fellBack = false;
+        begin = readFilesUring(&queue, paths, count, func, userData, &fellBack);
+        destroyUringQueue(&queue);
+        used = fellBack ? VITMAP_IO_BLOCKING : VITMAP_IO_URING;
+    }
+#else
+    (void)backend;
+#endif
+    readFilesBlocking(paths, begin, count, func, userData);
+    VITMAP_SPAN_END(span);
+    return used;
+}
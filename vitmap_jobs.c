@@ -0,0 +1,420 @@
+#include <stdlib.h>
+#include "include/vitmap_jobs.h"
+#include "include/vitmap_platform.h"
+#include "include/vitmap_trace.h"
+
+struct VitmapJob
+{
+    VitmapJobFunc func;
+    void* userData;
+    VitmapJob* parent;
+    int unfinished;         // The job itself plus its children that are not done
+    VitmapJob* next;        // Link in the shared queue
+};
+
+// Chase-Lev deque. Only the owner touches bottom, thieves race for top.
+typedef struct JobDeque
+{
+    VitmapJob* jobs[VITMAP_JOB_DEQUE_SIZE];
+    long long top;
+    long long bottom;
+} JobDeque;
+
+typedef struct JobWorker
+{
+    JobDeque deque;
+    VitmapThread thread;
+    unsigned int random;    // Picks where to start stealing
+} JobWorker;
+
+static JobWorker* workers = NULL;
+static int numWorkers = 0;          // 0 while the scheduler is stopped
+static int numThreads = 1;
+static bool running = false;
+
+// Idle workers sleep until a job is queued
+static int numQueued = 0;
+static int numSleeping = 0;
+static VitmapMutex sleepLock;
+static VitmapCondition wakeCondition;
+
+// Jobs submitted from threads that are not workers
+static VitmapMutex sharedLock;
+static VitmapJob* sharedHead = NULL;
+static VitmapJob* sharedTail = NULL;
+
+static __thread JobWorker* currentWorker = NULL;
+static __thread unsigned int outsideRandom = 0x9e3779b9u;
+static __thread int inlineDepth = 0;     // Jobs submitted from this thread run right away
+
+static bool pushJob(JobDeque* deque, VitmapJob* job)
+{
+    long long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+    long long top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    if (bottom - top >= VITMAP_JOB_DEQUE_SIZE)
+    {
+        return false;
+    }
+    __atomic_store_n(&deque->jobs[bottom & (VITMAP_JOB_DEQUE_SIZE - 1)], job, __ATOMIC_RELAXED);
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+static VitmapJob* popJob(JobDeque* deque)
+{
+    long long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long long top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+    if (top > bottom)
+    {
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    VitmapJob* job = __atomic_load_n(&deque->jobs[bottom & (VITMAP_JOB_DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+    if (top == bottom)
+    {
+        // Last job, a thief may be after it too
+        if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        {
+            job = NULL;
+        }
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    }
+    return job;
+}
+
+static VitmapJob* stealJob(JobDeque* deque)
+{
+    long long top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+    if (top >= bottom)
+    {
+        return NULL;
+    }
+    VitmapJob* job = __atomic_load_n(&deque->jobs[top & (VITMAP_JOB_DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+    {
+        return NULL;
+    }
+    return job;
+}
+
+static VitmapJob* takeSharedJob()
+{
+    if (__atomic_load_n(&sharedHead, __ATOMIC_ACQUIRE) == NULL)
+    {
+        return NULL;
+    }
+    lockVitmapMutex(&sharedLock);
+    VitmapJob* job = sharedHead;
+    if (job != NULL)
+    {
+        __atomic_store_n(&sharedHead, job->next, __ATOMIC_RELEASE);
+        if (sharedHead == NULL)
+        {
+            sharedTail = NULL;
+        }
+    }
+    unlockVitmapMutex(&sharedLock);
+    return job;
+}
+
+static unsigned int nextRandom(unsigned int* state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+// Own deque first, newest job first for cache warmth, then the shared queue,
+// then the oldest job of another worker
+static VitmapJob* takeJob(JobWorker* worker)
+{
+    VitmapJob* job = worker != NULL ? popJob(&worker->deque) : NULL;
+    if (job == NULL)
+    {
+        job = takeSharedJob();
+    }
+    if (job == NULL)
+    {
+        int start = (int)(nextRandom(worker != NULL ? &worker->random : &outsideRandom) % numWorkers);
+        for (int i = 0; job == NULL && i < numWorkers; i++)
+        {
+            JobWorker* victim = &workers[(start + i) % numWorkers];
+            if (victim != worker)
+            {
+                job = stealJob(&victim->deque);
+            }
+        }
+    }
+    if (job != NULL)
+    {
+        __atomic_sub_fetch(&numQueued, 1, __ATOMIC_SEQ_CST);
+    }
+    return job;
+}
+
+static void finishJob(VitmapJob* job)
+{
+    // Read before the count drops, a job without a parent can be freed by
+    // its waiter the moment it reaches zero
+    VitmapJob* parent = job->parent;
+    if (__atomic_sub_fetch(&job->unfinished, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        if (parent != NULL)
+        {
+            free(job);
+            finishJob(parent);
+        }
+    }
+}
+
+static void executeJob(VitmapJob* job)
+{
+    if (job->func != NULL)
+    {
+        job->func(job->userData);
+    }
+    finishJob(job);
+}
+
+static void workerMain(void* userData)
+{
+    JobWorker* worker = userData;
+    currentWorker = worker;
+    while (__atomic_load_n(&running, __ATOMIC_ACQUIRE))
+    {
+        VitmapJob* job = takeJob(worker);
+        if (job != NULL)
+        {
+            executeJob(job);
+            continue;
+        }
+        // Sleeping is announced before checking for work, and queueing
+        // checks for sleepers after counting the job, so no wake is lost
+        lockVitmapMutex(&sleepLock);
+        __atomic_add_fetch(&numSleeping, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&numQueued, __ATOMIC_SEQ_CST) <= 0 && __atomic_load_n(&running, __ATOMIC_ACQUIRE))
+        {
+            waitVitmapCondition(&wakeCondition, &sleepLock);
+        }
+        __atomic_sub_fetch(&numSleeping, 1, __ATOMIC_SEQ_CST);
+        unlockVitmapMutex(&sleepLock);
+    }
+    currentWorker = NULL;
+}
+
+bool startVitmapJobs(int maxThreads)
+{
+    if (numWorkers > 0)
+    {
+        return true;
+    }
+    int count = maxThreads > 0 ? maxThreads : getVitmapCpuCount();
+    workers = calloc(count, sizeof(JobWorker));
+    if (workers == NULL) {
+        return false;
+    }
+    if (!initVitmapMutex(&sleepLock) || !initVitmapCondition(&wakeCondition) || !initVitmapMutex(&sharedLock))
+    {
+        free(workers);
+        workers = NULL;
+        return false;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        workers[i].random = 0x9e3779b9u * (unsigned int)(i + 1);
+    }
+    numQueued = 0;
+    numSleeping = 0;
+    sharedHead = NULL;
+    sharedTail = NULL;
+    __atomic_store_n(&running, true, __ATOMIC_RELEASE);
+    __atomic_store_n(&numWorkers, count, __ATOMIC_RELEASE);
+
+    // The caller is worker 0, the rest get threads. A thread that fails to
+    // start leaves an empty deque behind, which costs nothing.
+    currentWorker = &workers[0];
+    numThreads = 1;
+    for (int i = 1; i < count; i++)
+    {
+        if (startVitmapThread(&workers[i].thread, workerMain, &workers[i]))
+        {
+            numThreads++;
+        }
+    }
+    return true;
+}
+
+void stopVitmapJobs()
+{
+    if (numWorkers == 0)
+    {
+        return;
+    }
+    lockVitmapMutex(&sleepLock);
+    __atomic_store_n(&running, false, __ATOMIC_RELEASE);
+    broadcastVitmapCondition(&wakeCondition);
+    unlockVitmapMutex(&sleepLock);
+    for (int i = 1; i < numWorkers; i++)
+    {
+        if (workers[i].thread.handle != NULL)
+        {
+            joinVitmapThread(&workers[i].thread);
+        }
+    }
+    __atomic_store_n(&numWorkers, 0, __ATOMIC_RELEASE);
+    numThreads = 1;
+    currentWorker = NULL;
+    destroyVitmapMutex(&sleepLock);
+    destroyVitmapCondition(&wakeCondition);
+    destroyVitmapMutex(&sharedLock);
+    free(workers);
+    workers = NULL;
+}
+
+int getVitmapJobThreadCount()
+{
+    return __atomic_load_n(&numWorkers, __ATOMIC_ACQUIRE) > 0 && inlineDepth == 0 ? numThreads : 1;
+}
+
+void beginVitmapJobsInline()
+{
+    inlineDepth++;
+}
+
+void endVitmapJobsInline()
+{
+    inlineDepth--;
+}
+
+// NULL when out of memory, the caller can still do the work itself
+VitmapJob* createVitmapJob(VitmapJobFunc func, void* userData, VitmapJob* parent)
+{
+    VitmapJob* job = malloc(sizeof *job);
+    if (job == NULL) {
+        return NULL;
+    }
+    job->func = func;
+    job->userData = userData;
+    job->parent = parent;
+    job->unfinished = 1;
+    job->next = NULL;
+    if (parent != NULL)
+    {
+        __atomic_add_fetch(&parent->unfinished, 1, __ATOMIC_RELAXED);
+    }
+    return job;
+}
+
+void runVitmapJob(VitmapJob* job)
+{
+    if (__atomic_load_n(&numWorkers, __ATOMIC_ACQUIRE) == 0 || inlineDepth > 0)
+    {
+        executeJob(job);
+        return;
+    }
+    __atomic_add_fetch(&numQueued, 1, __ATOMIC_SEQ_CST);
+    JobWorker* worker = currentWorker;
+    if (worker != NULL)
+    {
+        if (!pushJob(&worker->deque, job))
+        {
+            // The deque is full, which means there is plenty to steal already
+            __atomic_sub_fetch(&numQueued, 1, __ATOMIC_SEQ_CST);
+            executeJob(job);
+            return;
+        }
+    }
+    else
+    {
+        lockVitmapMutex(&sharedLock);
+        if (sharedTail != NULL)
+        {
+            sharedTail->next = job;
+        }
+        else
+        {
+            __atomic_store_n(&sharedHead, job, __ATOMIC_RELEASE);
+        }
+        sharedTail = job;
+        unlockVitmapMutex(&sharedLock);
+    }
+    if (__atomic_load_n(&numSleeping, __ATOMIC_SEQ_CST) > 0)
+    {
+        lockVitmapMutex(&sleepLock);
+        signalVitmapCondition(&wakeCondition);
+        unlockVitmapMutex(&sleepLock);
+    }
+}
+
+void waitVitmapJob(VitmapJob* job)
+{
+    while (__atomic_load_n(&job->unfinished, __ATOMIC_ACQUIRE) > 0)
+    {
+        VitmapJob* other = __atomic_load_n(&numWorkers, __ATOMIC_ACQUIRE) > 0 && inlineDepth == 0 ? takeJob(currentWorker) : NULL;
+        if (other != NULL)
+        {
+            executeJob(other);
+        }
+        else
+        {
+            yieldVitmapThread();
+        }
+    }
+    free(job);
+}
+
+typedef struct JobRange
+{
+    VitmapJobRangeFunc func;
+    void* userData;
+    int begin;
+    int end;
+} JobRange;
+
+static void runJobRange(void* userData)
+{
+    JobRange* range = userData;
+    VITMAP_SPAN_BEGIN(span, "jobRange");
+    range->func(range->userData, range->begin, range->end);
+    VITMAP_SPAN_END(span);
+}
+
+void runVitmapJobsFor(int count, int batchSize, VitmapJobRangeFunc func, void* userData)
+{
+    if (count <= 0)
+    {
+        return;
+    }
+    batchSize = batchSize > 0 ? batchSize : 1;
+    int numBatches = (count + batchSize - 1) / batchSize;
+    JobRange* ranges = numBatches > 1 && getVitmapJobThreadCount() > 1 ? malloc(numBatches * sizeof(JobRange)) : NULL;
+    VitmapJob* root = ranges != NULL ? createVitmapJob(NULL, NULL, NULL) : NULL;
+    if (root == NULL)
+    {
+        free(ranges);
+        func(userData, 0, count);
+        return;
+    }
+    for (int i = 0; i < numBatches; i++)
+    {
+        int begin = i * batchSize;
+        ranges[i] = (JobRange){func, userData, begin, begin + batchSize < count ? begin + batchSize : count};
+        VitmapJob* job = createVitmapJob(runJobRange, &ranges[i], root);
+        if (job != NULL)
+        {
+            runVitmapJob(job);
+        }
+        else
+        {
+            runJobRange(&ranges[i]);
+        }
+    }
+    runVitmapJob(root);
+    waitVitmapJob(root);
+    free(ranges);
+}
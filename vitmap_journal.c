@@ -0,0 +1,758 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "include/vitmap_journal.h"
+#include "include/vitmap_log.h"
+#include "include/vitmap_platform.h"
+#include "include/vitmap_trace.h"
+
+// Bumped whenever the records below change
+#define JOURNAL_LAYOUT 1
+
+static const char journalMagic[4] = {'V', 'J', 'N', 'L'};
+
+typedef struct JournalHeader
+{
+    char magic[4];
+    int layout;
+    int version;                        // Format version of the frames in the records
+    int reserved;
+    unsigned long long baseChecksum;    // Of the animation file the saves go on top of
+} JournalHeader;
+
+typedef enum JournalRecordType
+{
+    JOURNAL_FRAME = 1,      // A frame body for frame value, appended when value is the frame count
+    JOURNAL_COMMIT,         // Ends a save, value is the frame count after it
+    JOURNAL_COMPACTED       // A JournalCompacted follows
+} JournalRecordType;
+
+typedef struct JournalRecord
+{
+    int type;
+    int value;
+    int size;                           // Bytes that follow the record
+    int reserved;
+    unsigned long long checksum;        // Of the record with this zeroed, then the bytes that follow
+} JournalRecord;
+
+// Written before a compacted animation file replaces the old one. Until the
+// journal is rewritten for the new file, this says where its saves start.
+typedef struct JournalCompacted
+{
+    unsigned long long baseChecksum;
+    long long offset;
+} JournalCompacted;
+
+struct VitmapJournal
+{
+    char* path;
+    char* journalPath;
+    char* tempPath;                     // The animation file while it is written
+    char* journalTempPath;
+    VitmapAnimation* animation;
+    VitmapSnapshot* snapshots;          // Each frame as of the last save
+    int numSnapshots;
+    int snapshotCapacity;
+    size_t compactSize;
+    // Held while the journal file is written, saves and compactions take turns
+    VitmapMutex lock;
+    FILE* file;                         // NULL after a failed append, the next save writes everything
+    long long size;
+    long long start;                    // Where the saves on top of the animation file begin
+    unsigned long long baseChecksum;
+    // Compaction is long blocking file work, so it gets a thread of its own
+    // instead of tying up a worker of the job system
+    VitmapThread compactionThread;
+    bool compacting;                    // The thread is running or finished but not joined yet
+    long long compactEnd;               // The compaction folds in the saves before this
+    int compactionDone;
+};
+
+// A save's records, built in memory and written with one call
+typedef struct JournalBuffer
+{
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+    bool failed;
+} JournalBuffer;
+
+// 64 bit FNV-1a
+static unsigned long long hashJournalBytes(unsigned long long hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static unsigned long long getJournalChecksum(const void* data, size_t size)
+{
+    return hashJournalBytes(14695981039346656037ULL, data, size);
+}
+
+static unsigned long long getRecordChecksum(JournalRecord record, const void* data)
+{
+    record.checksum = 0;
+    return hashJournalBytes(getJournalChecksum(&record, sizeof record), data, record.size);
+}
+
+static void appendJournalRecord(JournalBuffer* buffer, int type, int value, const void* data, int size)
+{
+    if (buffer->failed || (size > 0 && data == NULL))
+    {
+        buffer->failed = true;
+        return;
+    }
+    size_t needed = buffer->size + sizeof(JournalRecord) + size;
+    if (needed > buffer->capacity)
+    {
+        size_t capacity = buffer->capacity > 0 ? buffer->capacity : 4096;
+        while (capacity < needed)
+        {
+            capacity *= 2;
+        }
+        unsigned char* grown = realloc(buffer->data, capacity);
+        if (grown == NULL) {
+            buffer->failed = true;
+            return;
+        }
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+    JournalRecord record = {type, value, size, 0, 0};
+    record.checksum = getRecordChecksum(record, data);
+    memcpy(buffer->data + buffer->size, &record, sizeof record);
+    if (size > 0)
+    {
+        memcpy(buffer->data + buffer->size + sizeof record, data, size);
+    }
+    buffer->size = needed;
+}
+
+// Returns where the next record starts, or -1 if this one is cut off or damaged
+static long long readJournalRecord(const unsigned char* data, long long size, long long offset,
+    JournalRecord* recordOut, const unsigned char** payloadOut)
+{
+    if (size - offset < (long long)sizeof(JournalRecord))
+    {
+        return -1;
+    }
+    memcpy(recordOut, data + offset, sizeof(JournalRecord));
+    offset += sizeof(JournalRecord);
+    if (recordOut->size < 0 || recordOut->size > size - offset)
+    {
+        return -1;
+    }
+    *payloadOut = data + offset;
+    if (getRecordChecksum(*recordOut, *payloadOut) != recordOut->checksum)
+    {
+        return -1;
+    }
+    return offset + recordOut->size;
+}
+
+// Where the saves on top of the animation file start, -1 if the journal
+// belongs to some other animation file
+static long long findJournalStart(const unsigned char* data, long long size, unsigned long long baseChecksum)
+{
+    JournalHeader header;
+    if (size < (long long)sizeof header)
+    {
+        return -1;
+    }
+    memcpy(&header, data, sizeof header);
+    if (memcmp(header.magic, journalMagic, 4) != 0 || header.layout != JOURNAL_LAYOUT
+        || header.version < 1 || header.version > VITMAP_FORMAT_VERSION)
+    {
+        return -1;
+    }
+    if (header.baseChecksum == baseChecksum)
+    {
+        return sizeof header;
+    }
+    // A compaction that replaced the animation file but not the journal yet
+    long long start = -1;
+    long long offset = sizeof header;
+    JournalRecord record;
+    const unsigned char* payload;
+    while ((offset = readJournalRecord(data, size, offset, &record, &payload)) >= 0)
+    {
+        if (record.type == JOURNAL_COMPACTED && record.size == sizeof(JournalCompacted))
+        {
+            JournalCompacted compacted;
+            memcpy(&compacted, payload, sizeof compacted);
+            if (compacted.baseChecksum == baseChecksum && compacted.offset >= (long long)sizeof header && compacted.offset <= size)
+            {
+                start = compacted.offset;
+            }
+        }
+    }
+    return start;
+}
+
+// Applies every finished save from start on. Returns where the last one ends,
+// anything after it is a save cut short. -1 if a save does not fit the animation.
+static long long replayJournal(const unsigned char* data, long long size, long long start, int version,
+    VitmapAnimation* animation, int* numSavesOut, const char** error)
+{
+    long long end = start;
+    long long offset = start;
+    JournalRecord record;
+    const unsigned char* payload;
+    *numSavesOut = 0;
+    bool inSave = false;
+    while ((offset = readJournalRecord(data, size, offset, &record, &payload)) >= 0)
+    {
+        // Compaction markers go between saves and are no part of them
+        if (record.type == JOURNAL_COMPACTED && !inSave)
+        {
+            end = offset;
+        }
+        if (record.type != JOURNAL_COMMIT)
+        {
+            inSave = inSave || record.type == JOURNAL_FRAME;
+            continue;
+        }
+        // Only now that the save is known to be whole are its frames applied
+        long long frame = end;
+        while (frame < offset)
+        {
+            frame = readJournalRecord(data, size, frame, &record, &payload);
+            if (record.type == JOURNAL_FRAME && !decodeAnimationFrame(payload, record.size, version, animation, record.value, error))
+            {
+                return -1;
+            }
+        }
+        if (record.value > animation->numFrames)
+        {
+            *error = "save has fewer frames than it counts";
+            return -1;
+        }
+        for (int i = record.value; i < animation->numFrames; i++)
+        {
+            unloadVitmap(&animation->frames[i]);
+        }
+        animation->numFrames = record.value;
+        if (animation->currentFrame >= animation->numFrames)
+        {
+            animation->currentFrame = animation->numFrames > 0 ? animation->numFrames - 1 : 0;
+        }
+        end = offset;
+        inSave = false;
+        (*numSavesOut)++;
+    }
+    return end;
+}
+
+static bool writeSyncedFile(const char* path, const void* data, size_t size)
+{
+    FILE* file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        return false;
+    }
+    bool ok = fwrite(data, 1, size, file) == size && syncVitmapFile(file);
+    return fclose(file) == 0 && ok;
+}
+
+// Reads the journal from offset to its current size
+static unsigned char* readJournalTail(VitmapJournal* journal, long long offset, long long size)
+{
+    unsigned char* data = malloc(size > offset ? (size_t)(size - offset) : 1);
+    FILE* file = fopen(journal->journalPath, "rb");
+    bool ok = data != NULL && file != NULL && fseek(file, (long)offset, SEEK_SET) == 0
+        && fread(data, 1, (size_t)(size - offset), file) == (size_t)(size - offset);
+    if (file != NULL)
+    {
+        fclose(file);
+    }
+    if (!ok)
+    {
+        free(data);
+        return NULL;
+    }
+    return data;
+}
+
+// Replaces the journal whole, under a temporary name renamed into place, so a
+// crash leaves either the old journal or the new one. The records go on top of
+// the animation file with the given checksum.
+static bool writeJournalFile(VitmapJournal* journal, unsigned long long baseChecksum, const unsigned char* records, size_t size)
+{
+    JournalHeader header = {{0}, JOURNAL_LAYOUT, VITMAP_FORMAT_VERSION, 0, baseChecksum};
+    memcpy(header.magic, journalMagic, 4);
+    FILE* file = fopen(journal->journalTempPath, "wb");
+    if (file == NULL)
+    {
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof header, 1, file) == 1 && (size == 0 || fwrite(records, 1, size, file) == size)
+        && syncVitmapFile(file);
+    ok = fclose(file) == 0 && ok;
+    // Windows cannot rename over a file that is open
+    if (journal->file != NULL)
+    {
+        fclose(journal->file);
+        journal->file = NULL;
+    }
+    ok = ok && replaceVitmapFile(journal->journalTempPath, journal->journalPath);
+    if (!ok)
+    {
+        remove(journal->journalTempPath);
+    }
+    else
+    {
+        journal->size = sizeof header + size;
+        journal->start = sizeof header;
+        journal->baseChecksum = baseChecksum;
+    }
+    // Appending goes on in the old journal if the new one did not make it
+    journal->file = fopen(journal->journalPath, "ab");
+    return ok && journal->file != NULL;
+}
+
+static bool growJournalSnapshots(VitmapJournal* journal, int numFrames)
+{
+    if (numFrames <= journal->snapshotCapacity)
+    {
+        return true;
+    }
+    int capacity = journal->snapshotCapacity > 0 ? journal->snapshotCapacity : 16;
+    while (capacity < numFrames)
+    {
+        capacity *= 2;
+    }
+    VitmapSnapshot* snapshots = realloc(journal->snapshots, capacity * sizeof(VitmapSnapshot));
+    if (snapshots == NULL) {
+        return false;
+    }
+    journal->snapshots = snapshots;
+    journal->snapshotCapacity = capacity;
+    return true;
+}
+
+static void releaseJournalSnapshots(VitmapJournal* journal)
+{
+    for (int i = 0; i < journal->numSnapshots; i++)
+    {
+        releaseVitmapSnapshot(&journal->snapshots[i]);
+    }
+    journal->numSnapshots = 0;
+}
+
+static bool takeJournalSnapshots(VitmapJournal* journal)
+{
+    releaseJournalSnapshots(journal);
+    VitmapAnimation* animation = journal->animation;
+    if (!growJournalSnapshots(journal, animation->numFrames))
+    {
+        return false;
+    }
+    for (int i = 0; i < animation->numFrames; i++)
+    {
+        journal->snapshots[i] = takeVitmapSnapshot(&animation->frames[i]);
+    }
+    journal->numSnapshots = animation->numFrames;
+    return true;
+}
+
+// Saves the whole animation and starts an empty journal on top of it
+static bool rewriteJournal(VitmapJournal* journal)
+{
+    int size = 0;
+    unsigned char* data = encodeAnimation(journal->animation, VITMAP_FORMAT_VERSION, &size);
+    bool ok = data != NULL && writeSyncedFile(journal->tempPath, data, size)
+        && replaceVitmapFile(journal->tempPath, journal->path);
+    if (!ok)
+    {
+        remove(journal->tempPath);
+    }
+    unsigned long long checksum = ok ? getJournalChecksum(data, size) : 0;
+    free(data);
+    return ok && writeJournalFile(journal, checksum, NULL, 0) && takeJournalSnapshots(journal);
+}
+
+static char* joinJournalPath(const char* path, const char* suffix)
+{
+    size_t length = strlen(path);
+    size_t suffixLength = strlen(suffix);
+    char* joined = malloc(length + suffixLength + 1);
+    if (joined == NULL) {
+        return NULL;
+    }
+    memcpy(joined, path, length);
+    memcpy(joined + length, suffix, suffixLength + 1);
+    return joined;
+}
+
+static void destroyJournal(VitmapJournal* journal)
+{
+    releaseJournalSnapshots(journal);
+    if (journal->file != NULL)
+    {
+        fclose(journal->file);
+    }
+    destroyVitmapMutex(&journal->lock);
+    free(journal->snapshots);
+    free(journal->path);
+    free(journal->journalPath);
+    free(journal->tempPath);
+    free(journal->journalTempPath);
+    free(journal);
+}
+
+static VitmapJournal* createJournal(const char* path, size_t compactSize, VitmapAnimation* animation)
+{
+    VitmapJournal* journal = calloc(1, sizeof *journal);
+    if (journal == NULL) {
+        return NULL;
+    }
+    journal->path = joinJournalPath(path, "");
+    journal->journalPath = joinJournalPath(path, ".journal");
+    journal->tempPath = joinJournalPath(path, ".tmp");
+    journal->journalTempPath = joinJournalPath(path, ".journal.tmp");
+    journal->animation = animation;
+    journal->compactSize = compactSize;
+    if (!initVitmapMutex(&journal->lock))
+    {
+        free(journal);
+        return NULL;
+    }
+    if (journal->path == NULL || journal->journalPath == NULL || journal->tempPath == NULL || journal->journalTempPath == NULL)
+    {
+        destroyJournal(journal);
+        return NULL;
+    }
+    return journal;
+}
+
+// Builds the new animation file from the files alone, so the animation can go
+// on changing and saving while this runs on a worker
+static bool compactJournal(VitmapJournal* journal)
+{
+    lockVitmapMutex(&journal->lock);
+    long long start = journal->start;
+    long long end = journal->compactEnd;
+    unlockVitmapMutex(&journal->lock);
+
+    const char* error = "cannot read the animation or its journal";
+    int baseSize = 0;
+    int journalSize = 0;
+    unsigned char* base = loadVitmapFileData(journal->path, &baseSize);
+    unsigned char* data = loadVitmapFileData(journal->journalPath, &journalSize);
+    unsigned char* encoded = NULL;
+    int encodedSize = 0;
+    bool ok = base != NULL && data != NULL && journalSize >= end;
+    if (ok)
+    {
+        JournalHeader header;
+        memcpy(&header, data, sizeof header);
+        VitmapAnimation animation;
+        int numSaves = 0;
+        ok = decodeAnimation(base, baseSize, &animation, &error)
+            && replayJournal(data, end, start, header.version, &animation, &numSaves, &error) == end;
+        encoded = ok ? encodeAnimation(&animation, VITMAP_FORMAT_VERSION, &encodedSize) : NULL;
+        unloadAnimation(&animation);
+    }
+    free(base);
+    free(data);
+    if (ok && (encoded == NULL || !writeSyncedFile(journal->tempPath, encoded, encodedSize)))
+    {
+        error = "cannot write the animation";
+        ok = false;
+    }
+    unsigned long long checksum = getJournalChecksum(encoded, encoded != NULL ? encodedSize : 0);
+    free(encoded);
+
+    lockVitmapMutex(&journal->lock);
+    JournalBuffer marker = {NULL, 0, 0, false};
+    JournalCompacted compacted = {checksum, end};
+    appendJournalRecord(&marker, JOURNAL_COMPACTED, 0, &compacted, sizeof compacted);
+    // Once the marker is on disk a crash at any point below still recovers
+    if (ok && (marker.failed || journal->file == NULL || fwrite(marker.data, 1, marker.size, journal->file) != marker.size
+        || !syncVitmapFile(journal->file)))
+    {
+        // Whatever part of the marker made it would hide every later save
+        if (journal->file != NULL)
+        {
+            fclose(journal->file);
+            journal->file = NULL;
+        }
+        error = "cannot append to the journal";
+        ok = false;
+    }
+    if (ok && !replaceVitmapFile(journal->tempPath, journal->path))
+    {
+        error = "cannot replace the animation";
+        ok = false;
+    }
+    if (ok)
+    {
+        journal->baseChecksum = checksum;
+        journal->start = end;
+        // Saves that came in meanwhile move to the new journal, the marker stays behind
+        unsigned char* tail = readJournalTail(journal, end, journal->size);
+        if (tail == NULL || !writeJournalFile(journal, checksum, tail, (size_t)(journal->size - end)))
+        {
+            journal->size += marker.size;
+        }
+        free(tail);
+    }
+    else
+    {
+        remove(journal->tempPath);
+        VITMAP_WARNING("Failed to compact %s: %s.", journal->journalPath, error);
+    }
+    unlockVitmapMutex(&journal->lock);
+    free(marker.data);
+    if (ok)
+    {
+        VITMAP_INFO("Compacted %s, %lld journal bytes folded in.", journal->journalPath, end - start);
+    }
+    return ok;
+}
+
+static void compactJournalThread(void* userData)
+{
+    VitmapJournal* journal = userData;
+    VITMAP_SPAN_BEGIN(span, "compactVitmapJournal");
+    compactJournal(journal);
+    VITMAP_SPAN_END(span);
+    __atomic_store_n(&journal->compactionDone, 1, __ATOMIC_RELEASE);
+}
+
+// A compaction that cannot start is tried again on the next save
+static void startJournalCompaction(VitmapJournal* journal)
+{
+    __atomic_store_n(&journal->compactionDone, 0, __ATOMIC_RELAXED);
+    journal->compacting = startVitmapThread(&journal->compactionThread, compactJournalThread, journal);
+    if (!journal->compacting)
+    {
+        VITMAP_WARNING("Failed to start compacting %s.", journal->journalPath);
+    }
+}
+
+// Joining is instant once the thread is done
+static void finishJournalCompaction(VitmapJournal* journal, bool wait)
+{
+    if (journal->compacting && (wait || __atomic_load_n(&journal->compactionDone, __ATOMIC_ACQUIRE)))
+    {
+        joinVitmapThread(&journal->compactionThread);
+        journal->compacting = false;
+    }
+}
+
+VitmapJournal* openVitmapJournal(const char* path, size_t compactSize, VitmapAnimation* animationOut)
+{
+    VITMAP_SPAN_BEGIN(span, "openVitmapJournal");
+    initVitmapAnimation(animationOut);
+    int baseSize = 0;
+    unsigned char* base = loadVitmapFileData(path, &baseSize);
+    if (base == NULL)
+    {
+        VITMAP_ERROR("Failed to open %s for reading.", path);
+        VITMAP_SPAN_END(span);
+        return NULL;
+    }
+    const char* error = NULL;
+    bool ok = decodeAnimation(base, baseSize, animationOut, &error);
+    unsigned long long baseChecksum = getJournalChecksum(base, baseSize);
+    free(base);
+    VitmapJournal* journal = ok ? createJournal(path, compactSize, animationOut) : NULL;
+    if (journal == NULL)
+    {
+        VITMAP_ERROR("Failed to load animation %s: %s", path, ok ? "out of memory" : error);
+        unloadAnimation(animationOut);
+        VITMAP_SPAN_END(span);
+        return NULL;
+    }
+
+    int journalSize = 0;
+    unsigned char* data = loadVitmapFileData(journal->journalPath, &journalSize);
+    long long start = data != NULL ? findJournalStart(data, journalSize, baseChecksum) : -1;
+    long long end = start;
+    int numSaves = 0;
+    int version = VITMAP_FORMAT_VERSION;
+    if (start >= 0)
+    {
+        JournalHeader header;
+        memcpy(&header, data, sizeof header);
+        version = header.version;
+        end = replayJournal(data, journalSize, start, version, animationOut, &numSaves, &error);
+    }
+    else if (data != NULL)
+    {
+        VITMAP_WARNING("Ignoring %s, it was not written for this version of %s.", journal->journalPath, path);
+    }
+
+    if (start >= 0 && end < 0)
+    {
+        VITMAP_ERROR("Failed to replay %s: %s", journal->journalPath, error);
+        ok = false;
+    }
+    else if (start >= 0 && version != VITMAP_FORMAT_VERSION)
+    {
+        // One journal holds one format version, older saves go into the animation file
+        ok = rewriteJournal(journal);
+    }
+    else if (start >= 0 && end == journalSize)
+    {
+        journal->file = fopen(journal->journalPath, "ab");
+        journal->size = journalSize;
+        journal->start = start;
+        journal->baseChecksum = baseChecksum;
+        ok = journal->file != NULL && takeJournalSnapshots(journal);
+    }
+    else
+    {
+        if (start >= 0)
+        {
+            VITMAP_WARNING("Dropped %lld bytes of an unfinished save from %s.", journalSize - end, journal->journalPath);
+        }
+        // Appends have to follow the last whole save
+        ok = writeJournalFile(journal, baseChecksum, start >= 0 ? data + start : NULL, start >= 0 ? (size_t)(end - start) : 0)
+            && takeJournalSnapshots(journal);
+    }
+    free(data);
+    if (!ok)
+    {
+        VITMAP_ERROR("Failed to open the journal of %s.", path);
+        destroyJournal(journal);
+        unloadAnimation(animationOut);
+        VITMAP_SPAN_END(span);
+        return NULL;
+    }
+    VITMAP_INFO("Animation loaded from %s with %d saves from its journal, %d frames.", path, numSaves, animationOut->numFrames);
+    VITMAP_SPAN_END(span);
+    return journal;
+}
+
+VitmapJournal* createVitmapJournal(const char* path, size_t compactSize, VitmapAnimation* animation)
+{
+    VitmapJournal* journal = createJournal(path, compactSize, animation);
+    if (journal == NULL || !rewriteJournal(journal))
+    {
+        VITMAP_ERROR("Failed to save animation to %s.", path);
+        if (journal != NULL)
+        {
+            destroyJournal(journal);
+        }
+        return NULL;
+    }
+    VITMAP_INFO("Animation saved to %s.", path);
+    return journal;
+}
+
+void closeVitmapJournal(VitmapJournal* journal)
+{
+    if (journal == NULL)
+    {
+        return;
+    }
+    finishJournalCompaction(journal, true);
+    // Leaves the animation file whole for everything that does not read journals
+    if (journal->file != NULL && journal->size > journal->start)
+    {
+        journal->compactEnd = journal->size;
+        compactJournal(journal);
+    }
+    destroyJournal(journal);
+}
+
+bool saveVitmapJournal(VitmapJournal* journal)
+{
+    VITMAP_SPAN_BEGIN(span, "saveVitmapJournal");
+    finishJournalCompaction(journal, false);
+    VitmapAnimation* animation = journal->animation;
+    JournalBuffer buffer = {NULL, 0, 0, false};
+    int numChanged = 0;
+    for (int i = 0; i < animation->numFrames; i++)
+    {
+        if (i < journal->numSnapshots && isVitmapUnchangedSince(&animation->frames[i], &journal->snapshots[i]))
+        {
+            continue;
+        }
+        int size = 0;
+        unsigned char* frame = encodeVitmapFrame(&animation->frames[i], VITMAP_FORMAT_VERSION, &size);
+        appendJournalRecord(&buffer, JOURNAL_FRAME, i, frame, size);
+        free(frame);
+        numChanged++;
+    }
+    if (numChanged == 0 && animation->numFrames == journal->numSnapshots)
+    {
+        VITMAP_SPAN_END(span);
+        return true;
+    }
+    appendJournalRecord(&buffer, JOURNAL_COMMIT, animation->numFrames, NULL, 0);
+    if (buffer.failed || !growJournalSnapshots(journal, animation->numFrames))
+    {
+        VITMAP_ERROR("Failed to save animation to %s: out of memory.", journal->path);
+        free(buffer.data);
+        VITMAP_SPAN_END(span);
+        return false;
+    }
+
+    lockVitmapMutex(&journal->lock);
+    bool ok = journal->file != NULL && fwrite(buffer.data, 1, buffer.size, journal->file) == buffer.size
+        && syncVitmapFile(journal->file);
+    if (ok)
+    {
+        journal->size += buffer.size;
+    }
+    else if (journal->file != NULL)
+    {
+        // Part of this save may have made it, nothing can be appended after that
+        fclose(journal->file);
+        journal->file = NULL;
+    }
+    bool compact = ok && journal->size - journal->start > (long long)journal->compactSize && !journal->compacting;
+    if (compact)
+    {
+        journal->compactEnd = journal->size;
+    }
+    unlockVitmapMutex(&journal->lock);
+    free(buffer.data);
+
+    if (!ok)
+    {
+        VITMAP_WARNING("Failed to append to %s, saving the whole animation.", journal->journalPath);
+        finishJournalCompaction(journal, true);
+        ok = rewriteJournal(journal);
+        if (!ok)
+        {
+            VITMAP_ERROR("Failed to save animation to %s.", journal->path);
+        }
+        VITMAP_SPAN_END(span);
+        return ok;
+    }
+
+    for (int i = 0; i < animation->numFrames; i++)
+    {
+        if (i < journal->numSnapshots && isVitmapUnchangedSince(&animation->frames[i], &journal->snapshots[i]))
+        {
+            continue;
+        }
+        if (i < journal->numSnapshots)
+        {
+            releaseVitmapSnapshot(&journal->snapshots[i]);
+        }
+        journal->snapshots[i] = takeVitmapSnapshot(&animation->frames[i]);
+    }
+    for (int i = animation->numFrames; i < journal->numSnapshots; i++)
+    {
+        releaseVitmapSnapshot(&journal->snapshots[i]);
+    }
+    journal->numSnapshots = animation->numFrames;
+    VITMAP_DEBUG("Saved %d of %d frames to %s", numChanged, animation->numFrames, journal->journalPath);
+    if (compact)
+    {
+        startJournalCompaction(journal);
+    }
+    VITMAP_SPAN_END(span);
+    return true;
+}
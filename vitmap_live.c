@@ -0,0 +1,515 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "include/vitmap_live.h"
+#include "include/vitmap_log.h"
+#include "include/vitmap_platform.h"
+#include "include/vitmap_trace.h"
+
+#define LIVE_MAGIC 0x4556494cu      // "LIVE" in a little endian dump
+#define LIVE_LAYOUT 1               // Bump when the records below change
+#define LIVE_NUM_BUFFERS 3          // The newest, the one the view holds and one to write
+#define LIVE_HEADER_SIZE 64
+#define LIVE_NAME_SIZE 128
+
+// The shared memory is a header followed by the buffers. Records in a buffer
+// refer to each other by offsets from the start of the buffer, since pointers
+// mean nothing in the other process. Offset 0 is the animation record, so it
+// doubles as "none".
+typedef struct LiveHeader
+{
+    unsigned int magic;             // Written last, so a view never sees a half made header
+    unsigned int layout;
+    unsigned long long bufferSize;
+    unsigned int generation;        // Of the newest buffer, bumped by every publish
+    int newest;                     // Buffer the last publish wrote, -1 before the first
+    int held;                       // Buffer the view reads, which the publisher leaves alone. -1 for none.
+    int closed;                     // Set when the publisher goes away
+} LiveHeader;
+
+// At the start of every buffer
+typedef struct LiveAnimation
+{
+    unsigned int generation;
+    unsigned int used;              // Bytes of the buffer written, this record included
+    int numFrames;
+    int currentFrame;
+    unsigned int frames;            // LiveFrame[numFrames]
+} LiveAnimation;
+
+typedef struct LiveFrame
+{
+    Vector2 offset;
+    int numShapes;
+    int numPaletteColors;
+    unsigned int shapes;            // LiveShape[numShapes], in draw order
+    unsigned int palette;
+} LiveFrame;
+
+typedef struct LiveShape
+{
+    Vector2 offset;
+    Color color;
+    int paletteIndex;
+    int windingRule;
+    int numPoints;
+    int numContours;
+    int numCurves;
+    int numVertices;                // -1 for a shape that was not baked
+    int numIndices;
+    Vector2 boundsMin;
+    Vector2 boundsMax;
+    unsigned int points;
+    unsigned int contourStarts;
+    unsigned int curves;
+    unsigned int vertices;
+    unsigned int indices;
+} LiveShape;
+
+struct VitmapLivePublisher
+{
+    VitmapSharedMemory memory;
+    LiveHeader* header;
+    size_t bufferSize;
+    bool warnedFull;
+    char name[LIVE_NAME_SIZE];
+};
+
+struct VitmapLiveView
+{
+    VitmapSharedMemory memory;
+    LiveHeader* header;             // NULL until a publisher's memory is mapped
+    unsigned int generation;        // Of the buffer the animation was built from
+    bool hasAnimation;
+    VitmapAnimation animation;
+    char name[LIVE_NAME_SIZE];
+};
+
+static unsigned char* getLiveBuffer(LiveHeader* header, int index)
+{
+    return (unsigned char*)header + LIVE_HEADER_SIZE + (size_t)index * header->bufferSize;
+}
+
+// bufferSize 0 takes any size the memory has room for
+static bool isLiveHeaderValid(const VitmapSharedMemory* memory, size_t bufferSize)
+{
+    const LiveHeader* header = memory->data;
+    if (memory->size < LIVE_HEADER_SIZE || __atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != LIVE_MAGIC
+        || header->layout != LIVE_LAYOUT)
+    {
+        return false;
+    }
+    unsigned long long size = header->bufferSize;
+    return (bufferSize == 0 ? size >= sizeof(LiveAnimation) : size == bufferSize)
+        && size <= (memory->size - LIVE_HEADER_SIZE) / LIVE_NUM_BUFFERS;
+}
+
+VitmapLivePublisher* createVitmapLivePublisher(const char* name, size_t bufferSize)
+{
+    if (strlen(name) >= LIVE_NAME_SIZE)
+    {
+        VITMAP_ERROR("Live preview name %s is too long.", name);
+        return NULL;
+    }
+    VitmapLivePublisher* publisher = calloc(1, sizeof *publisher);
+    if (publisher == NULL) {
+        return NULL;
+    }
+    strcpy(publisher->name, name);
+    bufferSize = bufferSize > sizeof(LiveAnimation) ? bufferSize : sizeof(LiveAnimation);
+    bufferSize = (bufferSize + LIVE_HEADER_SIZE - 1) & ~(size_t)(LIVE_HEADER_SIZE - 1);
+    publisher->bufferSize = bufferSize;
+    size_t size = LIVE_HEADER_SIZE + LIVE_NUM_BUFFERS * bufferSize;
+    bool existed = false;
+    bool mapped = createVitmapSharedMemory(&publisher->memory, name, size, &existed);
+    // Memory left by a publisher with another buffer size is closed, so its
+    // view lets go of it, and made again
+    if (mapped && existed && !isLiveHeaderValid(&publisher->memory, bufferSize))
+    {
+        if (isLiveHeaderValid(&publisher->memory, 0))
+        {
+            __atomic_store_n(&((LiveHeader*)publisher->memory.data)->closed, 1, __ATOMIC_SEQ_CST);
+        }
+        closeVitmapSharedMemory(&publisher->memory);
+        removeVitmapSharedMemory(name);
+        mapped = createVitmapSharedMemory(&publisher->memory, name, size, &existed);
+        if (mapped && existed)
+        {
+            closeVitmapSharedMemory(&publisher->memory);
+            mapped = false;
+        }
+    }
+    if (!mapped)
+    {
+        VITMAP_ERROR("Could not make the live preview %s.", name);
+        free(publisher);
+        return NULL;
+    }
+    LiveHeader* header = publisher->memory.data;
+    publisher->header = header;
+    if (existed)
+    {
+        // Left by an earlier publisher and taken over as it is, so a buffer
+        // its view still reads stays held
+        __atomic_store_n(&header->closed, 0, __ATOMIC_SEQ_CST);
+    }
+    else
+    {
+        header->layout = LIVE_LAYOUT;
+        header->bufferSize = bufferSize;
+        header->generation = 0;
+        header->newest = -1;
+        header->held = -1;
+        header->closed = 0;
+        __atomic_store_n(&header->magic, LIVE_MAGIC, __ATOMIC_RELEASE);
+    }
+    VITMAP_INFO("Publishing live preview %s.", name);
+    return publisher;
+}
+
+void destroyVitmapLivePublisher(VitmapLivePublisher* publisher)
+{
+    if (publisher == NULL)
+    {
+        return;
+    }
+    __atomic_store_n(&publisher->header->closed, 1, __ATOMIC_SEQ_CST);
+    closeVitmapSharedMemory(&publisher->memory);
+    removeVitmapSharedMemory(publisher->name);
+    free(publisher);
+}
+
+typedef struct LiveWriter
+{
+    unsigned char* buffer;
+    size_t size;
+    size_t used;
+    bool full;
+} LiveWriter;
+
+// Offset of a zeroed block, 0 for an empty one or once the buffer is full.
+// The padding is zeroed too, so the same animation always gives the same bytes.
+static unsigned int reserveLive(LiveWriter* writer, size_t size)
+{
+    size_t start = (writer->used + 7) & ~(size_t)7;
+    if (size == 0 || writer->full)
+    {
+        return 0;
+    }
+    if (start + size > writer->size)
+    {
+        writer->full = true;
+        return 0;
+    }
+    memset(writer->buffer + writer->used, 0, start + size - writer->used);
+    writer->used = start + size;
+    return (unsigned int)start;
+}
+
+static unsigned int writeLive(LiveWriter* writer, const void* data, size_t size)
+{
+    unsigned int offset = reserveLive(writer, size);
+    if (offset != 0)
+    {
+        memcpy(writer->buffer + offset, data, size);
+    }
+    return offset;
+}
+
+static void writeLiveShape(LiveWriter* writer, unsigned int offset, const Shape* shape)
+{
+    LiveShape live = {0};
+    live.offset = shape->offset;
+    live.color = shape->color;
+    live.paletteIndex = shape->paletteIndex;
+    live.windingRule = (int)shape->windingRule;
+    live.numPoints = shape->numPoints;
+    live.numContours = shape->numContours;
+    live.numCurves = shape->numCurves;
+    live.points = writeLive(writer, shape->points, shape->numPoints * sizeof(Vector2));
+    if (shape->numContours > 1)
+    {
+        live.contourStarts = writeLive(writer, shape->contourStarts, (shape->numContours - 1) * sizeof(int));
+    }
+    live.curves = writeLive(writer, shape->curves, shape->numCurves * sizeof(ShapeCurve));
+    live.numVertices = -1;
+    // Unbaked shapes are baked by the view when it draws them
+    if (shape->mesh != NULL)
+    {
+        live.numVertices = shape->mesh->numVertices;
+        live.numIndices = shape->mesh->numIndices;
+        live.boundsMin = shape->mesh->boundsMin;
+        live.boundsMax = shape->mesh->boundsMax;
+        live.vertices = writeLive(writer, shape->mesh->vertices, shape->mesh->numVertices * sizeof(Vector2));
+        live.indices = writeLive(writer, shape->mesh->indices, shape->mesh->numIndices * sizeof(int));
+    }
+    if (!writer->full)
+    {
+        memcpy(writer->buffer + offset, &live, sizeof live);
+    }
+}
+
+bool publishVitmapAnimation(VitmapLivePublisher* publisher, const VitmapAnimation* animation)
+{
+    VITMAP_SPAN_BEGIN(span, "publishVitmapAnimation");
+    LiveHeader* header = publisher->header;
+    // The newest is read before the held one, the view does the opposite
+    // when it takes a buffer (see updateVitmapLiveView)
+    int newest = __atomic_load_n(&header->newest, __ATOMIC_SEQ_CST);
+    int held = __atomic_load_n(&header->held, __ATOMIC_SEQ_CST);
+    int target = 0;
+    while (target == newest || target == held)
+    {
+        target++;
+    }
+    LiveWriter writer = {getLiveBuffer(header, target), publisher->bufferSize, sizeof(LiveAnimation), false};
+    LiveAnimation live = {0};
+    live.numFrames = animation->numFrames;
+    live.currentFrame = animation->currentFrame;
+    live.frames = reserveLive(&writer, animation->numFrames * sizeof(LiveFrame));
+    for (int i = 0; i < animation->numFrames && !writer.full; i++)
+    {
+        const Vitmap* vitmap = &animation->frames[i];
+        LiveFrame frame = {0};
+        frame.offset = vitmap->offset;
+        frame.numShapes = vitmap->numShapes;
+        frame.numPaletteColors = vitmap->numPaletteColors;
+        frame.palette = writeLive(&writer, vitmap->palette, vitmap->numPaletteColors * sizeof(Color));
+        frame.shapes = reserveLive(&writer, vitmap->numShapes * sizeof(LiveShape));
+        for (int j = 0; j < vitmap->numShapes && !writer.full; j++)
+        {
+            writeLiveShape(&writer, frame.shapes + j * sizeof(LiveShape), getVitmapShape(vitmap, j));
+        }
+        if (!writer.full)
+        {
+            memcpy(writer.buffer + live.frames + i * sizeof(LiveFrame), &frame, sizeof frame);
+        }
+    }
+    if (writer.full)
+    {
+        if (!publisher->warnedFull)
+        {
+            VITMAP_WARNING("The animation does not fit in the %zu byte live preview buffers.", publisher->bufferSize);
+            publisher->warnedFull = true;
+        }
+        VITMAP_SPAN_END(span);
+        return false;
+    }
+    publisher->warnedFull = false;
+    live.used = (unsigned int)writer.used;
+
+    // An animation that did not change since the last publish is left out, so
+    // the view does not rebuild and rebake it every frame
+    if (newest >= 0)
+    {
+        const LiveAnimation* last = (const LiveAnimation*)getLiveBuffer(header, newest);
+        size_t start = offsetof(LiveAnimation, used);
+        if (last->used == live.used
+            && memcmp((const unsigned char*)last + start, (const unsigned char*)&live + start, sizeof live - start) == 0
+            && memcmp((const unsigned char*)last + sizeof live, writer.buffer + sizeof live, live.used - sizeof live) == 0)
+        {
+            VITMAP_SPAN_END(span);
+            return true;
+        }
+    }
+    live.generation = __atomic_load_n(&header->generation, __ATOMIC_RELAXED) + 1;
+    memcpy(writer.buffer, &live, sizeof live);
+    __atomic_store_n(&header->newest, target, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&header->generation, live.generation, __ATOMIC_SEQ_CST);
+    VITMAP_SPAN_END(span);
+    return true;
+}
+
+VitmapLiveView* openVitmapLiveView(const char* name)
+{
+    if (strlen(name) >= LIVE_NAME_SIZE)
+    {
+        VITMAP_ERROR("Live preview name %s is too long.", name);
+        return NULL;
+    }
+    VitmapLiveView* view = calloc(1, sizeof *view);
+    if (view == NULL) {
+        return NULL;
+    }
+    strcpy(view->name, name);
+    initVitmapAnimation(&view->animation);
+    return view;
+}
+
+static void dropLiveAnimation(VitmapLiveView* view)
+{
+    if (view->hasAnimation)
+    {
+        unloadAnimation(&view->animation);
+        view->hasAnimation = false;
+    }
+}
+
+// Gives the held buffer back, once nothing points into it
+static void unmapLiveView(VitmapLiveView* view)
+{
+    dropLiveAnimation(view);
+    if (view->header != NULL)
+    {
+        __atomic_store_n(&view->header->held, -1, __ATOMIC_SEQ_CST);
+        closeVitmapSharedMemory(&view->memory);
+        view->header = NULL;
+    }
+    view->generation = 0;
+}
+
+void closeVitmapLiveView(VitmapLiveView* view)
+{
+    if (view == NULL)
+    {
+        return;
+    }
+    unmapLiveView(view);
+    free(view);
+}
+
+// Checked against the part of the buffer that was written, so a damaged
+// buffer is turned down instead of read past its end
+static bool isLiveRangeValid(unsigned int used, unsigned int offset, int count, size_t size)
+{
+    return count >= 0 && (count == 0
+        || (offset >= sizeof(LiveAnimation) && offset <= used && (size_t)count <= (used - offset) / size));
+}
+
+// The geometry stays where it is in the buffer, only the shape itself is made here
+static bool addLiveShape(Vitmap* frame, unsigned char* buffer, unsigned int used, const LiveShape* from)
+{
+    bool baked = from->numVertices >= 0;
+    if (!isLiveRangeValid(used, from->points, from->numPoints, sizeof(Vector2)) || from->numContours < 1
+        || !isLiveRangeValid(used, from->contourStarts, from->numContours - 1, sizeof(int))
+        || !isLiveRangeValid(used, from->curves, from->numCurves, sizeof(ShapeCurve))
+        || (baked && !isLiveRangeValid(used, from->vertices, from->numVertices, sizeof(Vector2)))
+        || (baked && !isLiveRangeValid(used, from->indices, from->numIndices, sizeof(int)))
+        || from->windingRule < VITMAP_WINDING_ODD || from->windingRule > VITMAP_WINDING_POSITIVE)
+    {
+        return false;
+    }
+    Shape* shape = editShape(frame, addShapeToVitmap(frame));
+    ShapeMesh* mesh = baked ? allocateFromVitmapArena(frame->arena, sizeof(ShapeMesh)) : NULL;
+    if (shape == NULL || (baked && mesh == NULL)) {
+        return false;
+    }
+    shape->points = from->numPoints > 0 ? (Vector2*)(buffer + from->points) : NULL;
+    shape->numPoints = from->numPoints;
+    shape->pointCapacity = from->numPoints;
+    shape->contourStarts = from->numContours > 1 ? (const int*)(buffer + from->contourStarts) : NULL;
+    shape->numContours = from->numContours;
+    shape->windingRule = (VitmapWindingRule)from->windingRule;
+    shape->curves = from->numCurves > 0 ? (const ShapeCurve*)(buffer + from->curves) : NULL;
+    shape->numCurves = from->numCurves;
+    shape->color = from->color;
+    shape->paletteIndex = from->paletteIndex;
+    shape->offset = from->offset;
+    if (baked)
+    {
+        mesh->vertices = from->numVertices > 0 ? (Vector2*)(buffer + from->vertices) : NULL;
+        mesh->numVertices = from->numVertices;
+        mesh->indices = from->numIndices > 0 ? (int*)(buffer + from->indices) : NULL;
+        mesh->numIndices = from->numIndices;
+        mesh->boundsMin = from->boundsMin;
+        mesh->boundsMax = from->boundsMax;
+        shape->mesh = mesh;
+    }
+    return true;
+}
+
+static bool buildLiveAnimation(VitmapAnimation* animation, unsigned char* buffer, size_t bufferSize)
+{
+    const LiveAnimation* live = (const LiveAnimation*)buffer;
+    unsigned int used = live->used;
+    if (used < sizeof(LiveAnimation) || used > bufferSize
+        || !isLiveRangeValid(used, live->frames, live->numFrames, sizeof(LiveFrame)))
+    {
+        return false;
+    }
+    const LiveFrame* frames = (const LiveFrame*)(buffer + live->frames);
+    for (int i = 0; i < live->numFrames; i++)
+    {
+        const LiveFrame* from = &frames[i];
+        Vitmap* frame = addEmptyFrameToAnimation(animation);
+        if (frame == NULL || !isLiveRangeValid(used, from->shapes, from->numShapes, sizeof(LiveShape))
+            || !isLiveRangeValid(used, from->palette, from->numPaletteColors, sizeof(Color)))
+        {
+            return false;
+        }
+        frame->offset = from->offset;
+        frame->palette = from->numPaletteColors > 0 ? (const Color*)(buffer + from->palette) : NULL;
+        frame->numPaletteColors = from->numPaletteColors;
+        const LiveShape* shapes = (const LiveShape*)(buffer + from->shapes);
+        for (int j = 0; j < from->numShapes; j++)
+        {
+            if (!addLiveShape(frame, buffer, used, &shapes[j]))
+            {
+                return false;
+            }
+        }
+    }
+    animation->currentFrame = live->currentFrame >= 0 && live->currentFrame < live->numFrames ? live->currentFrame : 0;
+    return true;
+}
+
+bool updateVitmapLiveView(VitmapLiveView* view)
+{
+    bool hadAnimation = view->hasAnimation;
+    if (view->header == NULL)
+    {
+        if (!openVitmapSharedMemory(&view->memory, view->name))
+        {
+            return false;
+        }
+        // Still being made, or made by another version of the library
+        if (!isLiveHeaderValid(&view->memory, 0))
+        {
+            closeVitmapSharedMemory(&view->memory);
+            return false;
+        }
+        view->header = view->memory.data;
+    }
+    LiveHeader* header = view->header;
+    if (__atomic_load_n(&header->closed, __ATOMIC_SEQ_CST))
+    {
+        unmapLiveView(view);
+        return hadAnimation;
+    }
+    unsigned int generation = __atomic_load_n(&header->generation, __ATOMIC_SEQ_CST);
+    int newest = __atomic_load_n(&header->newest, __ATOMIC_SEQ_CST);
+    if (generation == view->generation || newest < 0)
+    {
+        return false;
+    }
+    VITMAP_SPAN_BEGIN(span, "updateVitmapLiveView");
+    // Nothing may point into the old buffer once the publisher can have it back
+    dropLiveAnimation(view);
+    // The publisher only writes a buffer that is neither the newest nor held
+    // when it looks, so holding one is only safe if it is still the newest after
+    for (;;)
+    {
+        __atomic_store_n(&header->held, newest, __ATOMIC_SEQ_CST);
+        int check = __atomic_load_n(&header->newest, __ATOMIC_SEQ_CST);
+        if (check == newest)
+        {
+            break;
+        }
+        newest = check;
+    }
+    unsigned char* buffer = getLiveBuffer(header, newest);
+    view->generation = ((const LiveAnimation*)buffer)->generation;
+    view->hasAnimation = buildLiveAnimation(&view->animation, buffer, header->bufferSize);
+    if (!view->hasAnimation)
+    {
+        unloadAnimation(&view->animation);
+        VITMAP_WARNING("Skipped a damaged update of live preview %s.", view->name);
+    }
+    VITMAP_SPAN_END(span);
+    return view->hasAnimation || hadAnimation;
+}
+
+VitmapAnimation* getVitmapLiveAnimation(VitmapLiveView* view)
+{
+    return view->hasAnimation ? &view->animation : NULL;
+}
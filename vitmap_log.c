@@ -0,0 +1,52 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include "include/vitmap_log.h"
+
+int vitmapLogLevel = VITMAP_LOG_INFO;
+
+static void printLogRecord(const VitmapLogRecord* record, void* userData)
+{
+    (void)userData;
+    // One fprintf per message keeps lines from different threads whole
+    fprintf(stdout, "%s: %s\n", getVitmapLogLevelName(record->level), record->message);
+}
+
+static VitmapLogSink logSink = printLogRecord;
+static void* logSinkUserData = NULL;
+
+void setVitmapLogLevel(int level)
+{
+    vitmapLogLevel = level;
+}
+
+// Passing NULL puts the default stdout sink back
+void setVitmapLogSink(VitmapLogSink sink, void* userData)
+{
+    logSink = sink != NULL ? sink : printLogRecord;
+    logSinkUserData = sink != NULL ? userData : NULL;
+}
+
+const char* getVitmapLogLevelName(int level)
+{
+    switch (level)
+    {
+        case VITMAP_LOG_TRACE: return "TRACE";
+        case VITMAP_LOG_DEBUG: return "DEBUG";
+        case VITMAP_LOG_INFO: return "INFO";
+        case VITMAP_LOG_WARNING: return "WARNING";
+        case VITMAP_LOG_ERROR: return "ERROR";
+        default: return "LOG";
+    }
+}
+
+void logVitmapMessage(int level, const char* file, int line, const char* format, ...)
+{
+    char message[512];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof message, format, args);
+    va_end(args);
+
+    VitmapLogRecord record = {level, file, line, message};
+    logSink(&record, logSinkUserData);
+}
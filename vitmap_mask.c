@@ -0,0 +1,295 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "include/vitmap_mask.h"
+
+// Where a scanline crosses an edge, and which way the edge goes
+typedef struct MaskCrossing
+{
+    float x;
+    int winding;
+} MaskCrossing;
+
+static int compareCrossings(const void* a, const void* b)
+{
+    float x = ((const MaskCrossing*)a)->x;
+    float y = ((const MaskCrossing*)b)->x;
+    return (x > y) - (x < y);
+}
+
+// Sets pixels x0 to x1, both included
+static void setMaskSpan(unsigned long long* row, int x0, int x1)
+{
+    int firstWord = x0 >> 6;
+    int lastWord = x1 >> 6;
+    unsigned long long firstBits = ~0ULL << (x0 & 63);
+    unsigned long long lastBits = ~0ULL >> (63 - (x1 & 63));
+    if (firstWord == lastWord)
+    {
+        row[firstWord] |= firstBits & lastBits;
+        return;
+    }
+    row[firstWord] |= firstBits;
+    for (int word = firstWord + 1; word < lastWord; word++)
+    {
+        row[word] = ~0ULL;
+    }
+    row[lastWord] |= lastBits;
+}
+
+// Curves are flattened to within a quarter pixel
+#define MASK_CURVE_TOLERANCE 0.25f
+
+// A shape flattened and moved into pixel space
+typedef struct MaskShape
+{
+    Vector2* points;
+    int numPoints;
+    int* contourStarts;
+    int numContours;
+    VitmapWindingRule windingRule;
+} MaskShape;
+
+// Scanline fill of one shape with its winding rule, sampling at pixel centers
+static void fillMaskShape(VitmapMask* mask, const MaskShape* shape, MaskCrossing* crossings)
+{
+    const Vector2* points = shape->points;
+    float minY = points[0].y;
+    float maxY = points[0].y;
+    for (int i = 1; i < shape->numPoints; i++)
+    {
+        minY = fminf(minY, points[i].y);
+        maxY = fmaxf(maxY, points[i].y);
+    }
+    int firstRow = (int)fmaxf(floorf(minY), 0.0f);
+    int lastRow = (int)fminf(ceilf(maxY), (float)mask->height);
+    for (int y = firstRow; y < lastRow; y++)
+    {
+        float centerY = y + 0.5f;
+        int numCrossings = 0;
+        for (int c = 0; c < shape->numContours; c++)
+        {
+            int start = c > 0 ? shape->contourStarts[c - 1] : 0;
+            int count = (c + 1 < shape->numContours ? shape->contourStarts[c] : shape->numPoints) - start;
+            const Vector2* contour = &points[start];
+            for (int i = 0, j = count - 1; i < count; j = i++)
+            {
+                Vector2 p = contour[i];
+                Vector2 q = contour[j];
+                if ((p.y > centerY) != (q.y > centerY))
+                {
+                    float x = p.x + (centerY - p.y) * (q.x - p.x) / (q.y - p.y);
+                    crossings[numCrossings++] = (MaskCrossing){x, p.y > q.y ? 1 : -1};
+                }
+            }
+        }
+        qsort(crossings, numCrossings, sizeof(MaskCrossing), compareCrossings);
+        // Left of every crossing the winding is 0, and each one passed changes it
+        unsigned long long* row = &mask->bits[(size_t)y * mask->wordsPerRow];
+        int winding = 0;
+        for (int i = 0; i + 1 < numCrossings; i++)
+        {
+            winding -= crossings[i].winding;
+            if (!isWindingFilled(shape->windingRule, winding))
+            {
+                continue;
+            }
+            int x0 = (int)ceilf(crossings[i].x - 0.5f);
+            int x1 = (int)ceilf(crossings[i + 1].x - 0.5f) - 1;
+            x0 = x0 < 0 ? 0 : x0;
+            x1 = x1 >= mask->width ? mask->width - 1 : x1;
+            if (x0 <= x1)
+            {
+                setMaskSpan(row, x0, x1);
+            }
+        }
+    }
+}
+
+VitmapMask createVitmapMask(const Vitmap* vitmap, float scale)
+{
+    VitmapMask mask = {0, 0, 0, NULL, 0, 0};
+    if (scale <= 0.0f)
+    {
+        return mask;
+    }
+    VitmapArena* scratch = createVitmapArena(64 * 1024);
+    MaskShape* shapes = scratch != NULL ? allocateFromVitmapArena(scratch, (vitmap->numShapes + 1) * sizeof(MaskShape)) : NULL;
+    if (shapes == NULL)
+    {
+        destroyVitmapArena(scratch);
+        return mask;
+    }
+
+    // Every shape flattened into pixel space, with the pixel bounds of them all
+    float minX = INFINITY;
+    float minY = INFINITY;
+    float maxX = -INFINITY;
+    float maxY = -INFINITY;
+    int maxPoints = 0;
+    for (int i = 0; i < vitmap->numShapes; i++)
+    {
+        const Shape* shape = getVitmapShape(vitmap, i);
+        MaskShape* flat = &shapes[i];
+        flat->numPoints = flattenShape(shape, MASK_CURVE_TOLERANCE / scale, scratch, &flat->points, &flat->contourStarts);
+        flat->numContours = shape->numContours;
+        flat->windingRule = shape->windingRule;
+        if (flat->points == NULL)
+        {
+            destroyVitmapArena(scratch);
+            return mask;
+        }
+        Vector2 offset = getShapeOffset(vitmap, shape);
+        for (int j = 0; j < flat->numPoints; j++)
+        {
+            Vector2 point = {(flat->points[j].x + offset.x) * scale, (flat->points[j].y + offset.y) * scale};
+            flat->points[j] = point;
+            minX = fminf(minX, point.x);
+            minY = fminf(minY, point.y);
+            maxX = fmaxf(maxX, point.x);
+            maxY = fmaxf(maxY, point.y);
+        }
+        maxPoints = flat->numPoints > maxPoints ? flat->numPoints : maxPoints;
+    }
+    if (maxPoints < 3)
+    {
+        destroyVitmapArena(scratch);
+        return mask;
+    }
+    mask.originX = (int)floorf(minX);
+    mask.originY = (int)floorf(minY);
+    mask.width = (int)ceilf(maxX) - mask.originX;
+    mask.height = (int)ceilf(maxY) - mask.originY;
+    mask.wordsPerRow = (mask.width + 63) / 64;
+    mask.bits = calloc((size_t)mask.wordsPerRow * mask.height, sizeof(unsigned long long));
+    MaskCrossing* crossings = allocateFromVitmapArena(scratch, maxPoints * sizeof(MaskCrossing));
+    if (mask.bits == NULL || crossings == NULL)
+    {
+        destroyVitmapArena(scratch);
+        unloadVitmapMask(&mask);
+        return mask;
+    }
+
+    // Shapes are unioned, each one filled on its own with its winding rule
+    for (int i = 0; i < vitmap->numShapes; i++)
+    {
+        MaskShape* flat = &shapes[i];
+        if (flat->numPoints < 3)
+        {
+            continue;
+        }
+        for (int j = 0; j < flat->numPoints; j++)
+        {
+            flat->points[j].x -= mask.originX;
+            flat->points[j].y -= mask.originY;
+        }
+        fillMaskShape(&mask, flat, crossings);
+    }
+    destroyVitmapArena(scratch);
+    return mask;
+}
+
+void unloadVitmapMask(VitmapMask* mask)
+{
+    free(mask->bits);
+    memset(mask, 0, sizeof *mask);
+}
+
+bool getVitmapMaskPixel(const VitmapMask* mask, int x, int y)
+{
+    if (x < 0 || y < 0 || x >= mask->width || y >= mask->height)
+    {
+        return false;
+    }
+    return (mask->bits[(size_t)y * mask->wordsPerRow + (x >> 6)] >> (x & 63)) & 1;
+}
+
+// The 64 pixels of a row starting at pixel start, which may lie outside the
+// row on either side. Pixels outside the row read as clear.
+static unsigned long long readMaskBits(const unsigned long long* row, int wordsPerRow, int start)
+{
+    int word = start >= 0 ? start / 64 : -((63 - start) / 64);
+    int shift = start - word * 64;
+    unsigned long long low = word >= 0 && word < wordsPerRow ? row[word] : 0;
+    if (shift == 0)
+    {
+        return low;
+    }
+    unsigned long long high = word + 1 >= 0 && word + 1 < wordsPerRow ? row[word + 1] : 0;
+    return (low >> shift) | (high << (64 - shift));
+}
+
+bool doVitmapMasksOverlap(const VitmapMask* a, int ax, int ay, const VitmapMask* b, int bx, int by)
+{
+    // Where b's top left pixel lands in a's pixel grid
+    int offsetX = (bx + b->originX) - (ax + a->originX);
+    int offsetY = (by + b->originY) - (ay + a->originY);
+    int x0 = offsetX > 0 ? offsetX : 0;
+    int y0 = offsetY > 0 ? offsetY : 0;
+    int x1 = offsetX + b->width < a->width ? offsetX + b->width : a->width;
+    int y1 = offsetY + b->height < a->height ? offsetY + b->height : a->height;
+    if (x0 >= x1 || y0 >= y1)
+    {
+        return false;
+    }
+    // Padding bits past a mask's width are always clear, so whole words can
+    // be compared without trimming them to the overlapping columns
+    for (int y = y0; y < y1; y++)
+    {
+        const unsigned long long* rowA = &a->bits[(size_t)y * a->wordsPerRow];
+        const unsigned long long* rowB = &b->bits[(size_t)(y - offsetY) * b->wordsPerRow];
+        for (int word = x0 >> 6; word <= (x1 - 1) >> 6; word++)
+        {
+            if (rowA[word] & readMaskBits(rowB, b->wordsPerRow, word * 64 - offsetX))
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+VitmapAnimationMasks createVitmapAnimationMasks(const VitmapAnimation* animation, float scale)
+{
+    VitmapAnimationMasks masks = {NULL, NULL, 0, scale};
+    if (animation->numFrames == 0)
+    {
+        return masks;
+    }
+    masks.masks = calloc(animation->numFrames, sizeof(VitmapMask));
+    masks.generated = calloc(animation->numFrames, sizeof(bool));
+    if (masks.masks == NULL || masks.generated == NULL)
+    {
+        unloadVitmapAnimationMasks(&masks);
+        return masks;
+    }
+    masks.numFrames = animation->numFrames;
+    return masks;
+}
+
+const VitmapMask* getVitmapAnimationMask(VitmapAnimationMasks* masks, const VitmapAnimation* animation, int frame)
+{
+    if (frame < 0 || frame >= masks->numFrames || frame >= animation->numFrames)
+    {
+        return NULL;
+    }
+    if (!masks->generated[frame])
+    {
+        masks->masks[frame] = createVitmapMask(&animation->frames[frame], masks->scale);
+        masks->generated[frame] = true;
+    }
+    return &masks->masks[frame];
+}
+
+void unloadVitmapAnimationMasks(VitmapAnimationMasks* masks)
+{
+    for (int i = 0; i < masks->numFrames; i++)
+    {
+        unloadVitmapMask(&masks->masks[i]);
+    }
+    free(masks->masks);
+    free(masks->generated);
+    masks->masks = NULL;
+    masks->generated = NULL;
+    masks->numFrames = 0;
+}
@@ -0,0 +1,529 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#define _XOPEN_SOURCE 700      // realpath
+#endif
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "include/vitmap_platform.h"
+
+#ifdef _WIN32
+
+#define WIN32_LEAN_AND_MEAN
+#include <io.h>
+#include <windows.h>
+
+typedef struct ThreadStart
+{
+    VitmapThreadFunc func;
+    void* userData;
+} ThreadStart;
+
+static DWORD WINAPI threadEntry(LPVOID param)
+{
+    ThreadStart start = *(ThreadStart*)param;
+    free(param);
+    start.func(start.userData);
+    return 0;
+}
+
+bool startVitmapThread(VitmapThread* thread, VitmapThreadFunc func, void* userData)
+{
+    ThreadStart* start = malloc(sizeof *start);
+    if (start == NULL) {
+        return false;
+    }
+    start->func = func;
+    start->userData = userData;
+    thread->handle = CreateThread(NULL, 0, threadEntry, start, 0, NULL);
+    if (thread->handle == NULL) {
+        free(start);
+        return false;
+    }
+    return true;
+}
+
+void joinVitmapThread(VitmapThread* thread)
+{
+    WaitForSingleObject((HANDLE)thread->handle, INFINITE);
+    CloseHandle((HANDLE)thread->handle);
+    thread->handle = NULL;
+}
+
+void yieldVitmapThread()
+{
+    SwitchToThread();
+}
+
+bool initVitmapMutex(VitmapMutex* mutex)
+{
+    SRWLOCK* lock = malloc(sizeof *lock);
+    if (lock == NULL) {
+        return false;
+    }
+    InitializeSRWLock(lock);
+    mutex->handle = lock;
+    return true;
+}
+
+void destroyVitmapMutex(VitmapMutex* mutex)
+{
+    free(mutex->handle);
+    mutex->handle = NULL;
+}
+
+void lockVitmapMutex(VitmapMutex* mutex)
+{
+    AcquireSRWLockExclusive((SRWLOCK*)mutex->handle);
+}
+
+void unlockVitmapMutex(VitmapMutex* mutex)
+{
+    ReleaseSRWLockExclusive((SRWLOCK*)mutex->handle);
+}
+
+bool initVitmapCondition(VitmapCondition* condition)
+{
+    CONDITION_VARIABLE* cv = malloc(sizeof *cv);
+    if (cv == NULL) {
+        return false;
+    }
+    InitializeConditionVariable(cv);
+    condition->handle = cv;
+    return true;
+}
+
+void destroyVitmapCondition(VitmapCondition* condition)
+{
+    free(condition->handle);
+    condition->handle = NULL;
+}
+
+void waitVitmapCondition(VitmapCondition* condition, VitmapMutex* mutex)
+{
+    SleepConditionVariableSRW((CONDITION_VARIABLE*)condition->handle, (SRWLOCK*)mutex->handle, INFINITE, 0);
+}
+
+void signalVitmapCondition(VitmapCondition* condition)
+{
+    WakeConditionVariable((CONDITION_VARIABLE*)condition->handle);
+}
+
+void broadcastVitmapCondition(VitmapCondition* condition)
+{
+    WakeAllConditionVariable((CONDITION_VARIABLE*)condition->handle);
+}
+
+int getVitmapCpuCount()
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+}
+
+double getVitmapTime()
+{
+    static LARGE_INTEGER frequency = {0};
+    if (frequency.QuadPart == 0)
+    {
+        QueryPerformanceFrequency(&frequency);
+    }
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+}
+
+bool makeVitmapDirectory(const char* path)
+{
+    return CreateDirectoryA(path, NULL) || GetLastError() == ERROR_ALREADY_EXISTS;
+}
+
+bool replaceVitmapFile(const char* from, const char* to)
+{
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+bool syncVitmapFile(FILE* file)
+{
+    return fflush(file) == 0 && _commit(_fileno(file)) == 0;
+}
+
+bool touchVitmapFile(const char* path)
+{
+    HANDLE file = CreateFileA(path, FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    bool touched = SetFileTime(file, NULL, NULL, &now) != 0;
+    CloseHandle(file);
+    return touched;
+}
+
+bool getVitmapFullPath(const char* path, char* out, int outSize)
+{
+    DWORD length = GetFullPathNameA(path, (DWORD)outSize, out, NULL);
+    if (length == 0 || length >= (DWORD)outSize)
+    {
+        return false;
+    }
+    for (char* c = out; *c != '\0'; c++)
+    {
+        *c = (char)tolower((unsigned char)*c);
+    }
+    return true;
+}
+
+bool getVitmapFileInfo(const char* path, long long* modifiedOut, long long* sizeOut)
+{
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &data))
+    {
+        return false;
+    }
+    *modifiedOut = (long long)(((unsigned long long)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime);
+    *sizeOut = (long long)(((unsigned long long)data.nFileSizeHigh << 32) | data.nFileSizeLow);
+    return true;
+}
+
+// Local to the login session, Global names need extra privileges
+static void getSharedMemoryName(const char* name, char* out, int outSize)
+{
+    snprintf(out, outSize, "Local\\%s", name);
+}
+
+// Views map whole pages, so the size comes out rounded up to one
+static bool mapSharedMemory(VitmapSharedMemory* memory, HANDLE mapping)
+{
+    void* data = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    MEMORY_BASIC_INFORMATION info;
+    if (data != NULL && VirtualQuery(data, &info, sizeof info) == 0)
+    {
+        UnmapViewOfFile(data);
+        data = NULL;
+    }
+    if (data == NULL)
+    {
+        CloseHandle(mapping);
+        return false;
+    }
+    memory->handle = mapping;
+    memory->data = data;
+    memory->size = info.RegionSize;
+    return true;
+}
+
+bool createVitmapSharedMemory(VitmapSharedMemory* memory, const char* name, size_t size, bool* existedOut)
+{
+    char fullName[256];
+    getSharedMemoryName(name, fullName, sizeof fullName);
+    unsigned long long size64 = size;
+    HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+        (DWORD)(size64 >> 32), (DWORD)size64, fullName);
+    if (mapping == NULL)
+    {
+        return false;
+    }
+    *existedOut = GetLastError() == ERROR_ALREADY_EXISTS;
+    return mapSharedMemory(memory, mapping);
+}
+
+bool openVitmapSharedMemory(VitmapSharedMemory* memory, const char* name)
+{
+    char fullName[256];
+    getSharedMemoryName(name, fullName, sizeof fullName);
+    HANDLE mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, fullName);
+    if (mapping == NULL)
+    {
+        return false;
+    }
+    return mapSharedMemory(memory, mapping);
+}
+
+void closeVitmapSharedMemory(VitmapSharedMemory* memory)
+{
+    if (memory->data != NULL)
+    {
+        UnmapViewOfFile(memory->data);
+        CloseHandle((HANDLE)memory->handle);
+    }
+    memory->handle = NULL;
+    memory->data = NULL;
+    memory->size = 0;
+}
+
+void removeVitmapSharedMemory(const char* name)
+{
+    (void)name;
+}
+
+#else
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <utime.h>
+
+typedef struct ThreadStart
+{
+    VitmapThreadFunc func;
+    void* userData;
+} ThreadStart;
+
+static void* threadEntry(void* param)
+{
+    ThreadStart start = *(ThreadStart*)param;
+    free(param);
+    start.func(start.userData);
+    return NULL;
+}
+
+bool startVitmapThread(VitmapThread* thread, VitmapThreadFunc func, void* userData)
+{
+    ThreadStart* start = malloc(sizeof *start);
+    pthread_t* handle = malloc(sizeof *handle);
+    if (start == NULL || handle == NULL) {
+        free(start);
+        free(handle);
+        return false;
+    }
+    start->func = func;
+    start->userData = userData;
+    if (pthread_create(handle, NULL, threadEntry, start) != 0) {
+        free(start);
+        free(handle);
+        return false;
+    }
+    thread->handle = handle;
+    return true;
+}
+
+void joinVitmapThread(VitmapThread* thread)
+{
+    pthread_join(*(pthread_t*)thread->handle, NULL);
+    free(thread->handle);
+    thread->handle = NULL;
+}
+
+void yieldVitmapThread()
+{
+    sched_yield();
+}
+
+bool initVitmapMutex(VitmapMutex* mutex)
+{
+    pthread_mutex_t* lock = malloc(sizeof *lock);
+    if (lock == NULL) {
+        return false;
+    }
+    pthread_mutex_init(lock, NULL);
+    mutex->handle = lock;
+    return true;
+}
+
+void destroyVitmapMutex(VitmapMutex* mutex)
+{
+    pthread_mutex_destroy((pthread_mutex_t*)mutex->handle);
+    free(mutex->handle);
+    mutex->handle = NULL;
+}
+
+void lockVitmapMutex(VitmapMutex* mutex)
+{
+    pthread_mutex_lock((pthread_mutex_t*)mutex->handle);
+}
+
+void unlockVitmapMutex(VitmapMutex* mutex)
+{
+    pthread_mutex_unlock((pthread_mutex_t*)mutex->handle);
+}
+
+bool initVitmapCondition(VitmapCondition* condition)
+{
+    pthread_cond_t* cv = malloc(sizeof *cv);
+    if (cv == NULL) {
+        return false;
+    }
+    pthread_cond_init(cv, NULL);
+    condition->handle = cv;
+    return true;
+}
+
+void destroyVitmapCondition(VitmapCondition* condition)
+{
+    pthread_cond_destroy((pthread_cond_t*)condition->handle);
+    free(condition->handle);
+    condition->handle = NULL;
+}
+
+void waitVitmapCondition(VitmapCondition* condition, VitmapMutex* mutex)
+{
+    pthread_cond_wait((pthread_cond_t*)condition->handle, (pthread_mutex_t*)mutex->handle);
+}
+
+void signalVitmapCondition(VitmapCondition* condition)
+{
+    pthread_cond_signal((pthread_cond_t*)condition->handle);
+}
+
+void broadcastVitmapCondition(VitmapCondition* condition)
+{
+    pthread_cond_broadcast((pthread_cond_t*)condition->handle);
+}
+
+int getVitmapCpuCount()
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+}
+
+double getVitmapTime()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+
+bool makeVitmapDirectory(const char* path)
+{
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+bool replaceVitmapFile(const char* from, const char* to)
+{
+    return rename(from, to) == 0;
+}
+
+bool syncVitmapFile(FILE* file)
+{
+    return fflush(file) == 0 && fsync(fileno(file)) == 0;
+}
+
+bool touchVitmapFile(const char* path)
+{
+    return utime(path, NULL) == 0;
+}
+
+bool getVitmapFullPath(const char* path, char* out, int outSize)
+{
+    char* full = realpath(path, NULL);
+    if (full == NULL)
+    {
+        return false;
+    }
+    size_t length = strlen(full);
+    bool fits = length < (size_t)outSize;
+    if (fits)
+    {
+        memcpy(out, full, length + 1);
+    }
+    free(full);
+    return fits;
+}
+
+bool getVitmapFileInfo(const char* path, long long* modifiedOut, long long* sizeOut)
+{
+    struct stat info;
+    if (stat(path, &info) != 0)
+    {
+        return false;
+    }
+    *modifiedOut = (long long)info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+    *sizeOut = (long long)info.st_size;
+    return true;
+}
+
+// Portable names are one component with a leading slash
+static void getSharedMemoryName(const char* name, char* out, int outSize)
+{
+    snprintf(out, outSize, "/%s", name);
+}
+
+// Takes over the descriptor, which the mapping does not need once it is made
+static bool mapSharedMemory(VitmapSharedMemory* memory, int fd, size_t size)
+{
+    void* data = size > 0 ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+    memory->handle = NULL;
+    memory->data = data;
+    memory->size = size;
+    return true;
+}
+
+static bool mapExistingSharedMemory(VitmapSharedMemory* memory, int fd)
+{
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        close(fd);
+        return false;
+    }
+    // Zero while its creator is still sizing it, the caller tries again later
+    return mapSharedMemory(memory, fd, (size_t)info.st_size);
+}
+
+bool createVitmapSharedMemory(VitmapSharedMemory* memory, const char* name, size_t size, bool* existedOut)
+{
+    char fullName[256];
+    getSharedMemoryName(name, fullName, sizeof fullName);
+    int fd = shm_open(fullName, O_RDWR | O_CREAT | O_EXCL, 0600);
+    *existedOut = fd < 0 && errno == EEXIST;
+    if (*existedOut)
+    {
+        fd = shm_open(fullName, O_RDWR, 0600);
+        return fd >= 0 && mapExistingSharedMemory(memory, fd);
+    }
+    if (fd < 0)
+    {
+        return false;
+    }
+    if (ftruncate(fd, (off_t)size) != 0)
+    {
+        close(fd);
+        shm_unlink(fullName);
+        return false;
+    }
+    return mapSharedMemory(memory, fd, size);
+}
+
+bool openVitmapSharedMemory(VitmapSharedMemory* memory, const char* name)
+{
+    char fullName[256];
+    getSharedMemoryName(name, fullName, sizeof fullName);
+    int fd = shm_open(fullName, O_RDWR, 0600);
+    return fd >= 0 && mapExistingSharedMemory(memory, fd);
+}
+
+void closeVitmapSharedMemory(VitmapSharedMemory* memory)
+{
+    if (memory->data != NULL)
+    {
+        munmap(memory->data, memory->size);
+    }
+    memory->handle = NULL;
+    memory->data = NULL;
+    memory->size = 0;
+}
+
+void removeVitmapSharedMemory(const char* name)
+{
+    char fullName[256];
+    getSharedMemoryName(name, fullName, sizeof fullName);
+    shm_unlink(fullName);
+}
+
+#endif
@@ -0,0 +1,377 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "include/vitmap_query.h"
+
+// Caps the grid so a stray far away shape cannot blow up the cell count
+#define MAX_GRID_DIMENSION 512
+// Shapes whose hit flags fit on the stack, bigger vitmaps allocate them per query
+#define STACK_HIT_WORDS 64
+
+typedef enum QueryKind
+{
+    QUERY_POINT,
+    QUERY_RECT,
+    QUERY_CIRCLE
+} QueryKind;
+
+typedef struct Query
+{
+    QueryKind kind;
+    Vector2 min;            // Bounds of the query area
+    Vector2 max;
+    Vector2 center;         // Point or circle center
+    float radius;
+} Query;
+
+static int clampInt(int value, int min, int max)
+{
+    return value < min ? min : (value > max ? max : value);
+}
+
+static float cross(Vector2 origin, Vector2 a, Vector2 b)
+{
+    return (a.x - origin.x) * (b.y - origin.y) - (a.y - origin.y) * (b.x - origin.x);
+}
+
+VitmapCollider createVitmapCollider(const Vitmap* vitmap, float cellSize)
+{
+    VitmapCollider collider;
+    memset(&collider, 0, sizeof collider);
+
+    int numTriangles = 0;
+    for (int i = 0; i < vitmap->numShapes; i++)
+    {
+        const Shape* shape = getVitmapShape(vitmap, i);
+        if (shape->mesh != NULL)
+        {
+            numTriangles += shape->mesh->numIndices / 3;
+        }
+    }
+    collider.arena = createVitmapArena(VITMAP_ARENA_DEFAULT_CHUNK_SIZE);
+    if (collider.arena == NULL) {
+        return collider;
+    }
+    collider.shapeBounds = allocateFromVitmapArena(collider.arena, vitmap->numShapes * sizeof(Rectangle));
+    collider.triangles = allocateFromVitmapArena(collider.arena, numTriangles * sizeof(VitmapColliderTriangle));
+    if (collider.shapeBounds == NULL || collider.triangles == NULL) {
+        return collider;
+    }
+    collider.numShapes = vitmap->numShapes;
+
+    // Copy the triangles out in world space and find the grid's extent
+    Vector2 min = {INFINITY, INFINITY};
+    Vector2 max = {-INFINITY, -INFINITY};
+    for (int i = 0; i < vitmap->numShapes; i++)
+    {
+        const Shape* shape = getVitmapShape(vitmap, i);
+        const ShapeMesh* mesh = shape->mesh;
+        collider.shapeBounds[i] = (Rectangle){0.0f, 0.0f, 0.0f, 0.0f};
+        if (mesh == NULL || mesh->numIndices == 0)
+        {
+            continue;
+        }
+        Vector2 offset = getShapeOffset(vitmap, shape);
+        Vector2 shapeMin = {mesh->boundsMin.x + offset.x, mesh->boundsMin.y + offset.y};
+        Vector2 shapeMax = {mesh->boundsMax.x + offset.x, mesh->boundsMax.y + offset.y};
+        collider.shapeBounds[i] = (Rectangle){shapeMin.x, shapeMin.y, shapeMax.x - shapeMin.x, shapeMax.y - shapeMin.y};
+        min.x = fminf(min.x, shapeMin.x);
+        min.y = fminf(min.y, shapeMin.y);
+        max.x = fmaxf(max.x, shapeMax.x);
+        max.y = fmaxf(max.y, shapeMax.y);
+        for (int j = 0; j < mesh->numIndices; j += 3)
+        {
+            VitmapColliderTriangle* triangle = &collider.triangles[collider.numTriangles++];
+            Vector2 a = mesh->vertices[mesh->indices[j]];
+            Vector2 b = mesh->vertices[mesh->indices[j + 1]];
+            Vector2 c = mesh->vertices[mesh->indices[j + 2]];
+            triangle->a = (Vector2){a.x + offset.x, a.y + offset.y};
+            triangle->b = (Vector2){b.x + offset.x, b.y + offset.y};
+            triangle->c = (Vector2){c.x + offset.x, c.y + offset.y};
+            triangle->shape = i;
+        }
+    }
+    if (collider.numTriangles == 0)
+    {
+        return collider;
+    }
+
+    float width = max.x - min.x;
+    float height = max.y - min.y;
+    if (cellSize <= 0.0f)
+    {
+        cellSize = sqrtf(width * height / collider.numTriangles);
+    }
+    cellSize = fmaxf(cellSize, fmaxf(width, height) / (MAX_GRID_DIMENSION - 1));
+    if (cellSize <= 0.0f)
+    {
+        cellSize = 1.0f;
+    }
+    collider.origin = min;
+    collider.cellSize = cellSize;
+    collider.columns = (int)(width / cellSize) + 1;
+    collider.rows = (int)(height / cellSize) + 1;
+
+    // Counting pass then filling pass. Triangles go in ascending, so every cell
+    // lists its triangles grouped by shape in draw order.
+    int numCells = collider.columns * collider.rows;
+    collider.cellStarts = allocateFromVitmapArena(collider.arena, (numCells + 1) * sizeof(int));
+    int* cursors = allocateFromVitmapArena(collider.arena, numCells * sizeof(int));
+    if (collider.cellStarts == NULL || cursors == NULL) {
+        collider.numTriangles = 0;
+        return collider;
+    }
+    memset(collider.cellStarts, 0, (numCells + 1) * sizeof(int));
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (int i = 0; i < collider.numTriangles; i++)
+        {
+            const VitmapColliderTriangle* triangle = &collider.triangles[i];
+            float minX = fminf(triangle->a.x, fminf(triangle->b.x, triangle->c.x));
+            float minY = fminf(triangle->a.y, fminf(triangle->b.y, triangle->c.y));
+            float maxX = fmaxf(triangle->a.x, fmaxf(triangle->b.x, triangle->c.x));
+            float maxY = fmaxf(triangle->a.y, fmaxf(triangle->b.y, triangle->c.y));
+            int x0 = clampInt((int)((minX - min.x) / cellSize), 0, collider.columns - 1);
+            int y0 = clampInt((int)((minY - min.y) / cellSize), 0, collider.rows - 1);
+            int x1 = clampInt((int)((maxX - min.x) / cellSize), 0, collider.columns - 1);
+            int y1 = clampInt((int)((maxY - min.y) / cellSize), 0, collider.rows - 1);
+            for (int y = y0; y <= y1; y++)
+            {
+                for (int x = x0; x <= x1; x++)
+                {
+                    int cell = y * collider.columns + x;
+                    if (pass == 0)
+                    {
+                        collider.cellStarts[cell + 1]++;
+                    }
+                    else
+                    {
+                        collider.cellTriangles[cursors[cell]++] = i;
+                    }
+                }
+            }
+        }
+        if (pass == 0)
+        {
+            for (int cell = 0; cell < numCells; cell++)
+            {
+                collider.cellStarts[cell + 1] += collider.cellStarts[cell];
+                cursors[cell] = collider.cellStarts[cell];
+            }
+            collider.cellTriangles = allocateFromVitmapArena(collider.arena, collider.cellStarts[numCells] * sizeof(int));
+            if (collider.cellTriangles == NULL) {
+                collider.numTriangles = 0;
+                return collider;
+            }
+        }
+    }
+    return collider;
+}
+
+void unloadVitmapCollider(VitmapCollider* collider)
+{
+    destroyVitmapArena(collider->arena);
+    memset(collider, 0, sizeof *collider);
+}
+
+static bool isPointInTriangle(Vector2 point, const VitmapColliderTriangle* triangle)
+{
+    // Inside when the point is on the same side of all three edges, whichever
+    // way the triangle winds
+    float d0 = cross(triangle->a, triangle->b, point);
+    float d1 = cross(triangle->b, triangle->c, point);
+    float d2 = cross(triangle->c, triangle->a, point);
+    bool hasNegative = d0 < 0.0f || d1 < 0.0f || d2 < 0.0f;
+    bool hasPositive = d0 > 0.0f || d1 > 0.0f || d2 > 0.0f;
+    return !(hasNegative && hasPositive);
+}
+
+// Separating axis test, the box's own axes first and then the triangle's edge normals
+static bool doesRectTouchTriangle(const Query* query, const VitmapColliderTriangle* triangle)
+{
+    Vector2 corners[3] = {triangle->a, triangle->b, triangle->c};
+    if (fmaxf(triangle->a.x, fmaxf(triangle->b.x, triangle->c.x)) < query->min.x
+        || fminf(triangle->a.x, fminf(triangle->b.x, triangle->c.x)) > query->max.x
+        || fmaxf(triangle->a.y, fmaxf(triangle->b.y, triangle->c.y)) < query->min.y
+        || fminf(triangle->a.y, fminf(triangle->b.y, triangle->c.y)) > query->max.y)
+    {
+        return false;
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        Vector2 edgeStart = corners[i];
+        Vector2 edgeEnd = corners[(i + 1) % 3];
+        Vector2 axis = {edgeStart.y - edgeEnd.y, edgeEnd.x - edgeStart.x};
+        float triangleMin = INFINITY;
+        float triangleMax = -INFINITY;
+        for (int j = 0; j < 3; j++)
+        {
+            float projection = corners[j].x * axis.x + corners[j].y * axis.y;
+            triangleMin = fminf(triangleMin, projection);
+            triangleMax = fmaxf(triangleMax, projection);
+        }
+        // The box's extent along the axis, from its center and half size
+        float centerProjection = (query->min.x + query->max.x) * 0.5f * axis.x + (query->min.y + query->max.y) * 0.5f * axis.y;
+        float radius = (query->max.x - query->min.x) * 0.5f * fabsf(axis.x) + (query->max.y - query->min.y) * 0.5f * fabsf(axis.y);
+        if (centerProjection + radius < triangleMin || centerProjection - radius > triangleMax)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static float getSegmentDistanceSquared(Vector2 point, Vector2 a, Vector2 b)
+{
+    Vector2 ab = {b.x - a.x, b.y - a.y};
+    Vector2 ap = {point.x - a.x, point.y - a.y};
+    float lengthSquared = ab.x * ab.x + ab.y * ab.y;
+    float t = lengthSquared > 0.0f ? (ap.x * ab.x + ap.y * ab.y) / lengthSquared : 0.0f;
+    t = fminf(fmaxf(t, 0.0f), 1.0f);
+    float dx = ap.x - ab.x * t;
+    float dy = ap.y - ab.y * t;
+    return dx * dx + dy * dy;
+}
+
+static bool doesCircleTouchTriangle(const Query* query, const VitmapColliderTriangle* triangle)
+{
+    if (isPointInTriangle(query->center, triangle))
+    {
+        return true;
+    }
+    float radiusSquared = query->radius * query->radius;
+    return getSegmentDistanceSquared(query->center, triangle->a, triangle->b) <= radiusSquared
+        || getSegmentDistanceSquared(query->center, triangle->b, triangle->c) <= radiusSquared
+        || getSegmentDistanceSquared(query->center, triangle->c, triangle->a) <= radiusSquared;
+}
+
+static bool doBoundsOverlap(const Query* query, Rectangle bounds)
+{
+    return query->min.x <= bounds.x + bounds.width && query->max.x >= bounds.x
+        && query->min.y <= bounds.y + bounds.height && query->max.y >= bounds.y;
+}
+
+static int runQuery(const VitmapCollider* collider, const Query* query, int* hitsOut, int maxHits)
+{
+    if (collider->numTriangles == 0)
+    {
+        return 0;
+    }
+    Vector2 origin = collider->origin;
+    float cellSize = collider->cellSize;
+    // Nothing to do when the query misses the grid altogether
+    if (query->max.x < origin.x || query->max.y < origin.y
+        || query->min.x > origin.x + collider->columns * cellSize
+        || query->min.y > origin.y + collider->rows * cellSize)
+    {
+        return 0;
+    }
+    int x0 = clampInt((int)floorf((query->min.x - origin.x) / cellSize), 0, collider->columns - 1);
+    int y0 = clampInt((int)floorf((query->min.y - origin.y) / cellSize), 0, collider->rows - 1);
+    int x1 = clampInt((int)floorf((query->max.x - origin.x) / cellSize), 0, collider->columns - 1);
+    int y1 = clampInt((int)floorf((query->max.y - origin.y) / cellSize), 0, collider->rows - 1);
+
+    // One flag per shape, so a shape is tested no further once it is hit and
+    // reported once however many cells and triangles it covers
+    unsigned long long stackHits[STACK_HIT_WORDS];
+    int numWords = (collider->numShapes + 63) / 64;
+    unsigned long long* hitShapes = stackHits;
+    if (numWords > STACK_HIT_WORDS)
+    {
+        hitShapes = calloc(numWords, sizeof(unsigned long long));
+        if (hitShapes == NULL) {
+            return 0;
+        }
+    }
+    else
+    {
+        memset(stackHits, 0, numWords * sizeof(unsigned long long));
+    }
+
+    for (int y = y0; y <= y1; y++)
+    {
+        for (int x = x0; x <= x1; x++)
+        {
+            int cell = y * collider->columns + x;
+            for (int i = collider->cellStarts[cell]; i < collider->cellStarts[cell + 1]; i++)
+            {
+                const VitmapColliderTriangle* triangle = &collider->triangles[collider->cellTriangles[i]];
+                int shape = triangle->shape;
+                unsigned long long bit = 1ULL << (shape & 63);
+                if ((hitShapes[shape >> 6] & bit) || !doBoundsOverlap(query, collider->shapeBounds[shape]))
+                {
+                    continue;
+                }
+                bool hit = false;
+                switch (query->kind)
+                {
+                    case QUERY_POINT:
+                        hit = isPointInTriangle(query->center, triangle);
+                        break;
+                    case QUERY_RECT:
+                        hit = doesRectTouchTriangle(query, triangle);
+                        break;
+                    case QUERY_CIRCLE:
+                        hit = doesCircleTouchTriangle(query, triangle);
+                        break;
+                }
+                if (hit)
+                {
+                    hitShapes[shape >> 6] |= bit;
+                }
+            }
+        }
+    }
+
+    // Reading the flags back in order gives the hits bottom shape first
+    int numHits = 0;
+    for (int word = 0; word < numWords; word++)
+    {
+        unsigned long long bits = hitShapes[word];
+        while (bits != 0)
+        {
+            int shape = word * 64 + __builtin_ctzll(bits);
+            bits &= bits - 1;
+            if (numHits < maxHits)
+            {
+                hitsOut[numHits] = shape;
+            }
+            numHits++;
+        }
+    }
+    if (hitShapes != stackHits)
+    {
+        free(hitShapes);
+    }
+    return numHits;
+}
+
+int queryVitmapPoint(const VitmapCollider* collider, Vector2 point, int* hitsOut, int maxHits)
+{
+    Query query = {QUERY_POINT, point, point, point, 0.0f};
+    return runQuery(collider, &query, hitsOut, maxHits);
+}
+
+int queryVitmapRect(const VitmapCollider* collider, Rectangle rect, int* hitsOut, int maxHits)
+{
+    Vector2 min = {rect.x, rect.y};
+    Vector2 max = {rect.x + rect.width, rect.y + rect.height};
+    Query query = {QUERY_RECT, min, max, min, 0.0f};
+    return runQuery(collider, &query, hitsOut, maxHits);
+}
+
+int queryVitmapCircle(const VitmapCollider* collider, Vector2 center, float radius, int* hitsOut, int maxHits)
+{
+    Vector2 min = {center.x - radius, center.y - radius};
+    Vector2 max = {center.x + radius, center.y + radius};
+    Query query = {QUERY_CIRCLE, min, max, center, radius};
+    return runQuery(collider, &query, hitsOut, maxHits);
+}
+
+bool isPointInShape(const Vitmap* vitmap, const Shape* shape, Vector2 point)
+{
+    // Test in the shape's own space instead of moving every point
+    Vector2 offset = getShapeOffset(vitmap, shape);
+    Vector2 test = {point.x - offset.x, point.y - offset.y};
+    return isWindingFilled(shape->windingRule, getShapeWinding(shape, test));
+}
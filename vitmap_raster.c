@@ -0,0 +1,294 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "include/vitmap_jobs.h"
+#include "include/vitmap_raster.h"
+
+// Rows per job when a raster is filled on the job system. Every band walks
+// all the triangles, so bands are kept tall enough to amortize that.
+#define RASTER_BAND_HEIGHT 32
+
+VitmapRaster createVitmapRaster(int width, int height)
+{
+    VitmapRaster raster = {0, 0, NULL};
+    if (width <= 0 || height <= 0)
+    {
+        return raster;
+    }
+    raster.pixels = calloc((size_t)width * height, 4);
+    if (raster.pixels != NULL)
+    {
+        raster.width = width;
+        raster.height = height;
+    }
+    return raster;
+}
+
+void unloadVitmapRaster(VitmapRaster* raster)
+{
+    free(raster->pixels);
+    raster->pixels = NULL;
+    raster->width = 0;
+    raster->height = 0;
+}
+
+void clearVitmapRaster(VitmapRaster* raster, Color color)
+{
+    int count = raster->width * raster->height;
+    for (int i = 0; i < count; i++)
+    {
+        memcpy(&raster->pixels[i * 4], &color, 4);
+    }
+}
+
+static void blendPixel(unsigned char* pixel, Color color)
+{
+    if (color.a == 255)
+    {
+        memcpy(pixel, &color, 4);
+        return;
+    }
+    int a = color.a;
+    pixel[0] = (unsigned char)((color.r * a + pixel[0] * (255 - a)) / 255);
+    pixel[1] = (unsigned char)((color.g * a + pixel[1] * (255 - a)) / 255);
+    pixel[2] = (unsigned char)((color.b * a + pixel[2] * (255 - a)) / 255);
+    pixel[3] = (unsigned char)(a + pixel[3] * (255 - a) / 255);
+}
+
+static float edgeFunction(Vector2 a, Vector2 b, float x, float y)
+{
+    return (b.x - a.x) * (y - a.y) - (b.y - a.y) * (x - a.x);
+}
+
+// Top-left fill convention, so triangles sharing an edge never cover a pixel twice
+static bool isTopLeftEdge(Vector2 a, Vector2 b)
+{
+    return (a.y == b.y && b.x < a.x) || (b.y < a.y);
+}
+
+// Only fills rows firstRow to lastRow, both included
+static void rasterizeTriangle(VitmapRaster* raster, int firstRow, int lastRow, Vector2 v0, Vector2 v1, Vector2 v2, Color color)
+{
+    // Make the winding consistent so the inside is where all edge functions are positive
+    float area = edgeFunction(v0, v1, v2.x, v2.y);
+    if (area == 0.0f)
+    {
+        return;
+    }
+    if (area < 0.0f)
+    {
+        Vector2 temp = v1;
+        v1 = v2;
+        v2 = temp;
+    }
+
+    int minX = (int)floorf(fminf(v0.x, fminf(v1.x, v2.x)));
+    int maxX = (int)ceilf(fmaxf(v0.x, fmaxf(v1.x, v2.x)));
+    int minY = (int)floorf(fminf(v0.y, fminf(v1.y, v2.y)));
+    int maxY = (int)ceilf(fmaxf(v0.y, fmaxf(v1.y, v2.y)));
+    if (minX < 0) minX = 0;
+    if (minY < firstRow) minY = firstRow;
+    if (maxX > raster->width - 1) maxX = raster->width - 1;
+    if (maxY > lastRow) maxY = lastRow;
+
+    bool topLeft0 = isTopLeftEdge(v1, v2);
+    bool topLeft1 = isTopLeftEdge(v2, v0);
+    bool topLeft2 = isTopLeftEdge(v0, v1);
+
+    for (int y = minY; y <= maxY; y++)
+    {
+        float sampleY = y + 0.5f;
+        unsigned char* row = &raster->pixels[(size_t)y * raster->width * 4];
+        for (int x = minX; x <= maxX; x++)
+        {
+            float sampleX = x + 0.5f;
+            float w0 = edgeFunction(v1, v2, sampleX, sampleY);
+            float w1 = edgeFunction(v2, v0, sampleX, sampleY);
+            float w2 = edgeFunction(v0, v1, sampleX, sampleY);
+            bool inside = (w0 > 0.0f || (w0 == 0.0f && topLeft0))
+                && (w1 > 0.0f || (w1 == 0.0f && topLeft1))
+                && (w2 > 0.0f || (w2 == 0.0f && topLeft2));
+            if (inside)
+            {
+                blendPixel(&row[x * 4], color);
+            }
+        }
+    }
+}
+
+typedef struct RasterJob
+{
+    VitmapRaster* raster;
+    const Vitmap* vitmap;
+    Vector2 position;
+    Vector2 scale;
+} RasterJob;
+
+// Bands cover separate rows, so they can be filled at once and each one still
+// blends its shapes in draw order
+static void rasterizeBand(void* userData, int firstRow, int endRow)
+{
+    const RasterJob* job = userData;
+    VitmapRaster* raster = job->raster;
+    const Vitmap* vitmap = job->vitmap;
+    Vector2 position = job->position;
+    Vector2 scale = job->scale;
+    for (int i = 0; i < vitmap->numShapes; i++)
+    {
+        const Shape* shape = getVitmapShape(vitmap, i);
+        if (shape->mesh == NULL)
+        {
+            continue;
+        }
+        const Vector2* vertices = shape->mesh->vertices;
+        const int* indices = shape->mesh->indices;
+        Vector2 offset = getShapeOffset(vitmap, shape);
+        Color color = getShapeColor(shape, vitmap->palette, vitmap->numPaletteColors);
+        for (int j = 0; j < shape->mesh->numIndices; j += 3)
+        {
+            Vector2 triVerts[3];
+            for (int k = 0; k < 3; k++)
+            {
+                triVerts[k].x = position.x + (vertices[indices[j + k]].x + offset.x) * scale.x;
+                triVerts[k].y = position.y + (vertices[indices[j + k]].y + offset.y) * scale.y;
+            }
+            rasterizeTriangle(raster, firstRow, endRow - 1, triVerts[0], triVerts[1], triVerts[2], color);
+        }
+    }
+}
+
+void rasterizeVitmap(VitmapRaster* raster, const Vitmap* vitmap, Vector2 position, Vector2 scale)
+{
+    RasterJob job = {raster, vitmap, position, scale};
+    runVitmapJobsFor(raster->height, RASTER_BAND_HEIGHT, rasterizeBand, &job);
+}
+
+//----------------------------------------------------------------------------------
+// Minimal PNG writer. The image data goes into uncompressed deflate blocks,
+// which keeps this dependency free at the cost of file size.
+//----------------------------------------------------------------------------------
+
+// Built per export rather than cached in a global so concurrent exports never race
+static void buildCrcTable(unsigned int crcTable[256])
+{
+    for (unsigned int n = 0; n < 256; n++)
+    {
+        unsigned int c = n;
+        for (int k = 0; k < 8; k++)
+        {
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        crcTable[n] = c;
+    }
+}
+
+static unsigned int updateCrc(const unsigned int crcTable[256], unsigned int crc, const unsigned char* data, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        crc = crcTable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+static void putBigEndian(unsigned char* out, unsigned int value)
+{
+    out[0] = (unsigned char)(value >> 24);
+    out[1] = (unsigned char)(value >> 16);
+    out[2] = (unsigned char)(value >> 8);
+    out[3] = (unsigned char)value;
+}
+
+static bool writePngChunk(FILE* file, const unsigned int crcTable[256], const char type[4], const unsigned char* data, size_t size)
+{
+    unsigned char header[8];
+    putBigEndian(header, (unsigned int)size);
+    memcpy(header + 4, type, 4);
+    unsigned int crc = updateCrc(crcTable, 0xFFFFFFFFu, header + 4, 4);
+    crc = updateCrc(crcTable, crc, data, size) ^ 0xFFFFFFFFu;
+    unsigned char footer[4];
+    putBigEndian(footer, crc);
+    return fwrite(header, 1, 8, file) == 8
+        && (size == 0 || fwrite(data, 1, size, file) == size)
+        && fwrite(footer, 1, 4, file) == 4;
+}
+
+bool exportVitmapRasterToPng(const VitmapRaster* raster, const char* filename)
+{
+    if (raster->pixels == NULL)
+    {
+        return false;
+    }
+    unsigned int crcTable[256];
+    buildCrcTable(crcTable);
+
+    // Filtered scanlines: one filter byte (none) per row, then the pixels
+    size_t rowSize = (size_t)raster->width * 4 + 1;
+    size_t rawSize = rowSize * raster->height;
+    size_t numBlocks = rawSize / 65535 + 1;
+    size_t zlibSize = 2 + rawSize + numBlocks * 5 + 4;
+    unsigned char* zlib = malloc(zlibSize);
+    if (zlib == NULL)
+    {
+        return false;
+    }
+
+    unsigned char* out = zlib;
+    *out++ = 0x78;
+    *out++ = 0x01;
+    unsigned int adlerA = 1;
+    unsigned int adlerB = 0;
+    size_t remaining = rawSize;
+    size_t rawPos = 0;
+    while (true)
+    {
+        unsigned int blockSize = remaining > 65535 ? 65535 : (unsigned int)remaining;
+        remaining -= blockSize;
+        *out++ = remaining == 0 ? 1 : 0;
+        *out++ = (unsigned char)(blockSize & 0xFF);
+        *out++ = (unsigned char)(blockSize >> 8);
+        *out++ = (unsigned char)(~blockSize & 0xFF);
+        *out++ = (unsigned char)((~blockSize >> 8) & 0xFF);
+        for (unsigned int i = 0; i < blockSize; i++, rawPos++)
+        {
+            size_t column = rawPos % rowSize;
+            unsigned char value = column == 0 ? 0 : raster->pixels[(rawPos / rowSize) * (rowSize - 1) + column - 1];
+            *out++ = value;
+            adlerA = (adlerA + value) % 65521;
+            adlerB = (adlerB + adlerA) % 65521;
+        }
+        if (remaining == 0)
+        {
+            break;
+        }
+    }
+    putBigEndian(out, (adlerB << 16) | adlerA);
+    out += 4;
+
+    FILE* file = fopen(filename, "wb");
+    if (file == NULL)
+    {
+        free(zlib);
+        return false;
+    }
+    static const unsigned char signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+    unsigned char ihdr[13];
+    putBigEndian(ihdr, (unsigned int)raster->width);
+    putBigEndian(ihdr + 4, (unsigned int)raster->height);
+    ihdr[8] = 8;  // Bit depth
+    ihdr[9] = 6;  // Color type RGBA
+    ihdr[10] = 0; // Deflate
+    ihdr[11] = 0; // Adaptive filtering
+    ihdr[12] = 0; // No interlace
+    bool ok = fwrite(signature, 1, 8, file) == 8
+        && writePngChunk(file, crcTable, "IHDR", ihdr, sizeof ihdr)
+        && writePngChunk(file, crcTable, "IDAT", zlib, (size_t)(out - zlib))
+        && writePngChunk(file, crcTable, "IEND", NULL, 0);
+    if (fclose(file) != 0)
+    {
+        ok = false;
+    }
+    free(zlib);
+    return ok;
+}
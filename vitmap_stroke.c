@@ -0,0 +1,224 @@
+#include <math.h>
+#include "include/vitmap.h"
+
+// Round joins and caps keep their edge within this distance of a true arc
+#define STROKE_ARC_TOLERANCE 0.25f
+#define STROKE_MIN_ARC_SEGMENTS 8       // Per full turn
+#define STROKE_MAX_ARC_SEGMENTS 64
+
+typedef struct StrokeBuilder
+{
+    ShapeMesh* mesh;        // Sized for the worst case up front
+    float halfWidth;
+    float arcStep;          // Angle covered by one segment of a round join or cap
+} StrokeBuilder;
+
+static int addStrokeVertex(StrokeBuilder* builder, Vector2 vertex)
+{
+    ShapeMesh* mesh = builder->mesh;
+    if (mesh->numVertices == 0)
+    {
+        mesh->boundsMin = vertex;
+        mesh->boundsMax = vertex;
+    }
+    mesh->boundsMin.x = fminf(mesh->boundsMin.x, vertex.x);
+    mesh->boundsMin.y = fminf(mesh->boundsMin.y, vertex.y);
+    mesh->boundsMax.x = fmaxf(mesh->boundsMax.x, vertex.x);
+    mesh->boundsMax.y = fmaxf(mesh->boundsMax.y, vertex.y);
+    mesh->vertices[mesh->numVertices] = vertex;
+    return mesh->numVertices++;
+}
+
+// Wound the same way as the fan drawVitmap falls back to, counter-clockwise on a y down screen
+static void addStrokeTriangle(StrokeBuilder* builder, int a, int b, int c)
+{
+    ShapeMesh* mesh = builder->mesh;
+    Vector2 pa = mesh->vertices[a];
+    Vector2 pb = mesh->vertices[b];
+    Vector2 pc = mesh->vertices[c];
+    float cross = (pb.x - pa.x) * (pc.y - pa.y) - (pb.y - pa.y) * (pc.x - pa.x);
+    int* indices = &mesh->indices[mesh->numIndices];
+    indices[0] = a;
+    indices[1] = cross < 0.0f ? b : c;
+    indices[2] = cross < 0.0f ? c : b;
+    mesh->numIndices += 3;
+}
+
+static Vector2 offsetStrokePoint(Vector2 point, Vector2 direction, float distance)
+{
+    return (Vector2){point.x + direction.x * distance, point.y + direction.y * distance};
+}
+
+// Fan around center from one rim vertex to another, turning by sweep radians
+static void addStrokeArc(StrokeBuilder* builder, Vector2 center, int centerIndex, int from, int to, Vector2 fromDirection, float sweep)
+{
+    int steps = (int)ceilf(fabsf(sweep) / builder->arcStep);
+    int previous = from;
+    float startAngle = atan2f(fromDirection.y, fromDirection.x);
+    for (int i = 1; i < steps; i++)
+    {
+        float angle = startAngle + sweep * i / steps;
+        Vector2 rim = {cosf(angle), sinf(angle)};
+        int next = addStrokeVertex(builder, offsetStrokePoint(center, rim, builder->halfWidth));
+        addStrokeTriangle(builder, centerIndex, previous, next);
+        previous = next;
+    }
+    addStrokeTriangle(builder, centerIndex, previous, to);
+}
+
+// Fills the wedge on the outer side of the corner at point, between the
+// quads of the edges going in and out of it. The inner side is already
+// covered where the two quads overlap.
+static void addStrokeJoin(StrokeBuilder* builder, const VitmapStrokeStyle* style, Vector2 point, Vector2 in, Vector2 out)
+{
+    float cross = in.x * out.y - in.y * out.x;
+    float dot = in.x * out.x + in.y * out.y;
+    if (fabsf(cross) < 1e-6f && dot > 0.0f)
+    {
+        return;
+    }
+    // The outer side is to the right of a left turn and to the left of a right one
+    float side = cross > 0.0f ? -1.0f : 1.0f;
+    Vector2 inNormal = {-in.y * side, in.x * side};
+    Vector2 outNormal = {-out.y * side, out.x * side};
+    float h = builder->halfWidth;
+    int center = addStrokeVertex(builder, point);
+    int from = addStrokeVertex(builder, offsetStrokePoint(point, inNormal, h));
+    int to = addStrokeVertex(builder, offsetStrokePoint(point, outNormal, h));
+    float turn = atan2f(fabsf(cross), dot);
+    if (style->join == VITMAP_JOIN_ROUND)
+    {
+        float sweep = atan2f(inNormal.x * outNormal.y - inNormal.y * outNormal.x, inNormal.x * outNormal.x + inNormal.y * outNormal.y);
+        if (fabsf(cross) < 1e-6f)
+        {
+            // A full reversal, go around the front of the incoming edge
+            sweep = -side * PI;
+        }
+        addStrokeArc(builder, point, center, from, to, inNormal, sweep);
+        return;
+    }
+    // The miter tip is 1 / cos(turn / 2) half widths out, along the bisector
+    float miterScale = 1.0f / cosf(turn * 0.5f);
+    if (style->join == VITMAP_JOIN_MITER && miterScale <= style->miterLimit && turn < PI - 1e-3f)
+    {
+        Vector2 bisector = {inNormal.x + outNormal.x, inNormal.y + outNormal.y};
+        float length = sqrtf(bisector.x * bisector.x + bisector.y * bisector.y);
+        bisector = (Vector2){bisector.x / length, bisector.y / length};
+        int tip = addStrokeVertex(builder, offsetStrokePoint(point, bisector, h * miterScale));
+        addStrokeTriangle(builder, center, from, tip);
+        addStrokeTriangle(builder, center, tip, to);
+        return;
+    }
+    addStrokeTriangle(builder, center, from, to);
+}
+
+// direction points away from the stroke, out of its open end
+static void addStrokeCap(StrokeBuilder* builder, const VitmapStrokeStyle* style, Vector2 point, Vector2 direction)
+{
+    float h = builder->halfWidth;
+    Vector2 normal = {-direction.y, direction.x};
+    if (style->cap == VITMAP_CAP_SQUARE)
+    {
+        Vector2 tip = offsetStrokePoint(point, direction, h);
+        int a = addStrokeVertex(builder, offsetStrokePoint(point, normal, h));
+        int b = addStrokeVertex(builder, offsetStrokePoint(point, normal, -h));
+        int c = addStrokeVertex(builder, offsetStrokePoint(tip, normal, -h));
+        int d = addStrokeVertex(builder, offsetStrokePoint(tip, normal, h));
+        addStrokeTriangle(builder, a, b, c);
+        addStrokeTriangle(builder, a, c, d);
+    }
+    else if (style->cap == VITMAP_CAP_ROUND)
+    {
+        int center = addStrokeVertex(builder, point);
+        int from = addStrokeVertex(builder, offsetStrokePoint(point, normal, h));
+        int to = addStrokeVertex(builder, offsetStrokePoint(point, normal, -h));
+        addStrokeArc(builder, point, center, from, to, normal, -PI);
+    }
+}
+
+bool tessellateStroke(const Vector2* points, int numPoints, const VitmapStrokeStyle* style, VitmapArena* arena, ShapeMesh* meshOut)
+{
+    *meshOut = (ShapeMesh){NULL, 0, NULL, 0, {0.0f, 0.0f}, {0.0f, 0.0f}};
+    if (numPoints < 2 || !(style->width > 0.0f))
+    {
+        return true;
+    }
+
+    // Direction of every edge, with repeated points dropped
+    Vector2* corners = allocateFromVitmapArena(arena, numPoints * sizeof(Vector2));
+    Vector2* directions = allocateFromVitmapArena(arena, numPoints * sizeof(Vector2));
+    if (corners == NULL || directions == NULL) {
+        return false;
+    }
+    int numCorners = 0;
+    for (int i = 0; i < numPoints; i++)
+    {
+        if (numCorners == 0 || points[i].x != corners[numCorners - 1].x || points[i].y != corners[numCorners - 1].y)
+        {
+            corners[numCorners++] = points[i];
+        }
+    }
+    if (style->closed && numCorners > 1 && corners[0].x == corners[numCorners - 1].x && corners[0].y == corners[numCorners - 1].y)
+    {
+        numCorners--;
+    }
+    if (numCorners < 2)
+    {
+        return true;
+    }
+    bool closed = style->closed && numCorners > 2;
+    int numEdges = closed ? numCorners : numCorners - 1;
+    for (int i = 0; i < numEdges; i++)
+    {
+        Vector2 a = corners[i];
+        Vector2 b = corners[(i + 1) % numCorners];
+        float length = sqrtf((b.x - a.x) * (b.x - a.x) + (b.y - a.y) * (b.y - a.y));
+        directions[i] = (Vector2){(b.x - a.x) / length, (b.y - a.y) / length};
+    }
+
+    // Room for the worst case: a quad per edge, a half turn at every corner
+    // and a round cap at both ends
+    float halfWidth = style->width * 0.5f;
+    int arcSegments = STROKE_MIN_ARC_SEGMENTS;
+    if (halfWidth > STROKE_ARC_TOLERANCE)
+    {
+        arcSegments = (int)ceilf(2.0f * PI / acosf(1.0f - STROKE_ARC_TOLERANCE / halfWidth));
+    }
+    arcSegments = arcSegments < STROKE_MIN_ARC_SEGMENTS ? STROKE_MIN_ARC_SEGMENTS : arcSegments;
+    arcSegments = arcSegments > STROKE_MAX_ARC_SEGMENTS ? STROKE_MAX_ARC_SEGMENTS : arcSegments;
+    int perCorner = arcSegments / 2 + 4;
+    int vertexCapacity = numEdges * 4 + (numCorners + 2) * perCorner;
+    int indexCapacity = numEdges * 6 + (numCorners + 2) * perCorner * 3;
+    meshOut->vertices = allocateFromVitmapArena(arena, vertexCapacity * sizeof(Vector2));
+    meshOut->indices = allocateFromVitmapArena(arena, indexCapacity * sizeof(int));
+    if (meshOut->vertices == NULL || meshOut->indices == NULL) {
+        return false;
+    }
+    StrokeBuilder builder = {meshOut, halfWidth, 2.0f * PI / arcSegments};
+
+    // One quad per edge, triangulated as a two triangle strip
+    for (int i = 0; i < numEdges; i++)
+    {
+        Vector2 normal = {-directions[i].y, directions[i].x};
+        Vector2 a = corners[i];
+        Vector2 b = corners[(i + 1) % numCorners];
+        int v0 = addStrokeVertex(&builder, offsetStrokePoint(a, normal, halfWidth));
+        int v1 = addStrokeVertex(&builder, offsetStrokePoint(a, normal, -halfWidth));
+        int v2 = addStrokeVertex(&builder, offsetStrokePoint(b, normal, halfWidth));
+        int v3 = addStrokeVertex(&builder, offsetStrokePoint(b, normal, -halfWidth));
+        addStrokeTriangle(&builder, v0, v1, v2);
+        addStrokeTriangle(&builder, v2, v1, v3);
+    }
+    for (int i = closed ? 0 : 1; i < numCorners - (closed ? 0 : 1); i++)
+    {
+        int in = (i + numEdges - 1) % numEdges;
+        addStrokeJoin(&builder, style, corners[i], directions[in], directions[i]);
+    }
+    if (!closed)
+    {
+        Vector2 start = directions[0];
+        addStrokeCap(&builder, style, corners[0], (Vector2){-start.x, -start.y});
+        addStrokeCap(&builder, style, corners[numCorners - 1], directions[numEdges - 1]);
+    }
+    return true;
+}
@@ -0,0 +1,597 @@
+// Headless batch tool for vitmap asset pipelines. Opens no window and needs
+// no GL context; files are handled as jobs on the library's job system, which
+// also runs the baking, decoding and rasterizing inside each file.
+
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "include/vitmap.h"
+#include "include/vitmap_bake_cache.h"
+#include "include/vitmap_io.h"
+#include "include/vitmap_jobs.h"
+#include "include/vitmap_log.h"
+#include "include/vitmap_platform.h"
+#include "include/vitmap_raster.h"
+#include "include/vitmap_trace.h"
+
+typedef enum ToolCommand
+{
+    COMMAND_VALIDATE,
+    COMMAND_STATS,
+    COMMAND_CONVERT,
+    COMMAND_BAKE,
+    COMMAND_RASTERIZE,
+    COMMAND_BENCH_IO,
+    COMMAND_MAX
+} ToolCommand;
+
+const char* commandNames[COMMAND_MAX] = {
+    "validate",
+    "stats",
+    "convert",
+    "bake",
+    "rasterize",
+    "bench-io"
+};
+
+typedef struct ToolOptions
+{
+    ToolCommand command;
+    int version;
+    const char* outDir;
+    int rasterSize;
+    float rasterExtent;
+    int numThreads;
+    const char* traceFile;
+    VitmapBakeOptions bake;
+    const char* cacheDir;
+    int cacheMegabytes;
+    int repeat;
+} ToolOptions;
+
+typedef struct FileList
+{
+    char** paths;
+    int count;
+    int capacity;
+} FileList;
+
+typedef struct WorkQueue
+{
+    const ToolOptions* options;
+    const FileList* files;
+    int numFailed;
+    VitmapMutex lock;
+} WorkQueue;
+
+static void printUsage()
+{
+    printf("usage: vitmap-tool <command> [options] <file-or-directory>...\n");
+    printf("commands:\n");
+    printf("  validate      check that every file decodes cleanly\n");
+    printf("  stats         print frame, shape and point counts and bounds\n");
+    printf("  convert       rewrite files in another format version\n");
+    printf("  bake          tessellate every shape and report triangle counts\n");
+    printf("  rasterize     render every frame to PNG on the CPU\n");
+    printf("  bench-io      time reading the files with io_uring against pread\n");
+    printf("options:\n");
+    printf("  -j <n>        worker threads (default: one per core)\n");
+    printf("  -o <dir>      output directory for convert and rasterize\n");
+    printf("  --version <n> format version to write (default: %d)\n", VITMAP_FORMAT_VERSION);
+    printf("  --size <n>    PNG width and height in pixels (default: 256)\n");
+    printf("  --extent <n>  world units covered by the PNG (default: 16)\n");
+    printf("  --weld <d>    bake: merge points closer than d (default: 0, exact repeats)\n");
+    printf("  --collinear <d>  bake: drop points within d of their neighbours' line (default: 0)\n");
+    printf("  --min-area <a>   bake: leave shapes with no more area than a empty (default: 0)\n");
+    printf("  --curve-tolerance <px>  bake: how far flattened curves may stray, in pixels (default: 0.25)\n");
+    printf("  --scale <n>   bake: pixels per unit to flatten curves for, rounded up to a power of two (default: %g)\n",
+        VITMAP_DEFAULT_PIXELS_PER_UNIT);
+    printf("  --repeat <n>  bench-io: rounds per backend (default: 5)\n");
+    printf("  --cache <dir>    reuse baked meshes from earlier runs, kept in dir\n");
+    printf("  --cache-size <n> megabytes the bake cache may grow to (default: 256)\n");
+    printf("  -v            log library debug messages\n");
+    printf("  --trace <f>   write spans as Chrome trace JSON (needs VITMAP_ENABLE_TRACING)\n");
+}
+
+static bool hasExtension(const char* path, const char* extension)
+{
+    size_t pathLength = strlen(path);
+    size_t extensionLength = strlen(extension);
+    return pathLength >= extensionLength && strcmp(path + pathLength - extensionLength, extension) == 0;
+}
+
+static bool isVitmapAssetPath(const char* path)
+{
+    return hasExtension(path, ".vmp") || hasExtension(path, ".vmpa") || hasExtension(path, ".vmps");
+}
+
+static const char* getBaseName(const char* path)
+{
+    const char* base = path;
+    for (const char* c = path; *c != '\0'; c++)
+    {
+        if (*c == '/' || *c == '\\')
+        {
+            base = c + 1;
+        }
+    }
+    return base;
+}
+
+static void addFileToList(FileList* list, const char* path)
+{
+    if (list->count == list->capacity)
+    {
+        list->capacity = list->capacity > 0 ? list->capacity * 2 : 64;
+        list->paths = realloc(list->paths, list->capacity * sizeof(char*));
+    }
+    list->paths[list->count] = malloc(strlen(path) + 1);
+    strcpy(list->paths[list->count], path);
+    list->count++;
+}
+
+static void collectFiles(FileList* list, const char* path)
+{
+    struct stat info;
+    if (stat(path, &info) != 0)
+    {
+        printf("Cannot open %s\n", path);
+        return;
+    }
+    if (!S_ISDIR(info.st_mode))
+    {
+        addFileToList(list, path);
+        return;
+    }
+
+    DIR* dir = opendir(path);
+    if (dir == NULL)
+    {
+        printf("Cannot open directory %s\n", path);
+        return;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+        {
+            continue;
+        }
+        size_t length = strlen(path) + strlen(entry->d_name) + 2;
+        char* childPath = malloc(length);
+        snprintf(childPath, length, "%s/%s", path, entry->d_name);
+        if (stat(childPath, &info) == 0)
+        {
+            if (S_ISDIR(info.st_mode))
+            {
+                collectFiles(list, childPath);
+            }
+            else if (isVitmapAssetPath(childPath))
+            {
+                addFileToList(list, childPath);
+            }
+        }
+        free(childPath);
+    }
+    closedir(dir);
+}
+
+static void makeOutputPath(char* out, int outSize, const ToolOptions* options, const char* path, const char* suffix)
+{
+    if (options->outDir == NULL)
+    {
+        snprintf(out, outSize, "%s%s", path, suffix);
+    }
+    else
+    {
+        snprintf(out, outSize, "%s/%s%s", options->outDir, getBaseName(path), suffix);
+    }
+}
+
+// Vitmaps are processed as one-frame animations so every command handles both
+// the same way, and animation sets as the animation of their frame pool
+static bool processFile(const ToolOptions* options, const char* path, char* message, int messageSize)
+{
+    int size = 0;
+    unsigned char* data = loadVitmapFileData(path, &size);
+    if (data == NULL)
+    {
+        snprintf(message, messageSize, "cannot read file");
+        return false;
+    }
+
+    VitmapFileKind kind = VITMAP_FILE_UNKNOWN;
+    int version = readVitmapFileHeader(data, size, &kind);
+    if (kind == VITMAP_FILE_UNKNOWN)
+    {
+        kind = hasExtension(path, ".vmpa") ? VITMAP_FILE_ANIMATION : VITMAP_FILE_VITMAP;
+    }
+
+    VitmapAnimation animation;
+    initVitmapAnimation(&animation);
+    VitmapAnimationSet set;
+    initVitmapAnimationSet(&set);
+    VitmapAnimation* frames = kind == VITMAP_FILE_ANIMATION_SET ? &set.pool : &animation;
+    const char* error = NULL;
+    bool ok;
+    if (kind == VITMAP_FILE_ANIMATION)
+    {
+        ok = decodeAnimation(data, size, &animation, &error);
+    }
+    else if (kind == VITMAP_FILE_ANIMATION_SET)
+    {
+        ok = decodeAnimationSet(data, size, &set, &error);
+    }
+    else
+    {
+        Vitmap vitmap;
+        ok = decodeVitmap(data, size, &vitmap, &error);
+        addFrameToAnimation(&animation, vitmap);
+    }
+    free(data);
+    if (!ok)
+    {
+        snprintf(message, messageSize, "invalid: %s", error);
+        unloadAnimation(&animation);
+        unloadAnimationSet(&set);
+        return false;
+    }
+
+    const char* kindName = kind == VITMAP_FILE_ANIMATION ? "animation" : kind == VITMAP_FILE_ANIMATION_SET ? "animation set" : "vitmap";
+    switch (options->command)
+    {
+        case COMMAND_VALIDATE:
+        {
+            if (kind == VITMAP_FILE_ANIMATION_SET)
+            {
+                snprintf(message, messageSize, "ok (%s v%d, %d animations, %d frames)", kindName, version, set.numAnimations, set.pool.numFrames);
+            }
+            else
+            {
+                snprintf(message, messageSize, "ok (%s v%d, %d frames)", kindName, version, animation.numFrames);
+            }
+            break;
+        }
+        case COMMAND_STATS:
+        {
+            int numShapes = 0;
+            int numPoints = 0;
+            Vector2 min = {0.0f, 0.0f};
+            Vector2 max = {0.0f, 0.0f};
+            bool first = true;
+            for (int i = 0; i < frames->numFrames; i++)
+            {
+                Vitmap* frame = &frames->frames[i];
+                numShapes += frame->numShapes;
+                for (int j = 0; j < frame->numShapes; j++)
+                {
+                    const Shape* shape = getVitmapShape(frame, j);
+                    Vector2 offset = getShapeOffset(frame, shape);
+                    numPoints += shape->numPoints;
+                    for (int k = 0; k < shape->numPoints; k++)
+                    {
+                        Vector2 point = {shape->points[k].x + offset.x, shape->points[k].y + offset.y};
+                        if (first || point.x < min.x) min.x = point.x;
+                        if (first || point.y < min.y) min.y = point.y;
+                        if (first || point.x > max.x) max.x = point.x;
+                        if (first || point.y > max.y) max.y = point.y;
+                        first = false;
+                    }
+                }
+            }
+            snprintf(message, messageSize, "%s v%d, %d bytes, %d frames, %d shapes, %d points, bounds (%.2f, %.2f)-(%.2f, %.2f)",
+                     kindName, version, size, frames->numFrames, numShapes, numPoints, min.x, min.y, max.x, max.y);
+            break;
+        }
+        case COMMAND_CONVERT:
+        {
+            char outPath[1024];
+            makeOutputPath(outPath, sizeof outPath, options, path, "");
+            if (kind == VITMAP_FILE_ANIMATION)
+            {
+                ok = saveAnimationToFileVersion(&animation, outPath, options->version);
+            }
+            else if (kind == VITMAP_FILE_ANIMATION_SET)
+            {
+                ok = saveAnimationSetToFileVersion(&set, outPath, options->version);
+            }
+            else
+            {
+                ok = saveVitmapToFileVersion(&frames->frames[0], outPath, options->version);
+            }
+            snprintf(message, messageSize, ok ? "v%d -> v%d, %s" : "v%d -> v%d failed, %s", version, options->version, outPath);
+            break;
+        }
+        case COMMAND_BAKE:
+        {
+            double bakeStart = getVitmapTime();
+            int numTriangles = 0;
+            VitmapBakeStats stats = {0, 0, 0, 0};
+            for (int i = 0; i < frames->numFrames; i++)
+            {
+                Vitmap* frame = &frames->frames[i];
+                bakeVitmapWithOptions(frame, &options->bake, &stats);
+                for (int j = 0; j < frame->numShapes; j++)
+                {
+                    numTriangles += getVitmapShape(frame, j)->mesh->numIndices / 3;
+                }
+            }
+            snprintf(message, messageSize, "%d triangles, cleanup saved %d points, %d triangles and dropped %d shapes, bake %.3f ms",
+                numTriangles, stats.numPointsRemoved, stats.numTrianglesSaved, stats.numShapesDropped, (getVitmapTime() - bakeStart) * 1000.0);
+            break;
+        }
+        case COMMAND_RASTERIZE:
+        {
+            VitmapRaster raster = createVitmapRaster(options->rasterSize, options->rasterSize);
+            float scale = options->rasterSize / options->rasterExtent;
+            Vector2 center = {options->rasterSize * 0.5f, options->rasterSize * 0.5f};
+            char outPath[1024];
+            for (int i = 0; ok && i < frames->numFrames; i++)
+            {
+                char suffix[32];
+                if (kind != VITMAP_FILE_VITMAP)
+                {
+                    snprintf(suffix, sizeof suffix, "_%03d.png", i);
+                }
+                else
+                {
+                    snprintf(suffix, sizeof suffix, ".png");
+                }
+                makeOutputPath(outPath, sizeof outPath, options, path, suffix);
+                // Curves are flattened for the size they come out at
+                VitmapBakeOptions bake = VITMAP_DEFAULT_BAKE_OPTIONS;
+                bake.pixelsPerUnit = scale;
+                bakeVitmapWithOptions(&frames->frames[i], &bake, NULL);
+                clearVitmapRaster(&raster, (Color){0, 0, 0, 0});
+                rasterizeVitmap(&raster, &frames->frames[i], center, (Vector2){scale, scale});
+                ok = exportVitmapRasterToPng(&raster, outPath);
+            }
+            unloadVitmapRaster(&raster);
+            if (ok)
+            {
+                snprintf(message, messageSize, "%d frames to PNG", frames->numFrames);
+            }
+            else
+            {
+                snprintf(message, messageSize, "failed writing %s", outPath);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+
+    unloadAnimation(&animation);
+    unloadAnimationSet(&set);
+    return ok;
+}
+
+static void processFileRange(void* userData, int begin, int end)
+{
+    WorkQueue* queue = userData;
+    for (int index = begin; index < end; index++)
+    {
+        const char* path = queue->files->paths[index];
+        char message[1280];
+        double start = getVitmapTime();
+        VITMAP_SPAN_BEGIN(span, "processFile");
+        bool ok = processFile(queue->options, path, message, sizeof message);
+        VITMAP_SPAN_END(span);
+        double elapsed = getVitmapTime() - start;
+
+        lockVitmapMutex(&queue->lock);
+        if (!ok)
+        {
+            queue->numFailed++;
+        }
+        printf("%s %9.3f ms  %s: %s\n", ok ? "  " : "! ", elapsed * 1000.0, path, message);
+        unlockVitmapMutex(&queue->lock);
+    }
+}
+
+typedef struct ReadTally
+{
+    int numRead;
+    long long bytes;
+} ReadTally;
+
+static void tallyFileRead(void* userData, int index, unsigned char* data, int size)
+{
+    (void)index;
+    ReadTally* tally = userData;
+    tally->numRead += data != NULL ? 1 : 0;
+    tally->bytes += size;
+    free(data);
+}
+
+// Alternates the backends each round so neither gets a warmer page cache
+static void benchmarkReads(const FileList* files, int repeat)
+{
+    const VitmapIoBackend backends[2] = {VITMAP_IO_URING, VITMAP_IO_BLOCKING};
+    double seconds[2] = {0.0, 0.0};
+    ReadTally tallies[2] = {{0, 0}, {0, 0}};
+    VitmapIoBackend used[2] = {VITMAP_IO_BLOCKING, VITMAP_IO_BLOCKING};
+    for (int round = 0; round < repeat; round++)
+    {
+        for (int i = 0; i < 2; i++)
+        {
+            double start = getVitmapTime();
+            used[i] = readVitmapFiles((const char* const*)files->paths, files->count, backends[i], tallyFileRead, &tallies[i]);
+            seconds[i] += getVitmapTime() - start;
+        }
+    }
+    if (used[0] != VITMAP_IO_URING)
+    {
+        printf("io_uring is not available here, both rows read with pread\n");
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        double perRound = seconds[i] / repeat;
+        double megabytes = tallies[i].bytes / (1024.0 * 1024.0) / repeat;
+        printf("%-9s %d of %d files, %.2f MB, %9.3f ms per round, %10.0f files/s, %8.1f MB/s\n",
+               getVitmapIoBackendName(backends[i]), tallies[i].numRead / repeat, files->count, megabytes,
+               perRound * 1000.0, perRound > 0.0 ? files->count / perRound : 0.0, perRound > 0.0 ? megabytes / perRound : 0.0);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        printUsage();
+        return 1;
+    }
+
+    ToolOptions options = {COMMAND_MAX, VITMAP_FORMAT_VERSION, NULL, 256, 16.0f, getVitmapCpuCount(), NULL, VITMAP_DEFAULT_BAKE_OPTIONS, NULL, 256, 5};
+    for (int i = 0; i < COMMAND_MAX; i++)
+    {
+        if (strcmp(argv[1], commandNames[i]) == 0)
+        {
+            options.command = (ToolCommand)i;
+        }
+    }
+    if (options.command == COMMAND_MAX)
+    {
+        printf("Unknown command %s\n", argv[1]);
+        printUsage();
+        return 1;
+    }
+
+    FileList files = {NULL, 0, 0};
+    for (int i = 2; i < argc; i++)
+    {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "-j") == 0 && hasValue)
+        {
+            options.numThreads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-o") == 0 && hasValue)
+        {
+            options.outDir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--version") == 0 && hasValue)
+        {
+            options.version = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--size") == 0 && hasValue)
+        {
+            options.rasterSize = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--extent") == 0 && hasValue)
+        {
+            options.rasterExtent = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--weld") == 0 && hasValue)
+        {
+            options.bake.weldDistance = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--collinear") == 0 && hasValue)
+        {
+            options.bake.collinearTolerance = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--min-area") == 0 && hasValue)
+        {
+            options.bake.minArea = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--curve-tolerance") == 0 && hasValue)
+        {
+            options.bake.curveTolerance = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--scale") == 0 && hasValue)
+        {
+            options.bake.pixelsPerUnit = getVitmapCurveScale((float)atof(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--cache") == 0 && hasValue)
+        {
+            options.cacheDir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--cache-size") == 0 && hasValue)
+        {
+            options.cacheMegabytes = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--repeat") == 0 && hasValue)
+        {
+            options.repeat = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--trace") == 0 && hasValue)
+        {
+            options.traceFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "-v") == 0)
+        {
+            setVitmapLogLevel(VITMAP_LOG_DEBUG);
+        }
+        else
+        {
+            collectFiles(&files, argv[i]);
+        }
+    }
+    if (options.numThreads < 1)
+    {
+        options.numThreads = 1;
+    }
+    if (options.rasterSize < 1 || options.rasterExtent <= 0.0f)
+    {
+        printf("Raster size and extent must be positive\n");
+        return 1;
+    }
+    if (files.count == 0)
+    {
+        printf("No vitmap files given\n");
+        return 1;
+    }
+
+    if (options.command == COMMAND_BENCH_IO)
+    {
+        benchmarkReads(&files, options.repeat > 0 ? options.repeat : 1);
+        for (int i = 0; i < files.count; i++)
+        {
+            free(files.paths[i]);
+        }
+        free(files.paths);
+        return 0;
+    }
+
+    if (options.cacheDir != NULL && !openVitmapBakeCache(options.cacheDir, (size_t)(options.cacheMegabytes > 0 ? options.cacheMegabytes : 0) * 1024 * 1024))
+    {
+        printf("Cannot open bake cache %s\n", options.cacheDir);
+        return 1;
+    }
+
+    WorkQueue queue = {&options, &files, 0, {NULL}};
+    initVitmapMutex(&queue.lock);
+
+    // Without the job system everything still runs, on this thread
+    startVitmapJobs(options.numThreads);
+    double start = getVitmapTime();
+    runVitmapJobsFor(files.count, 1, processFileRange, &queue);
+    double elapsed = getVitmapTime() - start;
+
+    printf("%s: %d files, %d failed, %.3f ms on %d threads\n",
+           commandNames[options.command], files.count, queue.numFailed, elapsed * 1000.0, getVitmapJobThreadCount());
+    if (options.cacheDir != NULL)
+    {
+        VitmapBakeCacheStats cacheStats = getVitmapBakeCacheStats();
+        printf("bake cache: %d hits, %d misses, %d evicted, %.1f MB\n",
+               cacheStats.hits, cacheStats.misses, cacheStats.evictions, cacheStats.bytes / (1024.0 * 1024.0));
+        closeVitmapBakeCache();
+    }
+    stopVitmapJobs();
+    if (options.traceFile != NULL && !dumpVitmapTrace(options.traceFile))
+    {
+        printf("Failed to write trace to %s\n", options.traceFile);
+    }
+    shutdownVitmapTrace();
+
+    destroyVitmapMutex(&queue.lock);
+    for (int i = 0; i < files.count; i++)
+    {
+        free(files.paths[i]);
+    }
+    free(files.paths);
+
+    return queue.numFailed > 0 ? 1 : 0;
+}
@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "include/vitmap_trace.h"
+#include "include/vitmap_platform.h"
+
+__thread VitmapTraceBuffer* vitmapTraceBuffer = NULL;
+
+// Every buffer ever registered, newest first. Threads only take the lock once,
+// when they record their first span.
+static VitmapTraceBuffer* traceBuffers = NULL;
+static int traceLock = 0;
+static int numTraceThreads = 0;
+
+// Clock reading and wall time taken together at the first span, used to
+// turn clock ticks into microseconds at dump time
+static unsigned long long traceBaseTicks = 0;
+static double traceBaseTime = 0.0;
+
+static void lockTrace()
+{
+    while (__atomic_exchange_n(&traceLock, 1, __ATOMIC_ACQUIRE))
+    {
+    }
+}
+
+static void unlockTrace()
+{
+    __atomic_store_n(&traceLock, 0, __ATOMIC_RELEASE);
+}
+
+unsigned long long readVitmapTraceClockFallback()
+{
+    return (unsigned long long)(getVitmapTime() * 1e9);
+}
+
+VitmapTraceBuffer* registerVitmapTraceThread()
+{
+    VitmapTraceBuffer* buffer = malloc(sizeof *buffer);
+    if (buffer == NULL) {
+        return NULL;
+    }
+    buffer->count = 0;
+    lockTrace();
+    if (numTraceThreads == 0)
+    {
+        traceBaseTicks = readVitmapTraceClock();
+        traceBaseTime = getVitmapTime();
+    }
+    buffer->threadIndex = numTraceThreads++;
+    buffer->next = traceBuffers;
+    traceBuffers = buffer;
+    unlockTrace();
+    vitmapTraceBuffer = buffer;
+    return buffer;
+}
+
+// Spans still being recorded while this runs may come out torn, so dump
+// once the threads being traced are idle
+bool dumpVitmapTrace(const char* filename)
+{
+    FILE* file = fopen(filename, "w");
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    lockTrace();
+    double ticksPerMicrosecond = 1e-3;
+#if defined(__x86_64__) || defined(__i386__)
+    double elapsed = getVitmapTime() - traceBaseTime;
+    if (elapsed > 0.0)
+    {
+        ticksPerMicrosecond = (double)(readVitmapTraceClock() - traceBaseTicks) / (elapsed * 1e6);
+    }
+#endif
+
+    fprintf(file, "{\"traceEvents\":[\n");
+    bool first = true;
+    for (VitmapTraceBuffer* buffer = traceBuffers; buffer != NULL; buffer = buffer->next)
+    {
+        unsigned long long begin = buffer->count > VITMAP_TRACE_BUFFER_SIZE ? buffer->count - VITMAP_TRACE_BUFFER_SIZE : 0;
+        for (unsigned long long i = begin; i < buffer->count; i++)
+        {
+            const VitmapTraceEvent* event = &buffer->events[i & (VITMAP_TRACE_BUFFER_SIZE - 1)];
+            double start = (double)(long long)(event->start - traceBaseTicks) / ticksPerMicrosecond;
+            double duration = (double)(event->end - event->start) / ticksPerMicrosecond;
+            fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+                first ? "" : ",\n", event->name, start, duration, buffer->threadIndex);
+            first = false;
+        }
+    }
+    fprintf(file, "\n],\"displayTimeUnit\":\"ns\"}\n");
+    unlockTrace();
+
+    return fclose(file) == 0;
+}
+
+void clearVitmapTrace()
+{
+    lockTrace();
+    for (VitmapTraceBuffer* buffer = traceBuffers; buffer != NULL; buffer = buffer->next)
+    {
+        buffer->count = 0;
+    }
+    unlockTrace();
+}
+
+// Frees every buffer. Only call it once no thread records spans anymore.
+void shutdownVitmapTrace()
+{
+    lockTrace();
+    VitmapTraceBuffer* buffer = traceBuffers;
+    while (buffer != NULL)
+    {
+        VitmapTraceBuffer* next = buffer->next;
+        free(buffer);
+        buffer = next;
+    }
+    traceBuffers = NULL;
+    numTraceThreads = 0;
+    unlockTrace();
+    vitmapTraceBuffer = NULL;
+}